@@ -22,6 +22,7 @@
 #include "delay.h"
 #include "gfx.h"
 #include "button.h"
+#include "input.h"
 #include "testers/gfx_tester.h"
 
 #include "config.h"
@@ -35,6 +36,12 @@
 #include "app_i2cscan.h"
 #include "app_wavegen.h"
 #include "app_cont.h"
+#include "app_bode.h"
+#include "app_logic.h"
+#include "app_freq.h"
+#include "app_pwm.h"
+#include "app_cap.h"
+#include "settings.h"
 
 /*
  Pins used in this application:
@@ -69,7 +76,7 @@
  P0.10  D15   I2C0 SCL
  P0.11  D14   I2C0 SDA
 
- WAVEGEN DAC OUTPUT
+ WAVEGEN DAC OUTPUT (ALSO BODE PLOT STIMULUS, RESPONSE ON A0)
  LPC    ARD   Description
  -----  ---   -----------
  P0.18        DAC1 Enable (Analog Switch)
@@ -138,6 +145,16 @@ int main(void)
 	// Initialize the QEI switch pin and and other input buttons
 	button_init();
 
+	// Start the input events (debounced from SysTick)
+	input_init();
+
+	// Restore the last used instrument settings from flash
+	settings_init();
+	app_scope_load_settings();
+	app_wavegen_load_settings();
+	app_about_load_settings();
+	settings_save();
+
 	// Initialize the SSD1306 display
 	ssd1306_init();
 	ssd1306_refresh();
@@ -182,6 +199,31 @@ int main(void)
 			app_cont_init();
 			app_cont_run();
 			break;
+		case APP_MENU_OPTION_BODE:
+			// Init frequency response analyzer
+			app_bode_init();
+			app_bode_run();
+			break;
+		case APP_MENU_OPTION_LOGIC:
+			// Init logic analyzer
+			app_logic_init();
+			app_logic_run();
+			break;
+		case APP_MENU_OPTION_FREQ:
+			// Init frequency meter
+			app_freq_init();
+			app_freq_run();
+			break;
+		case APP_MENU_OPTION_PWM:
+			// Init PWM / servo generator
+			app_pwm_init();
+			app_pwm_run();
+			break;
+		case APP_MENU_OPTION_CAP:
+			// Init capacitance meter
+			app_cap_init();
+			app_cap_run();
+			break;
 		}
 	}
 
@@ -14,6 +14,7 @@
 #include "chip_setup.h"
 #include "mrt.h"
 #include "uart.h"
+#include "capt_filter.h"
 
 
 volatile uint32_t raw_data;
@@ -24,27 +25,19 @@ volatile uint32_t x_data[NUM_SENSORS];
 volatile uint32_t last_touch_cnt[NUM_SENSORS];
 volatile uint8_t largest;
 volatile bool touching;
-volatile uint8_t latest_largests[CHAIN_LENGTH];
+volatile uint8_t latest_largest;
+volatile uint32_t largest_run;          // Interrupts in a row with the same largest sensor
 volatile uint32_t duty_cycle[NUM_SENSORS];
-volatile uint32_t filter[NUM_SENSORS][NUM_SAMPLES];
 volatile uint8_t current_x;
 extern volatile uint32_t touch_threshold;
-volatile uint32_t decim_counter[NUM_SENSORS] = {0};
 extern volatile bool mrt_expired;
 extern volatile bool in_lp_mode;
 
 
 
 
-// Filtering function declarations
-uint32_t FIR_average(uint32_t new_data);
-void IIR_average(uint32_t new_data);
-uint32_t Butterworth_lpf(uint32_t new_data);
-uint32_t Decimator(uint32_t new_data);
-
 // Other function declarations
 uint8_t find_larger(uint32_t a, uint32_t b);
-bool is_equal(uint8_t a, uint8_t b);
 uint8_t find_smaller(uint32_t a, uint32_t b);
 void Enter_Normal_Mode(void);
 
@@ -56,9 +49,9 @@ void Enter_Normal_Mode(void);
 //
 void CAPT_IRQHandler(void) {
   uint32_t n;
-  bool dc_flag;
   bool false_notouch;
-  static uint32_t index = 0;
+  uint16_t count;
+  uint32_t prev;
   
   temp_status = LPC_CAPT->STATUS;                          // Read the status flags from the STATUS register
   raw_data = LPC_CAPT->TOUCH;                              // Read the data from the TOUCH register
@@ -101,61 +94,33 @@ void CAPT_IRQHandler(void) {
 
     if ((temp_status & (YESTOUCH)) | false_notouch) {
 
-      // Apply your filter of choice to the new sample from this sensor Xn
-#if FIR == 1
-      // Call FIR L-point average filter
-      last_touch_cnt[current_x] = FIR_average(raw_data & 0xFFF);
-#elif IIR == 1
-      // Call IIR L-point average filter
-      IIR_average(raw_data & 0xFFF);
-      last_touch_cnt[current_x] = filter[current_x][0];
-#elif BUTT == 1
-      // Call digital Butterworth low-pass filter 
-      last_touch_cnt[current_x] = Butterworth_lpf(raw_data & 0xFFF);
-#elif DECIM == 1
-      // Call the decimating filter (envelope follower)
-      n = Decimator(raw_data & 0xFFF);
-      if (decim_counter[current_x] == DECIMATE_FACTOR) {
-        decim_counter[current_x] = 0;
-        last_touch_cnt[current_x] = n;
-      }
-#else
-      // Update the last_touch_cnt variable for this sensor with unfiltered data
-      last_touch_cnt[current_x] = raw_data & 0xFFF;    
-#endif
-
-#if DECIM == 1
-  if (decim_counter[current_x] == 0) {
-#endif
-
-      // Find the sensor with the largest count of the last_touch_cnts
-      largest = 0;
-      for (n=0; n!=NUM_SENSORS-1; n++) {
-        if (find_larger(last_touch_cnt[n+1], last_touch_cnt[largest]))
-          largest = n+1;
-      }
-      
-      // Replace the oldest of the latest_largests 
-      latest_largests[index++] = largest;
-      if (index == CHAIN_LENGTH)
-        index = 0; 
-    
-      // If all elements of latest_largests[] match, report this as DC, else return from interrupt
-      for (n=0; n!=CHAIN_LENGTH-1; n++) {
-        if (is_equal(latest_largests[n], latest_largests[n+1])) {
-          dc_flag = 1;
+      // Apply the filter of choice (see capt_filter_select()) to the new sample from this sensor Xn.
+      // The decimator only has a new count every DECIMATE_FACTOR samples.
+      if (capt_filter_run(current_x, raw_data & 0xFFF, &count)) {
+        prev = last_touch_cnt[current_x];
+        last_touch_cnt[current_x] = count;
+
+        // Only this sensor's count moved, so the others only need a look when it
+        // was the largest and went down (or after a NOTOUCH)
+        if (largest >= NUM_SENSORS || (current_x == largest && count < prev)) {
+          largest = 0;
+          for (n=0; n!=NUM_SENSORS-1; n++) {
+            if (find_larger(last_touch_cnt[n+1], last_touch_cnt[largest]))
+              largest = n+1;
+          }
         }
-        else {
-          dc_flag = 0;
-          break;
+        else if (find_larger(count, last_touch_cnt[largest]) || (count == last_touch_cnt[largest] && current_x < largest)) {
+          largest = current_x;
         }
-      }
-      touching = dc_flag;
 
-    
-#if DECIM == 1
-  }
-#endif
+        // Report DC once the same sensor has been the largest CHAIN_LENGTH times in a row
+        if (!largest_run || largest != latest_largest)
+          largest_run = 1;
+        else if (largest_run < CHAIN_LENGTH)
+          largest_run++;
+        latest_largest = largest;
+        touching = largest_run >= CHAIN_LENGTH;
+      }
 
       // 'Feed' the MRT on every touch or false_notouch
       #if 0
@@ -168,9 +133,7 @@ void CAPT_IRQHandler(void) {
     else {                                     // This is a true NOTOUCH, all sensors are outside of threshold, revert to NOTOUCH idle
       touching = 0;
       largest = 0xFF;
-      for (n=0; n!=CHAIN_LENGTH; n++) {         // Invalidate the delay chain
-        latest_largests[n] = n;
-      }
+      largest_run = 0;                          // Invalidate the delay chain
       LPC_CAPT->STATUS = NOTOUCH;
       return;
     } // end if((temp_status & YESTOUCH) | false_notouch)
@@ -3,6 +3,7 @@
 #include "syscon.h"
 #include "swm.h"
 #include "chip_setup.h"
+#include "delay.h"
 
 
 
@@ -102,3 +103,53 @@ void setup_debug_uart() {
 
 }
 
+
+
+//
+// Function: set_debug_uart_baud
+//
+// Changes the debug UART baud rate on the fly (0 = back to DBGBAUDRATE). The BRG/OSR pair is picked
+// for the lowest error from main_clk, since with the fixed 16x oversampling
+// used by setup_debug_uart() most rates above 9600 are way off at 12 MHz:
+// baud = main_clk Hz. / ((BRG + 1) * (OSR + 1)), with OSR 4..15.
+//
+void set_debug_uart_baud(uint32_t baud) {
+  if (baud == 0) baud = DBGBAUDRATE;
+
+  uint32_t best_brg = 0, best_osr = 15, best_err = 0xFFFFFFFF;
+
+  for (uint32_t osr = 15; osr >= 4; osr--) {
+    uint32_t brg = (main_clk + (baud * (osr + 1)) / 2) / (baud * (osr + 1));
+    if (brg == 0) continue;
+    uint32_t actual = main_clk / (brg * (osr + 1));
+    uint32_t err = actual > baud ? actual - baud : baud - actual;
+    if (err < best_err) {
+      best_err = err;
+      best_brg = brg - 1;
+      best_osr = osr;
+    }
+  }
+
+  // Let the last character go out before switching
+  while (!((pDBGU->STAT) & TXIDLE));
+
+  pDBGU->CFG &= ~(UART_EN);
+  pDBGU->OSR = best_osr;
+  pDBGU->BRG = best_brg;
+  pDBGU->CFG |= UART_EN;
+}
+
+
+//
+// Function: getkey_timeout
+//
+// Same as getkey(), but gives up after timeout_ms and returns -1.
+//
+int getkey_timeout(uint32_t timeout_ms) {
+  uint32_t start = millis();
+
+  while (!((pDBGU->STAT) & RXRDY)) {
+    if ((millis() - start) > timeout_ms) return -1;
+  }
+  return (pDBGU->RXDAT );
+}
@@ -19,28 +19,40 @@
 #include "dma.h"
 #include "mrt.h"
 
+#include "dma_common.h"
 #include "adc_dma.h"
+#include "adc_poll.h"
 
 // Buffer with max number of samples to store via DMA
 // Should be a multiple of 1024 (DMA_BUFFER_SIZE)
-uint16_t adc_buffer[2 * DMA_BUFFER_SIZE];
+// Apps that leave the ADC idle borrow it through adc_dma_get_buffer(),
+// some keep 32-bit words in it
+ALIGN(4) uint16_t adc_buffer[2 * DMA_BUFFER_SIZE];
 
 // Used to track the sample that caused the threshold interrupt to fire
 volatile int16_t _adc_dma_trigger_offset;
 
 uint32_t _adc_rate_us;
 
-// Instantiate the channel descriptor table, which must be 512-byte aligned (see lpc8xx_dma.h)
-ALIGN(512) DMA_CHDESC_T Chan_Desc_Table[NUM_DMA_CHANNELS];
-
 // Instantiate one reload descriptor. All descriptors must be 16-byte aligned (see lpc8xx_dma.h)
 ALIGN(16) DMA_RELOADDESC_T dma2ndDesc;
 
+// Sink for the conversions adc_dma_start_triggered() throws away
+static uint16_t _adc_dma_discard;
+
+// Continuous mode: two descriptors linked in a ring over the two halves
+// of adc_buffer, counting completed halves in the DMA IRQ
+ALIGN(16) static DMA_RELOADDESC_T _adc_dma_ring[2];
+static volatile uint32_t _adc_dma_blocks;
+static volatile uint8_t  _adc_dma_continuous = 0;
+
 // ADC channel to use
 // In this application it is P0.14 (A0)  Analog Input - ADC2
 const uint8_t _channel = 2;
 #define ADC_N(_n)    (1 << (14+(_n)))
 
+static void adc_dma_isr(void);
+
 static inline void enable_sample_timer(void)
 {
   NVIC_EnableIRQ(MRT_IRQn);
@@ -118,16 +130,9 @@ void adc_dma_init(void)
 
   /*------------- DMA -------------*/
 
-  // Reset the DMA, and enable peripheral clocks
-  LPC_SYSCON->PRESETCTRL0 &= (DMA_RST_N);
-  LPC_SYSCON->PRESETCTRL0 |= ~(DMA_RST_N);
-  LPC_SYSCON->SYSAHBCLKCTRL0 |= DMA;
-
-  // Set the master DMA controller enable bit in the CTRL register
-  LPC_DMA->CTRL = 1;
-
-  // Point the SRAMBASE register to the beginning of the channel descriptor SRAM table
-  LPC_DMA->SRAMBASE = (uint32_t) (&Chan_Desc_Table);
+  // Bring up the DMA controller (shared with the DAC wavegen)
+  dma_common_init();
+  dma_common_set_handler(DMA_CH_ADC, adc_dma_isr);
 
   // Enable DMA channel 0 in the ENABLE register
   LPC_DMA->ENABLESET0 = 1 << 0;
@@ -293,6 +298,9 @@ int32_t adc_dma_start_with_threshold(uint16_t low, uint16_t high, uint8_t mode,
     			return -1;
     		}
     	}
+
+    	// Woken by the DMA block interrupt, or the SysTick at the latest
+    	__WFI();
     }
   }
 
@@ -330,13 +338,146 @@ int32_t adc_dma_start_with_threshold(uint16_t low, uint16_t high, uint8_t mode,
   return 0;
 }
 
+/**
+ * Captures 'count' samples into 'dst', converting on each rising edge of a
+ * hardware trigger (see the ADC trigger inputs in adc.h) instead of the
+ * MRT, so the samples are locked to whatever drives the trigger. The first
+ * 'skip' conversions are thrown away to let the input settle.
+ *
+ * Returns once the transfer is armed, poll adc_dma_busy() for the end.
+ * adc_dma_stop() hands the sequence back to the MRT.
+ *
+ * @return 0 on success, -1 on a bad count
+ */
+int adc_dma_start_triggered(uint16_t *dst, uint16_t count, uint16_t skip, uint8_t trigger)
+{
+  if (count == 0 || count > DMA_BUFFER_SIZE || skip > DMA_BUFFER_SIZE)
+  {
+    return -1;
+  }
+
+  // If DMA is busy, wait until it is finished
+  while ( adc_dma_busy() ) { }
+  disable_sample_timer();
+
+  // The trigger source may only change while the sequence is disabled
+  LPC_ADC->SEQA_CTRL &= ~(1UL << ADC_SEQ_ENA);
+  LPC_ADC->SEQA_CTRL = (LPC_ADC->SEQA_CTRL & ~((0xF << ADC_TRIGGER) | (1 << ADC_TRIGPOL))) |
+                       trigger << ADC_TRIGGER |
+                       1 << ADC_TRIGPOL;          // Rising edge
+  LPC_ADC->INTEN = (1 << SEQA_INTEN);
+  LPC_ADC->SEQA_CTRL |= (1UL << ADC_SEQ_ENA);
+
+  uint32_t xfercfg = 1 << DMA_XFERCFG_CFGVALID |
+                     1 << DMA_XFERCFG_SETINTA |
+                     1 << DMA_XFERCFG_WIDTH |     // 16 bits for 12-bit ADC values
+                     0 << DMA_XFERCFG_SRCINC |
+                     1 << DMA_XFERCFG_DSTINC |
+                     (count - 1) << DMA_XFERCFG_XFERCOUNT;
+
+  Chan_Desc_Table[0].source = (uint32_t) &LPC_ADC->DAT[_channel];
+
+  if (skip)
+  {
+    // Settling samples all land on one word, then reload the capture
+    dma2ndDesc.xfercfg = xfercfg;
+    dma2ndDesc.source  = (uint32_t) &LPC_ADC->DAT[_channel];
+    dma2ndDesc.dest    = (uint32_t) &dst[count - 1];
+    dma2ndDesc.next    = 0;
+
+    Chan_Desc_Table[0].dest = (uint32_t) &_adc_dma_discard;
+    Chan_Desc_Table[0].next = (uint32_t) &dma2ndDesc;
+
+    xfercfg = 1 << DMA_XFERCFG_CFGVALID |
+              1 << DMA_XFERCFG_RELOAD |
+              1 << DMA_XFERCFG_WIDTH |
+              (skip - 1) << DMA_XFERCFG_XFERCOUNT;
+  }
+  else
+  {
+    Chan_Desc_Table[0].dest = (uint32_t) &dst[count - 1];
+    Chan_Desc_Table[0].next = 0;
+  }
+
+  LPC_DMA->SETVALID0 = 1 << 0;
+  LPC_DMA->CHANNEL[0].XFERCFG = xfercfg;
+
+  return 0;
+}
+
+/**
+ * Samples forever at the adc_dma_set_rate() rate, alternating between the
+ * two DMA_BUFFER_SIZE halves of the buffer. adc_dma_blocks() counts the
+ * completed halves: block b (from 1) lives in half (b - 1) & 1, and stays
+ * untouched for one block period after it completes.
+ */
+void adc_dma_start_continuous(void)
+{
+  // If DMA is busy, wait until it is finished
+  while ( adc_dma_busy() ) { }
+
+  uint32_t xfercfg = 1 << DMA_XFERCFG_CFGVALID |
+                     1 << DMA_XFERCFG_RELOAD |
+                     1 << DMA_XFERCFG_SETINTA |
+                     1 << DMA_XFERCFG_WIDTH |     // 16 bits for 12-bit ADC values
+                     0 << DMA_XFERCFG_SRCINC |
+                     1 << DMA_XFERCFG_DSTINC |
+                     (DMA_BUFFER_SIZE - 1) << DMA_XFERCFG_XFERCOUNT;
+
+  for (uint8_t i = 0; i < 2; i++)
+  {
+    _adc_dma_ring[i].xfercfg = xfercfg;
+    _adc_dma_ring[i].source  = (uint32_t) &LPC_ADC->DAT[_channel];
+    _adc_dma_ring[i].dest    = (uint32_t) &adc_buffer[(i + 1) * DMA_BUFFER_SIZE - 1];
+    _adc_dma_ring[i].next    = (uint32_t) &_adc_dma_ring[i ^ 1];
+  }
+
+  Chan_Desc_Table[0].source = _adc_dma_ring[0].source;
+  Chan_Desc_Table[0].dest   = _adc_dma_ring[0].dest;
+  Chan_Desc_Table[0].next   = _adc_dma_ring[0].next;
+
+  _adc_dma_blocks = 0;
+  _adc_dma_continuous = 1;
+
+  LPC_ADC->INTEN = (1 << SEQA_INTEN);
+  LPC_DMA->SETVALID0 = 1 << 0;
+  LPC_DMA->CHANNEL[0].XFERCFG = xfercfg;
+
+  // Start sampling using hardware timer
+  enable_sample_timer();
+}
+
+uint32_t adc_dma_blocks(void)
+{
+  return _adc_dma_blocks;
+}
+
 void adc_dma_stop(void)
 {
+  if (_adc_dma_continuous)
+  {
+    // The ring never ends by itself, pull the plug on it
+    disable_sample_timer();
+    LPC_DMA->ENABLECLR0 = 1 << 0;
+    LPC_DMA->ABORT0 = 1 << 0;
+    LPC_DMA->CHANNEL[0].XFERCFG = 0;
+    LPC_DMA->ENABLESET0 = 1 << 0;
+    _adc_dma_continuous = 0;
+  }
+
   // If DMA is busy, wait until it is finished
   while ( adc_dma_busy() ) { }
 
   // Disable sampling timer
   disable_sample_timer();
+
+  // Back to software (MRT) triggered conversions
+  if (LPC_ADC->SEQA_CTRL & (0xF << ADC_TRIGGER))
+  {
+    LPC_ADC->SEQA_CTRL &= ~(1UL << ADC_SEQ_ENA);
+    LPC_ADC->SEQA_CTRL &= ~((0xF << ADC_TRIGGER) | (1 << ADC_TRIGPOL));
+    LPC_ADC->SEQA_CTRL |= (1UL << ADC_SEQ_ENA);
+  }
 }
 
 bool adc_dma_busy(void)
@@ -356,23 +497,15 @@ uint16_t *adc_dma_get_buffer()
 	return adc_buffer;
 }
 
-void DMA_IRQHandler(void)
+static void adc_dma_isr(void)
 {
   // When the DMA hits 1024, this ISR is called
   // Currently there are 2 1KB DMA transfers linked together.
   // Therefore this function will be called twice to fill the 2KB buffer
-
-  uint32_t intsts = LPC_DMA->INTA0; // Get the interrupt A flag
-
-  // CH0 is active
-  if (intsts & 1UL)
-  {
-  }
-
-  LPC_DMA->INTA0 = intsts; // Clear interrupt
+  _adc_dma_blocks++;
 
   // End of DMA descriptor chain, disable timer ADC trigger
-  if ( ! (LPC_DMA->CHANNEL[0].XFERCFG & (1 << DMA_XFERCFG_CFGVALID)) )
+  if ( ! (LPC_DMA->CHANNEL[DMA_CH_ADC].XFERCFG & (1 << DMA_XFERCFG_CFGVALID)) )
   {
     // Disable sampling timer
     disable_sample_timer();
@@ -382,6 +515,13 @@ void DMA_IRQHandler(void)
 // This interrupt handler determines the sample that triggered the threshold interrupt
 void ADC_THCMP_IRQHandler(void)
 {
+  // A threshold watch on sequence B (adc_poll) shares this vector
+  if ( adc_poll_watching() )
+  {
+    adc_poll_thcmp_isr();
+    return;
+  }
+
   // Only check the threshold interrupt status of our ADC channel
   uint32_t intsts = (LPC_ADC->FLAGS & (1 << _channel)) ;
 
@@ -24,6 +24,9 @@ bool adc_dma_busy(void);
 
 int32_t adc_dma_start_with_threshold(uint16_t low, uint16_t high, uint8_t mode, uint8_t cancel_on_btn);
 void adc_dma_start(void);
+int adc_dma_start_triggered(uint16_t *dst, uint16_t count, uint16_t skip, uint8_t trigger);
+void adc_dma_start_continuous(void);
+uint32_t adc_dma_blocks(void);
 void adc_dma_stop(void);
 
 uint16_t *adc_dma_get_buffer(void);
@@ -4,7 +4,7 @@
  Author      : $(author)
  Version     :
  Copyright   : $(copyright)
- Description : Polling based ADC sampler
+ Description : On-demand ADC conversions (sequence B, interrupt driven)
 ===============================================================================
 */
 
@@ -20,8 +20,20 @@
  Pins used in this application:
 
  P0.14 [I] - ADC2
+ P0.23 [I] - ADC3
 */
 
+// Sequence A belongs to adc_dma, on-demand scans run on sequence B. The
+// LPC845 ADC has no internal reference channel (the bandgap only reaches
+// the comparator), so a scan covers any mix of the 12 pin channels.
+static adc_poll_scan_t * volatile _adc_poll_scan = 0;   // Scan in flight, 0 = idle
+static adc_poll_cb_t              _adc_poll_cb = 0;
+
+// Threshold watch, also on sequence B, compared against THR1 so adc_dma
+// keeps THR0 for the scope trigger
+static int8_t                     _adc_poll_watch_ch = -1;   // -1 = not watching
+static adc_poll_watch_cb_t        _adc_poll_watch_cb = 0;
+
 int adc_poll_init(void)
 {
 	LPC_SYSCON->SYSAHBCLKCTRL0 |= (IOCON);  // Enable the IOCON clock
@@ -71,37 +83,219 @@ int adc_poll_init(void)
 	return 0;
 }
 
+/**
+ * Starts one conversion of each channel in 'channels' and returns right
+ * away. The results land in 'scan' from the sequence B interrupt, which
+ * then sets scan->done and calls 'cb' (if not 0, in interrupt context).
+ *
+ * @param channels  Bit mask of ADC channels 0..11
+ * @param scan      Result struct, must stay valid until done
+ * @param cb        Completion callback, or 0 to poll/wait on scan->done
+ *
+ * @return 0 if the scan started, -1 if one is already running or the
+ *         mask is invalid
+ */
+int adc_poll_scan_start(uint16_t channels, adc_poll_scan_t *scan, adc_poll_cb_t cb)
+{
+	if (_adc_poll_scan || _adc_poll_watch_ch >= 0 || channels == 0 || (channels & ~ADC_POLL_CHANNELS_ALL))
+	{
+		return -1;
+	}
+
+	scan->channels = channels;
+	scan->done = 0;
+	_adc_poll_cb = cb;
+	_adc_poll_scan = scan;
+
+	// Drop any stale DATAVALID from an earlier conversion
+	for (uint8_t ch = 0; ch < ADC_POLL_CHANNELS; ch++)
+	{
+		if (channels & (1 << ch))
+		{
+			(void)LPC_ADC->DAT[ch];
+		}
+	}
+
+	// Interrupt at the end of the whole sequence, not per conversion
+	LPC_ADC->FLAGS = (1UL << ADC_SEQB_INT);
+	LPC_ADC->INTEN |= (1 << SEQB_INTEN);
+	NVIC_EnableIRQ(ADC_SEQB_IRQn);
+
+	LPC_ADC->SEQB_CTRL = 1UL << ADC_SEQ_ENA |	// Enable sequence
+						 1UL << ADC_MODE    |	// End of sequence interrupt
+						 1   << ADC_START   |	// Start
+						 1   << ADC_TRIGPOL |	// Trigger pos edge
+						 0   << ADC_TRIGGER |	// SW trigger
+						 channels;				// Select channels
+
+	return 0;
+}
+
+/**
+ * Returns non-zero while a scan is running.
+ */
+int adc_poll_scan_busy(void)
+{
+	return _adc_poll_scan != 0;
+}
+
+/**
+ * Sleeps until 'scan' completes. Interrupts are masked around the check so
+ * the completion can't slip in between it and the WFI (a pending interrupt
+ * still wakes the core with PRIMASK set).
+ */
+void adc_poll_scan_wait(adc_poll_scan_t *scan)
+{
+	__disable_irq();
+	while (!scan->done)
+	{
+		__WFI();
+		__enable_irq();
+		__disable_irq();
+	}
+	__enable_irq();
+}
+
+/**
+ * Single conversion, for callers that just want a number. The core sleeps
+ * until the result is in instead of spinning on the data register. A scan
+ * already in flight is waited out, but a threshold watch holds sequence B
+ * until adc_poll_watch_stop(), so that case fails straight away.
+ *
+ * @return 12-bit result, or ADC_POLL_READ_ERROR if the channel is invalid
+ *         or a watch is running
+ */
 uint16_t adc_poll_read(uint8_t adc_ch)
 {
-	uint32_t sample;
+	adc_poll_scan_t scan;
+
+	if (adc_ch >= ADC_POLL_CHANNELS || _adc_poll_watch_ch >= 0)
+	{
+		return ADC_POLL_READ_ERROR;
+	}
+
+	while (adc_poll_scan_start(1 << adc_ch, &scan, 0))
+	{
+		__WFI();
+	}
+	adc_poll_scan_wait(&scan);
+
+	return scan.value[adc_ch];
+}
+
+/**
+ * Hands sequence B to the threshold comparator: 'channel' is converted on
+ * every rising edge of the hardware 'trigger' (see adc.h) with no CPU
+ * involvement, and the THCMP interrupt fires only when a result crosses
+ * 'threshold' in either direction. 'cb' gets the result that crossed, in
+ * interrupt context. Scans are refused until adc_poll_watch_stop().
+ *
+ * @return 0 on success, -1 if a scan or another watch is running
+ */
+int adc_poll_watch_start(uint8_t channel, uint16_t threshold, uint8_t trigger, adc_poll_watch_cb_t cb)
+{
+	if (_adc_poll_scan || _adc_poll_watch_ch >= 0 || channel >= ADC_POLL_CHANNELS)
+	{
+		return -1;
+	}
+
+	_adc_poll_watch_cb = cb;
+	_adc_poll_watch_ch = channel;
+
+	LPC_ADC->THR1_LOW = threshold << 4;
+	LPC_ADC->THR1_HIGH = 0xFFF0;
+	LPC_ADC->CHAN_THRSEL |= (1 << channel);
+
+	// Crossing mode (2) only, no end of sequence interrupt. Only the
+	// sequence B and this channel's compare bits are touched, the rest of
+	// INTEN belongs to adc_dma.
+	LPC_ADC->FLAGS = (1 << channel) | (1UL << ADC_THCMP_INT);
+	LPC_ADC->INTEN = (LPC_ADC->INTEN & ~((1 << SEQB_INTEN) | (3 << (ADCMPINTEN0 + 2 * channel)))) |
+	                 (2 << (ADCMPINTEN0 + 2 * channel));
+	NVIC_EnableIRQ(ADC_THCMP_IRQn);
 
-	LPC_ADC->SEQA_CTRL = 1UL << ADC_SEQ_ENA |	// Enable sequence
-						 0   << ADC_BURST   |   // Single read
-						 0   << ADC_START   |   // Do not start
-						 1   << ADC_TRIGPOL |   // Trigger pos edge
-						 0   << ADC_TRIGGER |   // SW trigger
-						 1   << adc_ch;         // Select channel
+	LPC_ADC->SEQB_CTRL = 1UL << ADC_SEQ_ENA |	// Enable sequence
+						 1   << ADC_TRIGPOL |	// Trigger pos edge
+						 trigger << ADC_TRIGGER |	// HW trigger
+						 (1 << channel);		// Select channel
 
-	// Clear DATAVALID before the next sample
-	do
+	return 0;
+}
+
+/**
+ * Moves the watch threshold, e.g. from the callback for hysteresis.
+ */
+void adc_poll_watch_threshold(uint16_t threshold)
+{
+	LPC_ADC->THR1_LOW = threshold << 4;
+}
+
+void adc_poll_watch_stop(void)
+{
+	if (_adc_poll_watch_ch < 0)
 	{
-	   sample = LPC_ADC->SEQA_GDAT;
+		return;
 	}
-	while((sample & (1UL<<31)) != 0);
 
-	LPC_ADC->SEQA_CTRL = 1UL << ADC_SEQ_ENA | 	// Enable sequence
-						 0   << ADC_BURST   | 	// Single read
-						 1   << ADC_START   | 	// Start
-						 1   << ADC_TRIGPOL | 	// Trigger pos edge
-						 0   << ADC_TRIGGER | 	// SW trigger
-						 1   << adc_ch;       	// Select channel
+	NVIC_DisableIRQ(ADC_THCMP_IRQn);
+	LPC_ADC->SEQB_CTRL = 0;
+	LPC_ADC->INTEN &= ~(3 << (ADCMPINTEN0 + 2 * _adc_poll_watch_ch));
+	LPC_ADC->CHAN_THRSEL &= ~(1 << _adc_poll_watch_ch);
+	LPC_ADC->FLAGS = (1 << _adc_poll_watch_ch) | (1UL << ADC_THCMP_INT);
+
+	_adc_poll_watch_ch = -1;
+}
+
+/**
+ * Returns non-zero while a threshold watch owns the THCMP interrupt.
+ */
+int adc_poll_watching(void)
+{
+	return _adc_poll_watch_ch >= 0;
+}
 
-	// Wait for DATAVALID = 1
-	do
+/**
+ * Threshold compare interrupt for the watch, called from the shared
+ * ADC_THCMP_IRQHandler in adc_dma.c.
+ */
+void adc_poll_thcmp_isr(void)
+{
+	uint32_t flags = LPC_ADC->FLAGS & (1 << _adc_poll_watch_ch);
+	uint16_t value = (uint16_t)((LPC_ADC->DAT[_adc_poll_watch_ch] & 0xFFF0) >> 4);
+
+	LPC_ADC->FLAGS = flags | (1UL << ADC_THCMP_INT);
+
+	if (flags && _adc_poll_watch_cb)
+	{
+		_adc_poll_watch_cb(value);
+	}
+}
+
+void ADC_SEQB_IRQHandler(void)
+{
+	adc_poll_scan_t *scan = _adc_poll_scan;
+
+	LPC_ADC->FLAGS = (1UL << ADC_SEQB_INT);
+	LPC_ADC->SEQB_CTRL = 0;
+
+	if (!scan)
+	{
+		return;
+	}
+
+	for (uint8_t ch = 0; ch < ADC_POLL_CHANNELS; ch++)
 	{
-	   sample = LPC_ADC->SEQA_GDAT;
+		if (scan->channels & (1 << ch))
+		{
+			scan->value[ch] = (uint16_t)((LPC_ADC->DAT[ch] & 0xFFF0) >> 4);
+		}
 	}
-	while((sample & (1UL<<31)) == 0);
 
-	return (uint16_t)((sample & 0xFFF0) >> 4) ;
+	_adc_poll_scan = 0;
+	scan->done = 1;
+
+	if (_adc_poll_cb)
+	{
+		_adc_poll_cb(scan);
+	}
 }
@@ -9,11 +9,34 @@
 */
 
 #include <stdio.h>
+#include <stdint.h>
 
 #ifndef ADC_POLL_H_
 #define ADC_POLL_H_
 
+#define ADC_POLL_CHANNELS      (12)
+#define ADC_POLL_CHANNELS_ALL  ((1 << ADC_POLL_CHANNELS) - 1)
+#define ADC_POLL_READ_ERROR    (0xFFFF)	// Out of the 12-bit range
+
+typedef struct adc_poll_scan
+{
+	uint16_t         value[ADC_POLL_CHANNELS];	// 12-bit results, indexed by channel
+	uint16_t         channels;					// Channel mask of the scan
+	volatile uint8_t done;						// Set once every channel is in
+} adc_poll_scan_t;
+
+typedef void (*adc_poll_cb_t)(adc_poll_scan_t *scan);
+typedef void (*adc_poll_watch_cb_t)(uint16_t value);
+
 int      adc_poll_init(void);
+int      adc_poll_scan_start(uint16_t channels, adc_poll_scan_t *scan, adc_poll_cb_t cb);
+int      adc_poll_scan_busy(void);
+void     adc_poll_scan_wait(adc_poll_scan_t *scan);
 uint16_t adc_poll_read(uint8_t adc_ch);
+int      adc_poll_watch_start(uint8_t channel, uint16_t threshold, uint8_t trigger, adc_poll_watch_cb_t cb);
+void     adc_poll_watch_threshold(uint16_t threshold);
+void     adc_poll_watch_stop(void);
+int      adc_poll_watching(void);
+void     adc_poll_thcmp_isr(void);
 
 #endif /* ADC_POLL_H_ */
@@ -15,9 +15,51 @@
 
 #include "config.h"
 #include "button.h"
+#include "evloop.h"
+#include "settings.h"
+#include "capt_filter.h"
 #include "app_about.h"
 #include "gfx.h"
 
+// Restores the captouch filter, unknown values fall back to raw counts
+void app_about_load_settings(void)
+{
+	if (!settings_loaded())
+	{
+		app_about_save_settings();
+		return;
+	}
+
+	capt_filter_select((capt_filter_type_t)_settings.capt_filter);
+}
+
+void app_about_save_settings(void)
+{
+	_settings.capt_filter = (uint8_t)capt_filter_type();
+}
+
+#if BUTTON_USE_CAPTOUCH
+static void app_about_render_filter(void)
+{
+	ssd1306_fill_rect(0, 8, 128, 8, 0);
+	ssd1306_set_text(0, 8, 1, "TOUCH FILTER", 1);
+	ssd1306_set_text(64, 8, 1, (char *)capt_filter_name(capt_filter_type()), 1);
+	ssd1306_refresh();
+}
+
+// QEI = captouch filter, in use at once so the buttons can be tried on it
+static void app_about_filter_qei(int32_t steps, void *arg)
+{
+	int32_t type = ((int32_t)capt_filter_type() + steps) % CAPT_FILTER_LAST;
+
+	(void)arg;
+
+	if (type < 0) type += CAPT_FILTER_LAST;
+	capt_filter_select((capt_filter_type_t)type);
+	app_about_render_filter();
+}
+#endif
+
 void app_about_init(void)
 {
 	ssd1306_clear();
@@ -26,6 +68,8 @@ void app_about_init(void)
 
 void app_about_run(void)
 {
+	evloop_handlers_t h = { 0 };
+
 	ssd1306_clear();
     ssd1306_set_text(0, 0, 1, "LPC SAKEE", 1);
     ssd1306_set_text(127-60, 0, 1, "ABOUT SAKEE", 1);
@@ -42,11 +86,21 @@ void app_about_run(void)
 
     ssd1306_refresh();
 
+#if BUTTON_USE_CAPTOUCH
+	h.qei = app_about_filter_qei;
+	app_about_render_filter();
+#endif
+
 	/* Wait for the QEI switch to exit */
-	while (!(button_pressed() &  ( 1 << QEI_SW_PIN)))
-	{
+	evloop_run(&h);
 
+#if BUTTON_USE_CAPTOUCH
+	if (_settings.capt_filter != (uint8_t)capt_filter_type())
+	{
+		app_about_save_settings();
+		settings_save();
 	}
+#endif
 }
 
 
@@ -11,6 +11,8 @@
 #ifndef APP_ABOUT_H_
 #define APP_ABOUT_H_
 
+void app_about_load_settings(void);
+void app_about_save_settings(void);
 void app_about_init(void);
 void app_about_run(void);
 
@@ -0,0 +1,456 @@
+/*
+===============================================================================
+ Name        : app_bode.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Frequency response (Bode) analyzer, DAC out to ADC in
+===============================================================================
+ */
+
+#include <stdio.h>
+
+#include "LPC8xx.h"
+#include "gpio.h"
+#include "adc.h"
+
+#include "config.h"
+#include "delay.h"
+#include "evloop.h"
+#include "button.h"
+#include "qei.h"
+#include "ssd1306.h"
+#include "gfx.h"
+#include "dsp.h"
+#include "adc_dma.h"
+#include "dac_wavegen.h"
+#include "app_bode.h"
+
+// Every point plays the stimulus from the dual channel DMA generator and
+// captures the DUT output with the ADC hardware triggered from the same
+// timer (CTIMER0 MAT3, every second DAC sample), so each capture holds a
+// whole number of cycles and a single Goertzel bin gives gain and phase
+// without leakage or windowing.
+#define APP_BODE_POINTS         (64)    // 2 pixels per point across the display
+#define APP_BODE_ADC_PER_CYCLE  (DAC_WAVEGEN_DMA_SAMPLES / 2)
+#define APP_BODE_SAMPLES        (DMA_BUFFER_SIZE)
+#define APP_BODE_BIN            (APP_BODE_SAMPLES / APP_BODE_ADC_PER_CYCLE)
+#define APP_BODE_SETTLE         (4 * APP_BODE_ADC_PER_CYCLE)  // Whole cycles, keeps the phase reference
+
+// Stimulus is the 0..1.8V sine table, 279 DAC lsb peak or 1116 ADC lsb.
+// Without a THRU calibration the results are relative to this.
+#define APP_BODE_GAIN           (256)
+#define APP_BODE_REF_MAG        ((279 * 4) << 8)    // Q8, as returned by dsp_goertzel()
+#define APP_BODE_REF_PHASE      (0xC0000000)        // Sine, -90 degrees from the cosine bin
+
+// Plot area below the title bar, 1dB per row from +10dB down
+#define APP_BODE_PLOT_Y         (10)
+#define APP_BODE_PLOT_H         (54)
+#define APP_BODE_DB10_TOP       (100)
+
+// Log spaced from 20Hz to just under the dual DAC limit
+static const uint16_t _app_bode_freq[APP_BODE_POINTS] = {
+	  20,   22,   24,   26,   28,   30,   33,   36,
+	  39,   42,   46,   50,   55,   59,   65,   70,
+	  76,   83,   90,   98,  107,  116,  126,  137,
+	 149,  162,  176,  192,  208,  227,  246,  268,
+	 291,  317,  344,  374,  407,  443,  481,  523,
+	 569,  619,  673,  731,  795,  865,  940, 1022,
+	1111, 1208, 1314, 1428, 1553, 1689, 1836, 1996,
+	2171, 2360, 2566, 2790, 3034, 3299, 3587, 3900
+};
+
+enum
+{
+	APP_BODE_CONFIG_SWEEP = 0,
+	APP_BODE_CONFIG_CAL,
+	APP_BODE_CONFIG_VIEW,
+	APP_BODE_CONFIG_EXIT,
+	APP_BODE_CONFIG_LAST,
+};
+
+static dac_wavegen_chcfg_t _app_bode_cfg[2];
+
+static int16_t  _app_bode_db10[APP_BODE_POINTS];
+static int16_t  _app_bode_deg10[APP_BODE_POINTS];
+static uint8_t  _app_bode_count = 0;
+
+// THRU calibration, the raw bins with DAC out wired straight to ADC in
+static uint32_t _app_bode_cal_mag[APP_BODE_POINTS];
+static uint32_t _app_bode_cal_phase[APP_BODE_POINTS];
+static uint8_t  _app_bode_cal_valid = 0;
+
+void app_bode_init(void)
+{
+	// Initialize the DMA based ADC sampler
+	adc_dma_init();
+
+	// Analog front end: 3.3V VRef, no divider, DC coupled
+	GPIOSetDir(AN_IN_VREF_3_3V_0_971V/32, AN_IN_VREF_3_3V_0_971V%32, 1);
+	GPIOSetDir(AN_IN_VDIV_0_787X/32, AN_IN_VDIV_0_787X%32, 1);
+	GPIOSetDir(AN_IN_220NF_BLOCKING/32, AN_IN_220NF_BLOCKING%32, 1);
+	GPIOSetBitValue(AN_IN_VREF_3_3V_0_971V/32, AN_IN_VREF_3_3V_0_971V%32, 1);
+	GPIOSetBitValue(AN_IN_VDIV_0_787X/32, AN_IN_VDIV_0_787X%32, 1);
+	GPIOSetBitValue(AN_IN_220NF_BLOCKING/32, AN_IN_220NF_BLOCKING%32, 1);
+
+	// Route DAC1 to the DACOUT connector rather than the speaker
+	dac_wavegen_init(WAVEGEN_DAC);
+	GPIOSetDir(DAC1EN_PIN/32, DAC1EN_PIN%32, 1);
+	GPIOSetBitValue(DAC1EN_PIN/32, DAC1EN_PIN%32, 0);
+
+	// Stimulus on the wavegen DAC, the other one idles at 0V
+	for (uint8_t i = 0; i < 2; i++)
+	{
+		_app_bode_cfg[i].samples = dac_wavegen_sine_1024;
+		_app_bode_cfg[i].count = 1024;
+		_app_bode_cfg[i].gain = (i == WAVEGEN_DAC) ? APP_BODE_GAIN : 0;
+		_app_bode_cfg[i].phase_deg = 0;
+	}
+
+	ssd1306_clear();
+	ssd1306_refresh();
+}
+
+// Actual stimulus frequency, the DMA sample clock is a whole tick count
+static uint32_t app_bode_actual_hz(uint8_t point)
+{
+	uint32_t ticks = system_ahb_clk / (_app_bode_freq[point] * DAC_WAVEGEN_DMA_SAMPLES);
+
+	return system_ahb_clk / (ticks * DAC_WAVEGEN_DMA_SAMPLES);
+}
+
+// Arms the capture for a point, then starts its stimulus. The ADC only
+// converts on timer edges, so the first sample lines up with the first
+// DAC sample no matter how long the setup takes.
+static void app_bode_stimulus(uint8_t point, uint16_t *buf)
+{
+	dac_wavegen_dual_stop();
+	adc_dma_start_triggered(buf, APP_BODE_SAMPLES, APP_BODE_SETTLE, TIM0_MAT3);
+	dac_wavegen_dual_run(_app_bode_cfg, _app_bode_freq[point]);
+}
+
+static void app_bode_analyze(uint8_t point, const uint16_t *buf, uint8_t cal)
+{
+	int32_t re, im;
+	uint32_t mag, phase;
+
+	dsp_goertzel(buf, APP_BODE_SAMPLES, 4, APP_BODE_BIN, &re, &im);   // 12-bit results sit in DAT[15:4]
+	mag = dsp_mag(re, im);
+	phase = dsp_atan2(im, re);
+
+	if (cal)
+	{
+		_app_bode_cal_mag[point] = mag;
+		_app_bode_cal_phase[point] = phase;
+	}
+
+	if (_app_bode_cal_valid || cal)
+	{
+		_app_bode_db10[point] = dsp_db10(mag, _app_bode_cal_mag[point]);
+		_app_bode_deg10[point] = DSP_TURN_DEG10(phase - _app_bode_cal_phase[point]);
+	}
+	else
+	{
+		_app_bode_db10[point] = dsp_db10(mag, APP_BODE_REF_MAG);
+		_app_bode_deg10[point] = DSP_TURN_DEG10(phase - APP_BODE_REF_PHASE);
+	}
+}
+
+static void app_bode_print_tenths(int32_t v)
+{
+	if (v < 0)
+	{
+		printf("-");
+		v = -v;
+	}
+	printf("%d.%d", (int)(v / 10), (int)(v % 10));
+}
+
+// Streams one point as 'Hz,dB,degrees'
+static void app_bode_print_point(uint8_t point)
+{
+	printf("%d,", (int)app_bode_actual_hz(point));
+	app_bode_print_tenths(_app_bode_db10[point]);
+	printf(",");
+	app_bode_print_tenths(_app_bode_deg10[point]);
+	printf("\n\r");
+}
+
+static uint8_t app_bode_db_y(int32_t db10)
+{
+	int32_t y = (APP_BODE_DB10_TOP - db10) / 10;
+
+	if (y < 0) y = 0;
+	if (y > APP_BODE_PLOT_H - 1) y = APP_BODE_PLOT_H - 1;
+
+	return APP_BODE_PLOT_Y + y;
+}
+
+static uint8_t app_bode_deg_y(int32_t deg10)
+{
+	return APP_BODE_PLOT_Y + ((1800 - deg10) * (APP_BODE_PLOT_H - 1)) / 3600;
+}
+
+// Magnitude as a solid trace, phase as dots, cursor < 0 for none
+static void app_bode_render_plot(int32_t cursor)
+{
+	uint8_t y, last_y = 0;
+
+	ssd1306_fill_rect(0, APP_BODE_PLOT_Y, 128, APP_BODE_PLOT_H, 0);
+
+	// 0dB and 0 degree reference lines
+	for (uint8_t x = 0; x < 128; x += 4)
+	{
+		ssd1306_set_pixel(x, app_bode_db_y(0), 1);
+		ssd1306_set_pixel(x + 2, app_bode_deg_y(0), 1);
+	}
+
+	for (uint8_t i = 0; i < _app_bode_count; i++)
+	{
+		y = app_bode_db_y(_app_bode_db10[i]);
+		if (i)
+		{
+			// Join up with the previous point
+			if (y > last_y) ssd1306_fill_rect(i * 2, last_y, 1, y - last_y + 1, 1);
+			else ssd1306_fill_rect(i * 2, y, 1, last_y - y + 1, 1);
+		}
+		ssd1306_set_pixel(i * 2, y, 1);
+		ssd1306_set_pixel(i * 2 + 1, y, 1);
+		last_y = y;
+
+		ssd1306_set_pixel(i * 2, app_bode_deg_y(_app_bode_deg10[i]), 1);
+	}
+
+	if (cursor >= 0)
+	{
+		for (y = APP_BODE_PLOT_Y; y < APP_BODE_PLOT_Y + APP_BODE_PLOT_H; y += 3)
+		{
+			ssd1306_set_pixel(cursor * 2, y, 1);
+		}
+	}
+}
+
+static void app_bode_render_title(int32_t cursor)
+{
+	uint8_t x;
+
+	ssd1306_fill_rect(0, 0, 128, 8, 0);
+
+	if (cursor < 0)
+	{
+		ssd1306_set_text(0, 0, 1, "LPC SAKEE", 1);
+		ssd1306_set_text(127 - 54, 0, 1, "BODE PLOT", 1);
+		return;
+	}
+
+	// Cursor readout: frequency, gain and phase
+	gfx_printdec(0, 0, app_bode_actual_hz(cursor), 1, 1);
+	ssd1306_set_text(gfx_num_digits(app_bode_actual_hz(cursor)) * 6, 0, 1, "Hz", 1);
+	x = gfx_printfixed(42, 0, _app_bode_db10[cursor], 1, 1, 1);
+	ssd1306_set_text(x, 0, 1, "dB", 1);
+	gfx_printdec(98, 0, _app_bode_deg10[cursor] / 10, 1, 1);
+}
+
+/**
+ * Runs one sweep across all points, plotting and streaming as it goes.
+ *
+ * The next stimulus is started as soon as a capture completes, so its
+ * settling and capture time hide the Goertzel, display and UART work for
+ * the previous point. The two halves of the ADC buffer alternate.
+ *
+ * @return 0 when complete, -1 if cancelled with the QEI switch
+ */
+static int32_t app_bode_sweep(uint8_t cal)
+{
+	uint16_t *buf[2];
+	int32_t ret = 0;
+
+	buf[0] = adc_dma_get_buffer();
+	buf[1] = buf[0] + DMA_BUFFER_SIZE;
+
+	_app_bode_count = 0;
+	if (cal)
+	{
+		_app_bode_cal_valid = 0;
+	}
+
+	ssd1306_clear();
+	app_bode_render_title(-1);
+	app_bode_render_plot(-1);
+	ssd1306_refresh();
+
+	printf("BODE %s\n\r", cal ? "CAL" : "SWEEP");
+	printf("Hz,dB,deg\n\r");
+
+	app_bode_stimulus(0, buf[0]);
+
+	for (uint8_t i = 0; i < APP_BODE_POINTS; i++)
+	{
+		while (adc_dma_busy())
+		{
+			if (button_pressed() & (1 << QEI_SW_PIN))
+			{
+				ret = -1;
+			}
+
+			// Woken by the DMA block interrupt, or the SysTick at the latest
+			__WFI();
+		}
+		if (ret < 0) break;
+
+		// Next point runs while this one is crunched
+		if (i + 1 < APP_BODE_POINTS)
+		{
+			app_bode_stimulus(i + 1, buf[(i + 1) & 1]);
+		}
+		else
+		{
+			dac_wavegen_dual_stop();
+		}
+
+		app_bode_analyze(i, buf[i & 1], cal);
+		_app_bode_count = i + 1;
+		app_bode_print_point(i);
+
+		app_bode_render_plot(i);
+		ssd1306_refresh();
+	}
+
+	dac_wavegen_dual_stop();
+	adc_dma_stop();
+
+	if (ret < 0)
+	{
+		printf("BODE CANCELLED\n\r");
+		return -1;
+	}
+
+	if (cal)
+	{
+		_app_bode_cal_valid = 1;
+	}
+
+	return 0;
+}
+
+static void app_bode_cursor_qei(int32_t steps, void *arg)
+{
+	int32_t *cursor = arg;
+
+	*cursor += steps;
+	if (*cursor < 0) *cursor = 0;
+	if (*cursor >= _app_bode_count) *cursor = _app_bode_count - 1;
+
+	app_bode_render_title(*cursor);
+	app_bode_render_plot(*cursor);
+	ssd1306_refresh();
+}
+
+// Scrolls a cursor over the last sweep until the QEI switch is pressed
+static void app_bode_cursor(void)
+{
+	int32_t cursor = _app_bode_count - 1;
+	const evloop_handlers_t h = { .qei = app_bode_cursor_qei, .arg = &cursor };
+
+	qei_reset_step();
+
+	app_bode_render_title(cursor);
+	app_bode_render_plot(cursor);
+	ssd1306_refresh();
+
+	evloop_run(&h);
+}
+
+// Draws the menu selection indicator next to row 'selected'
+static void app_bode_render_indicator(int32_t selected)
+{
+	uint8_t y = ((selected + 2) * 8) - 2;
+
+	ssd1306_fill_rect(4, 12, 3, 40, 0);
+	ssd1306_set_pixel(6, y, 1);
+	ssd1306_set_pixel(5, y-1, 1);
+	ssd1306_set_pixel(5, y, 1);
+	ssd1306_set_pixel(5, y+1, 1);
+	ssd1306_set_pixel(4, y-2, 1);
+	ssd1306_set_pixel(4, y-1, 1);
+	ssd1306_set_pixel(4, y, 1);
+	ssd1306_set_pixel(4, y+1, 1);
+	ssd1306_set_pixel(4, y+2, 1);
+	ssd1306_refresh();
+}
+
+static void app_bode_config_qei(int32_t steps, void *arg)
+{
+	int32_t *menu_selected = arg;
+
+	*menu_selected += steps;
+	if (*menu_selected < 0)
+	{
+		*menu_selected = APP_BODE_CONFIG_LAST - 1;
+	}
+	if (*menu_selected >= APP_BODE_CONFIG_LAST)
+	{
+		*menu_selected = 0;
+	}
+
+	app_bode_render_indicator(*menu_selected);
+}
+
+static int32_t app_bode_config_screen(void)
+{
+	int32_t menu_selected = APP_BODE_CONFIG_SWEEP;
+	const evloop_handlers_t h = { .qei = app_bode_config_qei, .arg = &menu_selected };
+
+	// Reset the QEI encoder position counter
+	qei_reset_step();
+
+	ssd1306_clear();
+
+	// Render the title bars
+	ssd1306_set_text(0, 0, 1, "LPC SAKEE", 1);
+	ssd1306_set_text(127 - 54, 0, 1, "BODE PLOT", 1);
+	ssd1306_set_text(10, 12, 1, "START SWEEP", 1);
+	ssd1306_set_text(10, 20, 1, "CALIBRATE (THRU)", 1);
+	ssd1306_set_text(10, 28, 1, "VIEW LAST SWEEP", 1);
+	ssd1306_set_text(10, 36, 1, "MAIN MENU", 1);
+	ssd1306_set_text(10, 55, 1, _app_bode_cal_valid ? "CAL: THRU" : "CAL: NONE", 1);
+	app_bode_render_indicator(menu_selected);
+
+	// Wait for a click on the selected row
+	evloop_run(&h);
+
+	return menu_selected;
+}
+
+void app_bode_run(void)
+{
+	while (1)
+	{
+		switch (app_bode_config_screen())
+		{
+		case APP_BODE_CONFIG_SWEEP:
+			// Sweep the DUT
+			if (app_bode_sweep(0) == 0)
+			{
+				app_bode_cursor();
+			}
+			break;
+		case APP_BODE_CONFIG_CAL:
+			// DAC out wired to ADC in, the result should be flat
+			if (app_bode_sweep(1) == 0)
+			{
+				app_bode_cursor();
+			}
+			break;
+		case APP_BODE_CONFIG_VIEW:
+			if (_app_bode_count)
+			{
+				ssd1306_clear();
+				app_bode_cursor();
+			}
+			break;
+		default:
+			return;
+		}
+	}
+}
@@ -0,0 +1,16 @@
+/*
+===============================================================================
+ Name        : app_bode.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description :
+===============================================================================
+ */
+#ifndef APP_BODE_H_
+#define APP_BODE_H_
+
+void app_bode_init(void);
+void app_bode_run(void);
+
+#endif /* APP_BODE_H_ */
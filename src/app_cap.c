@@ -0,0 +1,146 @@
+/*
+===============================================================================
+ Name        : app_cap.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Capacitance and ESR meter
+===============================================================================
+ */
+
+#include "LPC8xx.h"
+
+#include "config.h"
+#include "button.h"
+#include "delay.h"
+#include "qei.h"
+#include "evloop.h"
+#include "cap_meter.h"
+#include "app_cap.h"
+#include "gfx.h"
+
+/*
+ Pins used in this application:
+
+ CAP_SENSE_PIN     [I] - DUT +, DUT - to GND (mind the polarity)
+ CAP_CHARGE_HI_PIN [O] - 1M to CAP_SENSE_PIN
+ CAP_CHARGE_LO_PIN [O] - 1k to CAP_SENSE_PIN
+*/
+
+// Stray capacitance of the leads, nulled with USER1 with nothing connected
+static uint64_t _app_cap_null_pf = 0;
+
+void app_cap_init(void)
+{
+	ssd1306_clear();
+    ssd1306_refresh();
+}
+
+static void app_cap_render(const cap_meter_result_t *r)
+{
+	uint64_t c = r->c_pf;
+	uint8_t x;
+
+	ssd1306_fill_rect(0, 12, 128, 43, 0);
+
+	if (r->status == CAP_METER_OVER)
+	{
+		ssd1306_set_text(10, 16, 1, "OVER / SHORT", 1);
+		ssd1306_refresh();
+		return;
+	}
+
+	// The null only means anything next to the small parts
+	if (r->range == CAP_METER_RANGE_HI)
+	{
+		c = c > _app_cap_null_pf ? c - _app_cap_null_pf : 0;
+	}
+
+	if (c < 1000)
+	{
+		x = gfx_printfixed(0, 12, (int32_t)c, 0, 2, 1);
+		ssd1306_set_text(x + 4, 19, 1, "pF", 1);
+	}
+	else if (c < 1000000)
+	{
+		x = gfx_printfixed(0, 12, (int32_t)(c / 10), 2, 2, 1);
+		ssd1306_set_text(x + 4, 19, 1, "nF", 1);
+	}
+	else if (c < 1000000000)
+	{
+		x = gfx_printfixed(0, 12, (int32_t)(c / 1000), 3, 2, 1);
+		ssd1306_set_text(x + 4, 19, 1, "uF", 1);
+	}
+	else
+	{
+		x = gfx_printfixed(0, 12, (int32_t)(c / 100000), 1, 2, 1);
+		ssd1306_set_text(x + 4, 19, 1, "uF", 1);
+	}
+
+	ssd1306_set_text(0, 28, 1, "ESR", 1);
+	if (r->esr_mohm == CAP_METER_ESR_NONE)
+	{
+		ssd1306_set_text(40, 28, 1, "--", 1);
+	}
+	else
+	{
+		x = gfx_printfixed(40, 28, r->esr_mohm / 10, 2, 1, 1);
+		ssd1306_set_text(x + 2, 28, 1, "OHM", 1);
+	}
+
+	ssd1306_set_text(0, 37, 1, "RANGE", 1);
+	ssd1306_set_text(40, 37, 1, r->range == CAP_METER_RANGE_HI ? "1M" : "1k", 1);
+	ssd1306_set_text(64, 37, 1, "AVG", 1);
+	gfx_printdec(88, 37, r->count, 1, 1);
+
+	ssd1306_set_text(0, 46, 1, "USER1: NULL", 1);
+	if (_app_cap_null_pf)
+	{
+		gfx_printdec(64, 46, (int32_t)_app_cap_null_pf, 1, 1);
+		ssd1306_set_text(64 + 5 * gfx_num_digits((uint32_t)_app_cap_null_pf), 46, 1, "pF", 1);
+	}
+
+	ssd1306_refresh();
+}
+
+static void app_cap_button(uint32_t pressed, void *arg)
+{
+	cap_meter_result_t *r = arg;
+
+	if (pressed & (1 << BUTTON_USER1))
+	{
+		// Take the open leads as zero, or clear the null on the 1k range
+		_app_cap_null_pf = (r->status == CAP_METER_OK && r->range == CAP_METER_RANGE_HI) ? r->c_pf : 0;
+		if (r->count) app_cap_render(r);
+	}
+}
+
+static void app_cap_poll(void *arg)
+{
+	cap_meter_result_t *r = arg;
+
+	if (cap_meter_poll(r))
+	{
+		app_cap_render(r);
+	}
+}
+
+void app_cap_run(void)
+{
+	cap_meter_result_t r = { 0 };
+	const evloop_handlers_t h = { .button = app_cap_button, .poll = app_cap_poll, .arg = &r };
+
+	ssd1306_clear();
+    ssd1306_set_text(0, 0, 1, "LPC SAKEE", 1);
+    ssd1306_set_text(127-45, 0, 1, "CAP METER", 1);	// 45 pixels wide
+	ssd1306_set_text(10, 16, 1, "MEASURING", 2);
+	ssd1306_set_text(16, 55, 1, "CLICK FOR MAIN MENU", 1);
+	ssd1306_refresh();
+
+	cap_meter_start();
+
+	/* Wait for the QEI switch to exit */
+	evloop_run(&h);
+
+	cap_meter_stop();
+}
@@ -0,0 +1,17 @@
+/*
+===============================================================================
+ Name        : app_cap.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description :
+===============================================================================
+ */
+
+#ifndef APP_CAP_H_
+#define APP_CAP_H_
+
+void app_cap_init(void);
+void app_cap_run(void);
+
+#endif /* APP_CAP_H_ */
@@ -13,10 +13,13 @@
 #include "swm.h"
 #include "syscon.h"
 #include "gpio.h"
+#include "adc.h"
+#include "ctimer.h"
 
 #include "adc_poll.h"
 #include "config.h"
 #include "delay.h"
+#include "evloop.h"
 #include "button.h"
 #include "app_cont.h"
 #include "gfx.h"
@@ -24,6 +27,16 @@
 
 #define CONT_ADC_CHANNEL (3)
 
+// The ADC converts CONT_ADC_CHANNEL on every CTIMER0 MAT3 rising edge and
+// the threshold comparator interrupts only when the reading crosses the
+// continuity threshold, so the CPU sleeps until the probe state changes.
+// The threshold moves up once closed, for some hysteresis.
+#define CONT_THRESHOLD_CLOSE   (100)   // lsb, below = continuity
+#define CONT_THRESHOLD_OPEN    (120)   // lsb, above = open again
+#define CONT_SAMPLE_US         (500)   // Detect to beep latency is below this plus the ISR
+
+static volatile uint8_t _app_cont_closed = 0;
+
 // 0.0 .. 1.8V exponential decay by default
 static const uint16_t app_cont_dac_output[64] = {
 	   0,  34,  66,  95, 123, 150, 174, 198,
@@ -55,8 +68,77 @@ void app_cont_init(void)
     ssd1306_refresh();
 }
 
+// Beep and LED straight from the threshold interrupt, the display
+// follows from the main loop
+static void app_cont_set(uint8_t closed)
+{
+	_app_cont_closed = closed;
+
+	if (closed)
+	{
+		// Turn the LED on and enable the DAC audio output for an audible alert
+		LPC_GPIO_PORT->CLR0 = (1 << LED_PIN);
+	    GPIOSetBitValue(AUDIO_AMP_ENABLE_PORT, AUDIO_AMP_ENABLE_PIN, 1);
+		adc_poll_watch_threshold(CONT_THRESHOLD_OPEN);
+	}
+	else
+	{
+		// Turn the LED off and disable the DAC audio output
+		LPC_GPIO_PORT->SET0 = (1 << LED_PIN);
+	    GPIOSetBitValue(AUDIO_AMP_ENABLE_PORT, AUDIO_AMP_ENABLE_PIN, 0);
+		adc_poll_watch_threshold(CONT_THRESHOLD_CLOSE);
+	}
+}
+
+static void app_cont_on_cross(uint16_t value)
+{
+	app_cont_set(value < (_app_cont_closed ? CONT_THRESHOLD_OPEN : CONT_THRESHOLD_CLOSE));
+}
+
+// CTIMER0 MAT3 toggles at twice the sample rate, the ADC triggers on rising edges
+static void app_cont_timer_start(void)
+{
+	uint32_t ticks = (system_ahb_clk / 1000000) * CONT_SAMPLE_US / 2;
+
+	Enable_Periph_Clock(CLK_CTIMER0);
+	LPC_CTIMER0->TCR = 1<<CRST;
+	LPC_CTIMER0->PR  = 0;
+	LPC_CTIMER0->MR[3] = ticks - 1;
+	LPC_CTIMER0->MCR = (1<<MR3R);
+	LPC_CTIMER0->EMR = (TOGGLE_ON_MATCH<<EMC3);
+	LPC_CTIMER0->TCR = 1<<CEN;
+}
+
+static void app_cont_timer_stop(void)
+{
+	LPC_CTIMER0->TCR = 0;
+	LPC_CTIMER0->MCR = 0;
+	LPC_CTIMER0->EMR = 0;
+}
+
+static void app_cont_render(uint8_t closed)
+{
+	ssd1306_invert(closed);
+	ssd1306_refresh();
+}
+
+// Woken by the threshold interrupt, only redraws on a change of state
+static void app_cont_poll(void *arg)
+{
+	uint8_t *shown = arg;
+
+	if (*shown != _app_cont_closed)
+	{
+		*shown = _app_cont_closed;
+		app_cont_render(*shown);
+	}
+}
+
 void app_cont_run(void)
 {
+	uint8_t shown;
+	const evloop_handlers_t h = { .poll = app_cont_poll, .arg = &shown };
+
 	ssd1306_clear();
     ssd1306_set_text(0, 0, 1, "LPC SAKEE", 1);
     ssd1306_set_text(127-60, 0, 1, "CONT TESTER", 1);
@@ -65,35 +147,26 @@ void app_cont_run(void)
 	ssd1306_set_text(16, 55, 1, "CLICK FOR MAIN MENU", 1);
     ssd1306_refresh();
 
-	// Enable the DAC output for an audible alert
-	dac_wavegen_run(WAVEGEN_DAC, app_cont_dac_output, sizeof(app_cont_dac_output)/2, 500);
+	// The alert tone runs the whole time, the amplifier enable gates it
+	dac_wavegen_run(WAVEGEN_DAC, app_cont_dac_output, sizeof(app_cont_dac_output)/2, 100);
     GPIOSetDir(AUDIO_AMP_ENABLE_PORT, AUDIO_AMP_ENABLE_PIN, OUTPUT);
-    // Disable the audio output by default
-    GPIOSetBitValue(AUDIO_AMP_ENABLE_PORT, AUDIO_AMP_ENABLE_PIN, 0);
+
+	// Starting state from one conversion, then the comparator takes over
+	// (it compares against this result for the first crossing)
+	app_cont_set(adc_poll_read(CONT_ADC_CHANNEL) < CONT_THRESHOLD_CLOSE);
+	adc_poll_watch_start(CONT_ADC_CHANNEL, _app_cont_closed ? CONT_THRESHOLD_OPEN : CONT_THRESHOLD_CLOSE,
+	                     TIM0_MAT3, app_cont_on_cross);
+	app_cont_timer_start();
+
+	shown = _app_cont_closed;
+	app_cont_render(shown);
 
 	/* Wait for the QEI switch to exit */
-	while (!(button_pressed() &  ( 1 << QEI_SW_PIN)))
-	{
-		uint16_t v = adc_poll_read(CONT_ADC_CHANNEL);
-		if (v < 100)
-		{
-			ssd1306_invert(1);
-			// Turn the LED on
-			LPC_GPIO_PORT->CLR0 = (1 << LED_PIN);
-			// Enable the DAC audio output for an audible alert
-			dac_wavegen_run(WAVEGEN_DAC, app_cont_dac_output, sizeof(app_cont_dac_output)/2, 100);
-		    GPIOSetBitValue(AUDIO_AMP_ENABLE_PORT, AUDIO_AMP_ENABLE_PIN, 1);
-		}
-		else
-		{
-			ssd1306_invert(0);
-			// Turn the LED off
-			LPC_GPIO_PORT->SET0 = (1 << LED_PIN);
-			// Disable the DAC audio output
-		    GPIOSetBitValue(AUDIO_AMP_ENABLE_PORT, AUDIO_AMP_ENABLE_PIN, 0);
-		}
-		ssd1306_refresh();
-	}
+	evloop_run(&h);
+
+	app_cont_timer_stop();
+	adc_poll_watch_stop();
+	app_cont_set(0);
 
 	// Make sure to shut the DAC off before leaving
 	dac_wavegen_stop(WAVEGEN_DAC);
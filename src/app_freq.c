@@ -0,0 +1,155 @@
+/*
+===============================================================================
+ Name        : app_freq.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Frequency, period and duty cycle meter
+===============================================================================
+ */
+
+#include "LPC8xx.h"
+
+#include "config.h"
+#include "button.h"
+#include "delay.h"
+#include "evloop.h"
+#include "qei.h"
+#include "freq_meter.h"
+#include "app_freq.h"
+#include "gfx.h"
+
+/*
+ Pins used in this application:
+
+ FREQ_IN_PIN [I] - Input, 3.3V logic levels
+*/
+
+// Gate times, picked with the QEI
+static const uint16_t _app_freq_gates_ms[] = { 100, 1000, 10000 };
+#define APP_FREQ_GATES           (sizeof(_app_freq_gates_ms) / sizeof(_app_freq_gates_ms[0]))
+
+static uint8_t _app_freq_gate = 1;
+
+void app_freq_init(void)
+{
+	ssd1306_clear();
+    ssd1306_refresh();
+}
+
+static void app_freq_render_gate(void)
+{
+	ssd1306_fill_rect(64, 46, 64, 8, 0);
+	ssd1306_set_text(64, 46, 1, "GATE", 1);
+	uint8_t x = gfx_printfixed(88, 46, _app_freq_gates_ms[_app_freq_gate] / 100, 1, 1, 1);
+	ssd1306_set_text(x, 46, 1, "s", 1);
+}
+
+static void app_freq_render(const freq_meter_result_t *r)
+{
+	uint8_t x;
+
+	ssd1306_fill_rect(0, 12, 128, 43, 0);
+
+	if (r->periods == 0)
+	{
+		ssd1306_set_text(10, 16, 1, "NO SIGNAL", 2);
+	}
+	else
+	{
+		// Frequency, with the digits the resolution supports at the top end
+		if (r->freq_mhz < 1000000)
+		{
+			x = gfx_printfixed(0, 12, (int32_t)r->freq_mhz, 3, 2, 1);
+			ssd1306_set_text(x + 4, 19, 1, "Hz", 1);
+		}
+		else if (r->freq_mhz < 1000000000)
+		{
+			x = gfx_printfixed(0, 12, (int32_t)(r->freq_mhz / 100), 4, 2, 1);
+			ssd1306_set_text(x + 4, 19, 1, "kHz", 1);
+		}
+		else
+		{
+			x = gfx_printfixed(0, 12, (int32_t)(r->freq_mhz / 1000), 6, 2, 1);
+			ssd1306_set_text(x + 4, 19, 1, "MHz", 1);
+		}
+
+		ssd1306_set_text(0, 28, 1, "PERIOD", 1);
+		if (r->period_ns < 1000000)
+		{
+			x = gfx_printfixed(40, 28, (int32_t)r->period_ns, 3, 1, 1);
+			ssd1306_set_text(x + 2, 28, 1, "us", 1);
+		}
+		else
+		{
+			x = gfx_printfixed(40, 28, (int32_t)(r->period_ns / 1000), 3, 1, 1);
+			ssd1306_set_text(x + 2, 28, 1, "ms", 1);
+		}
+
+		ssd1306_set_text(0, 37, 1, "DUTY", 1);
+		if (r->duty == FREQ_METER_DUTY_NONE)
+		{
+			ssd1306_set_text(40, 37, 1, "--", 1);
+		}
+		else
+		{
+			x = gfx_printfixed(40, 37, r->duty, 1, 1, 1);
+			ssd1306_set_text(x + 2, 37, 1, "%", 1);
+		}
+	}
+
+	ssd1306_set_text(0, 46, 1, r->mode == FREQ_METER_MODE_EDGE ? "EDGE" : "COUNT", 1);
+	app_freq_render_gate();
+	ssd1306_refresh();
+}
+
+// QEI scroll = gate time
+static void app_freq_qei(int32_t steps, void *arg)
+{
+	int32_t g = (int32_t)_app_freq_gate + steps;
+
+	(void)arg;
+
+	// Clamp, no roll over from 10s back to 0.1s
+	if (g < 0) g = 0;
+	if (g >= (int32_t)APP_FREQ_GATES) g = APP_FREQ_GATES - 1;
+	_app_freq_gate = (uint8_t)g;
+
+	freq_meter_set_gate(_app_freq_gates_ms[_app_freq_gate]);
+	app_freq_render_gate();
+	ssd1306_refresh();
+}
+
+// The capture interrupts wake the loop, a result comes once per gate
+static void app_freq_poll(void *arg)
+{
+	freq_meter_result_t *r = arg;
+
+	if (freq_meter_poll(r))
+	{
+		app_freq_render(r);
+	}
+}
+
+void app_freq_run(void)
+{
+	freq_meter_result_t r;
+	const evloop_handlers_t h = { .qei = app_freq_qei, .poll = app_freq_poll, .arg = &r };
+
+	qei_reset_step();
+
+	ssd1306_clear();
+    ssd1306_set_text(0, 0, 1, "LPC SAKEE", 1);
+    ssd1306_set_text(127-50, 0, 1, "FREQ METER", 1);	// 50 pixels wide
+	ssd1306_set_text(10, 16, 1, "WAITING", 2);
+	app_freq_render_gate();
+	ssd1306_set_text(16, 55, 1, "CLICK FOR MAIN MENU", 1);
+	ssd1306_refresh();
+
+	freq_meter_start(_app_freq_gates_ms[_app_freq_gate]);
+
+	/* Wait for the QEI switch to exit */
+	evloop_run(&h);
+
+	freq_meter_stop();
+}
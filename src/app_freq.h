@@ -0,0 +1,17 @@
+/*
+===============================================================================
+ Name        : app_freq.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description :
+===============================================================================
+ */
+
+#ifndef APP_FREQ_H_
+#define APP_FREQ_H_
+
+void app_freq_init(void);
+void app_freq_run(void);
+
+#endif /* APP_FREQ_H_ */
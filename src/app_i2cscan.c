@@ -4,21 +4,134 @@
  Author      : $(author)
  Version     :
  Copyright   : $(copyright)
- Description : Main menu
+ Description : I2C bus scanner and sniffer
 ===============================================================================
  */
 
+#include <stdio.h>
+
 #include "LPC8xx.h"
 #include "i2c.h"
 #include "swm.h"
 #include "syscon.h"
+#include "ctimer.h"
+#include "uart.h"
+#include "chip_setup.h"
 
 #include "config.h"
 #include "button.h"
 #include "delay.h"
+#include "evloop.h"
+#include "adc_dma.h"
+#include "qei.h"
 #include "app_i2cscan.h"
+#include "dma_common.h"
 #include "gfx.h"
 
+// The scan runs from the I2C0 interrupt: every probe is a (repeated) START
+// with the next address, chained straight from the previous ACK/NACK, and
+// a single STOP ends the scan. The hardware timeout catches a stuck bus,
+// so nothing waits on delay_ms and 112 probes take ~3ms at 400kHz.
+// Above 400kHz the pins switch to Fast-mode Plus drive (up to 1MHz), the
+// bus pull-ups have to be sized for it.
+#define APP_I2CSCAN_RATE_HZ      (400000)
+#define APP_I2CSCAN_TIMEOUT_US   (1000)     // SCL held low or no progress
+#define APP_I2CSCAN_ADDR_FIRST   (0x08)
+#define APP_I2CSCAN_ADDR_LAST    (0x77)
+#define APP_I2CSCAN_SHOW_MAX     (10)       // Addresses that fit the display
+
+// The sniffer puts I2C0 in monitor-only mode. The monitor has no DMA
+// request, so a short ISR moves every MONRXDAT word (data plus START,
+// repeated START and NACK flags) into a RAM ring, adds a marker when the
+// bus goes idle after a STOP, and timestamps each START from CTIMER0 at
+// 1MHz. A 400kHz byte is 22.5us, far more than the ISR needs. The main
+// loop decodes the ring into transactions for the OLED log and the UART;
+// if those fall behind, the ring overflow is counted, not hidden. Once a
+// word is lost the rest of its transaction is thrown away too, and a LOST
+// marker takes the place of the START or STOP that ends it, so the decoder
+// never glues bytes onto the wrong address.
+//
+// The UART gets a compact hex stream, one line per transaction:
+// S<usec:8><addr> for a START, r<addr> for a repeated START, <data> per
+// byte, then P for the STOP or L for LOST. A * after a byte means NACK.
+// The decoder only queues it in a ring that DMA feeds to the UART at
+// 1Mbaud, 100k chars/s, so neither waits for the other. A 400kHz data
+// byte is 2 chars per 22.5us, 89% of the link, so long transfers keep up
+// at full bus speed. Each transaction costs 13 chars on top, a register
+// read (S addr reg Sr addr data P) is ~20 chars for ~110us of bus time:
+// back to back those are sustainable up to about half the bus. Beyond
+// that the rings cover bursts of ~10ms, then the loss shows as DROPPED.
+#define APP_I2CSCAN_SNIFF_RING   (512)      // Bus words, power of 2
+#define APP_I2CSCAN_SNIFF_STARTS (256)      // START timestamps, power of 2
+#define APP_I2CSCAN_SNIFF_LINES  (5)        // Log lines on the OLED
+#define APP_I2CSCAN_SNIFF_COLS   (25)       // 5px characters per line
+#define APP_I2CSCAN_SNIFF_TX     (512)      // UART stream chars, power of 2
+#define APP_I2CSCAN_SNIFF_TX_REC (13)       // Longest record, "\nS<usec><addr>*"
+#define APP_I2CSCAN_SNIFF_BAUD   (1000000)  // Exact from 12, 18, 24 or 30MHz
+#define APP_I2CSCAN_SNIFF_REFRESH_MS (100)
+
+#define IOCON_I2CMODE_FMPLUS     (2 << 8)
+
+// Monitor bits missing from i2c.h
+#define STAT_MONRDY              (1 << 16)
+#define STAT_MONOV               (1 << 17)
+#define STAT_MONIDLEF            (1 << 19)
+#define MONRXDAT_START           (1 << 8)
+#define MONRXDAT_RESTART         (1 << 9)
+#define MONRXDAT_NACK            (1 << 10)
+#define APP_I2CSCAN_SNIFF_STOP   (1 << 15)  // Ring marker, bus idle
+#define APP_I2CSCAN_SNIFF_LOST   (1 << 14)  // Ring marker, transaction cut short
+
+#if DBGUART != 0
+#error "The sniffer stream needs the USART0 TX DMA request"
+#endif
+
+// The rings borrow the ADC DMA buffer (bytes), the ADC is idle in this app
+#if APP_I2CSCAN_SNIFF_STARTS * 4 + APP_I2CSCAN_SNIFF_RING * 2 + APP_I2CSCAN_SNIFF_TX > 4 * DMA_BUFFER_SIZE
+#error "The sniffer rings don't fit in the ADC DMA buffer"
+#endif
+
+typedef enum
+{
+	APP_I2CSCAN_MODE_SCAN = 0,
+	APP_I2CSCAN_MODE_SNIFF,
+	APP_I2CSCAN_MODE_LAST
+} app_i2cscan_mode_t;
+
+typedef struct
+{
+	uint8_t        dirty;          // Log changed since the last render
+	evloop_timer_t refresh;
+} app_i2cscan_sniff_loop_t;
+
+typedef struct
+{
+	uint32_t starts[APP_I2CSCAN_SNIFF_STARTS];   // START timestamps
+	uint16_t ring[APP_I2CSCAN_SNIFF_RING];       // Bus words
+	char     tx[APP_I2CSCAN_SNIFF_TX];           // UART stream
+} app_i2cscan_sniff_buf_t;
+
+void set_debug_uart_baud(uint32_t baud);		// Serial.c
+
+static app_i2cscan_mode_t _app_i2cscan_mode = APP_I2CSCAN_MODE_SCAN;
+
+static volatile uint8_t  _app_i2cscan_addr;
+static volatile uint8_t  _app_i2cscan_done;
+static volatile uint8_t  _app_i2cscan_error;
+static uint8_t           _app_i2cscan_found[16];  // One bit per 7-bit address
+
+static app_i2cscan_sniff_buf_t *_app_i2cscan_buf;  // In adc_buffer while sniffing
+static volatile uint16_t _app_i2cscan_ring_head;
+static uint16_t          _app_i2cscan_ring_tail;
+static volatile uint16_t _app_i2cscan_starts_head;
+static uint16_t          _app_i2cscan_starts_tail;
+static volatile uint32_t _app_i2cscan_dropped;   // Ring full or monitor overrun
+static uint8_t           _app_i2cscan_skip;      // ISR only, dropping until the next START/STOP
+static volatile uint16_t _app_i2cscan_tx_head;   // Written by the decoder
+static volatile uint16_t _app_i2cscan_tx_tail;   // Written by the DMA handler
+static volatile uint16_t _app_i2cscan_tx_len;    // Chars in flight, 0 = DMA idle
+static char              _app_i2cscan_log[APP_I2CSCAN_SNIFF_LINES][APP_I2CSCAN_SNIFF_COLS + 1];
+
 void app_i2cscan_reseti2c(void)
 {
 	// Give I2C0 a reset
@@ -26,22 +139,28 @@ void app_i2cscan_reseti2c(void)
 	LPC_SYSCON->PRESETCTRL0 |= ~(I2C0_RST_N);
 
 	// Configure the I2C0 clock divider
-	// Desired bit rate = Fscl = 100,000 Hz (1/Fscl = 10 us, 5 us low and 5 us high)
 	// Use default clock high and clock low times (= 2 clocks each)
-	// So 4 I2C_PCLKs = 100,000/second, or 1 I2C_PCLK = 400,000/second
-	// I2C_PCLK = SystemClock = 30,000,000/second, so we divide by 30000000/400000 = 75
+	// So 4 I2C_PCLKs per SCL period, rounded down to never exceed the rate
 	// Remember, value written to DIV divides by value+1
 	SystemCoreClockUpdate(); // Get main_clk frequency
-	LPC_I2C0->DIV = (main_clk/400000) - 1;
+	uint32_t div = (main_clk + APP_I2CSCAN_RATE_HZ*4 - 1) / (APP_I2CSCAN_RATE_HZ*4);
+	LPC_I2C0->DIV = div - 1;
+
+	// Timeout counts 16 I2C_PCLKs per step, in the 12 bit TO field [15:4].
+	// 64 bit math, dividing down to whole MHz first lost up to a third.
+	uint32_t timeout = (uint32_t)((uint64_t)(main_clk / div) * APP_I2CSCAN_TIMEOUT_US / 1000000 / 16);
+	if (timeout < 1) timeout = 1;
+	if (timeout > 0x1000) timeout = 0x1000;
+	LPC_I2C0->TIMEOUT = ((timeout - 1) << 4) | 0xF;
 
 	// Configure the I2C0 CFG register:
 	// Master enable = true
 	// Slave enable = false
 	// Monitor enable = false
-	// Time-out enable = false
+	// Time-out enable = true
 	// Monitor function clock stretching = false
 	//
-	LPC_I2C0->CFG = CFG_MSTENA;
+	LPC_I2C0->CFG = CFG_MSTENA | CFG_TIMEOUTENA;
 }
 
 void app_i2cscan_init(void)
@@ -59,79 +178,544 @@ void app_i2cscan_init(void)
 	LPC_SWM->PINENABLE0 &= ~(I2C0_SCL|I2C0_SDA);
 
 	// Make sure there are no pullup conflics on 0.10 (SCL) and 0.11 (SDA)
-	LPC_IOCON->PIO0_10 = 1<<7;	 			// No pull-up/down
-	LPC_IOCON->PIO0_11 = 1<<7;	 			// No pull-up/down
+	// and pick the drive mode for the bit rate
+	LPC_IOCON->PIO0_10 = 1<<7 | (APP_I2CSCAN_RATE_HZ > 400000 ? IOCON_I2CMODE_FMPLUS : 0);
+	LPC_IOCON->PIO0_11 = 1<<7 | (APP_I2CSCAN_RATE_HZ > 400000 ? IOCON_I2CMODE_FMPLUS : 0);
 
 	// Give I2C a reset
 	app_i2cscan_reseti2c();
 }
 
-int app_i2cscan_check_addr(uint8_t addr)
+// Kicks off the interrupt driven scan, app_i2cscan_done flags the end
+static void app_i2cscan_start(void)
 {
-    // Wait for the master state to be idle
-    while ((LPC_I2C0->STAT & MASTER_STATE_MASK) != I2C_STAT_MSTST_IDLE);
+	for (uint8_t i = 0; i < sizeof(_app_i2cscan_found); i++)
+	{
+		_app_i2cscan_found[i] = 0;
+	}
+	_app_i2cscan_error = 0;
+	_app_i2cscan_done = 0;
+	_app_i2cscan_addr = APP_I2CSCAN_ADDR_FIRST;
 
-    // Try to communicate with the specified addr
-    LPC_I2C0->MSTDAT = (addr<<1) | 0;                  // Address with 0 for RWn bit (WRITE)
-    LPC_I2C0->MSTCTL = CTL_MSTSTART;                   // Start the transaction by setting the MSTSTART bit to 1 in the Master control register.
+	// Wait for the master state to be idle
+	while ((LPC_I2C0->STAT & MASTER_STATE_MASK) != I2C_STAT_MSTST_IDLE) { }
 
-    // Wait for MSTPENDING bit to indicate that the request has been ACK'd
-    uint8_t timeout = 0;
-    while(!(LPC_I2C0->STAT & STAT_MSTPEND) && (timeout < 3))
-    {
-    	delay_ms(1);
-    	timeout++;
-    }
+	LPC_I2C0->STAT = STAT_MSTARBLOSS | STAT_MSTSSERR | STAT_EVTIMEOUT | STAT_SCLTIMEOUT;
+	LPC_I2C0->INTENSET = STAT_MSTPEND | STAT_MSTARBLOSS | STAT_MSTSSERR | STAT_EVTIMEOUT | STAT_SCLTIMEOUT;
+	NVIC_EnableIRQ(I2C0_IRQn);
 
-    if((LPC_I2C0->STAT & MASTER_STATE_MASK) != I2C_STAT_MSTST_TX) {
-    	// Error!
-	    LPC_I2C0->MSTCTL = CTL_MSTSTOP;                // Send a stop to end the transaction
-	    app_i2cscan_reseti2c();
-		return -1;
-    }
+	LPC_I2C0->MSTDAT = (APP_I2CSCAN_ADDR_FIRST<<1) | 0;  // Address with 0 for RWn bit (WRITE)
+	LPC_I2C0->MSTCTL = CTL_MSTSTART;
+}
+
+static void app_i2cscan_finish(uint8_t error)
+{
+	LPC_I2C0->INTENCLR = STAT_MSTPEND | STAT_MSTARBLOSS | STAT_MSTSSERR | STAT_EVTIMEOUT | STAT_SCLTIMEOUT;
+	NVIC_DisableIRQ(I2C0_IRQn);
+
+	_app_i2cscan_error = error;
+	_app_i2cscan_done = 1;
+}
+
+// Returns 1 if the word made it into the ring
+static inline int app_i2cscan_sniff_push(uint16_t word)
+{
+	uint16_t head = _app_i2cscan_ring_head;
+
+	if (((head + 1) & (APP_I2CSCAN_SNIFF_RING - 1)) == _app_i2cscan_ring_tail)
+	{
+		_app_i2cscan_dropped++;
+		return 0;
+	}
+	_app_i2cscan_buf->ring[head] = word;
+	_app_i2cscan_ring_head = (head + 1) & (APP_I2CSCAN_SNIFF_RING - 1);
+
+	return 1;
+}
+
+static void app_i2cscan_sniff_isr(void)
+{
+	uint32_t stat = LPC_I2C0->STAT;
+
+	if (stat & STAT_MONOV)
+	{
+		_app_i2cscan_dropped++;
+		_app_i2cscan_skip = 1;
+		LPC_I2C0->STAT = STAT_MONOV;
+	}
+
+	while (LPC_I2C0->STAT & STAT_MONRDY)
+	{
+		uint16_t word = (uint16_t)(LPC_I2C0->MONRXDAT & 0x7FF);
+
+		if (word & (MONRXDAT_START | MONRXDAT_RESTART))
+		{
+			// A START and its timestamp go in together or not at all
+			uint16_t head = _app_i2cscan_starts_head;
+			uint16_t next = (head + 1) & (APP_I2CSCAN_SNIFF_STARTS - 1);
+
+			if (_app_i2cscan_skip)
+			{
+				if (!app_i2cscan_sniff_push(APP_I2CSCAN_SNIFF_LOST)) continue;
+				_app_i2cscan_skip = 0;
+			}
+			if (next == _app_i2cscan_starts_tail)
+			{
+				_app_i2cscan_dropped++;
+				_app_i2cscan_skip = 1;
+				continue;
+			}
+			_app_i2cscan_buf->starts[head] = LPC_CTIMER0->TC;
+			if (app_i2cscan_sniff_push(word))
+			{
+				_app_i2cscan_starts_head = next;
+			}
+			else
+			{
+				_app_i2cscan_skip = 1;
+			}
+			continue;
+		}
+
+		// The rest of a transaction that already lost a word
+		if (_app_i2cscan_skip)
+		{
+			_app_i2cscan_dropped++;
+			continue;
+		}
+		if (!app_i2cscan_sniff_push(word))
+		{
+			_app_i2cscan_skip = 1;
+		}
+	}
+
+	if (stat & STAT_MONIDLEF)
+	{
+		LPC_I2C0->STAT = STAT_MONIDLEF;
+		if (app_i2cscan_sniff_push(_app_i2cscan_skip ? APP_I2CSCAN_SNIFF_LOST : APP_I2CSCAN_SNIFF_STOP))
+		{
+			_app_i2cscan_skip = 0;
+		}
+		else
+		{
+			_app_i2cscan_skip = 1;
+		}
+	}
+}
+
+void I2C0_IRQHandler(void)
+{
+	uint32_t stat = LPC_I2C0->STAT;
+
+	if (_app_i2cscan_mode == APP_I2CSCAN_MODE_SNIFF)
+	{
+		app_i2cscan_sniff_isr();
+		return;
+	}
+
+	uint8_t addr = _app_i2cscan_addr;
+
+	// Stuck bus or lost arbitration, nothing more to learn from this scan
+	if (stat & (STAT_MSTARBLOSS | STAT_MSTSSERR | STAT_EVTIMEOUT | STAT_SCLTIMEOUT))
+	{
+		LPC_I2C0->STAT = STAT_MSTARBLOSS | STAT_MSTSSERR | STAT_EVTIMEOUT | STAT_SCLTIMEOUT;
+		app_i2cscan_finish(1);
+		app_i2cscan_reseti2c();
+		return;
+	}
+
+	if (!(stat & STAT_MSTPEND))
+	{
+		return;
+	}
+
+	// Address ACK'd leaves the master in the transmit state
+	if ((stat & MASTER_STATE_MASK) == STAT_MSTTX)
+	{
+		_app_i2cscan_found[addr >> 3] |= (1 << (addr & 7));
+	}
+
+	if (addr >= APP_I2CSCAN_ADDR_LAST)
+	{
+	    LPC_I2C0->MSTCTL = CTL_MSTSTOP;                // Send a stop to end the scan
+		app_i2cscan_finish(0);
+		return;
+	}
+
+	// Repeated START straight into the next probe
+	_app_i2cscan_addr = ++addr;
+    LPC_I2C0->MSTDAT = (addr<<1) | 0;
+    LPC_I2C0->MSTCTL = CTL_MSTSTART;
+}
+
+static void app_i2cscan_render_mode_name(void)
+{
+	ssd1306_fill_rect(0, 24, 128, 15, 0);
+	ssd1306_set_text(10, 24, 1, _app_i2cscan_mode == APP_I2CSCAN_MODE_SNIFF ? "SNIFFER" : "SCANNER", 2);
+	ssd1306_refresh();
+}
+
+static void app_i2cscan_mode_qei(int32_t steps, void *arg)
+{
+	int32_t m = (int32_t)_app_i2cscan_mode + steps;
+
+	(void)arg;
+
+	// Roll over in both directions
+	if (m < 0) m = APP_I2CSCAN_MODE_LAST - 1;
+	if (m >= APP_I2CSCAN_MODE_LAST) m = 0;
+	_app_i2cscan_mode = (app_i2cscan_mode_t)m;
+
+	app_i2cscan_render_mode_name();
+}
+
+static void app_i2cscan_render_mode(void)
+{
+	const evloop_handlers_t h = { .qei = app_i2cscan_mode_qei };
+
+	// Reset the QEI encoder position counter
+	qei_reset_step();
+
+	ssd1306_clear();
+    ssd1306_set_text(0, 0, 1, "LPC SAKEE", 1);
+    ssd1306_set_text(127-15, 0, 1, "I2C", 1);
+	ssd1306_set_text(15, 55, 1, "SELECT TO CONTINUE", 1);
+	ssd1306_set_text(0, 12, 1, "SELECT MODE", 1);
+	app_i2cscan_render_mode_name();
+
+	evloop_run(&h);
+}
+
+static char app_i2cscan_hex(uint8_t v)
+{
+	return v < 10 ? '0' + v : 'A' + v - 10;
+}
+
+// Appends "XX" plus a NACK mark to a log line, if it fits
+static uint8_t app_i2cscan_log_byte(char *line, uint8_t col, uint16_t word)
+{
+	if (col + 3 > APP_I2CSCAN_SNIFF_COLS)
+	{
+		line[APP_I2CSCAN_SNIFF_COLS - 1] = '+';
+		return col;
+	}
+	line[col++] = app_i2cscan_hex((word >> 4) & 0xF);
+	line[col++] = app_i2cscan_hex(word & 0xF);
+	line[col++] = (word & MONRXDAT_NACK) ? '*' : ' ';
+	line[col] = '\0';
+
+	return col;
+}
+
+// Sends the oldest run of queued chars, up to the end of the ring. Runs
+// from the DMA handler, or with interrupts masked.
+static void app_i2cscan_tx_start(void)
+{
+	uint16_t tail = _app_i2cscan_tx_tail;
+	uint16_t head = _app_i2cscan_tx_head;
+	uint16_t len;
+
+	if (_app_i2cscan_tx_len || tail == head) return;
+
+	len = head > tail ? head - tail : APP_I2CSCAN_SNIFF_TX - tail;
+	_app_i2cscan_tx_len = len;
+
+	// Source and destination are end addresses
+	Chan_Desc_Table[DMA_CH_UART0_TX].source = (uint32_t) &_app_i2cscan_buf->tx[tail + len - 1];
+	Chan_Desc_Table[DMA_CH_UART0_TX].dest   = (uint32_t) &pDBGU->TXDAT;
+	Chan_Desc_Table[DMA_CH_UART0_TX].next   = 0;
+
+	LPC_DMA->CHANNEL[DMA_CH_UART0_TX].XFERCFG = 1 << DMA_XFERCFG_CFGVALID |
+	                                            1 << DMA_XFERCFG_SWTRIG |
+	                                            1 << DMA_XFERCFG_SETINTA |
+	                                            0 << DMA_XFERCFG_WIDTH |     // 8 bits
+	                                            1 << DMA_XFERCFG_SRCINC |
+	                                            0 << DMA_XFERCFG_DSTINC |
+	                                            (uint32_t)(len - 1) << DMA_XFERCFG_XFERCOUNT;
+}
+
+static void app_i2cscan_tx_isr(void)
+{
+	_app_i2cscan_tx_tail = (_app_i2cscan_tx_tail + _app_i2cscan_tx_len) & (APP_I2CSCAN_SNIFF_TX - 1);
+	_app_i2cscan_tx_len = 0;
+	app_i2cscan_tx_start();
+}
+
+static void app_i2cscan_tx_kick(void)
+{
+	uint32_t primask = __get_PRIMASK();
+
+	__disable_irq();
+	app_i2cscan_tx_start();
+	__set_PRIMASK(primask);
+}
+
+static uint16_t app_i2cscan_tx_room(void)
+{
+	return (_app_i2cscan_tx_tail - _app_i2cscan_tx_head - 1) & (APP_I2CSCAN_SNIFF_TX - 1);
+}
+
+// The decoder checks the room for a whole record first
+static void app_i2cscan_tx_put(char c)
+{
+	_app_i2cscan_buf->tx[_app_i2cscan_tx_head] = c;
+	_app_i2cscan_tx_head = (_app_i2cscan_tx_head + 1) & (APP_I2CSCAN_SNIFF_TX - 1);
+}
+
+static void app_i2cscan_tx_hex(uint32_t v, uint8_t digits)
+{
+	while (digits--)
+	{
+		app_i2cscan_tx_put(app_i2cscan_hex((v >> (digits * 4)) & 0xF));
+	}
+}
+
+// Pulls the ring apart into transactions (START/RESTART .. next START,
+// STOP or LOST). Each byte is queued for the UART as it is decoded, and
+// the OLED log gets one line per transaction. A full UART ring leaves the
+// rest of the words for later. Returns non-zero if the log changed.
+static uint8_t app_i2cscan_sniff_decode(void)
+{
+	static uint8_t active = 0, col = 0;
+	static char line[APP_I2CSCAN_SNIFF_COLS + 1];
+	uint8_t changed = 0;
+
+	while (_app_i2cscan_ring_tail != _app_i2cscan_ring_head && app_i2cscan_tx_room() >= APP_I2CSCAN_SNIFF_TX_REC)
+	{
+		uint16_t word = _app_i2cscan_buf->ring[_app_i2cscan_ring_tail];
+		_app_i2cscan_ring_tail = (_app_i2cscan_ring_tail + 1) & (APP_I2CSCAN_SNIFF_RING - 1);
+
+		// A new START, a STOP or a LOST closes the transaction in progress
+		if (active && (word & (MONRXDAT_START | MONRXDAT_RESTART | APP_I2CSCAN_SNIFF_STOP | APP_I2CSCAN_SNIFF_LOST)))
+		{
+			if (word & APP_I2CSCAN_SNIFF_LOST)
+			{
+				// Mark the line as cut short
+				if (col >= APP_I2CSCAN_SNIFF_COLS) col = APP_I2CSCAN_SNIFF_COLS - 1;
+				line[col++] = '!';
+				line[col] = '\0';
+			}
+			for (uint8_t i = 0; i < APP_I2CSCAN_SNIFF_LINES - 1; i++)
+			{
+				for (uint8_t c = 0; c <= APP_I2CSCAN_SNIFF_COLS; c++)
+				{
+					_app_i2cscan_log[i][c] = _app_i2cscan_log[i + 1][c];
+				}
+			}
+			for (uint8_t c = 0; c <= APP_I2CSCAN_SNIFF_COLS; c++)
+			{
+				_app_i2cscan_log[APP_I2CSCAN_SNIFF_LINES - 1][c] = line[c];
+			}
+			if (word & (APP_I2CSCAN_SNIFF_STOP | APP_I2CSCAN_SNIFF_LOST))
+			{
+				app_i2cscan_tx_put((word & APP_I2CSCAN_SNIFF_STOP) ? 'P' : 'L');
+			}
+			if (!(word & MONRXDAT_RESTART))
+			{
+				app_i2cscan_tx_put('\n');
+			}
+			active = 0;
+			changed = 1;
+		}
+
+		if (word & (MONRXDAT_START | MONRXDAT_RESTART))
+		{
+			uint32_t t = _app_i2cscan_buf->starts[_app_i2cscan_starts_tail];
+			_app_i2cscan_starts_tail = (_app_i2cscan_starts_tail + 1) & (APP_I2CSCAN_SNIFF_STARTS - 1);
+
+			// Address byte: "R3C " / "W3C*" (NACK'd)
+			line[0] = (word & 1) ? 'R' : 'W';
+			line[1] = app_i2cscan_hex((word >> 5) & 0x7);
+			line[2] = app_i2cscan_hex((word >> 1) & 0xF);
+			line[3] = (word & MONRXDAT_NACK) ? '*' : ' ';
+			line[4] = '\0';
+			col = 4;
+			active = 1;
+
+			if (word & MONRXDAT_RESTART)
+			{
+				app_i2cscan_tx_put('r');
+			}
+			else
+			{
+				app_i2cscan_tx_put('S');
+				app_i2cscan_tx_hex(t, 8);
+			}
+			app_i2cscan_tx_hex(word & 0xFF, 2);
+			if (word & MONRXDAT_NACK) app_i2cscan_tx_put('*');
+		}
+		else if (active && !(word & (APP_I2CSCAN_SNIFF_STOP | APP_I2CSCAN_SNIFF_LOST)))
+		{
+			col = app_i2cscan_log_byte(line, col, word);
+			app_i2cscan_tx_hex(word & 0xFF, 2);
+			if (word & MONRXDAT_NACK) app_i2cscan_tx_put('*');
+		}
+	}
+
+	app_i2cscan_tx_kick();
+
+	return changed;
+}
+
+static void app_i2cscan_render_sniff(void)
+{
+	ssd1306_fill_rect(0, 8, 128, 46, 0);
+
+	for (uint8_t i = 0; i < APP_I2CSCAN_SNIFF_LINES; i++)
+	{
+		ssd1306_set_text(0, 9 + i * 9, 1, _app_i2cscan_log[i], 1);
+	}
+	if (_app_i2cscan_dropped)
+	{
+		ssd1306_fill_rect(0, 55, 128, 8, 0);
+		ssd1306_set_text(0, 55, 1, "DROPPED", 1);
+		gfx_printdec(40, 55, (int32_t)_app_i2cscan_dropped, 1, 1);
+	}
 
-    // ACK received!
-    LPC_I2C0->MSTCTL = CTL_MSTSTOP;                    // Send a stop to end the transaction
+	ssd1306_refresh();
+}
+
+// The I2C0 interrupt wakes the loop for every bus word
+static void app_i2cscan_sniff_poll(void *arg)
+{
+	app_i2cscan_sniff_loop_t *l = arg;
+
+	l->dirty |= app_i2cscan_sniff_decode();
+}
+
+static void app_i2cscan_sniff_refresh(void *arg)
+{
+	app_i2cscan_sniff_loop_t *l = arg;
 
-    return 1;
+	if (l->dirty)
+	{
+		app_i2cscan_render_sniff();
+		l->dirty = 0;
+	}
+}
+
+static void app_i2cscan_sniff_run(void)
+{
+	app_i2cscan_sniff_loop_t l = { .dirty = 1 };
+	const evloop_handlers_t h = { .poll = app_i2cscan_sniff_poll, .arg = &l };
+
+	for (uint8_t i = 0; i < APP_I2CSCAN_SNIFF_LINES; i++)
+	{
+		_app_i2cscan_log[i][0] = '\0';
+	}
+	_app_i2cscan_buf = (app_i2cscan_sniff_buf_t *)adc_dma_get_buffer();
+	_app_i2cscan_ring_head = _app_i2cscan_ring_tail = 0;
+	_app_i2cscan_starts_head = _app_i2cscan_starts_tail = 0;
+	_app_i2cscan_dropped = 0;
+	_app_i2cscan_skip = 0;
+	_app_i2cscan_tx_head = _app_i2cscan_tx_tail = _app_i2cscan_tx_len = 0;
+
+	ssd1306_clear();
+    ssd1306_set_text(0, 0, 1, "LPC SAKEE", 1);
+    ssd1306_set_text(127-55, 0, 1, "I2C SNIFFER", 1);	// 55 pixels wide
+	ssd1306_set_text(16, 55, 1, "CLICK FOR MAIN MENU", 1);
+
+	set_debug_uart_baud(APP_I2CSCAN_SNIFF_BAUD);
+	printf("I2C SNIFFER: S<usec:8><addr>[*] [r<addr>[*]] <data>[*].. P|L, * = NACK, L = LOST\n\r");
+
+	// UART stream, sent by DMA on the USART0 TX request
+	dma_common_init();
+	dma_common_set_handler(DMA_CH_UART0_TX, app_i2cscan_tx_isr);
+	LPC_DMA->CHANNEL[DMA_CH_UART0_TX].CFG = 1 << DMA_CFG_PERIPHREQEN;
+	LPC_DMA->INTA0 = 1 << DMA_CH_UART0_TX;
+	LPC_DMA->ENABLESET0 = 1 << DMA_CH_UART0_TX;
+	LPC_DMA->INTENSET0 = 1 << DMA_CH_UART0_TX;
+	NVIC_EnableIRQ(DMA_IRQn);
+
+	// 1MHz free running timestamp
+	Enable_Periph_Clock(CLK_CTIMER0);
+	LPC_CTIMER0->TCR = 1<<CRST;
+	LPC_CTIMER0->PR  = (main_clk / 1000000) - 1;
+	LPC_CTIMER0->MCR = 0;
+	LPC_CTIMER0->TCR = 1<<CEN;
+
+	// Monitor only, sampling with the undivided function clock
+	LPC_I2C0->CFG = 0;
+	LPC_I2C0->DIV = 0;
+	LPC_I2C0->STAT = STAT_MONOV | STAT_MONIDLEF;
+	LPC_I2C0->CFG = CFG_MONENA;
+	LPC_I2C0->INTENSET = STAT_MONRDY | STAT_MONOV | STAT_MONIDLEF;
+	NVIC_EnableIRQ(I2C0_IRQn);
+
+	evloop_timer_start(&l.refresh, 0, APP_I2CSCAN_SNIFF_REFRESH_MS, app_i2cscan_sniff_refresh, &l);
+
+	/* Wait for the QEI switch to exit */
+	evloop_run(&h);
+
+	evloop_timer_stop(&l.refresh);
+	NVIC_DisableIRQ(I2C0_IRQn);
+	LPC_I2C0->INTENCLR = STAT_MONRDY | STAT_MONOV | STAT_MONIDLEF;
+	LPC_CTIMER0->TCR = 0;
+	app_i2cscan_reseti2c();
+
+	// Let the queued stream out, 5ms at most
+	while (_app_i2cscan_tx_len)
+	{
+		__WFI();
+	}
+	LPC_DMA->ENABLECLR0 = 1 << DMA_CH_UART0_TX;
+	LPC_DMA->INTENCLR0  = 1 << DMA_CH_UART0_TX;
+	dma_common_set_handler(DMA_CH_UART0_TX, 0);
+
+	printf("\n\r");
+	set_debug_uart_baud(0);
 }
 
 void app_i2cscan_run(void)
 {
+	const evloop_handlers_t h = { 0 };
 	uint8_t addr, dev_count;
 
+	app_i2cscan_render_mode();
+	if (_app_i2cscan_mode == APP_I2CSCAN_MODE_SNIFF)
+	{
+		app_i2cscan_sniff_run();
+		return;
+	}
+
 	ssd1306_clear();
 
 	// Render the title bars
     ssd1306_set_text(0, 0, 1, "LPC SAKEE", 1);
     ssd1306_set_text(127-66, 0, 1, "I2C SCANNER", 1);	// 66 pixels wide
 
-    // Render the static address label text
-    ssd1306_set_text(0, 8, 1, "SCANNING I2C ADDR: 0x", 1);
+    // Scan, sleeping until the interrupt driven probes are through
+    uint32_t t = millis();
+    app_i2cscan_start();
+    while (!_app_i2cscan_done)
+    {
+    	__WFI();
+    }
+    t = millis() - t;
 
-    // Render the bottom button options
-	//ssd1306_fill_rect(0, 55, 127, 8, 1);
-    //ssd1306_set_text(8, 56, 0, "HOME", 1);
+    // Render the whole batch of results at once
+    ssd1306_set_text(0, 8, 1, "SCAN TIME:      ms", 1);
+    gfx_printdec(60, 8, (int32_t)t, 1, 1);
 
-    /* Scan all valid I2C addresses (0x08..0x77) */
     dev_count = 0;
-    for (addr = 0x08; addr < 0x78; addr++)
+    for (addr = APP_I2CSCAN_ADDR_FIRST; addr <= APP_I2CSCAN_ADDR_LAST; addr++)
     {
-		ssd1306_fill_rect(105, 8, 12, 8, 0);
-	    gfx_printhex8(105, 8, addr, 1, 1);
-        ssd1306_refresh();
-
-        /* Display the addr if a response was received */
-        int rc = app_i2cscan_check_addr(addr);
-        if (rc > 0)
+        if (!(_app_i2cscan_found[addr >> 3] & (1 << (addr & 7))))
+        {
+        	continue;
+        }
+        if (dev_count < APP_I2CSCAN_SHOW_MAX)
         {
-		    gfx_printhex8(dev_count*24, 25, addr, 2, 1);
-            dev_count++;
-		    ssd1306_refresh();
+		    gfx_printhex8((dev_count % 5)*24, 18 + (dev_count / 5)*14, addr, 2, 1);
         }
+        dev_count++;
     }
 
-    if (dev_count < 10)
+    if (_app_i2cscan_error)
+    {
+        ssd1306_set_text(25, 48, 1, "I2C BUS ERROR", 1);
+    }
+    else if (dev_count < 10)
     {
         ssd1306_set_text(14, 48, 1, "I2C Devices Found: ", 1);
     	gfx_printdec(109, 48, (int32_t)dev_count, 1, 1);
@@ -147,7 +731,5 @@ void app_i2cscan_run(void)
 	ssd1306_refresh();
 
 	/* Wait for the QEI switch to exit */
-	while (!(button_pressed() &  ( 1 << QEI_SW_PIN)))
-    {
-    }
+	evloop_run(&h);
 }
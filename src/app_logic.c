@@ -0,0 +1,646 @@
+/*
+===============================================================================
+ Name        : app_logic.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : 8 channel logic analyzer
+===============================================================================
+ */
+
+#include <stdio.h>
+
+#include "LPC8xx.h"
+#include "syscon.h"
+
+#include "config.h"
+#include "button.h"
+#include "delay.h"
+#include "evloop.h"
+#include "qei.h"
+#include "adc_dma.h"
+#include "logic_dma.h"
+#include "proto_decode.h"
+#include "app_logic.h"
+#include "gfx.h"
+
+/*
+ Pins used in this application (read as they are, the pin functions are
+ left alone so the I2C bus, the sweep sync and the buttons can be watched):
+
+ P0.8  .. P0.15 [I] - Channels 0..7
+*/
+
+// The capture store borrows the ADC DMA buffer, 2048 run-length entries,
+// which holds anything from 2048 edges to minutes of an idle bus. Once
+// done the capture goes out over the UART as a VCD file (GTKWave, sigrok).
+#define APP_LOGIC_STORE          (2 * DMA_BUFFER_SIZE)
+#define APP_LOGIC_POST           (65536)    // Samples after the trigger
+#define APP_LOGIC_BAUD           (230400)
+#define APP_LOGIC_ZOOM_MAX       (10)       // 1024 samples per pixel
+#define APP_LOGIC_SCROLL_PX      (16)       // Per QEI step
+#define APP_LOGIC_TRACE_Y        (8)
+#define APP_LOGIC_TRACE_H        (6)
+
+#define APP_LOGIC_ANN            (64)       // Decoded bytes kept, power of 2
+#define APP_LOGIC_ANN_ROWS       (6)
+
+// Config screen items: rate, decoder, a trigger condition per channel,
+// then actions
+#define APP_LOGIC_ITEM_RATE      (0)
+#define APP_LOGIC_ITEM_DECODE    (1)
+#define APP_LOGIC_ITEM_CH0       (2)
+#define APP_LOGIC_ITEM_ARM       (APP_LOGIC_ITEM_CH0 + LOGIC_DMA_CHANNELS)
+#define APP_LOGIC_ITEM_EXIT      (APP_LOGIC_ITEM_ARM + 1)
+#define APP_LOGIC_ITEM_LAST      (APP_LOGIC_ITEM_EXIT + 1)
+
+typedef struct
+{
+	uint16_t period_us;
+	char    *name;
+} app_logic_rate_t;
+
+// Walks the capture one value at a time, merging extension entries
+typedef struct
+{
+	const logic_dma_capture_t *cap;
+	uint32_t i;                 // Next entry
+	uint32_t start;             // Samples [start, end) have 'value'
+	uint32_t end;
+	uint8_t  value;
+} app_logic_seg_t;
+
+// Decoded byte list, scrolled with the QEI
+typedef struct
+{
+	const logic_dma_capture_t *cap;
+	uint32_t first;             // Oldest annotation kept
+	uint32_t top;               // Annotation on the top row
+} app_logic_list_t;
+
+void set_debug_uart_baud(uint32_t baud);		// Serial.c
+
+static const app_logic_rate_t _app_logic_rates[] = {
+	{    2, "500 kHz" },
+	{    5, "200 kHz" },
+	{   10, "100 kHz" },
+	{   20, "50 kHz"  },
+	{   50, "20 kHz"  },
+	{  100, "10 kHz"  },
+	{ 1000, "1 kHz"   },
+};
+#define APP_LOGIC_RATES          (sizeof(_app_logic_rates) / sizeof(_app_logic_rates[0]))
+
+// Decoders, indexed by proto_decode_type_t. The channels are fixed, I2C
+// sits on the board's own bus (P0_10 / P0_11).
+static const proto_decode_cfg_t _app_logic_decoders[PROTO_DECODE_LAST] = {
+	{ PROTO_DECODE_OFF },
+	{ PROTO_DECODE_UART, 0, PROTO_DECODE_NO_CH, PROTO_DECODE_NO_CH, 0, 0, 0 },	// RX, auto baud
+	{ PROTO_DECODE_SPI,  0, 1, 2, 0, 0, 0 },									// SCK, MOSI, CS, mode 0
+	{ PROTO_DECODE_I2C,  2, 3, PROTO_DECODE_NO_CH, 0, 0, 0 },					// SCL, SDA
+};
+static char * const _app_logic_decoder_name[PROTO_DECODE_LAST] = { "OFF", "UART", "SPI", "I2C" };
+static char * const _app_logic_decoder_hint[PROTO_DECODE_LAST] = {
+	"NO DECODER", "RX CH0, AUTO BAUD", "SCK0 MOSI1 CS2 MODE0", "SCL CH2 SDA CH3"
+};
+
+// Indexed by logic_dma_cond_t
+static const char _app_logic_cond_char[LOGIC_DMA_COND_LAST] = { 'X', '0', '1', 'R', 'F' };
+static char * const _app_logic_cond_name[LOGIC_DMA_COND_LAST] = { "ANY", "LOW", "HIGH", "RISING", "FALLING" };
+
+static uint8_t  _app_logic_rate = 2;
+static uint8_t  _app_logic_decode = PROTO_DECODE_OFF;
+static uint8_t  _app_logic_cond[LOGIC_DMA_CHANNELS];
+static uint8_t  _app_logic_item = APP_LOGIC_ITEM_ARM;
+static uint8_t  _app_logic_zoom = 0;     // log2 samples per pixel
+static uint32_t _app_logic_view;         // Sample at the left edge
+
+static proto_decoder_t _app_logic_dec;
+static proto_ann_t     _app_logic_ann[APP_LOGIC_ANN];
+
+void app_logic_init(void)
+{
+	ssd1306_clear();
+    ssd1306_refresh();
+}
+
+static void app_logic_render_header(void)
+{
+	ssd1306_clear();
+    ssd1306_set_text(0, 0, 1, "LPC SAKEE", 1);
+    ssd1306_set_text(127-25, 0, 1, "LOGIC", 1);		// 25 pixels wide
+}
+
+// Draws text, inverted if selected
+static void app_logic_render_item(uint8_t x, uint8_t y, char *text, uint8_t len, uint8_t selected)
+{
+	if (selected)
+	{
+		ssd1306_fill_rect(x - 1, y - 1, len * 5 + 2, 9, 1);
+	}
+	ssd1306_set_text(x, y, selected ? 0 : 1, text, 1);
+}
+
+static void app_logic_render_config(void)
+{
+	char c[2] = { 0x00, 0x00 };
+	uint8_t item = _app_logic_item;
+
+	app_logic_render_header();
+
+	ssd1306_set_text(0, 12, 1, "RATE", 1);
+	app_logic_render_item(40, 12, _app_logic_rates[_app_logic_rate].name, 7, item == APP_LOGIC_ITEM_RATE);
+	app_logic_render_item(96, 12, _app_logic_decoder_name[_app_logic_decode], 4, item == APP_LOGIC_ITEM_DECODE);
+
+	ssd1306_set_text(0, 24, 1, "TRIG", 1);
+	for (uint8_t ch = 0; ch < LOGIC_DMA_CHANNELS; ch++)
+	{
+		c[0] = _app_logic_cond_char[_app_logic_cond[ch]];
+		app_logic_render_item(40 + ch * 8, 24, c, 1, item == APP_LOGIC_ITEM_CH0 + ch);
+		c[0] = '0' + ch;
+		ssd1306_set_text(40 + ch * 8, 33, 1, c, 1);
+	}
+
+	app_logic_render_item(10, 44, "ARM", 3, item == APP_LOGIC_ITEM_ARM);
+	app_logic_render_item(60, 44, "MAIN MENU", 9, item == APP_LOGIC_ITEM_EXIT);
+
+	// What a click on the item does
+	if (item >= APP_LOGIC_ITEM_CH0 && item < APP_LOGIC_ITEM_ARM)
+	{
+		uint8_t ch = item - APP_LOGIC_ITEM_CH0;
+
+		ssd1306_set_text(0, 56, 1, "P0_", 1);
+		gfx_printdec(15, 56, LOGIC_DMA_PIN(ch), 1, 1);
+		ssd1306_set_text(30, 56, 1, _app_logic_cond_name[_app_logic_cond[ch]], 1);
+	}
+	else if (item == APP_LOGIC_ITEM_DECODE)
+	{
+		ssd1306_set_text(0, 56, 1, _app_logic_decoder_hint[_app_logic_decode], 1);
+	}
+	else if (item == APP_LOGIC_ITEM_RATE)
+	{
+		ssd1306_set_text(0, 56, 1, "CLICK TO CHANGE", 1);
+	}
+	else if (item == APP_LOGIC_ITEM_ARM)
+	{
+		ssd1306_set_text(0, 56, 1, "CLICK TO CAPTURE", 1);
+	}
+
+	ssd1306_refresh();
+}
+
+static void app_logic_config_qei(int32_t steps, void *arg)
+{
+	int32_t i = (int32_t)_app_logic_item + steps;
+
+	(void)arg;
+
+	// Roll over in both directions
+	if (i < 0) i = APP_LOGIC_ITEM_LAST - 1;
+	if (i >= APP_LOGIC_ITEM_LAST) i = 0;
+	_app_logic_item = (uint8_t)i;
+
+	app_logic_render_config();
+}
+
+// Runs the config screen until ARM (returns 1) or MAIN MENU (returns 0)
+static int app_logic_config(void)
+{
+	const evloop_handlers_t h = { .qei = app_logic_config_qei };
+
+	qei_reset_step();
+
+	app_logic_render_config();
+
+	while (1)
+	{
+		// Back on every click
+		evloop_run(&h);
+
+		if (_app_logic_item == APP_LOGIC_ITEM_ARM) return 1;
+		if (_app_logic_item == APP_LOGIC_ITEM_EXIT) return 0;
+
+		if (_app_logic_item == APP_LOGIC_ITEM_RATE)
+		{
+			_app_logic_rate = (_app_logic_rate + 1) % APP_LOGIC_RATES;
+		}
+		else if (_app_logic_item == APP_LOGIC_ITEM_DECODE)
+		{
+			_app_logic_decode = (_app_logic_decode + 1) % PROTO_DECODE_LAST;
+		}
+		else
+		{
+			uint8_t *cond = &_app_logic_cond[_app_logic_item - APP_LOGIC_ITEM_CH0];
+			*cond = (*cond + 1) % LOGIC_DMA_COND_LAST;
+		}
+
+		app_logic_render_config();
+	}
+}
+
+// Loads the next value, returns 0 past the end of the capture
+static int app_logic_seg_next(app_logic_seg_t *seg)
+{
+	const logic_dma_capture_t *cap = seg->cap;
+
+	if (seg->i >= cap->end) return 0;
+
+	uint16_t e = cap->store[seg->i++ & cap->mask];
+	seg->value = LOGIC_DMA_VALUE(e);
+	seg->start = seg->end;
+	seg->end += LOGIC_DMA_RUN(e);
+
+	while (seg->i < cap->end && LOGIC_DMA_IS_EXT(cap->store[seg->i & cap->mask]))
+	{
+		seg->end += LOGIC_DMA_RUN(cap->store[seg->i++ & cap->mask]);
+	}
+
+	return 1;
+}
+
+static void app_logic_seg_init(app_logic_seg_t *seg, const logic_dma_capture_t *cap)
+{
+	seg->cap = cap;
+	seg->i = cap->first;
+	seg->end = cap->first_sample;
+}
+
+// Every pixel column covers 2^zoom samples. A channel that stays put in
+// the column draws its level, one that changes draws a vertical edge.
+static void app_logic_render_traces(const logic_dma_capture_t *cap)
+{
+	app_logic_seg_t seg;
+	uint32_t step = 1UL << _app_logic_zoom;
+	uint32_t period_us = _app_logic_rates[_app_logic_rate].period_us;
+
+	// Samples per pixel, and the left edge relative to the trigger
+	ssd1306_clear();
+	ssd1306_set_text(0, 0, 1, "1:", 1);
+	gfx_printdec(10, 0, (int32_t)step, 1, 1);
+	ssd1306_set_text(40, 0, 1, "T", 1);
+	uint8_t x = gfx_printfixed(46, 0, (int32_t)(_app_logic_view - cap->trig_sample) * (int32_t)period_us, 0, 1, 1);
+	ssd1306_set_text(x + 2, 0, 1, "us", 1);
+
+	app_logic_seg_init(&seg, cap);
+	int more = app_logic_seg_next(&seg);
+
+	for (x = 0; x < 128 && more; x++)
+	{
+		uint32_t cs = _app_logic_view + x * step;
+		uint32_t ce = cs + step;
+		uint8_t  hi = 0, lo = 0xFF;
+
+		while (more && seg.end <= cs)
+		{
+			more = app_logic_seg_next(&seg);
+		}
+
+		if (!more) break;
+		if (seg.start >= ce) continue;
+
+		// Stop on the value that runs into the next column
+		while (1)
+		{
+			hi |= seg.value;
+			lo &= seg.value;
+
+			if (seg.end >= ce) break;
+			if (!(more = app_logic_seg_next(&seg))) break;
+		}
+
+		for (uint8_t ch = 0; ch < LOGIC_DMA_CHANNELS; ch++)
+		{
+			uint8_t y = APP_LOGIC_TRACE_Y + ch * APP_LOGIC_TRACE_H;
+
+			if ((hi ^ lo) & (1 << ch))
+			{
+				ssd1306_fill_rect(x, y, 1, 4, 1);
+			}
+			else
+			{
+				ssd1306_set_pixel(x, (hi & (1 << ch)) ? y : y + 3, 1);
+			}
+		}
+	}
+
+	// Dotted trigger marker
+	if (cap->trig_sample >= _app_logic_view && cap->trig_sample - _app_logic_view < 128 * step)
+	{
+		x = (cap->trig_sample - _app_logic_view) >> _app_logic_zoom;
+		for (uint8_t y = APP_LOGIC_TRACE_Y; y < APP_LOGIC_TRACE_Y + 8 * APP_LOGIC_TRACE_H; y += 2)
+		{
+			ssd1306_set_pixel(x, y, 1);
+		}
+	}
+
+	ssd1306_set_text(0, 57, 1, "U1 U2 ZOOM", 1);
+	ssd1306_set_text(127-45, 57, 1, "CLICK END", 1);
+	ssd1306_refresh();
+}
+
+// Keeps the view on the capture, centred on 'center'
+static void app_logic_view_center(const logic_dma_capture_t *cap, int32_t center)
+{
+	int32_t left = center - (int32_t)(64UL << _app_logic_zoom);
+
+	_app_logic_view = left > (int32_t)cap->first_sample ? (uint32_t)left : cap->first_sample;
+
+	if (_app_logic_view >= cap->samples)
+	{
+		_app_logic_view = cap->samples - 1;
+	}
+}
+
+// Dumps the capture as a Value Change Dump, time zero is the first sample
+static void app_logic_export(const logic_dma_capture_t *cap)
+{
+	app_logic_seg_t seg;
+	uint32_t period_us = _app_logic_rates[_app_logic_rate].period_us;
+	uint8_t  last = 0, diff = 0xFF;
+
+	set_debug_uart_baud(APP_LOGIC_BAUD);
+
+	printf("$comment LPC SAKEE logic capture, %s, trigger at #%lu $end\n\r",
+			_app_logic_rates[_app_logic_rate].name,
+			(unsigned long)((cap->trig_sample - cap->first_sample) * period_us));
+	printf("$timescale 1us $end\n\r$scope module logic $end\n\r");
+	for (uint8_t ch = 0; ch < LOGIC_DMA_CHANNELS; ch++)
+	{
+		printf("$var wire 1 %c P0_%u $end\n\r", '!' + ch, LOGIC_DMA_PIN(ch));
+	}
+	printf("$upscope $end\n\r$enddefinitions $end\n\r");
+
+	app_logic_seg_init(&seg, cap);
+	while (app_logic_seg_next(&seg))
+	{
+		diff |= seg.value ^ last;
+		if (!diff) continue;
+
+		printf("#%lu\n\r", (unsigned long)((seg.start - cap->first_sample) * period_us));
+		for (uint8_t ch = 0; ch < LOGIC_DMA_CHANNELS; ch++)
+		{
+			if (diff & (1 << ch))
+			{
+				printf("%c%c\n\r", (seg.value & (1 << ch)) ? '1' : '0', '!' + ch);
+			}
+		}
+
+		last = seg.value;
+		diff = 0;
+	}
+	printf("#%lu\n\r", (unsigned long)((cap->samples - cap->first_sample) * period_us));
+
+	set_debug_uart_baud(0);
+}
+
+// Runs the decoder over whatever the capture added since the last call
+static void app_logic_decode(void)
+{
+	uint32_t end, samples;
+
+	if (_app_logic_decode == PROTO_DECODE_OFF) return;
+
+	logic_dma_progress(&end, &samples);
+	proto_decode_feed_rle(&_app_logic_dec, adc_dma_get_buffer(), APP_LOGIC_STORE - 1, end, samples);
+}
+
+// Woken by the DMA block interrupt, decodes what came in and shows the
+// capture state until it's done
+static void app_logic_capture_poll(void *arg)
+{
+	logic_dma_state_t *shown = arg;
+	logic_dma_state_t state = logic_dma_state();
+
+	app_logic_decode();
+
+	if (state == LOGIC_DMA_DONE)
+	{
+		evloop_quit();
+		return;
+	}
+
+	if (state != *shown)
+	{
+		ssd1306_fill_rect(0, 24, 128, 15, 0);
+		ssd1306_set_text(10, 24, 1, state == LOGIC_DMA_ARMED ? "ARMED" : "CAPTURE", 2);
+		ssd1306_refresh();
+		*shown = state;
+	}
+}
+
+// Arms the capture and waits for it, returns 0 once done, -1 if cancelled.
+// The decoder follows the capture block by block, so it's done with it
+// when the capture is.
+static int app_logic_capture(void)
+{
+	logic_dma_state_t shown = LOGIC_DMA_IDLE;
+	proto_decode_cfg_t cfg = _app_logic_decoders[_app_logic_decode];
+	const evloop_handlers_t h = { .poll = app_logic_capture_poll, .arg = &shown };
+
+	app_logic_render_header();
+	ssd1306_set_text(16, 55, 1, "CLICK TO CANCEL", 1);
+
+	cfg.sample_hz = 1000000 / _app_logic_rates[_app_logic_rate].period_us;
+	proto_decode_init(&_app_logic_dec, &cfg, _app_logic_ann, APP_LOGIC_ANN);
+
+	if (logic_dma_start(adc_dma_get_buffer(), APP_LOGIC_STORE,
+			_app_logic_rates[_app_logic_rate].period_us, _app_logic_cond, APP_LOGIC_POST) < 0)
+	{
+		return -1;
+	}
+
+	// A click ends the loop before the capture did
+	if (evloop_run(&h))
+	{
+		logic_dma_stop();
+		return -1;
+	}
+
+	// The last run only goes in when the capture stops
+	app_logic_decode();
+
+	return 0;
+}
+
+static char app_logic_hex(uint8_t v)
+{
+	return v < 10 ? '0' + v : 'A' + v - 10;
+}
+
+// One annotation per row: time from the trigger, then the byte or bus
+// condition
+static void app_logic_render_decoded(const logic_dma_capture_t *cap, uint32_t top)
+{
+	uint32_t period_us = _app_logic_rates[_app_logic_rate].period_us;
+	uint32_t n = _app_logic_dec.ann_count - proto_decode_ann_first(&_app_logic_dec);
+
+	ssd1306_clear();
+	ssd1306_set_text(0, 0, 1, _app_logic_decoder_name[_app_logic_decode], 1);
+	if (_app_logic_decode == PROTO_DECODE_UART)
+	{
+		gfx_printdec(25, 0, (int32_t)_app_logic_dec.baud, 1, 1);
+	}
+	gfx_printdec(127-20, 0, (int32_t)n, 1, 1);
+
+	if (!n)
+	{
+		ssd1306_set_text(10, 24, 1, "NOTHING", 2);
+	}
+
+	for (uint8_t row = 0; row < APP_LOGIC_ANN_ROWS; row++)
+	{
+		const proto_ann_t *a = proto_decode_ann(&_app_logic_dec, top + row);
+		uint8_t y = 9 + row * 8;
+		char t[12];
+		uint8_t i = 0;
+
+		if (!a) break;
+
+		uint8_t x = gfx_printfixed(0, y, (int32_t)(a->sample - cap->trig_sample) * (int32_t)period_us, 0, 1, 1);
+		ssd1306_set_text(x + 2, y, 1, "us", 1);
+
+		switch (a->kind)
+		{
+		case PROTO_ANN_START:
+			t[i++] = 'S';
+			break;
+		case PROTO_ANN_STOP:
+			t[i++] = 'P';
+			break;
+		default:
+			t[i++] = app_logic_hex(a->data >> 4);
+			t[i++] = app_logic_hex(a->data & 0xF);
+			if (a->kind == PROTO_ANN_ADDR)
+			{
+				t[i++] = (a->data & 1) ? 'R' : 'W';
+			}
+			else if (_app_logic_decode == PROTO_DECODE_UART && a->data >= ' ' && a->data < 0x7F)
+			{
+				t[i++] = ' ';
+				t[i++] = '\'';
+				t[i++] = a->data;
+				t[i++] = '\'';
+			}
+			break;
+		}
+		if (a->flags & PROTO_ANN_NACK) t[i++] = '*';
+		if (a->flags & PROTO_ANN_ERR) t[i++] = '!';
+		t[i] = '\0';
+
+		ssd1306_set_text(72, y, 1, t, 1);
+	}
+
+	ssd1306_set_text(0, 57, 1, "* NACK  ! ERR", 1);
+	ssd1306_set_text(127-40, 57, 1, "CLICK GO", 1);
+	ssd1306_refresh();
+}
+
+static void app_logic_decoded_qei(int32_t steps, void *arg)
+{
+	app_logic_list_t *l = arg;
+	int32_t t = (int32_t)(l->top - l->first) + steps;
+	int32_t n = (int32_t)(_app_logic_dec.ann_count - l->first);
+
+	// Clamp, the list doesn't roll over
+	if (t > n - APP_LOGIC_ANN_ROWS) t = n - APP_LOGIC_ANN_ROWS;
+	if (t < 0) t = 0;
+	l->top = l->first + (uint32_t)t;
+
+	app_logic_render_decoded(l->cap, l->top);
+}
+
+// Lists the decoded bytes, returns the sample of the top row for the
+// trace view to start at
+static uint32_t app_logic_decoded(const logic_dma_capture_t *cap)
+{
+	app_logic_list_t l;
+	const evloop_handlers_t h = { .qei = app_logic_decoded_qei, .arg = &l };
+
+	qei_reset_step();
+
+	l.cap = cap;
+	l.first = proto_decode_ann_first(&_app_logic_dec);
+	l.top = l.first;
+
+	app_logic_render_decoded(cap, l.top);
+
+	evloop_run(&h);
+
+	const proto_ann_t *a = proto_decode_ann(&_app_logic_dec, l.top);
+	return a ? a->sample : cap->trig_sample;
+}
+
+// QEI scroll = pan, APP_LOGIC_SCROLL_PX per step at any zoom
+static void app_logic_view_qei(int32_t steps, void *arg)
+{
+	const logic_dma_capture_t *cap = arg;
+	int32_t center = (int32_t)(_app_logic_view + (64UL << _app_logic_zoom));
+
+	center += steps * (APP_LOGIC_SCROLL_PX << _app_logic_zoom);
+	app_logic_view_center(cap, center);
+	app_logic_render_traces(cap);
+}
+
+// USER1 zooms in, USER2 out, around the centre of the view
+static void app_logic_view_button(uint32_t pressed, void *arg)
+{
+	const logic_dma_capture_t *cap = arg;
+	int32_t center = (int32_t)(_app_logic_view + (64UL << _app_logic_zoom));
+	uint8_t dirty = 0;
+
+	if ((pressed & (1 << BUTTON_USER1)) && _app_logic_zoom > 0)
+	{
+		_app_logic_zoom--;
+		dirty = 1;
+	}
+
+	if ((pressed & (1 << BUTTON_USER2)) && _app_logic_zoom < APP_LOGIC_ZOOM_MAX)
+	{
+		_app_logic_zoom++;
+		dirty = 1;
+	}
+
+	if (dirty)
+	{
+		app_logic_view_center(cap, center);
+		app_logic_render_traces(cap);
+	}
+}
+
+static void app_logic_view(const logic_dma_capture_t *cap)
+{
+	uint32_t center = cap->trig_sample;
+	const evloop_handlers_t h = { .button = app_logic_view_button, .qei = app_logic_view_qei, .arg = (void *)cap };
+
+	app_logic_render_header();
+	ssd1306_set_text(10, 24, 1, "EXPORT", 2);
+	ssd1306_refresh();
+	app_logic_export(cap);
+
+	if (_app_logic_decode != PROTO_DECODE_OFF)
+	{
+		center = app_logic_decoded(cap);
+	}
+
+	qei_reset_step();
+
+	app_logic_view_center(cap, (int32_t)center);
+	app_logic_render_traces(cap);
+
+	evloop_run(&h);
+}
+
+void app_logic_run(void)
+{
+	logic_dma_capture_t cap;
+
+	while (app_logic_config())
+	{
+		if (app_logic_capture() < 0) continue;
+
+		if (logic_dma_capture(&cap) == 0)
+		{
+			app_logic_view(&cap);
+		}
+	}
+}
@@ -0,0 +1,17 @@
+/*
+===============================================================================
+ Name        : app_logic.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description :
+===============================================================================
+ */
+
+#ifndef APP_LOGIC_H_
+#define APP_LOGIC_H_
+
+void app_logic_init(void);
+void app_logic_run(void);
+
+#endif /* APP_LOGIC_H_ */
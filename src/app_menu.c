@@ -15,11 +15,30 @@
 #include "delay.h"
 #include "button.h"
 #include "qei.h"
+#include "evloop.h"
 #include "ssd1306.h"
 #include "gfx.h"
 #include "app_menu.h"
 
+// Rows that fit below the title bar, the list scrolls past this
+#define APP_MENU_ROWS (6)
+
+static char * const _app_menu_names[APP_MENU_OPTION_LAST] = {
+	"ABOUT",
+	"VOLTMETER",
+	"OSCILLOSCOPE",
+	"I2C SCAN / SNIFF",
+	"WAVEGEN",
+	"CONTINUITY TESTER",
+	"BODE PLOT",
+	"LOGIC ANALYZER",
+	"FREQUENCY METER",
+	"PWM GENERATOR",
+	"CAP / ESR METER",
+};
+
 static int32_t _app_menu_selected = APP_MENU_OPTION_ABOUT;
+static int32_t _app_menu_top = 0;
 
 void app_menu_render();
 
@@ -36,15 +55,23 @@ void app_menu_render()
     ssd1306_set_text(0, 0, 1, "LPC SAKEE", 1);
     ssd1306_set_text(127-54, 0, 1, "MAIN MENU", 1);	// 54 pixels wide
 
-    ssd1306_set_text(10, 12, 1, "ABOUT", 1);
-    ssd1306_set_text(10, 20, 1, "VOLTMETER", 1);
-    ssd1306_set_text(10, 28, 1, "OSCILLOSCOPE", 1);
-    ssd1306_set_text(10, 36, 1, "I2C BUS SCANNER", 1);
-    ssd1306_set_text(10, 44, 1, "WAVEGEN", 1);
-    ssd1306_set_text(10, 52, 1, "CONTINUITY TESTER", 1);
+    // Keep the selection inside the visible rows
+    if (_app_menu_selected < _app_menu_top)
+    {
+    	_app_menu_top = _app_menu_selected;
+    }
+    if (_app_menu_selected >= _app_menu_top + APP_MENU_ROWS)
+    {
+    	_app_menu_top = _app_menu_selected - APP_MENU_ROWS + 1;
+    }
+
+    for (int32_t i = 0; i < APP_MENU_ROWS && _app_menu_top + i < APP_MENU_OPTION_LAST; i++)
+    {
+    	ssd1306_set_text(10, 12 + (i * 8), 1, _app_menu_names[_app_menu_top + i], 1);
+    }
 
     // Draw the selection indicator
-    uint8_t y = ((_app_menu_selected + 2) * 8) -2;
+    uint8_t y = ((_app_menu_selected - _app_menu_top + 2) * 8) -2;
     ssd1306_set_pixel(6, y, 1);
     ssd1306_set_pixel(5, y-1, 1);
     ssd1306_set_pixel(5, y, 1);
@@ -58,41 +85,37 @@ void app_menu_render()
     ssd1306_refresh();
 }
 
+static void app_menu_qei(int32_t steps, void *arg)
+{
+	(void)arg;
+
+	_app_menu_selected += steps;
+
+	if (_app_menu_selected < 0)
+	{
+		_app_menu_selected = APP_MENU_OPTION_LAST - 1;
+	}
+	if (_app_menu_selected >= APP_MENU_OPTION_LAST)
+	{
+		_app_menu_selected = APP_MENU_OPTION_ABOUT;
+	}
+
+	// Update the display
+	app_menu_render();
+}
+
 app_menu_option_t app_menu_run(void)
 {
+	const evloop_handlers_t h = { .qei = app_menu_qei };
+
 	// Reset the QEI encoder position counter
-	int32_t last_position_qei = 0;
 	qei_reset_step();
 	_app_menu_selected = APP_MENU_OPTION_ABOUT;
+	_app_menu_top = 0;
     app_menu_render();
 
     // Wait for the button to execute the selected sub-app
-	while (!(button_pressed() &  ( 1 << QEI_SW_PIN)))
-    {
-		// Check for a scroll request on the QEI
-		int32_t abs = qei_abs_step();
-		if (abs != last_position_qei)
-		{
-			_app_menu_selected += qei_offset_step();
-
-			if (_app_menu_selected < 0)
-			{
-				_app_menu_selected = APP_MENU_OPTION_LAST - 1;
-			}
-			if (_app_menu_selected >= APP_MENU_OPTION_LAST)
-			{
-				_app_menu_selected = APP_MENU_OPTION_ABOUT;
-			}
-
-			// Track the position
-			last_position_qei = abs;
-
-			// Update the display
-			app_menu_render();
-		}
-
-    	delay_ms(1);
-    }
+	evloop_run(&h);
 
     return _app_menu_selected;
 }
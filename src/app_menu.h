@@ -19,6 +19,11 @@ typedef enum
 	APP_MENU_OPTION_I2CSCANNER = 3,
 	APP_MENU_OPTION_WAVEGEN = 4,
 	APP_MENU_OPTION_CONTINUITY = 5,
+	APP_MENU_OPTION_BODE = 6,
+	APP_MENU_OPTION_LOGIC = 7,
+	APP_MENU_OPTION_FREQ = 8,
+	APP_MENU_OPTION_PWM = 9,
+	APP_MENU_OPTION_CAP = 10,
 	APP_MENU_OPTION_LAST
 } app_menu_option_t;
 
@@ -0,0 +1,351 @@
+/*
+===============================================================================
+ Name        : app_pwm.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Three channel PWM and servo pulse generator
+===============================================================================
+ */
+
+#include "LPC8xx.h"
+
+#include "config.h"
+#include "button.h"
+#include "delay.h"
+#include "evloop.h"
+#include "qei.h"
+#include "sct_pwm.h"
+#include "app_pwm.h"
+#include "gfx.h"
+
+/*
+ Pins used in this application:
+
+ PWM_OUT0_PIN [O] - Channel 0 (servo pulses in SERVO mode)
+ PWM_OUT1_PIN [O] - Channel 1
+ PWM_OUT2_PIN [O] - Channel 2
+*/
+
+typedef enum
+{
+	APP_PWM_MODE_PWM = 0,
+	APP_PWM_MODE_SERVO,
+	APP_PWM_MODE_LAST
+} app_pwm_mode_t;
+
+// The items on the PWM screen, duty and phase per channel
+#define APP_PWM_ITEM_FREQ        (0)
+#define APP_PWM_ITEM_DUTY(_ch)   (1 + 2 * (_ch))
+#define APP_PWM_ITEM_PHASE(_ch)  (2 + 2 * (_ch))
+#define APP_PWM_ITEM_EXIT        (1 + 2 * SCT_PWM_CHANNELS)
+#define APP_PWM_ITEM_LAST        (APP_PWM_ITEM_EXIT + 1)
+
+// Frequencies go 1, 1.2, 1.5, 2, 2.5, 3, 4, 5, 6, 8 per decade, 1Hz..100kHz
+static const uint8_t _app_pwm_steps[] = { 10, 12, 15, 20, 25, 30, 40, 50, 60, 80 };
+#define APP_PWM_STEPS            (sizeof(_app_pwm_steps) / sizeof(_app_pwm_steps[0]))
+#define APP_PWM_FREQS            (5 * APP_PWM_STEPS + 1)
+
+#define APP_PWM_DUTY_STEP        (10)       // 1%
+#define APP_PWM_PHASE_STEP       (15)       // Degrees
+
+// Standard hobby servo frame and pulse range
+#define APP_PWM_SERVO_HZ         (50)
+#define APP_PWM_SERVO_MIN_US     (500)
+#define APP_PWM_SERVO_MAX_US     (2500)
+#define APP_PWM_SERVO_STEP_US    (10)
+
+static app_pwm_mode_t _app_pwm_mode = APP_PWM_MODE_PWM;
+static uint8_t  _app_pwm_freq = 3 * APP_PWM_STEPS;         // 1kHz
+static uint16_t _app_pwm_duty[SCT_PWM_CHANNELS] = { 500, 500, 500 };
+static uint16_t _app_pwm_phase[SCT_PWM_CHANNELS] = { 0, 120, 240 };
+static uint16_t _app_pwm_servo_us = 1500;
+static uint8_t  _app_pwm_item;
+static uint8_t  _app_pwm_edit;
+
+void app_pwm_init(void)
+{
+	ssd1306_clear();
+    ssd1306_refresh();
+}
+
+static uint32_t app_pwm_freq_hz(uint8_t i)
+{
+	uint32_t hz = _app_pwm_steps[i % APP_PWM_STEPS];
+
+	for (uint8_t d = 0; d < i / APP_PWM_STEPS; d++) hz *= 10;
+
+	return hz / 10;
+}
+
+static void app_pwm_render_header(void)
+{
+	ssd1306_clear();
+    ssd1306_set_text(0, 0, 1, "LPC SAKEE", 1);
+    ssd1306_set_text(127-15, 0, 1, "PWM", 1);			// 15 pixels wide
+}
+
+static void app_pwm_render_mode_name(void)
+{
+	ssd1306_fill_rect(0, 24, 128, 15, 0);
+	ssd1306_set_text(10, 24, 1, _app_pwm_mode == APP_PWM_MODE_SERVO ? "SERVO" : "PWM", 2);
+	ssd1306_refresh();
+}
+
+static void app_pwm_mode_qei(int32_t steps, void *arg)
+{
+	int32_t m = (int32_t)_app_pwm_mode + steps;
+
+	(void)arg;
+
+	// Roll over in both directions
+	if (m < 0) m = APP_PWM_MODE_LAST - 1;
+	if (m >= APP_PWM_MODE_LAST) m = 0;
+	_app_pwm_mode = (app_pwm_mode_t)m;
+
+	app_pwm_render_mode_name();
+}
+
+static void app_pwm_render_mode(void)
+{
+	const evloop_handlers_t h = { .qei = app_pwm_mode_qei };
+
+	// Reset the QEI encoder position counter
+	qei_reset_step();
+
+	app_pwm_render_header();
+	ssd1306_set_text(15, 55, 1, "SELECT TO CONTINUE", 1);
+	ssd1306_set_text(0, 12, 1, "SELECT MODE", 1);
+	app_pwm_render_mode_name();
+
+	evloop_run(&h);
+}
+
+// Prints val / 10^decimals and a unit, underlined if the item is selected
+// and inverted while it's being edited
+static void app_pwm_render_value(uint8_t x, uint8_t y, int32_t val, uint8_t decimals, char *unit, uint8_t item)
+{
+	uint8_t editing = (item == _app_pwm_item) && _app_pwm_edit;
+	uint8_t w = 5 * gfx_num_digits(val);
+
+	// Highlight first, the text goes on top of it
+	if (decimals)
+	{
+		if (w < 5 * (decimals + 1)) w = 5 * (decimals + 1);
+		w += 5;
+	}
+	for (char *u = unit; *u; u++) w += 5;
+
+	if (editing)
+	{
+		ssd1306_fill_rect(x - 1, y - 1, w + 2, 9, 1);
+	}
+	else if (item == _app_pwm_item)
+	{
+		ssd1306_fill_rect(x, y + 8, w, 1, 1);
+	}
+
+	x = gfx_printfixed(x, y, val, decimals, 1, editing ? 0 : 1);
+	ssd1306_set_text(x, y, editing ? 0 : 1, unit, 1);
+}
+
+static void app_pwm_render(void)
+{
+	uint32_t hz = app_pwm_freq_hz(_app_pwm_freq);
+	char c[4] = "CH0";
+
+	app_pwm_render_header();
+
+	ssd1306_set_text(0, 12, 1, "FREQ", 1);
+	if (hz < 1000)
+	{
+		app_pwm_render_value(40, 12, hz, 0, "Hz", APP_PWM_ITEM_FREQ);
+	}
+	else
+	{
+		app_pwm_render_value(40, 12, hz / 100, 1, "kHz", APP_PWM_ITEM_FREQ);
+	}
+
+	ssd1306_set_text(40, 22, 1, "DUTY", 1);
+	ssd1306_set_text(85, 22, 1, "PHASE", 1);
+
+	for (uint8_t ch = 0; ch < SCT_PWM_CHANNELS; ch++)
+	{
+		uint8_t y = 31 + 8 * ch;
+
+		c[2] = '0' + ch;
+		ssd1306_set_text(0, y, 1, c, 1);
+
+		app_pwm_render_value(40, y, _app_pwm_duty[ch] / 10, 0, "%", APP_PWM_ITEM_DUTY(ch));
+		app_pwm_render_value(85, y, _app_pwm_phase[ch], 0, "", APP_PWM_ITEM_PHASE(ch));
+	}
+
+	if (_app_pwm_item == APP_PWM_ITEM_EXIT)
+	{
+		ssd1306_fill_rect(15, 55, 9 * 5 + 2, 9, 1);
+	}
+	ssd1306_set_text(16, 56, _app_pwm_item == APP_PWM_ITEM_EXIT ? 0 : 1, "MAIN MENU", 1);
+
+	ssd1306_refresh();
+}
+
+static void app_pwm_apply(void)
+{
+	for (uint8_t ch = 0; ch < SCT_PWM_CHANNELS; ch++)
+	{
+		sct_pwm_set_duty(ch, _app_pwm_duty[ch], _app_pwm_phase[ch]);
+	}
+}
+
+// Applies a QEI step to the item being edited
+static void app_pwm_adjust(int32_t delta)
+{
+	uint8_t item = _app_pwm_item;
+	int32_t v;
+
+	if (item == APP_PWM_ITEM_FREQ)
+	{
+		v = (int32_t)_app_pwm_freq + delta;
+		if (v < 0) v = 0;
+		if (v >= (int32_t)APP_PWM_FREQS) v = APP_PWM_FREQS - 1;
+		_app_pwm_freq = (uint8_t)v;
+		sct_pwm_set_freq(app_pwm_freq_hz(_app_pwm_freq));
+		return;
+	}
+
+	uint8_t ch = (item - 1) / 2;
+
+	if (item == APP_PWM_ITEM_DUTY(ch))
+	{
+		v = (int32_t)_app_pwm_duty[ch] + delta * APP_PWM_DUTY_STEP;
+		if (v < 0) v = 0;
+		if (v > 1000) v = 1000;
+		_app_pwm_duty[ch] = (uint16_t)v;
+	}
+	else
+	{
+		// Phase rolls over
+		v = ((int32_t)_app_pwm_phase[ch] + delta * APP_PWM_PHASE_STEP) % 360;
+		if (v < 0) v += 360;
+		_app_pwm_phase[ch] = (uint16_t)v;
+	}
+
+	sct_pwm_set_duty(ch, _app_pwm_duty[ch], _app_pwm_phase[ch]);
+}
+
+// QEI scroll = next item, or the value of the one being edited
+static void app_pwm_qei(int32_t steps, void *arg)
+{
+	(void)arg;
+
+	if (_app_pwm_edit)
+	{
+		app_pwm_adjust(steps);
+	}
+	else
+	{
+		int32_t i = (int32_t)_app_pwm_item + steps;
+
+		// Roll over in both directions
+		if (i < 0) i = APP_PWM_ITEM_LAST - 1;
+		if (i >= APP_PWM_ITEM_LAST) i = 0;
+		_app_pwm_item = (uint8_t)i;
+	}
+
+	app_pwm_render();
+}
+
+static void app_pwm_run_pwm(void)
+{
+	const evloop_handlers_t h = { .qei = app_pwm_qei };
+
+	qei_reset_step();
+
+	_app_pwm_item = APP_PWM_ITEM_FREQ;
+	_app_pwm_edit = 0;
+
+	sct_pwm_start(app_pwm_freq_hz(_app_pwm_freq));
+	app_pwm_apply();
+	app_pwm_render();
+
+	while (1)
+	{
+		// The SCT does all the work, the loop is back on every click
+		evloop_run(&h);
+
+		if (_app_pwm_item == APP_PWM_ITEM_EXIT) return;
+
+		_app_pwm_edit = !_app_pwm_edit;
+		app_pwm_render();
+	}
+}
+
+static void app_pwm_render_servo(void)
+{
+	uint8_t x;
+
+	ssd1306_fill_rect(0, 12, 128, 43, 0);
+
+	ssd1306_set_text(0, 12, 1, "SERVO 50Hz", 1);
+	x = gfx_printfixed(10, 22, _app_pwm_servo_us, 0, 2, 1);
+	ssd1306_set_text(x + 4, 29, 1, "us", 1);
+
+	// 0 to 180 degrees over the pulse range
+	ssd1306_set_text(0, 42, 1, "ANGLE", 1);
+	gfx_printdec(40, 42, (_app_pwm_servo_us - APP_PWM_SERVO_MIN_US) * 180 / (APP_PWM_SERVO_MAX_US - APP_PWM_SERVO_MIN_US), 1, 1);
+
+	ssd1306_refresh();
+}
+
+static void app_pwm_servo_qei(int32_t steps, void *arg)
+{
+	int32_t us = (int32_t)_app_pwm_servo_us + steps * APP_PWM_SERVO_STEP_US;
+
+	(void)arg;
+
+	if (us < APP_PWM_SERVO_MIN_US) us = APP_PWM_SERVO_MIN_US;
+	if (us > APP_PWM_SERVO_MAX_US) us = APP_PWM_SERVO_MAX_US;
+	_app_pwm_servo_us = (uint16_t)us;
+
+	// Picked up at the end of the current frame
+	sct_pwm_set_pulse(0, _app_pwm_servo_us, 0);
+	app_pwm_render_servo();
+}
+
+static void app_pwm_run_servo(void)
+{
+	const evloop_handlers_t h = { .qei = app_pwm_servo_qei };
+
+	qei_reset_step();
+
+	app_pwm_render_header();
+	ssd1306_set_text(16, 55, 1, "CLICK FOR MAIN MENU", 1);
+	app_pwm_render_servo();
+
+	sct_pwm_start(APP_PWM_SERVO_HZ);
+	sct_pwm_set_pulse(0, _app_pwm_servo_us, 0);
+
+	/* Wait for the QEI switch to exit */
+	evloop_run(&h);
+}
+
+void app_pwm_run(void)
+{
+	app_pwm_render_mode();
+
+	// The PWM needs the whole SCT, the QEI decodes on pin interrupts while
+	// the app runs
+	qei_release_sct();
+
+	if (_app_pwm_mode == APP_PWM_MODE_SERVO)
+	{
+		app_pwm_run_servo();
+	}
+	else
+	{
+		app_pwm_run_pwm();
+	}
+
+	sct_pwm_stop();
+	qei_claim_sct();
+}
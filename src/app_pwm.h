@@ -0,0 +1,17 @@
+/*
+===============================================================================
+ Name        : app_pwm.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description :
+===============================================================================
+ */
+
+#ifndef APP_PWM_H_
+#define APP_PWM_H_
+
+void app_pwm_init(void);
+void app_pwm_run(void);
+
+#endif /* APP_PWM_H_ */
@@ -13,19 +13,56 @@
 
 #include "config.h"
 #include "delay.h"
+#include "evloop.h"
 #include "qei.h"
 #include "adc_dma.h"
 #include "button.h"
 #include "gfx.h"
+#include "autorange.h"
+#include "settings.h"
+#include "dsp.h"
 #include "app_scope.h"
 
 #define APP_SCOPE_WAVEFORM_RENDER_AS_BAR	(0)	// Set this to 1 to render waveform with solid bars from bottom to sample height
 
+// Fastest rate where the tone analysis of one 1K block finishes before
+// the next block is complete, so the THD meter sees every sample
+#define APP_SCOPE_THD_RATE_MAX				(APP_SCOPE_RATE_100_KHZ)
+// Slowest rate for the THD meter, a 1K block takes ~1s here but ~100s at
+// 10Hz, far too long to wait for a reading
+#define APP_SCOPE_THD_RATE_MIN				(APP_SCOPE_RATE_1_KHZ)
+#define APP_SCOPE_THD_UPDATE_MS				(250)	// Blocks are averaged between display updates
+#define APP_SCOPE_AUTORANGE_SHOTS			(3)		// Captures per trigger arm, when the range keeps changing
+
+// The captured waveform on display, scrolled with the QEI
+typedef struct
+{
+	int16_t sample;			// Trigger sample
+	int32_t offset;			// Scroll from the trigger, in samples
+} app_scope_view_t;
+
+// THD meter sums, averaged between display updates
+typedef struct
+{
+	uint64_t power[DSP_TONE_HARMONICS];
+	uint64_t freq;			// mHz
+	uint64_t rms2;
+	uint32_t n;				// Blocks in the sums
+	uint32_t missed;		// Blocks that came in while one was analysed
+	uint32_t last;			// adc_dma_blocks() already seen
+	uint32_t rate_hz;
+	uint32_t t;				// millis() of the last display update
+	uint8_t  harmonics;
+} app_scope_thd_t;
+
+app_scope_mode_t _app_scope_mode = APP_SCOPE_MODE_WAVEFORM;
+
 app_scope_rate_t _app_scope_rate = APP_SCOPE_RATE_100_KHZ;
 uint16_t         _app_scope_thresh_l = (uint16_t)(1001/MV_PER_LSB); // Default lower threshold in lsb
 uint16_t         _app_scope_thresh_h = (uint16_t)(1100/MV_PER_LSB); // Default upper threshold in lsb
 uint8_t          _app_scope_coupling = 0;		// 0 = DC, 1 = AC (default = DC)
 uint8_t          _app_scope_vdiv = 0;           // 0 = No input divider, 1 = Enable the 0.787X voltage divider
+uint8_t          _app_scope_autorange = 1;      // 1 = Switch the divider automatically, 0 = stay on _app_scope_vdiv
 int32_t          _app_scope_rate_lookup[16][2] = { { APP_SCOPE_RATE_10_HZ,   100000 },
 		                                           { APP_SCOPE_RATE_25_HZ,   40000 },
 		                                           { APP_SCOPE_RATE_50_HZ,   20000 },
@@ -43,6 +80,37 @@ int32_t          _app_scope_rate_lookup[16][2] = { { APP_SCOPE_RATE_10_HZ,   100
 		                                           { APP_SCOPE_RATE_250_KHZ, 4 },
 		                                           { APP_SCOPE_RATE_500_KHZ, 2 } };
 
+// Restores the last used scope setup, or seeds the store with the defaults
+void app_scope_load_settings(void)
+{
+	if (!settings_loaded())
+	{
+		app_scope_save_settings();
+		return;
+	}
+
+	if (_settings.scope_rate < APP_SCOPE_RATE_LAST)
+	{
+		_app_scope_rate = (app_scope_rate_t)_settings.scope_rate;
+	}
+	if (_settings.scope_thresh_h <= 4095 && _settings.scope_thresh_l < _settings.scope_thresh_h)
+	{
+		_app_scope_thresh_l = _settings.scope_thresh_l;
+		_app_scope_thresh_h = _settings.scope_thresh_h;
+	}
+	_app_scope_coupling = _settings.scope_coupling ? 1 : 0;
+	_app_scope_vdiv = _settings.scope_vdiv ? 1 : 0;
+}
+
+void app_scope_save_settings(void)
+{
+	_settings.scope_rate = (uint8_t)_app_scope_rate;
+	_settings.scope_thresh_l = _app_scope_thresh_l;
+	_settings.scope_thresh_h = _app_scope_thresh_h;
+	_settings.scope_coupling = _app_scope_coupling;
+	_settings.scope_vdiv = _app_scope_vdiv;
+}
+
 void app_scope_init(void)
 {
 	// Initialize the DMA and MRT based ADC sampler
@@ -51,7 +119,6 @@ void app_scope_init(void)
 
 	// Analog front end setup
 	GPIOSetDir(AN_IN_VREF_3_3V_0_971V/32, AN_IN_VREF_3_3V_0_971V%32, 1); /* 3.3V or 0.971V VRef (240K + 100K divider) */
-	GPIOSetDir(AN_IN_VDIV_0_787X/32, AN_IN_VDIV_0_787X%32, 1); 			 /* 0.787X voltage divider bypass */
 	GPIOSetDir(AN_IN_220NF_BLOCKING/32, AN_IN_220NF_BLOCKING%32, 1); 	 /* 220nF inline AC/DC blocking cap bypass */
 
 	// Toggle 0.971V VRef (3.3V by default)
@@ -65,33 +132,8 @@ void app_scope_init(void)
 		LPC_GPIO_PORT->SET0 = (1 << (AN_IN_VREF_3_3V_0_971V%32));
 	}
 
-	// Toggle 0.787X (27K+100K) Voltage Divider (Full 3.3V input range by default)
-	if (AN_IN_VDIV_0_787X/32)
-	{
-		if (_app_scope_vdiv)
-		{
-			// Enable the 0.787x voltage divider
-			LPC_GPIO_PORT->CLR1 = (1 << (AN_IN_VDIV_0_787X%32));
-		}
-		else
-		{
-			// No voltage divider
-			LPC_GPIO_PORT->SET1 = (1 << (AN_IN_VDIV_0_787X%32));
-		}
-	}
-	else
-	{
-		if (_app_scope_vdiv)
-		{
-			// Enable the 0.787x voltage divider
-			LPC_GPIO_PORT->CLR0 = (1 << (AN_IN_VDIV_0_787X%32));
-		}
-		else
-		{
-			// No voltage divider
-			LPC_GPIO_PORT->SET0 = (1 << (AN_IN_VDIV_0_787X%32));
-		}
-	}
+	// 0.787X (27K+100K) Voltage Divider, switched on the fly by the auto-ranger
+	autorange_init(_app_scope_autorange, _app_scope_vdiv, _app_scope_coupling);
 
 	// Toggle 220nF AC/DC blocking cap (DC coupling by default)
 	if (AN_IN_220NF_BLOCKING/32)
@@ -151,11 +193,15 @@ void app_scope_render_waveform(int16_t sample, int32_t offset_us)
 	// Render AD/DC coupling indicator
 	ssd1306_set_text(127-18, 8, 1, _app_scope_coupling ? "AC" : "DC", 1);
 
-	// Display voltage divider warning if enabled
-	if (_app_scope_vdiv)
+	// Display the auto-ranger state, divider in and/or clipping
+	if (autorange_vdiv())
 	{
 		ssd1306_set_text(70, 8, 1, "0.787x", 1);
 	}
+	if (autorange_clipped())
+	{
+		ssd1306_set_text(0, 8, 1, "CLIP", 1);
+	}
 
 	// Render the graticule and waveform
 	gfx_graticule(0, 16, &grcfg, 1);
@@ -179,7 +225,7 @@ void app_scope_render_waveform(int16_t sample, int32_t offset_us)
 
 	// Labels
 	uint16_t trig = adc_dma_get_buffer()[sample]>>4;
-	float trig_mv = MV_PER_LSB * trig;
+	float trig_mv = MV_PER_LSB * trig * autorange_gain_q16() / 65536;
 	uint32_t us_per_div = adc_dma_get_rate() * 8;
 	gfx_printdec(70, 16, (int32_t)trig_mv, 1, 1);
 	ssd1306_set_text(70, 16, 1, "        mV", 1);
@@ -196,7 +242,7 @@ void app_scope_render_waveform(int16_t sample, int32_t offset_us)
 	ssd1306_set_text(70, 35, 1, "    us/div", 1);
 	gfx_printdec(70, 35, (int32_t)us_per_div, 1, 1);
 	ssd1306_set_text(70, 43, 1, "    mV/div", 1);
-	gfx_printdec(70, 43, (int32_t)(3300/4), 1, 1);
+	gfx_printdec(70, 43, (int32_t)(((3300/4) * autorange_gain_q16()) >> 16), 1, 1);
 
 	ssd1306_set_text(16, 55, 1, "CLICK FOR MAIN MENU", 1);
 
@@ -204,10 +250,46 @@ void app_scope_render_waveform(int16_t sample, int32_t offset_us)
 	ssd1306_refresh();
 }
 
+// Converts an input referred threshold to ADC codes in the current range
+static uint16_t app_scope_thresh_adc(uint16_t lsb)
+{
+	uint32_t v = ((uint32_t)lsb << 16) / autorange_gain_q16();
+	return v > 4095 ? 4095 : (uint16_t)v;
+}
+
+// QEI scroll = adjust waveform offset, accelerated to cover the whole
+// capture in a quick spin
+static void app_scope_view_qei(int32_t steps, void *arg)
+{
+	app_scope_view_t *v = arg;
+	int32_t last = v->offset;
+
+	(void)steps;
+
+	v->offset += qei_accel_step();
+	// Don't allow scrolling outside the leading edge of the waveform
+	if (v->sample + v->offset <= 0)
+	{
+		v->offset = v->sample * -1;
+	}
+	// Stay within sample+1K sample upper limit
+	if (v->offset > 992)
+	{
+		v->offset = 992;
+	}
+	// Adjust waveform offset on qei scroll
+	if (v->offset != last)
+	{
+		app_scope_render_waveform(v->sample + v->offset, v->offset * adc_dma_get_rate());
+	}
+}
+
 void app_scope_arm_trigger(void)
 {
-	static int32_t last_position_qei = 0;
+	int32_t offset = 0;
 	int16_t sample = 0;
+	app_scope_view_t v;
+	const evloop_handlers_t h = { .qei = app_scope_view_qei, .arg = &v, .exit_mask = 0xFFFFFFFF };
 
 	app_scope_render_header();
 
@@ -227,14 +309,32 @@ void app_scope_arm_trigger(void)
 	  // Start sampling with threshold detection (low, high, mode)
 	  // interrupt mode: 0 = disabled, 1 = outside threshold, 2 = crossing threshold
 	  // Note: This is a blocking call, so enable cancel with button (last argument = 1)
-	  int32_t res = adc_dma_start_with_threshold(_app_scope_thresh_l, _app_scope_thresh_h, 2, 1);
-	  if (res == -1)
+	  // The shot is taken again if it made the auto-ranger switch
+	  uint8_t tries = 0;
+	  uint16_t start;
+	  do
 	  {
-		  // The user canceled the request before the trigger fired
-		  // The DMA engine is already stopped in adc_dma_start_with_threshold above
-		  return;
-	  }
-	  sample = adc_dma_get_threshold_sample();
+		  // The 1ms SysTick wakes the core to check again
+		  while (autorange_settling())
+		  {
+			  __WFI();
+		  }
+
+		  int32_t res = adc_dma_start_with_threshold(app_scope_thresh_adc(_app_scope_thresh_l),
+		                                             app_scope_thresh_adc(_app_scope_thresh_h), 2, 1);
+		  if (res == -1)
+		  {
+			  // The user canceled the request before the trigger fired
+			  // The DMA engine is already stopped in adc_dma_start_with_threshold above
+			  return;
+		  }
+		  sample = adc_dma_get_threshold_sample();
+
+		  // Range check on the span that gets displayed
+		  start = sample >= 32 ? sample - 32 : 0;
+	  } while (sample >= 0 && ++tries < APP_SCOPE_AUTORANGE_SHOTS &&
+	           autorange_shot(adc_dma_get_buffer() + start,
+	                          start + DMA_BUFFER_SIZE <= 2 * DMA_BUFFER_SIZE ? DMA_BUFFER_SIZE : 2 * DMA_BUFFER_SIZE - start, 4));
 	  if (sample < 0)
 	  {
 		  // ToDo: Error message
@@ -246,32 +346,9 @@ void app_scope_arm_trigger(void)
 	}
 
 	// Wait for a button press to escape waveform analysis
-	while (!button_pressed())
-	{
-		// Check for a scroll request on the QEI
-		// QEI scroll = adjust waveform offset
-		int32_t abs = qei_abs_step();
-		// Don't allow scrolling outside the leading edge of the waveform
-		if (sample+abs <= 0)
-		{
-			abs = sample * -1;
-			qei_reset_step_val(abs);
-		}
-		// Stay within sample+1K sample upper limit
-		if (sample+abs > sample+992)
-		{
-			abs = 992;
-			qei_reset_step_val(abs);
-		}
-		// Adjust waveform offset on qei scroll
-		if (abs != last_position_qei)
-		{
-			app_scope_render_waveform(sample+abs, (int32_t)abs*adc_dma_get_rate());
-			last_position_qei = abs;
-		}
-
-		delay_ms(1);
-	}
+	v.sample = sample;
+	v.offset = offset;
+	evloop_run(&h);
 }
 
 void app_scope_render_hz(uint8_t x, uint8_t y, uint8_t color)
@@ -333,10 +410,36 @@ void app_scope_render_hz(uint8_t x, uint8_t y, uint8_t color)
     }
 }
 
+static void app_scope_hz_qei(int32_t steps, void *arg)
+{
+	int32_t r = (int32_t)_app_scope_rate + steps;
+
+	(void)arg;
+
+	if (r < 0)
+	{
+		// Roll under to the top value
+		_app_scope_rate = APP_SCOPE_RATE_LAST - 1;
+	}
+	else if (r > (APP_SCOPE_RATE_LAST - 1))
+	{
+		// Roll over to the low value
+		_app_scope_rate = 0;
+	}
+	else
+	{
+		_app_scope_rate = r;
+	}
+
+	app_scope_render_hz(40, 24, 1);
+	ssd1306_refresh();
+}
+
 void app_scope_render_set_hz(void)
 {
+	const evloop_handlers_t h = { .qei = app_scope_hz_qei };
+
 	// Reset the QEI encoder position counter
-	int32_t last_position_qei = 0;
 	qei_reset_step();
 
 	// Render the title bars
@@ -348,47 +451,223 @@ void app_scope_render_set_hz(void)
 	ssd1306_refresh();
 
     // Wait for the button to execute Hz selection
-	while (!(button_pressed() &  ( 1 << QEI_SW_PIN)))
-    {
-		// Check for a scroll request on the QEI
-		int32_t abs = qei_abs_step();
-		if (abs != last_position_qei)
-		{
-			int32_t r = (int32_t)_app_scope_rate;
-
-			r += qei_offset_step();
-
-			if (r < 0)
-			{
-				// Roll under to the top value
-				_app_scope_rate = APP_SCOPE_RATE_LAST - 1;
-			}
-			else if (r > (APP_SCOPE_RATE_LAST - 1))
-			{
-				// Roll over to the low value
-				_app_scope_rate = 0;
-			}
-			else
-			{
-				_app_scope_rate = r;
-			}
-
-			// Track the position
-			last_position_qei = abs;
-
-			app_scope_render_hz(40, 24, 1);
-			ssd1306_refresh();
-		}
-    }
+	evloop_run(&h);
 
 	// Adjust the DMA rate
 	adc_dma_set_rate(_app_scope_rate_lookup[_app_scope_rate][1]);
+}
+
+static void app_scope_render_mode_name(void)
+{
+	ssd1306_fill_rect(0, 24, 128, 15, 0);
+	ssd1306_set_text(10, 24, 1, _app_scope_mode == APP_SCOPE_MODE_THD ? "THD METER" : "WAVEFORM", 2);
+	ssd1306_refresh();
+}
+
+static void app_scope_mode_qei(int32_t steps, void *arg)
+{
+	int32_t m = (int32_t)_app_scope_mode + steps;
+
+	(void)arg;
+
+	// Roll over in both directions
+	if (m < 0) m = APP_SCOPE_MODE_LAST - 1;
+	if (m >= APP_SCOPE_MODE_LAST) m = 0;
+	_app_scope_mode = (app_scope_mode_t)m;
+
+	app_scope_render_mode_name();
+}
+
+void app_scope_render_mode(void)
+{
+	const evloop_handlers_t h = { .qei = app_scope_mode_qei };
 
-	// Wait for the button to release
-	while ((button_pressed() &  ( 1 << QEI_SW_PIN)))
+	// Reset the QEI encoder position counter
+	qei_reset_step();
+
+	// Render the title bars
+	app_scope_render_header();
+	ssd1306_set_text(15, 55, 1, "SELECT TO CONTINUE", 1);
+	ssd1306_set_text(0, 12, 1, "SELECT MODE", 1);
+	app_scope_render_mode_name();
+
+	evloop_run(&h);
+}
+
+// Renders the averaged tone measurements, 'n' blocks worth of sums
+void app_scope_render_thd(uint32_t n, uint64_t freq_mhz, const uint64_t *power, uint8_t harmonics, uint64_t rms2, uint32_t missed)
+{
+	uint32_t a1, dist;
+	uint64_t p1, pnd, sum = 0;
+	uint8_t x;
+
+	ssd1306_clear();
+	ssd1306_set_text(0, 0, 1, "LPC SAKEE", 1);
+	ssd1306_set_text(127-45, 0, 1, "THD METER", 1);	// 45 pixels wide
+	ssd1306_set_text(0, 55, 1, "CLICK TO EXIT", 1);
+	if (missed)
+	{
+		ssd1306_set_text(127-20, 55, 1, "LATE", 1);
+	}
+
+	if (n == 0 || harmonics == 0)
+	{
+		ssd1306_set_text(20, 24, 1, "NO TONE DETECTED", 1);
+		ssd1306_refresh();
+		return;
+	}
+
+	// Average power of each harmonic, back to peak amplitudes (1/256 lsb)
+	a1 = dsp_isqrt64(power[0] / n);
+	for (uint8_t h = 1; h < harmonics; h++)
+	{
+		sum += power[h] / n;
+	}
+	dist = dsp_isqrt64(sum);
+
+	// SINAD: fundamental RMS against everything else in the block
+	p1 = (uint64_t)a1 * a1 / 2;
+	pnd = (rms2 / n > p1) ? (rms2 / n - p1) : 1;
+
+	ssd1306_set_text(0, 10, 1, "FREQ", 1);
+	x = gfx_printfixed(30, 10, (int32_t)(freq_mhz / n / 10), 2, 1, 1);
+	ssd1306_set_text(x, 10, 1, "Hz", 1);
+
+	ssd1306_set_text(0, 19, 1, "THD", 1);
+	x = gfx_printfixed(30, 19, (int32_t)(((uint64_t)dist * 10000) / (a1 ? a1 : 1)), 2, 1, 1);
+	ssd1306_set_text(x, 19, 1, "%", 1);
+	x = gfx_printfixed(80, 19, dsp_db10(dist, a1), 1, 1, 1);
+	ssd1306_set_text(x, 19, 1, "dB", 1);
+
+	int32_t sinad = dsp_db10(dsp_isqrt64(p1), dsp_isqrt64(pnd));
+	ssd1306_set_text(0, 28, 1, "SINAD", 1);
+	x = gfx_printfixed(30, 28, sinad, 1, 1, 1);
+	ssd1306_set_text(x, 28, 1, "dB", 1);
+	ssd1306_set_text(80, 28, 1, "ENOB", 1);
+	gfx_printfixed(105, 28, ((sinad - 18) * 10) / 60, 1, 1, 1);	// (SINAD - 1.76) / 6.02
+
+	ssd1306_set_text(0, 37, 1, "VRMS", 1);
+	x = gfx_printfixed(30, 37, (int32_t)(MV_PER_LSB * dsp_isqrt64(rms2 / n) / 256), 0, 1, 1);
+	ssd1306_set_text(x, 37, 1, "mV", 1);
+
+	// Each harmonic relative to the fundamental
+	for (uint8_t h = 1; h < harmonics; h++)
+	{
+		x = (h - 1) * 32;
+		gfx_printdec(x, 46, h + 1, 1, 1);
+		ssd1306_set_text(x + 5, 46, 1, ":", 1);
+		gfx_printdec(x + 10, 46, dsp_db10(dsp_isqrt64(power[h] / n), a1) / 10, 1, 1);
+	}
+
+	ssd1306_refresh();
+}
+
+// Starts a new average, the display refresh itself may cost a block
+static void app_scope_thd_restart(app_scope_thd_t *s)
+{
+	for (uint8_t h = 0; h < DSP_TONE_HARMONICS; h++)
 	{
-		delay_ms(10);
+		s->power[h] = 0;
 	}
+	s->freq = 0;
+	s->rms2 = 0;
+	s->n = 0;
+	s->missed = 0;
+	s->harmonics = DSP_TONE_HARMONICS;
+	s->last = adc_dma_blocks();
+	s->t = millis();
+}
+
+// The DMA interrupt wakes the loop, each new block is analysed here
+static void app_scope_thd_poll(void *arg)
+{
+	app_scope_thd_t *s = arg;
+	dsp_tone_t tone;
+	uint32_t b, gain;
+	uint16_t *buf;
+
+	b = adc_dma_blocks();
+	if (b == s->last)
+	{
+		return;
+	}
+	s->missed += b - s->last - 1;
+	s->last = b;
+
+	// Block b is in half (b - 1) & 1 and stays put for one block period
+	buf = adc_dma_get_buffer() + ((b - 1) & 1) * DMA_BUFFER_SIZE;
+
+	// Drop blocks that clipped into a range switch or are still settling
+	if (autorange_block(buf, DMA_BUFFER_SIZE, 4))
+	{
+		return;
+	}
+
+	if (dsp_tone_analyze(buf, DMA_BUFFER_SIZE, 4, s->rate_hz, &tone) == 0)
+	{
+		// Amplitudes back to the input, blocks may come from either range
+		gain = autorange_gain_q16();
+		tone.rms = (uint32_t)(((uint64_t)tone.rms * gain) >> 16);
+		for (uint8_t h = 0; h < tone.harmonics; h++)
+		{
+			tone.ampl[h] = (uint32_t)(((uint64_t)tone.ampl[h] * gain) >> 16);
+		}
+
+		s->freq += tone.freq_mhz;
+		s->rms2 += (uint64_t)tone.rms * tone.rms;
+		for (uint8_t h = 0; h < tone.harmonics; h++)
+		{
+			s->power[h] += (uint64_t)tone.ampl[h] * tone.ampl[h];
+		}
+		if (tone.harmonics < s->harmonics)
+		{
+			s->harmonics = tone.harmonics;
+		}
+		s->n++;
+	}
+
+	if (millis() - s->t >= APP_SCOPE_THD_UPDATE_MS)
+	{
+		app_scope_render_thd(s->n, s->freq, s->power, s->n ? s->harmonics : 0, s->rms2, s->missed);
+		app_scope_thd_restart(s);
+	}
+}
+
+/**
+ * THD meter sub-mode. The ADC runs continuously into the two halves of
+ * the DMA buffer and each completed block is analysed while the other
+ * fills (fundamental, harmonics 2..5, RMS), with the results averaged in
+ * the power domain between display updates. A click exits at once, the
+ * block in progress is dropped.
+ */
+void app_scope_thd_run(void)
+{
+	app_scope_thd_t s;
+	const evloop_handlers_t h = { .poll = app_scope_thd_poll, .arg = &s };
+
+	if (_app_scope_rate > APP_SCOPE_THD_RATE_MAX)
+	{
+		adc_dma_set_rate(_app_scope_rate_lookup[APP_SCOPE_THD_RATE_MAX][1]);
+	}
+	else if (_app_scope_rate < APP_SCOPE_THD_RATE_MIN)
+	{
+		adc_dma_set_rate(_app_scope_rate_lookup[APP_SCOPE_THD_RATE_MIN][1]);
+	}
+	s.rate_hz = 1000000 / adc_dma_get_rate();
+
+	app_scope_thd_restart(&s);
+	app_scope_render_thd(0, 0, s.power, 0, 0, 0);
+
+	adc_dma_start_continuous();
+	s.last = adc_dma_blocks();
+
+	/* Wait for the QEI switch to exit */
+	evloop_run(&h);
+
+	adc_dma_stop();
+
+	// Back to the rate the user picked
+	adc_dma_set_rate(_app_scope_rate_lookup[_app_scope_rate][1]);
 }
 
 void app_scope_render_threshold(uint16_t low, uint16_t high)
@@ -404,8 +683,41 @@ void app_scope_render_threshold(uint16_t low, uint16_t high)
     ssd1306_set_text(40, 32, 1, "     mV", 2);
 }
 
+// QEI scroll = trigger level, 50mV per step with the upper threshold
+// 100mV above
+static void app_scope_trig_qei(int32_t steps, void *arg)
+{
+	float offset = (steps * 50.0F)/MV_PER_LSB;
+
+	(void)arg;
+
+	// Stay above 0V
+	if ((int16_t)_app_scope_thresh_l + (int16_t)offset < 0)
+	{
+		_app_scope_thresh_l = 0;
+		_app_scope_thresh_h = (uint16_t)(100.0F/MV_PER_LSB);
+	}
+	// Stay below VCC
+	else if ((int16_t)_app_scope_thresh_l + (int16_t)offset > 4095 - (int16_t)(100.0F/MV_PER_LSB))
+	{
+		_app_scope_thresh_l = 4095 - (uint16_t)(100.0F/MV_PER_LSB);
+		_app_scope_thresh_h = 4095;
+	}
+	else
+	{
+		_app_scope_thresh_l += (int16_t)offset;
+		_app_scope_thresh_h = _app_scope_thresh_l + (uint16_t)(100.0F/MV_PER_LSB);
+	}
+
+	// Update the display
+	app_scope_render_threshold(_app_scope_thresh_l, _app_scope_thresh_h);
+	ssd1306_refresh();
+}
+
 void app_scope_render_trig(void)
 {
+	const evloop_handlers_t h = { .qei = app_scope_trig_qei };
+
 	app_scope_render_header();
 
     // Display the current lower/upper thresholds
@@ -417,56 +729,37 @@ void app_scope_render_trig(void)
     ssd1306_refresh();
 
 	// Reset the QEI encoder position counter
-	int32_t last_position_qei = 0;
 	qei_reset_step();
 
     // Wait for the button to arm the trigger
-	while (!(button_pressed() &  ( 1 << QEI_SW_PIN)))
-    {
-		// Check for a scroll request on the QEI
-        // Adjust the trigger level by default if any rotation occurs
-		int32_t abs = qei_abs_step();
-		// Adjust waveform offset on qei scroll
-		if (abs != last_position_qei)
-		{
-			float offset = ((abs - last_position_qei) * 50.0F)/MV_PER_LSB;
-			// Stay above 0V
-			if ((int16_t)_app_scope_thresh_l + (int16_t)offset < 0)
-			{
-				_app_scope_thresh_l = 0;
-				_app_scope_thresh_h = (uint16_t)(100.0F/MV_PER_LSB);
-			}
-			// Stay below VCC
-			else if ((int16_t)_app_scope_thresh_l + (int16_t)offset > 4095 - (int16_t)(100.0F/MV_PER_LSB))
-			{
-				_app_scope_thresh_l = 4095 - (uint16_t)(100.0F/MV_PER_LSB);
-				_app_scope_thresh_h = 4095;
-			}
-			else
-			{
-				_app_scope_thresh_l += (int16_t)offset;
-				_app_scope_thresh_h = _app_scope_thresh_l + (uint16_t)(100.0F/MV_PER_LSB);
-			}
-
-			// Update the display
-			app_scope_render_threshold(_app_scope_thresh_l, _app_scope_thresh_h);
-			ssd1306_refresh();
-
-			last_position_qei = abs;
-		}
-
-    	delay_ms(1);
-    }
+	evloop_run(&h);
 }
 
 void app_scope_run(void)
 {
+    // Pick the triggered waveform view or the THD meter
+    app_scope_render_mode();
+
+    if (_app_scope_mode == APP_SCOPE_MODE_THD)
+    {
+        app_scope_render_set_hz();
+        app_scope_save_settings();
+        settings_save();
+
+        app_scope_thd_run();
+        return;
+    }
+
     // Render the trigger selection menu
     app_scope_render_trig();
 
     // Render the rate selection menu
     app_scope_render_set_hz();
 
+    // Remember the trigger and rate for the next power up
+    app_scope_save_settings();
+    settings_save();
+
     // ARM the trigger
     app_scope_arm_trigger();
 }
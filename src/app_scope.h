@@ -31,6 +31,15 @@ typedef enum
 	APP_SCOPE_RATE_LAST
 } app_scope_rate_t;
 
+typedef enum
+{
+	APP_SCOPE_MODE_WAVEFORM = 0,	// Triggered single shot capture
+	APP_SCOPE_MODE_THD,				// Continuous tone/THD measurement
+	APP_SCOPE_MODE_LAST
+} app_scope_mode_t;
+
+void app_scope_load_settings(void);
+void app_scope_save_settings(void);
 void app_scope_init(void);
 void app_scope_run(void);
 
@@ -13,23 +13,81 @@
 
 #include "config.h"
 #include "delay.h"
-#include "adc_poll.h"
+#include "adc_dma.h"
+#include "qei.h"
+#include "evloop.h"
 #include "button.h"
 #include "gfx.h"
+#include "autorange.h"
+#include "dsp.h"
 #include "app_vm.h"
 
+// The ADC runs continuously by DMA in the background. Every 2^osr_bits
+// samples are summed into one reading (each 4x adds a bit of resolution,
+// the ADC noise acts as dither), readings go through an integer
+// exponential filter, and the display shows the filter output at a fixed
+// rate no matter how fast the conversions run.
+#define APP_VM_RATE_US          (10)    // 100kHz acquisition
+#define APP_VM_OSR_BITS_MAX     (10)    // Up to 1024x (17 bits)
+#define APP_VM_FILTER_SHIFT     (3)     // 1/8 of each new reading
+#define APP_VM_REFRESH_MS       (200)
+
+// True-RMS windows span whole periods of the input: from one rising
+// crossing of the running mean to the first one at least MIN_SAMPLES
+// later. Without crossings (DC, noise, < 1Hz) the window closes after
+// MAX_SAMPLES and the frequency reads as unknown.
+#define APP_VM_RMS_RATE_HZ      (1000000 / APP_VM_RATE_US)
+#define APP_VM_RMS_MIN_SAMPLES  (8192)
+#define APP_VM_RMS_MAX_SAMPLES  (131072)
+#define APP_VM_RMS_HYST_MIN     (4)     // Crossing hysteresis floor, lsb
+
+typedef struct
+{
+	int32_t  ref;           // Running mean (lsb), samples are taken relative to it
+	int32_t  hyst;          // Crossing hysteresis (lsb), from the last window peak
+	int32_t  sum;
+	uint64_t sum2;
+	int32_t  min;
+	int32_t  max;
+	uint32_t count;
+	uint32_t periods;
+	uint8_t  armed;         // Below -hyst, a rising crossing is due
+	uint8_t  locked;        // Window started on a crossing
+	uint8_t  seeded;        // ref holds a real mean
+} app_vm_rms_acc_t;
+
+typedef struct
+{
+	uint32_t rms;           // 1/256 lsb
+	int32_t  mean;          // lsb
+	uint32_t freq_dhz;      // 0.1Hz, 0 = no period found
+	uint32_t crest;         // Peak/RMS x100
+	uint8_t  valid;
+} app_vm_rms_t;
+
+app_vm_mode_t    _app_vm_mode = APP_VM_MODE_DC;
+
 uint8_t          _app_vm_coupling = 0;		// 0 = DC, 1 = AC (default = DC)
 uint8_t          _app_vm_vdiv = 0;          // 0 = No input divider, 1 = Enable the 0.787X voltage divider
+uint8_t          _app_vm_autorange = 1;     // 1 = Switch the divider automatically, 0 = stay on _app_vm_vdiv
+uint8_t          _app_vm_osr_bits = 8;      // 256x oversampling, 16 bits
+
+static uint32_t  _app_vm_sum;
+static uint32_t  _app_vm_count;
+static int32_t   _app_vm_filtered;          // 1/65536 lsb
+static uint8_t   _app_vm_primed;
+
+static app_vm_rms_acc_t _app_vm_rms_acc;
+static app_vm_rms_t     _app_vm_rms;
 
 void app_vm_init(void)
 {
-	adc_poll_init();
-
-	ssd1306_clear();
+	// Initialize the DMA and MRT based ADC sampler
+	adc_dma_init();
+	adc_dma_set_rate(APP_VM_RATE_US);
 
 	// Analog front end setup
 	GPIOSetDir(AN_IN_VREF_3_3V_0_971V/32, AN_IN_VREF_3_3V_0_971V%32, 1); /* 3.3V or 0.971V VRef (240K + 100K divider) */
-	GPIOSetDir(AN_IN_VDIV_0_787X/32, AN_IN_VDIV_0_787X%32, 1); 			 /* 0.787X voltage divider bypass */
 	GPIOSetDir(AN_IN_220NF_BLOCKING/32, AN_IN_220NF_BLOCKING%32, 1); 	 /* 220nF inline AC/DC blocking cap bypass */
 
 	// Toggle 0.971V VRef (3.3V by default)
@@ -43,33 +101,8 @@ void app_vm_init(void)
 		LPC_GPIO_PORT->SET0 = (1 << (AN_IN_VREF_3_3V_0_971V%32));
 	}
 
-	// Toggle 0.787X (27K+100K) Voltage Divider (Full 3.3V input range by default)
-	if (AN_IN_VDIV_0_787X/32)
-	{
-		if (_app_vm_vdiv)
-		{
-			// Enable the 0.787x voltage divider
-			LPC_GPIO_PORT->CLR1 = (1 << (AN_IN_VDIV_0_787X%32));
-		}
-		else
-		{
-			// No voltage divider
-			LPC_GPIO_PORT->SET1 = (1 << (AN_IN_VDIV_0_787X%32));
-		}
-	}
-	else
-	{
-		if (_app_vm_vdiv)
-		{
-			// Enable the 0.787x voltage divider
-			LPC_GPIO_PORT->CLR0 = (1 << (AN_IN_VDIV_0_787X%32));
-		}
-		else
-		{
-			// No voltage divider
-			LPC_GPIO_PORT->SET0 = (1 << (AN_IN_VDIV_0_787X%32));
-		}
-	}
+	// 0.787X (27K+100K) Voltage Divider, switched on the fly by the auto-ranger
+	autorange_init(_app_vm_autorange, _app_vm_vdiv, _app_vm_coupling);
 
 	// Toggle 220nF AC/DC blocking cap (DC coupling by default)
 	if (AN_IN_220NF_BLOCKING/32)
@@ -98,6 +131,11 @@ void app_vm_init(void)
 			LPC_GPIO_PORT->SET0 = (1 << (AN_IN_220NF_BLOCKING%32));
 		}
 	}
+}
+
+static void app_vm_render_header(void)
+{
+	ssd1306_clear();
 
 	// Render the title bars
     ssd1306_set_text(0, 0, 1, "LPC SAKEE", 1);
@@ -106,13 +144,28 @@ void app_vm_init(void)
 	// Render AD/DC coupling indicator
 	ssd1306_set_text(127-18, 8, 1, _app_vm_coupling ? "AC" : "DC", 1);
 
-	// Display voltage divider warning if enabled
-	if (_app_vm_vdiv)
+}
+
+// Divider and clipping indicators, these change with the auto-ranger
+static void app_vm_render_range(void)
+{
+	ssd1306_fill_rect(0, 8, 127-18, 8, 0);
+
+	if (autorange_clipped())
+	{
+		ssd1306_set_text(0, 8, 1, "CLIP", 1);
+	}
+	if (autorange_vdiv())
 	{
 		ssd1306_set_text(127-54, 8, 1, "0.787x", 1);
 	}
+}
+
+static void app_vm_render_screen(void)
+{
+	app_vm_render_header();
 
-    ssd1306_set_text(90, 32, 1, "mVOLTS", 1);
+    ssd1306_set_text(90, 28, 1, _app_vm_mode == APP_VM_MODE_RMS ? "mV RMS" : "mVOLTS", 1);
 
     // Render the bottom button options
 	//ssd1306_fill_rect(0, 55, 127, 8, 1);
@@ -126,14 +179,379 @@ void app_vm_init(void)
     ssd1306_refresh();
 }
 
-void app_vm_run(void)
+static void app_vm_render_mode_name(void)
 {
-	/* Wait for the QEI switch to exit */
-	while (!(button_pressed() & (1 << QEI_SW_PIN)))
+	ssd1306_fill_rect(0, 24, 128, 15, 0);
+	ssd1306_set_text(10, 24, 1, _app_vm_mode == APP_VM_MODE_RMS ? "TRUE RMS" : "DC VOLTS", 2);
+	ssd1306_refresh();
+}
+
+static void app_vm_mode_qei(int32_t steps, void *arg)
+{
+	int32_t m = (int32_t)_app_vm_mode + steps;
+
+	(void)arg;
+
+	// Roll over in both directions
+	if (m < 0) m = APP_VM_MODE_LAST - 1;
+	if (m >= APP_VM_MODE_LAST) m = 0;
+	_app_vm_mode = (app_vm_mode_t)m;
+
+	app_vm_render_mode_name();
+}
+
+static void app_vm_render_mode(void)
+{
+	const evloop_handlers_t h = { .qei = app_vm_mode_qei };
+
+	// Reset the QEI encoder position counter
+	qei_reset_step();
+
+	app_vm_render_header();
+	ssd1306_set_text(15, 55, 1, "SELECT TO CONTINUE", 1);
+	ssd1306_set_text(0, 12, 1, "SELECT MODE", 1);
+	app_vm_render_mode_name();
+
+	evloop_run(&h);
+}
+
+// Restarts the decimator and the filter, after an OSR change
+static void app_vm_reset_filter(void)
+{
+	_app_vm_sum = 0;
+	_app_vm_count = 0;
+	_app_vm_primed = 0;
+}
+
+// Decimates one DMA block into the filter
+static void app_vm_process(const uint16_t *buf)
+{
+	uint32_t osr = 1 << _app_vm_osr_bits;
+
+	// A range switch restarts the average in the new range
+	if (autorange_block(buf, DMA_BUFFER_SIZE, 4))
+	{
+		app_vm_reset_filter();
+		return;
+	}
+
+	for (uint32_t i = 0; i < DMA_BUFFER_SIZE; i++)
+	{
+		_app_vm_sum += buf[i] >> 4;		// 12-bit results sit in DAT[15:4]
+		if (++_app_vm_count < osr)
+		{
+			continue;
+		}
+
+		// Average with 16 fractional bits
+		int32_t x = (int32_t)(_app_vm_sum << (16 - _app_vm_osr_bits));
+
+		if (_app_vm_primed)
+		{
+			_app_vm_filtered += (x - _app_vm_filtered) >> APP_VM_FILTER_SHIFT;
+		}
+		else
+		{
+			_app_vm_filtered = x;
+			_app_vm_primed = 1;
+		}
+
+		_app_vm_sum = 0;
+		_app_vm_count = 0;
+	}
+}
+
+static void app_vm_render_dc(void)
+{
+	uint8_t x;
+
+	// 3300mV full scale over 4096 * 65536, times the range gain, in 0.1mV
+	int64_t v = (int64_t)_app_vm_filtered * 33000 * autorange_gain_q16();
+	int32_t mv10 = (int32_t)((v + (1LL << 43)) >> 44);
+
+	app_vm_render_range();
+
+	ssd1306_fill_rect(0, 20, 88, 16, 0);
+	if (_app_vm_primed)
+	{
+		gfx_printfixed(0, 20, mv10, 1, 2, 1);
+	}
+
+	ssd1306_fill_rect(0, 44, 128, 8, 0);
+	ssd1306_set_text(0, 44, 1, "AVG", 1);
+	x = gfx_printfixed(20, 44, 1 << _app_vm_osr_bits, 0, 1, 1);
+	ssd1306_set_text(x, 44, 1, "X", 1);
+	gfx_printdec(80, 44, 12 + _app_vm_osr_bits / 2, 1, 1);
+	ssd1306_set_text(92, 44, 1, "BITS", 1);
+
+	ssd1306_refresh();
+}
+
+// Starts a new RMS window, 'locked' if it begins on a rising crossing
+static void app_vm_rms_restart(uint8_t locked)
+{
+	_app_vm_rms_acc.sum = 0;
+	_app_vm_rms_acc.sum2 = 0;
+	_app_vm_rms_acc.min = INT32_MAX;
+	_app_vm_rms_acc.max = INT32_MIN;
+	_app_vm_rms_acc.count = 0;
+	_app_vm_rms_acc.periods = 0;
+	_app_vm_rms_acc.locked = locked;
+}
+
+// Turns the window sums into RMS, mean, frequency and crest factor, and
+// moves the running mean to this window's mean
+static void app_vm_rms_close(uint8_t locked)
+{
+	app_vm_rms_acc_t *acc = &_app_vm_rms_acc;
+	uint32_t n = acc->count;
+	int32_t mean, peak;
+	uint64_t var;
+
+	if (n == 0)
+	{
+		app_vm_rms_restart(locked);
+		return;
+	}
+
+	// Sum of squares about the window mean, so the result is AC only
+	mean = acc->sum / (int32_t)n;
+	var = acc->sum2 - (uint64_t)((int64_t)acc->sum * acc->sum) / n;
+	_app_vm_rms.rms = dsp_isqrt64((var << 16) / n);
+
+	peak = acc->max - mean;
+	if (mean - acc->min > peak) peak = mean - acc->min;
+
+	_app_vm_rms.crest = _app_vm_rms.rms ? (uint32_t)(((uint64_t)peak * 25600) / _app_vm_rms.rms) : 0;
+
+	// Back to input volts for the range the window was taken in
+	_app_vm_rms.rms = (uint32_t)(((uint64_t)_app_vm_rms.rms * autorange_gain_q16()) >> 16);
+	_app_vm_rms.mean = (int32_t)(((int64_t)(acc->ref + mean) * autorange_gain_q16()) >> 16);
+	_app_vm_rms.freq_dhz = (uint32_t)(((uint64_t)acc->periods * APP_VM_RMS_RATE_HZ * 10) / n);
+	_app_vm_rms.valid = 1;
+
+	acc->ref += mean;
+	acc->hyst = peak / 4;
+	if (acc->hyst < APP_VM_RMS_HYST_MIN) acc->hyst = APP_VM_RMS_HYST_MIN;
+
+	app_vm_rms_restart(locked);
+}
+
+// Integrates one DMA block into the current RMS window
+static void app_vm_rms_process(const uint16_t *buf)
+{
+	app_vm_rms_acc_t *acc = &_app_vm_rms_acc;
+
+	// A range switch drops the window, and the running mean is in the old range
+	if (autorange_block(buf, DMA_BUFFER_SIZE, 4))
+	{
+		app_vm_rms_restart(0);
+		acc->seeded = 0;
+		return;
+	}
+
+	// Start the running mean from the first block, rather than waiting a
+	// whole MAX_SAMPLES window for crossings of 0
+	if (!acc->seeded)
+	{
+		int32_t sum = 0;
+		for (uint32_t i = 0; i < DMA_BUFFER_SIZE; i++)
+		{
+			sum += buf[i] >> 4;
+		}
+		acc->ref = sum / DMA_BUFFER_SIZE;
+		acc->seeded = 1;
+	}
+
+	for (uint32_t i = 0; i < DMA_BUFFER_SIZE; i++)
+	{
+		int32_t d = (int32_t)(buf[i] >> 4) - acc->ref;
+
+		// Rising crossing of the running mean, with hysteresis
+		if (d < -acc->hyst)
+		{
+			acc->armed = 1;
+		}
+		else if (acc->armed && d >= 0)
+		{
+			acc->armed = 0;
+			if (!acc->locked)
+			{
+				app_vm_rms_restart(1);
+			}
+			else
+			{
+				acc->periods++;
+				if (acc->count >= APP_VM_RMS_MIN_SAMPLES)
+				{
+					app_vm_rms_close(1);
+				}
+			}
+		}
+
+		acc->sum += d;
+		acc->sum2 += (uint32_t)(d * d);
+		if (d < acc->min) acc->min = d;
+		if (d > acc->max) acc->max = d;
+
+		if (++acc->count >= APP_VM_RMS_MAX_SAMPLES)
+		{
+			acc->periods = 0;
+			app_vm_rms_close(0);
+		}
+	}
+}
+
+static void app_vm_render_rms(void)
+{
+	uint8_t x;
+
+	app_vm_render_range();
+	ssd1306_fill_rect(0, 20, 88, 16, 0);
+	ssd1306_fill_rect(0, 38, 128, 16, 0);
+
+	if (!_app_vm_rms.valid)
 	{
-		uint16_t v = adc_poll_read(ADC_CHANNEL);
-	    ssd1306_fill_rect(20, 20, 64, 24, 0);
-	    gfx_printdec(20, 20, (int32_t)(v*MV_PER_LSB), 3, 1);
 		ssd1306_refresh();
+		return;
+	}
+
+	// 3300mV full scale over 4096 * 256, in 0.1mV
+	gfx_printfixed(0, 20, (int32_t)(((uint64_t)_app_vm_rms.rms * 33000 + (1 << 19)) >> 20), 1, 2, 1);
+
+	ssd1306_set_text(0, 38, 1, "FREQ", 1);
+	if (_app_vm_rms.freq_dhz)
+	{
+		x = gfx_printfixed(30, 38, _app_vm_rms.freq_dhz, 1, 1, 1);
+		ssd1306_set_text(x + 3, 38, 1, "HZ", 1);
+	}
+	else
+	{
+		ssd1306_set_text(30, 38, 1, "---", 1);
+	}
+
+	ssd1306_set_text(0, 46, 1, "CF", 1);
+	gfx_printfixed(15, 46, _app_vm_rms.crest, 2, 1, 1);
+	ssd1306_set_text(64, 46, 1, "DC", 1);
+	x = gfx_printfixed(79, 46, (int32_t)(_app_vm_rms.mean * MV_PER_LSB), 0, 1, 1);
+	ssd1306_set_text(x + 3, 46, 1, "mV", 1);
+
+	ssd1306_refresh();
+}
+
+typedef struct
+{
+	uint32_t last;          // adc_dma_blocks() handled so far
+	evloop_timer_t refresh;
+} app_vm_loop_t;
+
+static void app_vm_rms_poll(void *arg)
+{
+	app_vm_loop_t *l = arg;
+	uint32_t b = adc_dma_blocks();
+
+	if (b != l->last)
+	{
+		// A gap in the samples breaks the window, start over
+		if (b - l->last > 1)
+		{
+			app_vm_rms_restart(0);
+		}
+		l->last = b;
+		app_vm_rms_process(adc_dma_get_buffer() + ((b - 1) & 1) * DMA_BUFFER_SIZE);
+	}
+}
+
+static void app_vm_rms_refresh(void *arg)
+{
+	(void)arg;
+	app_vm_render_rms();
+}
+
+static void app_vm_rms_run(void)
+{
+	app_vm_loop_t l;
+	const evloop_handlers_t h = { .poll = app_vm_rms_poll, .arg = &l };
+
+	_app_vm_rms.valid = 0;
+	_app_vm_rms_acc.seeded = 0;
+	_app_vm_rms_acc.hyst = APP_VM_RMS_HYST_MIN;
+	_app_vm_rms_acc.armed = 0;
+	app_vm_rms_restart(0);
+
+	adc_dma_start_continuous();
+	l.last = adc_dma_blocks();
+	evloop_timer_start(&l.refresh, APP_VM_REFRESH_MS, APP_VM_REFRESH_MS, app_vm_rms_refresh, 0);
+
+	/* Wait for the QEI switch to exit */
+	evloop_run(&h);
+
+	evloop_timer_stop(&l.refresh);
+	adc_dma_stop();
+}
+
+// QEI scroll = oversampling ratio, 4x per step
+static void app_vm_dc_qei(int32_t steps, void *arg)
+{
+	int32_t bits = (int32_t)_app_vm_osr_bits + 2 * steps;
+
+	(void)arg;
+
+	if (bits < 0) bits = 0;
+	if (bits > APP_VM_OSR_BITS_MAX) bits = APP_VM_OSR_BITS_MAX;
+	_app_vm_osr_bits = (uint8_t)bits;
+	app_vm_reset_filter();
+}
+
+static void app_vm_dc_poll(void *arg)
+{
+	app_vm_loop_t *l = arg;
+	uint32_t b = adc_dma_blocks();
+
+	// Catch up on the completed blocks, skipping any that were overwritten
+	if (b != l->last)
+	{
+		l->last = b;
+		app_vm_process(adc_dma_get_buffer() + ((b - 1) & 1) * DMA_BUFFER_SIZE);
+	}
+}
+
+static void app_vm_dc_refresh(void *arg)
+{
+	(void)arg;
+	app_vm_render_dc();
+}
+
+static void app_vm_dc_run(void)
+{
+	app_vm_loop_t l;
+	const evloop_handlers_t h = { .qei = app_vm_dc_qei, .poll = app_vm_dc_poll, .arg = &l };
+
+	qei_reset_step();
+	app_vm_reset_filter();
+
+	adc_dma_start_continuous();
+	l.last = adc_dma_blocks();
+	evloop_timer_start(&l.refresh, APP_VM_REFRESH_MS, APP_VM_REFRESH_MS, app_vm_dc_refresh, 0);
+
+	/* Wait for the QEI switch to exit */
+	evloop_run(&h);
+
+	evloop_timer_stop(&l.refresh);
+	adc_dma_stop();
+}
+
+void app_vm_run(void)
+{
+	app_vm_render_mode();
+	app_vm_render_screen();
+
+	if (_app_vm_mode == APP_VM_MODE_RMS)
+	{
+		app_vm_rms_run();
+	}
+	else
+	{
+		app_vm_dc_run();
 	}
 }
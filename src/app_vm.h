@@ -11,6 +11,13 @@
 #ifndef APP_VM_H_
 #define APP_VM_H_
 
+typedef enum
+{
+	APP_VM_MODE_DC = 0,		// Oversampled and filtered DC reading
+	APP_VM_MODE_RMS,		// True-RMS over whole signal periods
+	APP_VM_MODE_LAST
+} app_vm_mode_t;
+
 void app_vm_init(void);
 void app_vm_run(void);
 
@@ -11,14 +11,20 @@
 #include <string.h>
 
 #include "LPC8xx.h"
+#include "lpc_types.h"
 #include "dac.h"
 #include "gpio.h"
 
 #include "config.h"
 #include "delay.h"
+#include "evloop.h"
 #include "button.h"
 #include "qei.h"
 #include "gfx.h"
+#include "settings.h"
+#include "wave_synth.h"
+#include "crc32.h"
+#include "adc_dma.h"
 #include "app_wavegen.h"
 #include "dac_wavegen.h"
 
@@ -28,46 +34,99 @@
 // 3300mV / 1024 = 3.22265625mV per lsb
 #define APP_WAVEGEN_MAX_DAC_INPUT	(558)
 
-// Beyond about 800Hz the DAC IRQ fires too rapidly (<200 ticks)
-// and overwhelms the rest of the system at the default clock
-// speed. The clock will need to be raised to go beyond 800Hz.
-#define APP_WAVEGEN_HZ_MIN          (100)
-#define APP_WAVEGEN_HZ_MAX          (800)
+// The DAC runs in DDS mode from a fixed DAC_WAVEGEN_DDS_SAMPLE_HZ
+// sample clock, so the IRQ load no longer depends on the output
+// frequency. The upper limit keeps at least 4 samples per period.
+#define APP_WAVEGEN_HZ_MIN          (1)
+#define APP_WAVEGEN_HZ_MAX          (DAC_WAVEGEN_DDS_SAMPLE_HZ / 4)
+
+// In dual output mode both DACs are fed by DMA from one timer, the
+// limit comes from the shortest sample period the DMA can keep up with
+#define APP_WAVEGEN_DUAL_HZ_MAX     (system_ahb_clk / (DAC_WAVEGEN_DMA_SAMPLES * DAC_WAVEGEN_DMA_MIN_TICKS))
+#define APP_WAVEGEN_DUAL_PHASE_DEG  (90)    // DAC1 leads DAC0 by this much
+
+// User waveform, uploads of any length are resampled to this many points
+#define APP_WAVEGEN_USER_BITS       (10)
+#define APP_WAVEGEN_USER_LEN        (1 << APP_WAVEGEN_USER_BITS)
+
+// Binary upload, see app_wavegen_uart_read_binary()
+#define APP_WAVEGEN_UPLOAD_BAUD     (230400)
+#define APP_WAVEGEN_UPLOAD_TIMEOUT  (2000)  // ms without a byte before giving up
+#define APP_WAVEGEN_UPLOAD_FLASH    (1 << 0)
+
+
+void set_debug_uart_baud(uint32_t baud);		// Serial.c
+int getkey_timeout(uint32_t timeout_ms);		// Serial.c
+
+// Every waveform is synthesized into a RAM table that feeds the DDS
+#define APP_WAVEGEN_SYNTH_BITS      (10)
+#define APP_WAVEGEN_SYNTH_LEN       (1 << APP_WAVEGEN_SYNTH_BITS)
+
+// Both tables borrow the ADC DMA buffer, the ADC is idle in this app: the
+// synth table in the first half, the user table in the second. Uploads
+// land in the synth half and only replace the user table once complete
+// (and CRC checked), a bad upload leaves it as it was.
+#if APP_WAVEGEN_SYNTH_LEN + APP_WAVEGEN_USER_LEN > 2 * DMA_BUFFER_SIZE
+#error "The wave tables don't fit in the ADC DMA buffer"
+#endif
+#if APP_WAVEGEN_USER_LEN > APP_WAVEGEN_SYNTH_LEN
+#error "The upload scratch buffer is smaller than the user table"
+#endif
+
+// QEI steps for the live controls
+#define APP_WAVEGEN_LEVEL_STEP      (10)    // ~32 mV per detent
+#define APP_WAVEGEN_DUTY_STEP       (5)
+#define APP_WAVEGEN_DUTY_MIN        (5)
+#define APP_WAVEGEN_DUTY_MAX        (95)
+
+#define APP_WAVEGEN_SWEEP_TIME_MAX  (60)    // Seconds
 
 typedef enum
 {
 	APP_WAVEGEN_WAVE_SINE = 0,
-	APP_WAVEGEN_WAVE_TRIANGLE = 1,
-	APP_WAVEGEN_WAVE_EXPDECAY = 2,
-	APP_WAVEGEN_WAVE_USER = 3,
+	APP_WAVEGEN_WAVE_SQUARE,
+	APP_WAVEGEN_WAVE_TRIANGLE,
+	APP_WAVEGEN_WAVE_SAW,
+	APP_WAVEGEN_WAVE_NOISE,
+	APP_WAVEGEN_WAVE_EXPDECAY,
+	APP_WAVEGEN_WAVE_USER,
 	APP_WAVEGEN_WAVE_LAST
 } app_wavegen_wave_t;
 
+// What the QEI adjusts on the output screen, USER1 steps through them
+typedef enum
+{
+	APP_WAVEGEN_FIELD_WAVE = 0,
+	APP_WAVEGEN_FIELD_AMPL,
+	APP_WAVEGEN_FIELD_OFFSET,
+	APP_WAVEGEN_FIELD_PARAM,		// Duty (square) or harmonics (sine)
+	APP_WAVEGEN_FIELD_LAST
+} app_wavegen_field_t;
+
+// A config page value, see app_wavegen_config_value()
+typedef struct
+{
+	char         *unit;
+	char * const *labels;
+	uint16_t     *value;
+	uint16_t      min;
+	uint16_t      max;
+} app_wavegen_value_t;
+
 static app_wavegen_wave_t _app_wavegen_curwave = APP_WAVEGEN_WAVE_SINE;
+static app_wavegen_field_t _app_wavegen_field = APP_WAVEGEN_FIELD_WAVE;
+static uint16_t _app_wavegen_ampl = APP_WAVEGEN_MAX_DAC_INPUT;
+static uint16_t _app_wavegen_offset = APP_WAVEGEN_MAX_DAC_INPUT / 2;
+static uint8_t _app_wavegen_duty = 50;
+static uint8_t _app_wavegen_harmonics = 1;
 static uint16_t _app_wavegen_frequency_hz = 200;
 static uint8_t _app_wavegen_output_spkr = 0;
-
-static const uint16_t app_wavegen_sine_wave[64] = {
-	279, 306, 333, 360, 386, 411, 434, 456,
-	476, 495, 511, 525, 537, 546, 553, 557,
-	558, 557, 553, 546, 537, 525, 511, 495,
-	476, 456, 434, 411, 386, 360, 333, 306,
-	279, 252, 225, 198, 172, 147, 124, 102,
-	 82,  63,  47,  33,  21,  12,   5,   1,
-	   0,   1,   5,  12,  21,  33,  47,  63,
-	  82, 102, 124, 147, 172, 198, 225, 252
-};
-
-static const uint16_t app_wavegen_triangle_wave[64] = {
-	  17,  35,  52,  70,  87, 105, 122, 140,
-	 157, 174, 192, 209, 227, 244, 262, 279,
-	 296, 314, 331, 349, 366, 384, 401, 419,
-	 436, 453, 471, 488, 506, 523, 541, 558,
-	 541, 523, 506, 488, 471, 453, 436, 419,
-	 401, 384, 366, 349, 331, 314, 296, 279,
-	 262, 244, 227, 209, 192, 174, 157, 140,
-	 122, 105,  87,  70,  52,  35,  17,   0
-};
+static uint8_t _app_wavegen_output_dual = 0;
+static uint8_t _app_wavegen_sweep = 0;
+static uint16_t _app_wavegen_sweep_start_hz = 20;
+static uint16_t _app_wavegen_sweep_stop_hz = 5000;
+static uint16_t _app_wavegen_sweep_time_s = 10;
+static uint16_t _app_wavegen_sweep_log = 1;
 
 static const uint16_t app_wavegen_expdecay_wave[64] = {
 	   0,  34,  66,  95, 123, 150, 174, 198,
@@ -80,22 +139,97 @@ static const uint16_t app_wavegen_expdecay_wave[64] = {
 	 541, 542, 543, 544, 545, 546, 546, 547
 };
 
-static uint16_t app_wavegen_user_wave[64] = {
-	0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,
-	0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,
-	0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,
-	0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,
-	0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,
-	0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,
-	0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000,
-	0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000, 0x000
-};
+// User table, always held expanded to APP_WAVEGEN_USER_LEN points so it
+// can drive the DDS directly (word aligned for the IAP copy). Reloaded
+// from flash each time the app starts, see app_wavegen_init().
+static uint16_t *app_wavegen_user_wave;
+
+static uint16_t *app_wavegen_synth_wave;
+static uint16_t app_wavegen_preview[64];
+
+// Resamples the first 'count' entries of the user table to the full
+// APP_WAVEGEN_USER_LEN points (linear interpolation). Runs backwards
+// since the source index never passes the destination index, so no
+// second buffer is needed.
+static void app_wavegen_user_expand(uint16_t count)
+{
+	if (count >= 2 && count < APP_WAVEGEN_USER_LEN)
+	{
+		for (int32_t i = APP_WAVEGEN_USER_LEN - 1; i >= 0; i--)
+		{
+			// Source position in 24.8 fixed point
+			uint32_t pos = ((uint32_t)i * count << 8) / APP_WAVEGEN_USER_LEN;
+			uint32_t idx = pos >> 8;
+			uint32_t frac = pos & 0xFF;
+			uint32_t a = app_wavegen_user_wave[idx];
+			uint32_t b = app_wavegen_user_wave[(idx + 1) % count];
+
+			app_wavegen_user_wave[i] = (uint16_t)((a * (256 - frac) + b * frac) >> 8);
+		}
+	}
+}
+
+// Restores the waveform and frequency, or seeds the store with the defaults
+void app_wavegen_load_settings(void)
+{
+	if (!settings_loaded())
+	{
+		app_wavegen_save_settings();
+		return;
+	}
+
+	if (_settings.wavegen_hz >= APP_WAVEGEN_HZ_MIN && _settings.wavegen_hz <= APP_WAVEGEN_HZ_MAX)
+	{
+		_app_wavegen_frequency_hz = _settings.wavegen_hz;
+	}
+	if (_settings.wavegen_wave < APP_WAVEGEN_WAVE_LAST)
+	{
+		_app_wavegen_curwave = (app_wavegen_wave_t)_settings.wavegen_wave;
+	}
+	if (_settings.wavegen_ampl <= APP_WAVEGEN_MAX_DAC_INPUT && _settings.wavegen_offset <= APP_WAVEGEN_MAX_DAC_INPUT)
+	{
+		_app_wavegen_ampl = _settings.wavegen_ampl;
+		_app_wavegen_offset = _settings.wavegen_offset;
+	}
+	if (_settings.wavegen_duty >= APP_WAVEGEN_DUTY_MIN && _settings.wavegen_duty <= APP_WAVEGEN_DUTY_MAX)
+	{
+		_app_wavegen_duty = _settings.wavegen_duty;
+	}
+	if (_settings.wavegen_harmonics >= 1 && _settings.wavegen_harmonics <= WAVE_SYNTH_MAX_HARMONICS)
+	{
+		_app_wavegen_harmonics = _settings.wavegen_harmonics;
+	}
+}
+
+void app_wavegen_save_settings(void)
+{
+	_settings.wavegen_hz = _app_wavegen_frequency_hz;
+	_settings.wavegen_wave = (uint8_t)_app_wavegen_curwave;
+	_settings.wavegen_ampl = _app_wavegen_ampl;
+	_settings.wavegen_offset = _app_wavegen_offset;
+	_settings.wavegen_duty = _app_wavegen_duty;
+	_settings.wavegen_harmonics = _app_wavegen_harmonics;
+}
 
 void app_wavegen_init(void)
 {
   ssd1306_clear();
   ssd1306_refresh();
   dac_wavegen_init(WAVEGEN_DAC);
+
+  // Other apps have had the ADC buffer since, bring the user table back
+  const uint16_t *wave = settings_wave();
+
+  app_wavegen_synth_wave = adc_dma_get_buffer();
+  app_wavegen_user_wave = app_wavegen_synth_wave + APP_WAVEGEN_SYNTH_LEN;
+  if (wave && _settings.wavegen_user_len == APP_WAVEGEN_USER_LEN)
+  {
+	  memcpy(app_wavegen_user_wave, wave, APP_WAVEGEN_USER_LEN * sizeof(uint16_t));
+  }
+  else
+  {
+	  memset(app_wavegen_user_wave, 0, APP_WAVEGEN_USER_LEN * sizeof(uint16_t));
+  }
 }
 
 void app_wavegen_uart_help_msg(void)
@@ -106,8 +240,114 @@ void app_wavegen_uart_help_msg(void)
 		   "  values in decimal format (0..1023\\r).\n\r" \
 		   "- An 'OK[<samplenum>=<value>]\\n\\r' string will be sent after each\n\r" \
 		   "  valid sample, and at the end of the sequence a 'DONE\\n\\r' message\n\r" \
-		   "  will be sent, and the user waveform will be persisted to EEPROM.\n\r" \
-		   "- 'ERROR: *\\n\\r' at any time indicates a failure.\n\r");
+		   "  will be sent, and the user waveform will be persisted to flash.\n\r" \
+		   "- 'ERROR: *\\n\\r' at any time indicates a failure.\n\r" \
+		   "- Send 'B' to switch to the binary upload used by wave_upload.\n\r");
+}
+
+// Reads 'len' raw bytes from the UART, returns -1 on timeout
+static int app_wavegen_uart_read_bytes(uint8_t *buf, uint16_t len)
+{
+	while (len--)
+	{
+		int32_t c = getkey_timeout(APP_WAVEGEN_UPLOAD_TIMEOUT);
+		if (c < 0) return -1;
+		*buf++ = (uint8_t)c;
+	}
+
+	return 0;
+}
+
+// Receives and checks one binary frame, returns NULL or an error string
+static const char* app_wavegen_uart_read_frame(uint16_t *count, uint16_t *clipped)
+{
+	uint8_t hdr[6];
+	uint8_t b[4];
+	uint16_t *dst = app_wavegen_synth_wave;
+
+	if (app_wavegen_uart_read_bytes(hdr, sizeof(hdr))) return "Timeout";
+
+	*count = hdr[2] | (hdr[3] << 8);
+	if (hdr[0] != 'W' || hdr[1] != 'B' || *count < 2 || *count > APP_WAVEGEN_USER_LEN)
+	{
+		return "Bad header";
+	}
+
+	crc32_start();
+	crc32_update(hdr, sizeof(hdr));
+
+	for (uint16_t i = 0; i < *count; i++)
+	{
+		if (app_wavegen_uart_read_bytes(b, 2)) return "Timeout";
+		crc32_update(b, 2);
+		dst[i] = b[0] | (b[1] << 8);
+	}
+
+	if (app_wavegen_uart_read_bytes(b, 4)) return "Timeout";
+	if (crc32_sum() != (b[0] | (b[1] << 8) | (b[2] << 16) | ((uint32_t)b[3] << 24)))
+	{
+		return "CRC mismatch";
+	}
+
+	// Into the table, clipping to the DAC limit
+	*clipped = 0;
+	for (uint16_t i = 0; i < *count; i++)
+	{
+		uint16_t v = dst[i];
+		if (v > APP_WAVEGEN_MAX_DAC_INPUT)
+		{
+			v = APP_WAVEGEN_MAX_DAC_INPUT;
+			(*clipped)++;
+		}
+		app_wavegen_user_wave[i] = v;
+	}
+	app_wavegen_user_expand(*count);
+
+	if ((hdr[4] & APP_WAVEGEN_UPLOAD_FLASH) &&
+		settings_save_wave(app_wavegen_user_wave, APP_WAVEGEN_USER_LEN))
+	{
+		return "Flash write failed";
+	}
+
+	return NULL;
+}
+
+/**
+ * Binary user waveform upload, entered with 'B' from the text prompt.
+ *
+ * The UART switches to APP_WAVEGEN_UPLOAD_BAUD after the "BINARY <baud>"
+ * reply and expects a single little-endian frame:
+ *
+ *   'W' 'B' <count:u16> <flags:u8> <reserved:u8>
+ *   <count x sample:u16>
+ *   <crc:u32>   CRC-32 (zlib) over everything before it
+ *
+ * count is 2..APP_WAVEGEN_USER_LEN, samples are 10-bit and get clipped to
+ * APP_WAVEGEN_MAX_DAC_INPUT. Flag APP_WAVEGEN_UPLOAD_FLASH also persists
+ * the table. The reply ("OK <count> <clipped>" or "ERROR: *") is sent at
+ * the high baud rate, then the UART drops back to the default rate.
+ */
+static int app_wavegen_uart_read_binary(void)
+{
+	uint16_t count = 0, clipped = 0;
+	const char *err;
+
+	printf("BINARY %d\n\r", APP_WAVEGEN_UPLOAD_BAUD);
+	set_debug_uart_baud(APP_WAVEGEN_UPLOAD_BAUD);
+
+	err = app_wavegen_uart_read_frame(&count, &clipped);
+	if (err)
+	{
+		printf("ERROR: %s\n\r", err);
+	}
+	else
+	{
+		printf("OK %d %d\n\r", count, clipped);
+	}
+
+	set_debug_uart_baud(0);
+
+	return err ? -1 : 0;
 }
 
 void app_wavegen_uart_read_waveform(void)
@@ -115,6 +355,7 @@ void app_wavegen_uart_read_waveform(void)
 	char ch;
 	int i;
 	uint16_t count;
+	uint16_t *dst = app_wavegen_synth_wave;
 
 	ch = i = count = 0;
 
@@ -138,6 +379,12 @@ void app_wavegen_uart_read_waveform(void)
 				app_wavegen_uart_help_msg();
 				return;
 			}
+			// Switch to the binary protocol on 'B'
+			if (ch == 'B' && count == 0)
+			{
+				app_wavegen_uart_read_binary();
+				return;
+			}
 			// Parse integers ... this will also eat any non numeric characters
 			if (ch <= '9' && ch >= '0')
 			{
@@ -160,8 +407,8 @@ void app_wavegen_uart_read_waveform(void)
 			i = APP_WAVEGEN_MAX_DAC_INPUT;
 		}
 
-		// Add the new value to the user waveform
-		app_wavegen_user_wave[count] = (uint16_t)i;
+		// Add the new value to the upload
+		dst[count] = (uint16_t)i;
 		printf("OK[%d=%d]\n\r", count+1, i);
 
 		// Reset the integer placeholder
@@ -169,7 +416,13 @@ void app_wavegen_uart_read_waveform(void)
 
 		if (count == 63)
 		{
-			// ToDo: Persist user waveform to EEPROM!
+			memcpy(app_wavegen_user_wave, dst, 64 * sizeof(uint16_t));
+			app_wavegen_user_expand(64);
+			if (settings_save_wave(app_wavegen_user_wave, APP_WAVEGEN_USER_LEN))
+			{
+				printf("ERROR: Flash write failed\n\r");
+				return;
+			}
 			printf("DONE\n\r");
 		}
 
@@ -191,6 +444,7 @@ void app_wavegen_render_upload(void)
     ssd1306_set_text(0, 20, 1, "8N1 AND SEND 64 10-BIT", 1);
     ssd1306_set_text(0, 28, 1, "SAMPLES USING DECIMAL", 1);
     ssd1306_set_text(0, 36, 1, "VALUES (0..1023).", 1);
+    ssd1306_set_text(0, 44, 1, "OR USE WAVE_UPLOAD.", 1);
 
 	// Render the bottom button options
     ssd1306_set_text(16, 55, 1, "CLICK FOR MAIN MENU", 1);
@@ -199,8 +453,104 @@ void app_wavegen_render_upload(void)
 	ssd1306_refresh();
 }
 
-void app_wavegen_render_setup(void)
+// Synthesizes the current waveform into the DDS table and its preview.
+// Fast enough to be called on every QEI detent.
+static void app_wavegen_synth(void)
 {
+  wave_synth_cfg_t cfg =
+  {
+      .type = WAVE_SYNTH_SINE,
+      .duty = _app_wavegen_duty,
+      .harmonics = _app_wavegen_harmonics,
+      .amplitude = _app_wavegen_ampl,
+      .offset = _app_wavegen_offset,
+      .limit = APP_WAVEGEN_MAX_DAC_INPUT,
+      .table_max = APP_WAVEGEN_MAX_DAC_INPUT
+  };
+
+  switch(_app_wavegen_curwave)
+  {
+	  case APP_WAVEGEN_WAVE_LAST:
+	  case APP_WAVEGEN_WAVE_SINE:
+		  cfg.type = WAVE_SYNTH_SINE;
+		  break;
+	  case APP_WAVEGEN_WAVE_SQUARE:
+		  cfg.type = WAVE_SYNTH_SQUARE;
+		  break;
+	  case APP_WAVEGEN_WAVE_TRIANGLE:
+		  cfg.type = WAVE_SYNTH_TRIANGLE;
+		  break;
+	  case APP_WAVEGEN_WAVE_SAW:
+		  cfg.type = WAVE_SYNTH_SAW;
+		  break;
+	  case APP_WAVEGEN_WAVE_NOISE:
+		  cfg.type = WAVE_SYNTH_NOISE;
+		  break;
+	  case APP_WAVEGEN_WAVE_EXPDECAY:
+		  cfg.type = WAVE_SYNTH_TABLE;
+		  cfg.table = app_wavegen_expdecay_wave;
+		  cfg.table_bits = 6;
+		  break;
+	  case APP_WAVEGEN_WAVE_USER:
+		  cfg.type = WAVE_SYNTH_TABLE;
+		  cfg.table = app_wavegen_user_wave;
+		  cfg.table_bits = APP_WAVEGEN_USER_BITS;
+		  break;
+  }
+
+  wave_synth_render(app_wavegen_synth_wave, APP_WAVEGEN_SYNTH_BITS, &cfg);
+
+  for (uint8_t i = 0; i < 64; i++)
+  {
+	  app_wavegen_preview[i] = app_wavegen_synth_wave[i * (APP_WAVEGEN_SYNTH_LEN / 64)];
+  }
+}
+
+// (Re)starts the output from the synth table
+static void app_wavegen_start(void)
+{
+  if (_app_wavegen_output_dual)
+  {
+	  // Same waveform on both DACs, DAC1 phase shifted
+	  dac_wavegen_chcfg_t cfg[2] = {
+		  { app_wavegen_synth_wave, APP_WAVEGEN_SYNTH_LEN, 256, 0 },
+		  { app_wavegen_synth_wave, APP_WAVEGEN_SYNTH_LEN, 256, APP_WAVEGEN_DUAL_PHASE_DEG },
+	  };
+	  dac_wavegen_dual_run(cfg, _app_wavegen_frequency_hz);
+  }
+  else if (_app_wavegen_sweep)
+  {
+	  // Stepped from the DAC IRQ, phase continuous
+	  dac_wavegen_sweep_run(WAVEGEN_DAC, app_wavegen_synth_wave, APP_WAVEGEN_SYNTH_BITS,
+	                        _app_wavegen_sweep_start_hz * 1000, _app_wavegen_sweep_stop_hz * 1000,
+	                        _app_wavegen_sweep_time_s * 1000,
+	                        DAC_WAVEGEN_SWEEP_REPEAT | (_app_wavegen_sweep_log ? DAC_WAVEGEN_SWEEP_LOG : 0));
+  }
+  else
+  {
+	  dac_wavegen_dds_run(WAVEGEN_DAC, app_wavegen_synth_wave, APP_WAVEGEN_SYNTH_BITS, _app_wavegen_frequency_hz * 1000);
+  }
+}
+
+static void app_wavegen_render_mv(uint8_t y, char *label, uint16_t lsb)
+{
+  uint32_t mv = ((uint32_t)lsb * 3300) / 1024;
+
+  ssd1306_set_text(70, y, 1, label, 1);
+  gfx_printdec(88, y, (int32_t)mv, 1, 1);
+  ssd1306_set_text(88+(gfx_num_digits(mv)*6), y, 1, "mV", 1);
+}
+
+// Renders the preview and the labels on the right, with a marker on
+// the field the QEI currently adjusts
+static void app_wavegen_render_params(void)
+{
+  static char * const names[APP_WAVEGEN_WAVE_LAST] =
+  {
+      "WFRM SINE", "WFRM SQR", "WFRM TRIA", "WFRM SAW", "WFRM NOIS", "WFRM EXPO", "WFRM USER"
+  };
+  static const uint8_t marker_y[APP_WAVEGEN_FIELD_LAST] = { 16, 32, 40, 48 };
+
   gfx_graticule_cfg_t grcfg =
   {
       .w = 64,			// 64 pixels wide
@@ -210,6 +560,64 @@ void app_wavegen_render_setup(void)
       .block_spacing = 8	// Each block is 8x8 pixels
   };
 
+  ssd1306_fill_rect(0, 12, 128, 43, 0);
+
+  // Render the graticule and waveform
+  gfx_graticule(0, 16, &grcfg, 1);
+  gfx_waveform_64_32_10bit(0, 16, 1, app_wavegen_preview, 0, sizeof(app_wavegen_preview) / 2, 0, 0);
+
+  // Render some labels
+  ssd1306_set_text(70, 16, 1, names[_app_wavegen_curwave < APP_WAVEGEN_WAVE_LAST ? _app_wavegen_curwave : 0], 1);
+  if (_app_wavegen_sweep)
+  {
+	  ssd1306_set_text(70, 24, 1, _app_wavegen_sweep_log ? "SWP LOG" : "SWP LIN", 1);
+	  gfx_printdec(112, 24, _app_wavegen_sweep_time_s, 1, 1);
+	  ssd1306_set_text(112+(gfx_num_digits(_app_wavegen_sweep_time_s)*6), 24, 1, "s", 1);
+  }
+  else
+  {
+	  ssd1306_set_text(70, 24, 1, "FREQ", 1);
+	  gfx_printdec(94, 24, _app_wavegen_frequency_hz, 1, 1);
+	  ssd1306_set_text(94+(gfx_num_digits(_app_wavegen_frequency_hz)*6), 24, 1, "Hz", 1);
+  }
+  app_wavegen_render_mv(32, "AMP", _app_wavegen_ampl);
+  app_wavegen_render_mv(40, "OFS", _app_wavegen_offset);
+
+  if (_app_wavegen_curwave == APP_WAVEGEN_WAVE_SQUARE)
+  {
+	  ssd1306_set_text(70, 48, 1, "DTY", 1);
+	  gfx_printdec(88, 48, _app_wavegen_duty, 1, 1);
+	  ssd1306_set_text(88+(gfx_num_digits(_app_wavegen_duty)*6), 48, 1, "%", 1);
+  }
+  else if (_app_wavegen_curwave == APP_WAVEGEN_WAVE_SINE)
+  {
+	  ssd1306_set_text(70, 48, 1, "HRM", 1);
+	  gfx_printdec(88, 48, _app_wavegen_harmonics, 1, 1);
+  }
+  else if (_app_wavegen_output_dual)
+  {
+	  ssd1306_set_text(70, 48, 1, "DUAL +90", 1);
+  }
+  else
+  {
+	  ssd1306_set_text(70, 48, 1, _app_wavegen_output_spkr ? "SPKR OUT" : "DAC1 OUT", 1);
+  }
+
+  // Selected field marker
+  uint8_t y = marker_y[_app_wavegen_field] + 3;
+  ssd1306_set_pixel(66, y-2, 1);
+  ssd1306_set_pixel(66, y-1, 1);
+  ssd1306_set_pixel(66, y, 1);
+  ssd1306_set_pixel(66, y+1, 1);
+  ssd1306_set_pixel(66, y+2, 1);
+  ssd1306_set_pixel(67, y-1, 1);
+  ssd1306_set_pixel(67, y, 1);
+  ssd1306_set_pixel(67, y+1, 1);
+  ssd1306_set_pixel(68, y, 1);
+}
+
+void app_wavegen_render_setup(void)
+{
   //ssd1306_init();
   ssd1306_clear();
 
@@ -218,49 +626,108 @@ void app_wavegen_render_setup(void)
   ssd1306_set_text(127 - 60, 0, 1, "DAC WAVEGEN", 1);
   ssd1306_set_text(16, 55, 1, "CLICK FOR MAIN MENU", 1);
 
-  // Render the graticule and waveform
-  gfx_graticule(0, 16, &grcfg, 1);
+  app_wavegen_synth();
+  app_wavegen_start();
+  app_wavegen_render_params();
 
-  // Render a waveform
-  switch(_app_wavegen_curwave)
+  ssd1306_refresh();
+}
+
+// Applies a QEI delta to the selected field, clamping to the DAC range
+static void app_wavegen_adjust(int32_t delta)
+{
+  int32_t v;
+
+  switch (_app_wavegen_field)
   {
-  	  case APP_WAVEGEN_WAVE_LAST:
-	  case APP_WAVEGEN_WAVE_SINE:
-		  gfx_waveform_64_32_10bit(0, 16, 1, app_wavegen_sine_wave, 0, sizeof(app_wavegen_sine_wave) / 2, 0, 0);
-		  dac_wavegen_run(WAVEGEN_DAC, app_wavegen_sine_wave, sizeof(app_wavegen_sine_wave)/2, _app_wavegen_frequency_hz);
-		  ssd1306_set_text(70, 16, 1, "WFRM SINE", 1);
+	  case APP_WAVEGEN_FIELD_WAVE:
+	  case APP_WAVEGEN_FIELD_LAST:
+		  v = (int32_t)_app_wavegen_curwave + delta;
+		  if (v >= APP_WAVEGEN_WAVE_LAST) v = APP_WAVEGEN_WAVE_SINE;
+		  if (v < 0) v = APP_WAVEGEN_WAVE_LAST - 1;
+		  _app_wavegen_curwave = (app_wavegen_wave_t)v;
 		  break;
-	  case APP_WAVEGEN_WAVE_TRIANGLE:
-		  gfx_waveform_64_32_10bit(0, 16, 1, app_wavegen_triangle_wave, 0, sizeof(app_wavegen_triangle_wave) / 2, 0, 0);
-		  dac_wavegen_run(WAVEGEN_DAC, app_wavegen_triangle_wave, sizeof(app_wavegen_triangle_wave)/2, _app_wavegen_frequency_hz);
-		  ssd1306_set_text(70, 16, 1, "WFRM TRIA", 1);
+	  case APP_WAVEGEN_FIELD_AMPL:
+		  v = (int32_t)_app_wavegen_ampl + delta * APP_WAVEGEN_LEVEL_STEP;
+		  if (v < 0) v = 0;
+		  if (v > APP_WAVEGEN_MAX_DAC_INPUT) v = APP_WAVEGEN_MAX_DAC_INPUT;
+		  _app_wavegen_ampl = (uint16_t)v;
 		  break;
-	  case APP_WAVEGEN_WAVE_EXPDECAY:
-		  gfx_waveform_64_32_10bit(0, 16, 1, app_wavegen_expdecay_wave, 0, sizeof(app_wavegen_expdecay_wave) / 2, 0, 0);
-		  dac_wavegen_run(WAVEGEN_DAC, app_wavegen_expdecay_wave, sizeof(app_wavegen_expdecay_wave)/2, _app_wavegen_frequency_hz);
-		  ssd1306_set_text(70, 16, 1, "WFRM EXPO", 1);
+	  case APP_WAVEGEN_FIELD_OFFSET:
+		  v = (int32_t)_app_wavegen_offset + delta * APP_WAVEGEN_LEVEL_STEP;
+		  if (v < 0) v = 0;
+		  if (v > APP_WAVEGEN_MAX_DAC_INPUT) v = APP_WAVEGEN_MAX_DAC_INPUT;
+		  _app_wavegen_offset = (uint16_t)v;
 		  break;
-	  case APP_WAVEGEN_WAVE_USER:
-		  gfx_waveform_64_32_10bit(0, 16, 1, app_wavegen_user_wave, 0, sizeof(app_wavegen_user_wave) / 2, 0, 0);
-		  dac_wavegen_run(WAVEGEN_DAC, app_wavegen_user_wave, sizeof(app_wavegen_user_wave)/2, _app_wavegen_frequency_hz);
-		  ssd1306_set_text(70, 16, 1, "WFRM USER", 1);
+	  case APP_WAVEGEN_FIELD_PARAM:
+		  if (_app_wavegen_curwave == APP_WAVEGEN_WAVE_SQUARE)
+		  {
+			  v = (int32_t)_app_wavegen_duty + delta * APP_WAVEGEN_DUTY_STEP;
+			  if (v < APP_WAVEGEN_DUTY_MIN) v = APP_WAVEGEN_DUTY_MIN;
+			  if (v > APP_WAVEGEN_DUTY_MAX) v = APP_WAVEGEN_DUTY_MAX;
+			  _app_wavegen_duty = (uint8_t)v;
+		  }
+		  else
+		  {
+			  v = (int32_t)_app_wavegen_harmonics + delta;
+			  if (v < 1) v = 1;
+			  if (v > WAVE_SYNTH_MAX_HARMONICS) v = WAVE_SYNTH_MAX_HARMONICS;
+			  _app_wavegen_harmonics = (uint8_t)v;
+		  }
 		  break;
   }
+}
 
-  // Render some labels
-  ssd1306_set_text(70, 24, 1, "FREQ", 1);
-  gfx_printdec(94, 24, _app_wavegen_frequency_hz, 1, 1);
-  ssd1306_set_text(94+(gfx_num_digits(_app_wavegen_frequency_hz)*6), 24, 1, "Hz", 1);
-  ssd1306_set_text(70, 32, 1, "AMPL 1.8 V", 1);
-  ssd1306_set_text(70, 40, 1, _app_wavegen_output_spkr ? "SPKR OUT" : "DAC1 OUT", 1);
+static void app_wavegen_render_value(const app_wavegen_value_t *c)
+{
+	ssd1306_fill_rect(0, 24, 128, 31, 0);
+	if (c->labels)
+	{
+		ssd1306_set_text(40, 24, 1, c->labels[*c->value], 2);
+	}
+	else
+	{
+		gfx_printdec(40, 24, (int32_t)*c->value, 2, 1);
+		ssd1306_set_text(40, 24, 1, c->unit, 2);
+	}
+	ssd1306_refresh();
+}
 
-  ssd1306_refresh();
+static void app_wavegen_value_qei(int32_t steps, void *arg)
+{
+	app_wavegen_value_t *c = arg;
+
+	// Numbers follow the knob's speed, picking a label doesn't
+	int32_t fast = qei_accel_step();
+	int32_t v = (int32_t)*c->value + (c->labels ? steps : fast);
+	if (v < c->min)
+	{
+		// Stop at the bottom, then roll under to the top value
+		v = (*c->value == c->min) ? c->max : c->min;
+	}
+	if (v > c->max)
+	{
+		// Stop at the top, then roll over to the low value
+		v = (*c->value == c->max) ? c->min : c->max;
+	}
+	*c->value = (uint16_t)v;
+
+	app_wavegen_render_value(c);
 }
 
-void app_wavegen_config_set_hz(void)
+// Generic config page: the QEI scrolls 'value' between min and max
+// (rolling over at the ends), shown as a number with 'unit', or as
+// labels[value] when labels are given
+static void app_wavegen_config_value(char *title, char *unit, char * const *labels,
+                                     uint16_t *value, uint16_t min, uint16_t max)
 {
+	app_wavegen_value_t c = { unit, labels, value, min, max };
+	const evloop_handlers_t h = { .qei = app_wavegen_value_qei, .arg = &c };
+
+	if (*value < min) *value = min;
+	if (*value > max) *value = max;
+
 	// Reset the QEI encoder position counter
-	int32_t last_position_qei = 0;
 	qei_reset_step();
 
 	ssd1306_clear();
@@ -270,61 +737,91 @@ void app_wavegen_config_set_hz(void)
 	ssd1306_set_text(127 - 60, 0, 1, "DAC WAVEGEN", 1);
 	ssd1306_set_text(15, 55, 1, "SELECT TO CONTINUE", 1);
 
-	ssd1306_set_text(0, 12, 1, "SET OUTPUT FREQUENCY (Hz)", 1);
-	gfx_printdec(40, 24, (int32_t)_app_wavegen_frequency_hz, 2, 1);
-    ssd1306_set_text(40, 24, 1, "     Hz", 2);
+	ssd1306_set_text(0, 12, 1, title, 1);
+	app_wavegen_render_value(&c);
+
+	// Wait for the button to accept the value
+	evloop_run(&h);
+}
 
+void app_wavegen_config_set_hz(void)
+{
+	uint16_t hz_max = _app_wavegen_output_dual ? APP_WAVEGEN_DUAL_HZ_MAX : APP_WAVEGEN_HZ_MAX;
+
+	app_wavegen_config_value("SET OUTPUT FREQUENCY (Hz)", "     Hz", NULL,
+	                         &_app_wavegen_frequency_hz, APP_WAVEGEN_HZ_MIN, hz_max);
+}
+
+void app_wavegen_config_sweep(void)
+{
+	static char * const modes[] = { "LINEAR", "LOG" };
+
+	app_wavegen_config_value("SWEEP START FREQ (Hz)", "     Hz", NULL,
+	                         &_app_wavegen_sweep_start_hz, APP_WAVEGEN_HZ_MIN, APP_WAVEGEN_HZ_MAX);
+	app_wavegen_config_value("SWEEP STOP FREQ (Hz)", "     Hz", NULL,
+	                         &_app_wavegen_sweep_stop_hz, APP_WAVEGEN_HZ_MIN, APP_WAVEGEN_HZ_MAX);
+	app_wavegen_config_value("SWEEP TIME (s)", "     s", NULL,
+	                         &_app_wavegen_sweep_time_s, 1, APP_WAVEGEN_SWEEP_TIME_MAX);
+	app_wavegen_config_value("SWEEP MODE", NULL, modes,
+	                         &_app_wavegen_sweep_log, 0, 1);
+}
+
+// Config menu rows
+enum
+{
+	APP_WAVEGEN_CONFIG_DACOUT = 0,
+	APP_WAVEGEN_CONFIG_SPKROUT,
+	APP_WAVEGEN_CONFIG_DUALOUT,
+	APP_WAVEGEN_CONFIG_SWEEP,
+	APP_WAVEGEN_CONFIG_USER,
+	APP_WAVEGEN_CONFIG_CANCEL,
+	APP_WAVEGEN_CONFIG_LAST,
+};
+
+// Draws the menu selection indicator next to row 'selected'
+static void app_wavegen_render_indicator(int32_t selected)
+{
+	uint8_t y = ((selected + 2) * 8) -2;
+
+	ssd1306_fill_rect(4, 12, 3, 52, 0);
+	ssd1306_set_pixel(6, y, 1);
+	ssd1306_set_pixel(5, y-1, 1);
+	ssd1306_set_pixel(5, y, 1);
+	ssd1306_set_pixel(5, y+1, 1);
+	ssd1306_set_pixel(4, y-2, 1);
+	ssd1306_set_pixel(4, y-1, 1);
+	ssd1306_set_pixel(4, y, 1);
+	ssd1306_set_pixel(4, y+1, 1);
+	ssd1306_set_pixel(4, y+2, 1);
 	ssd1306_refresh();
+}
 
-    // Wait for the button to execute the selected sub-app
-	while (!(button_pressed() &  ( 1 << QEI_SW_PIN)))
-    {
-		// Check for a scroll request on the QEI
-		int32_t abs = qei_abs_step();
-		if (abs != last_position_qei)
-		{
-			_app_wavegen_frequency_hz += qei_offset_step();
-			if (_app_wavegen_frequency_hz < APP_WAVEGEN_HZ_MIN)
-			{
-				// Roll under to the top value
-				_app_wavegen_frequency_hz = APP_WAVEGEN_HZ_MAX;
-			}
-			if (_app_wavegen_frequency_hz > APP_WAVEGEN_HZ_MAX)
-			{
-				// Roll over to the low value
-				_app_wavegen_frequency_hz = APP_WAVEGEN_HZ_MIN;
-			}
-			ssd1306_fill_rect(0, 24, 128, 31, 0);
-			gfx_printdec(40, 24, (int32_t)_app_wavegen_frequency_hz, 2, 1);
-		    ssd1306_set_text(40, 24, 1, "     Hz", 2);
-			ssd1306_refresh();
-			// Track the position
-			last_position_qei = abs;
-		}
-    }
+static void app_wavegen_config_qei(int32_t steps, void *arg)
+{
+	int32_t *menu_selected = arg;
 
-	// Wait for the button to release
-	while ((button_pressed() &  ( 1 << QEI_SW_PIN)))
+	*menu_selected += steps;
+
+	if (*menu_selected < 0)
+	{
+		*menu_selected = APP_WAVEGEN_CONFIG_LAST - 1;
+	}
+	if (*menu_selected >= APP_WAVEGEN_CONFIG_LAST)
 	{
-		delay_ms(10);
+		// Roll back to the first menu item
+		*menu_selected = 0;
 	}
+
+	// Update the display
+	app_wavegen_render_indicator(*menu_selected);
 }
 
 int32_t app_wavegen_config_screen(void)
 {
-	enum
-	{
-		APP_WAVEGEN_CONFIG_DACOUT = 0,
-		APP_WAVEGEN_CONFIG_SPKROUT,
-		APP_WAVEGEN_CONFIG_USER,
-		APP_WAVEGEN_CONFIG_CANCEL,
-		APP_WAVEGEN_CONFIG_LAST,
-	};
-
 	int32_t menu_selected = APP_WAVEGEN_CONFIG_DACOUT;
+	const evloop_handlers_t h = { .qei = app_wavegen_config_qei, .arg = &menu_selected };
 
 	// Reset the QEI encoder position counter
-	int32_t last_position_qei = 0;
 	qei_reset_step();
 
 	ssd1306_clear();
@@ -332,77 +829,47 @@ int32_t app_wavegen_config_screen(void)
 	// Render the title bars
 	ssd1306_set_text(0, 0, 1, "LPC SAKEE", 1);
 	ssd1306_set_text(127 - 60, 0, 1, "DAC WAVEGEN", 1);
-	ssd1306_set_text(15, 55, 1, "SELECT TO CONTINUE", 1);
-
 	// Render the config menu options
     ssd1306_set_text(10, 12, 1, "START W/DAC0 OUT", 1);
     ssd1306_set_text(10, 20, 1, "START W/SPEAKER OUT", 1);
-    ssd1306_set_text(10, 28, 1, "UPLOAD USER WAVEFORM", 1);
-    ssd1306_set_text(10, 36, 1, "CANCEL", 1);
+    ssd1306_set_text(10, 28, 1, "START W/DUAL DAC OUT", 1);
+    ssd1306_set_text(10, 36, 1, "START FREQ SWEEP", 1);
+    ssd1306_set_text(10, 44, 1, "UPLOAD USER WAVEFORM", 1);
+    ssd1306_set_text(10, 52, 1, "CANCEL", 1);
 
     // Draw the initial selection indicator
-    uint8_t y = ((menu_selected + 2) * 8) -2;
-    ssd1306_set_pixel(6, y, 1);
-    ssd1306_set_pixel(5, y-1, 1);
-    ssd1306_set_pixel(5, y, 1);
-    ssd1306_set_pixel(5, y+1, 1);
-    ssd1306_set_pixel(4, y-2, 1);
-    ssd1306_set_pixel(4, y-1, 1);
-    ssd1306_set_pixel(4, y, 1);
-    ssd1306_set_pixel(4, y+1, 1);
-    ssd1306_set_pixel(4, y+2, 1);
-
-	ssd1306_refresh();
+	app_wavegen_render_indicator(menu_selected);
 
     // Wait for the button to execute the selected sub-app
-	while (!(button_pressed() &  ( 1 << QEI_SW_PIN)))
-    {
-		// Check for a scroll request on the QEI
-		int32_t abs = qei_abs_step();
-		if (abs != last_position_qei)
-		{
-			menu_selected += qei_offset_step();
-
-			if (menu_selected < 0)
-			{
-				menu_selected = APP_WAVEGEN_CONFIG_LAST - 1;
-			}
-			if (menu_selected >= APP_WAVEGEN_CONFIG_LAST)
-			{
-				// Roll back to the first menu item
-				menu_selected = 0;
-			}
-
-			// Track the position
-			last_position_qei = abs;
-
-			// Update the display
-			ssd1306_fill_rect(4, 12, 3, 52, 0);
-		    y = ((menu_selected + 2) * 8) -2;
-		    ssd1306_set_pixel(6, y, 1);
-		    ssd1306_set_pixel(5, y-1, 1);
-		    ssd1306_set_pixel(5, y, 1);
-		    ssd1306_set_pixel(5, y+1, 1);
-		    ssd1306_set_pixel(4, y-2, 1);
-		    ssd1306_set_pixel(4, y-1, 1);
-		    ssd1306_set_pixel(4, y, 1);
-		    ssd1306_set_pixel(4, y+1, 1);
-		    ssd1306_set_pixel(4, y+2, 1);
-			ssd1306_refresh();
-		}
-
-    	delay_ms(1);
-    }
+	evloop_run(&h);
 
 	switch (menu_selected)
 	{
 	case APP_WAVEGEN_CONFIG_DACOUT:
 		// Start with DAC0 output
 		_app_wavegen_output_spkr = 0;
+		_app_wavegen_output_dual = 0;
+		_app_wavegen_sweep = 0;
 		break;
 	case APP_WAVEGEN_CONFIG_SPKROUT:
 		// Start with SPKR output
 		_app_wavegen_output_spkr = 1;
+		_app_wavegen_output_dual = 0;
+		_app_wavegen_sweep = 0;
+		break;
+	case APP_WAVEGEN_CONFIG_SWEEP:
+		// Repeating sweep on the DAC out, sync pulse on SWEEP_SYNC_PIN
+		_app_wavegen_output_spkr = 0;
+		_app_wavegen_output_dual = 0;
+		_app_wavegen_sweep = 1;
+		app_wavegen_config_sweep();
+		return 0;
+	case APP_WAVEGEN_CONFIG_DUALOUT:
+		// DAC0 and DAC1 together, DAC1 goes to the DACOUT connector
+		_app_wavegen_output_spkr = 0;
+		_app_wavegen_output_dual = 1;
+		_app_wavegen_sweep = 0;
+		dac_wavegen_init(WAVEGEN_DAC ? 0 : 1);
 		break;
 	case APP_WAVEGEN_CONFIG_USER:
 		app_wavegen_render_upload();
@@ -416,11 +883,69 @@ int32_t app_wavegen_config_screen(void)
 	// Update frequency on dedicated config page
 	app_wavegen_config_set_hz();
 
+	// Remember the frequency for the next power up
+	app_wavegen_save_settings();
+	settings_save();
+
 	return 0;
 }
 
+// USER1 selects the next field for the QEI to adjust
+static void app_wavegen_button(uint32_t pressed, void *arg)
+{
+	(void)arg;
+
+	if (!(pressed & (1 << BUTTON_USER1)))
+	{
+		return;
+	}
+
+	_app_wavegen_field++;
+	if (_app_wavegen_field == APP_WAVEGEN_FIELD_PARAM &&
+		_app_wavegen_curwave != APP_WAVEGEN_WAVE_SQUARE &&
+		_app_wavegen_curwave != APP_WAVEGEN_WAVE_SINE)
+	{
+		// Only square and sine have a shape parameter
+		_app_wavegen_field++;
+	}
+	if (_app_wavegen_field >= APP_WAVEGEN_FIELD_LAST)
+	{
+		_app_wavegen_field = APP_WAVEGEN_FIELD_WAVE;
+	}
+	app_wavegen_render_params();
+	ssd1306_refresh();
+}
+
+// The levels and the duty cycle follow the knob's speed
+static void app_wavegen_qei(int32_t steps, void *arg)
+{
+	int32_t fast = qei_accel_step();
+
+	(void)arg;
+
+	app_wavegen_adjust(_app_wavegen_field == APP_WAVEGEN_FIELD_WAVE ? steps : fast);
+	if (_app_wavegen_field == APP_WAVEGEN_FIELD_PARAM &&
+		_app_wavegen_curwave != APP_WAVEGEN_WAVE_SQUARE &&
+		_app_wavegen_curwave != APP_WAVEGEN_WAVE_SINE)
+	{
+		_app_wavegen_field = APP_WAVEGEN_FIELD_WAVE;
+	}
+
+	// The DDS keeps reading the same table, so only the dual
+	// mode (which plays rendered copies) needs a restart
+	app_wavegen_synth();
+	if (_app_wavegen_output_dual)
+	{
+		app_wavegen_start();
+	}
+	app_wavegen_render_params();
+	ssd1306_refresh();
+}
+
 void app_wavegen_run(void)
 {
+	const evloop_handlers_t h = { .button = app_wavegen_button, .qei = app_wavegen_qei };
+
 	// First run the config screen
 	int32_t res = app_wavegen_config_screen();
 	if (res == -1)
@@ -434,7 +959,6 @@ void app_wavegen_run(void)
 	app_wavegen_render_setup();
 
 	// Reset the QEI encoder position counter
-	int32_t last_position_qei = 0;
 	qei_reset_step();
 
 	// Setup the analog switch that controls speaker/DACOUT
@@ -450,30 +974,20 @@ void app_wavegen_run(void)
 		LPC_GPIO_PORT->CLR0 = (1 << DAC1EN_PIN);
 	}
 
-	// Wait for the QEI switch to exit
-	while (!(button_pressed() & (1 << QEI_SW_PIN)))
+	_app_wavegen_field = APP_WAVEGEN_FIELD_WAVE;
+
+	// The DAC runs from its own interrupt or DMA, the loop only sleeps
+	// between the controls. Wait for the QEI switch to exit
+	evloop_run(&h);
+
+	// Come back with the same waveform next time
+	app_wavegen_save_settings();
+	settings_save();
+
+	if (_app_wavegen_output_dual)
 	{
-		// Check for a scroll request on the QEI
-		int32_t abs = qei_abs_step();
-		// Adjust waveform offset on qei scroll
-		if (abs != last_position_qei)
-		{
-			int16_t pos = (int16_t)_app_wavegen_curwave;
-			pos += (abs - last_position_qei);
-			if (pos >= APP_WAVEGEN_WAVE_LAST)
-			{
-				pos = APP_WAVEGEN_WAVE_SINE;
-			}
-			if (pos < 0)
-			{
-				pos = APP_WAVEGEN_WAVE_USER;
-			}
-			_app_wavegen_curwave = (app_wavegen_wave_t)pos;
-			app_wavegen_render_setup();
-			ssd1306_refresh();
-			last_position_qei = abs;
-		}
+		dac_wavegen_dual_stop();
+		dac_wavegen_stop(WAVEGEN_DAC ? 0 : 1);
 	}
-
 	dac_wavegen_stop(WAVEGEN_DAC);
 }
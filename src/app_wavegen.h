@@ -16,6 +16,8 @@
  extern "C" {
 #endif
 
+void app_wavegen_load_settings(void);
+void app_wavegen_save_settings(void);
 void app_wavegen_init(void);
 void app_wavegen_run(void);
 
@@ -0,0 +1,196 @@
+/*
+===============================================================================
+ Name        : autorange.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Analog front end auto-ranging (0.787X input divider)
+===============================================================================
+*/
+
+#include "LPC8xx.h"
+#include "gpio.h"
+
+#include "config.h"
+#include "delay.h"
+#include "autorange.h"
+
+// The only switchable range is the 0.787X divider, which stretches the
+// input range to ~4.19V. The 0.971V VREF select can't be used as a lower
+// range, the LPC845 needs at least 2.4V on VREFP, so VREF stays at 3.3V.
+//
+// Up-ranging happens as soon as a block reaches the top rail. Down-ranging
+// needs the peak to stay below what fits the 3.3V range with 10% headroom
+// for AUTORANGE_DOWN_BLOCKS blocks in a row, so a signal sitting near the
+// boundary doesn't make the divider chatter.
+#define AUTORANGE_CLIP_MARGIN    (16)       // lsb from either rail
+#define AUTORANGE_CLIP_HIGH      (4095 - AUTORANGE_CLIP_MARGIN)
+#define AUTORANGE_DOWN_MAX       (4095 * 100 / 127 * 9 / 10)
+#define AUTORANGE_DOWN_BLOCKS    (8)
+
+// The divider charges the input capacitance in microseconds, but with AC
+// coupling the 220nF cap has to recharge through 127K (28ms tau)
+#define AUTORANGE_SETTLE_DC_MS   (2)
+#define AUTORANGE_SETTLE_AC_MS   (150)
+
+static uint8_t  _autorange_enabled = 0;
+static uint8_t  _autorange_vdiv = 0;
+static uint8_t  _autorange_coupling = 0;  // 1 = AC, the signal sits around mid scale
+static uint8_t  _autorange_clipped = 0;
+static uint8_t  _autorange_pending = 0;   // Next block overlaps the end of the settle time
+static uint8_t  _autorange_low = 0;       // Consecutive blocks that fit the 3.3V range
+static uint32_t _autorange_settle_ms = AUTORANGE_SETTLE_DC_MS;
+static uint32_t _autorange_switched = 0;  // millis() of the last switch
+
+static void autorange_set_vdiv(uint8_t vdiv)
+{
+  // Low enables the divider, high bypasses it
+  GPIOSetBitValue(AN_IN_VDIV_0_787X/32, AN_IN_VDIV_0_787X%32, vdiv ? 0 : 1);
+
+  _autorange_vdiv = vdiv;
+  _autorange_low = 0;
+  _autorange_switched = millis();
+}
+
+// Scans a block for clipping and a low peak, switches the divider if
+// needed. Returns 1 if the range changed.
+static int autorange_evaluate(const uint16_t *x, uint32_t n, uint8_t shift, uint8_t down_blocks)
+{
+  uint16_t min = 0xFFFF, max = 0;
+
+  for (uint32_t i = 0; i < n; i++)
+  {
+    uint16_t v = x[i] >> shift;
+    if (v < min) min = v;
+    if (v > max) max = v;
+  }
+
+  // DC coupled, 0V is a valid reading. Only with AC coupling, where the
+  // signal rides on the mid scale offset, does the low rail mean clipping.
+  _autorange_clipped = (max >= AUTORANGE_CLIP_HIGH) ||
+                       (_autorange_coupling && min <= AUTORANGE_CLIP_MARGIN);
+
+  if (!_autorange_enabled)
+  {
+    return 0;
+  }
+
+  if (!_autorange_vdiv && max >= AUTORANGE_CLIP_HIGH)
+  {
+    autorange_set_vdiv(1);
+    return 1;
+  }
+
+  if (_autorange_vdiv && max < AUTORANGE_DOWN_MAX)
+  {
+    if (++_autorange_low >= down_blocks)
+    {
+      autorange_set_vdiv(0);
+      return 1;
+    }
+  }
+  else
+  {
+    _autorange_low = 0;
+  }
+
+  return 0;
+}
+
+/**
+ * Takes over the divider pin and selects the starting range.
+ *
+ * @param enabled   0 = stay on 'vdiv', 1 = switch ranges automatically
+ * @param vdiv      Starting range, 1 = 0.787X divider in
+ * @param coupling  1 = AC coupled front end (longer settle time)
+ */
+void autorange_init(uint8_t enabled, uint8_t vdiv, uint8_t coupling)
+{
+  GPIOSetDir(AN_IN_VDIV_0_787X/32, AN_IN_VDIV_0_787X%32, 1);
+
+  _autorange_enabled = enabled;
+  _autorange_coupling = coupling;
+  _autorange_settle_ms = coupling ? AUTORANGE_SETTLE_AC_MS : AUTORANGE_SETTLE_DC_MS;
+  _autorange_clipped = 0;
+  _autorange_pending = 0;
+
+  autorange_set_vdiv(vdiv);
+}
+
+/**
+ * Range check for continuous acquisition, call once per completed DMA
+ * block. Only scans the block, so it never holds up the sampler.
+ *
+ * Blocks taken while the front end settles are rejected, and so is the
+ * first one after, which was already filling when the settle time ran out.
+ *
+ * @return 0 if the block is usable in the current range, -1 if it has to
+ *         be dropped (range switched, or not settled yet)
+ */
+int autorange_block(const uint16_t *x, uint32_t n, uint8_t shift)
+{
+  if (autorange_settling())
+  {
+    _autorange_pending = 1;
+    return -1;
+  }
+
+  if (_autorange_pending)
+  {
+    _autorange_pending = 0;
+    return -1;
+  }
+
+  if (autorange_evaluate(x, n, shift, AUTORANGE_DOWN_BLOCKS))
+  {
+    _autorange_pending = 1;
+    return -1;
+  }
+
+  return 0;
+}
+
+/**
+ * Range check for a single shot capture. A shot shows the whole signal,
+ * so down-ranging doesn't wait for more blocks.
+ *
+ * @return 1 if the range changed and the shot should be taken again once
+ *         autorange_settling() clears, 0 if it stands
+ */
+int autorange_shot(const uint16_t *x, uint32_t n, uint8_t shift)
+{
+  return autorange_evaluate(x, n, shift, 1);
+}
+
+/**
+ * Returns non-zero until the front end has settled after the last switch.
+ */
+int autorange_settling(void)
+{
+  return (millis() - _autorange_switched) < _autorange_settle_ms;
+}
+
+/**
+ * Returns 1 if the 0.787X divider is in.
+ */
+uint8_t autorange_vdiv(void)
+{
+  return _autorange_vdiv;
+}
+
+/**
+ * Returns 1 if the last block reached the top rail, or with AC coupling
+ * either rail.
+ */
+uint8_t autorange_clipped(void)
+{
+  return _autorange_clipped;
+}
+
+/**
+ * Returns the ADC to input scale for the current range, Q16.
+ */
+uint32_t autorange_gain_q16(void)
+{
+  return _autorange_vdiv ? AUTORANGE_VDIV_GAIN_Q16 : (1UL << 16);
+}
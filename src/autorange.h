@@ -0,0 +1,27 @@
+/*
+===============================================================================
+ Name        : autorange.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description :
+===============================================================================
+*/
+
+#ifndef AUTORANGE_H_
+#define AUTORANGE_H_
+
+#include <stdint.h>
+
+// 0.787X divider (27K + 100K), readings scale back up by 127/100
+#define AUTORANGE_VDIV_GAIN_Q16  ((uint32_t)((127UL << 16) / 100))
+
+void     autorange_init(uint8_t enabled, uint8_t vdiv, uint8_t coupling);
+int      autorange_block(const uint16_t *x, uint32_t n, uint8_t shift);
+int      autorange_shot(const uint16_t *x, uint32_t n, uint8_t shift);
+int      autorange_settling(void);
+uint8_t  autorange_vdiv(void);
+uint8_t  autorange_clipped(void);
+uint32_t autorange_gain_q16(void);
+
+#endif /* AUTORANGE_H_ */
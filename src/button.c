@@ -17,6 +17,7 @@
 #include "config.h"
 #include "delay.h"
 #include "button.h"
+#include "input.h"
 #include "acomp.h"
 #include "iocon.h"
 #include "capt.h"
@@ -239,7 +240,22 @@ uint32_t capt_pressed(void)
 #endif
 
 /**
- * Check if a button has been pressed, including basic debouncing.
+ * Raw state of the buttons, no debouncing. Captouch pads are included when
+ * enabled. For input_tick(), the apps want button_pressed().
+ */
+uint32_t button_state(void)
+{
+#if BUTTON_USE_CAPTOUCH
+  return button_read() | capt_pressed();
+#else
+  return button_read();
+#endif
+}
+
+/**
+ * Check if a button has been pressed. The debouncing is done from SysTick
+ * by input_tick(), this just takes the PRESS events off its queue (the
+ * others are dropped, apps that want them use input_get() or evloop_run()).
  *
  * Note: Press and hold will be reported as a single click, and
  *       release isn't reported in the code below. Only a single
@@ -250,51 +266,16 @@ uint32_t capt_pressed(void)
  */
 uint32_t button_pressed(void)
 {
-  // MAX_CHECKS must be exponent of 2
-  enum { MAX_CHECKS = 2, SAMPLE_TIME = 3 };
-
-  /* Array that maintains bounce status, which is sampled
-   * at 10 ms/lsb. Debounced state is valid if all values
-   * on a switch maintain the same state (bit set or clear)
-   */
-  static uint32_t lastReadTime = 0;
-  static uint32_t states[MAX_CHECKS] = { 0 };
-  static uint32_t index = 0;
-
-  // Last debounce state, used to detect changes
-  static uint32_t lastDebounced = 0;
-
-#if BUTTON_USE_CAPTOUCH
-  // result always take in captouch
-  uint32_t result = capt_pressed();
-#else
+  input_event_t ev;
   uint32_t result = 0;
-#endif
-
-  // Too soon, nothing to do
-  if (millis() - lastReadTime < SAMPLE_TIME ) return result;
-
-  lastReadTime = millis();
 
-  // Take current read and mask with BUTTONs
-  // Note: Bitwise inverted since buttons are active (pressed) LOW
-  uint32_t debounced = button_read();
-
-  // Copy current state into array
-  states[ (index & (MAX_CHECKS-1)) ] = debounced;
-  index++;
-
-  // Bitwise 'and' all the states in the array together to get the result
-  // Pin must stay asserted at least MAX_CHECKS time to be recognized as valid
-  for(int i=0; i<MAX_CHECKS; i++)
+  while (input_get(&ev))
   {
-    debounced &= states[i];
+    if (ev.kind == INPUT_EV_PRESS)
+    {
+      result |= ev.value;
+    }
   }
 
-  // 'result' = button changed and passes debounce checks, 0 = failure or not-asserted
-  result |= ((debounced ^ lastDebounced) & debounced);
-
-  lastDebounced = debounced;
-
   return result;
 }
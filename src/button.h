@@ -17,9 +17,11 @@
 #define CAPT_PAD_1    1
 
 uint32_t button_pressed(void);
+uint32_t button_state(void);
 void     button_init(void);
 
 #if BUTTON_USE_CAPTOUCH
+uint32_t capt_pressed(void);
 #define capt_nvic_enable()    NVIC_EnableIRQ(CAPT_IRQn)
 #define capt_nvic_disable()   do { extern volatile bool touching; NVIC_DisableIRQ(CAPT_IRQn); touching = 0; } while(0)
 #else
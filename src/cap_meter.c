@@ -0,0 +1,393 @@
+/*
+===============================================================================
+ Name        : cap_meter.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : RC charge time capacitance and ESR meter (ACMP + CTIMER0)
+===============================================================================
+*/
+
+#include <stdbool.h>
+
+#include "LPC8xx.h"
+#include "syscon.h"
+#include "swm.h"
+#include "iocon.h"
+#include "acomp.h"
+#include "ctimer.h"
+#include "capt.h"
+
+#include "config.h"
+#include "delay.h"
+#include "button.h"
+#include "cap_meter.h"
+
+/*
+ Pins used in this application:
+
+ CAP_SENSE_PIN     [I] - ACMP_I4, DUT + (DUT - to GND)
+ CAP_CHARGE_HI_PIN [O] - T0_MAT0 or GPIO, 1M to CAP_SENSE_PIN
+ CAP_CHARGE_LO_PIN [O] - T0_MAT0 or GPIO, 1k to CAP_SENSE_PIN
+ CAP_LOOP_PIN      [O] - ACMP_O, read back by T0_CAP0, leave open
+*/
+
+// The DUT charges from empty through one of the resistors, and the
+// comparator trips when it crosses a ladder tap. Both ends are in
+// hardware: T0_MAT0 drives the charge pin, so the charge starts on an
+// exact count, and ACMP_O loops back through a pin to T0_CAP0, which
+// latches the count of the crossing. The CPU only polls for the result.
+//
+// Every measurement charges twice, to 10/31 and 20/31 of VDD. With
+// t = tau * ln(1 / (1 - Vtap/VDD)) for both, the difference
+//
+//   t2 - t1 = tau * ln(21/11)
+//
+// cancels the comparator delay and whatever charge was left in the DUT.
+// A series resistance shows up as a step at the start of the charge,
+// which makes t1 short of tau * ln(31/21). The shortfall gives the ESR:
+//
+//   ESR ~= R * (ln(31/21) - ln(21/11) * t1 / (t2 - t1))
+//
+// which only resolves anything against the 1k resistor.
+//
+// The captouch buttons (BUTTON_USE_CAPTOUCH) poll through the same
+// comparator. Their polling stops for the measurement and the comparator
+// setup is saved, cap_meter_stop() puts both back.
+#define CAP_METER_LAD_EMPTY      (1)         // Discharged below VDD/31
+#define CAP_METER_LAD_T1         (10)
+#define CAP_METER_LAD_T2         (20)
+#define CAP_METER_K_NS           (1546486000ULL)   // 1e9 / ln(21/11)
+#define CAP_METER_LN_T1_PPM      (389465)    // ln(31/21) * 1e6
+#define CAP_METER_LN_DT_PPM      (646627)    // ln(21/11) * 1e6
+
+#define CAP_METER_START_TICKS    (4)         // MAT0 goes high here
+#define CAP_METER_HI_TIMEOUT_MS  (250)       // More than ~200nF, go to 1k
+#define CAP_METER_LO_TIMEOUT_MS  (10000)     // More than ~9mF, give up
+#define CAP_METER_HI_MAX_PF      (100000)    // 1M range up to 100nF ..
+#define CAP_METER_LO_MIN_PF      (10000)     // .. 1k range down to 10nF
+#define CAP_METER_HOLD_MIN_US    (10)
+
+// Averaging, a result holds this many measurements or as many as fit in
+// the gate, whichever is fewer, but at least one
+#define CAP_METER_AVG_MAX        (16)
+#define CAP_METER_GATE_MS        (300)
+
+typedef enum
+{
+  CAP_METER_ST_DISCHARGE = 0,   // Charge pins low, waiting for the ladder
+  CAP_METER_ST_HOLD,            // Below VDD/31, draining the rest
+  CAP_METER_ST_CHARGE           // Charging, waiting for the capture
+} cap_meter_state_t;
+
+static cap_meter_state_t _cap_meter_state;
+static cap_meter_range_t _cap_meter_range;
+static uint8_t           _cap_meter_tap;          // 0 = to T1, 1 = to T2
+static uint32_t          _cap_meter_t1;           // This measurement's T1 charge time
+static uint64_t          _cap_meter_sum_t1;
+static uint64_t          _cap_meter_sum_t2;
+static uint16_t          _cap_meter_count;
+static uint32_t          _cap_meter_gate_start;   // millis()
+static uint32_t          _cap_meter_hold_ticks;   // Discharge time after the ladder trips
+static uint32_t          _cap_meter_cmp_ctrl;     // Comparator setup before cap_meter_start()
+static uint32_t          _cap_meter_cmp_lad;
+#if BUTTON_USE_CAPTOUCH
+static uint32_t          _cap_meter_capt_ctrl;
+static uint8_t           _cap_meter_capt_irq;
+#endif
+
+static void cap_meter_set_ladder(uint8_t tap)
+{
+  LPC_CMP->LAD = (SUPPLY_VDD<<LADREF) | (tap<<LADSEL) | (1<<LADEN);
+}
+
+// The charge pin of the range is T0_MAT0, the other one stays GPIO
+static uint8_t cap_meter_pin(void)
+{
+  return _cap_meter_range == CAP_METER_RANGE_HI ? CAP_CHARGE_HI_PIN : CAP_CHARGE_LO_PIN;
+}
+
+static uint8_t cap_meter_other_pin(void)
+{
+  return _cap_meter_range == CAP_METER_RANGE_HI ? CAP_CHARGE_LO_PIN : CAP_CHARGE_HI_PIN;
+}
+
+static uint32_t cap_meter_timeout_ticks(void)
+{
+  uint32_t ms = _cap_meter_range == CAP_METER_RANGE_HI ? CAP_METER_HI_TIMEOUT_MS : CAP_METER_LO_TIMEOUT_MS;
+
+  return (system_ahb_clk / 1000) * ms;
+}
+
+static void cap_meter_discharge(void)
+{
+  uint8_t other = cap_meter_other_pin();
+
+  LPC_CTIMER0->TCR = 1<<CRST;
+  LPC_CTIMER0->CCR = 0;
+  LPC_CTIMER0->MCR = 0;
+  LPC_CTIMER0->IR  = 0xFF;
+
+  // MAT0 low, and the other resistor in parallel
+  LPC_CTIMER0->EMR = DO_NOTHING_ON_MATCH<<EMC0 | 0<<EM0;
+  LPC_GPIO_PORT->CLR0 = 1<<other;
+  LPC_GPIO_PORT->DIRSET[0] = 1<<other;
+
+  cap_meter_set_ladder(CAP_METER_LAD_EMPTY);
+  _cap_meter_state = CAP_METER_ST_DISCHARGE;
+}
+
+static void cap_meter_hold(void)
+{
+  // Move the ladder now, it has the whole hold to settle
+  cap_meter_set_ladder(_cap_meter_tap ? CAP_METER_LAD_T2 : CAP_METER_LAD_T1);
+
+  LPC_CTIMER0->MR[1] = _cap_meter_hold_ticks;
+  LPC_CTIMER0->MCR = 1<<MR1I | 1<<MR1S;
+  LPC_CTIMER0->TCR = 1<<CEN;
+
+  _cap_meter_state = CAP_METER_ST_HOLD;
+}
+
+static void cap_meter_charge(void)
+{
+  uint8_t other = cap_meter_other_pin();
+
+  LPC_GPIO_PORT->DIRCLR[0] = 1<<other;
+
+  LPC_CTIMER0->TCR = 1<<CRST;
+  LPC_CTIMER0->IR  = 0xFF;
+  LPC_CTIMER0->MR[0] = CAP_METER_START_TICKS;
+  LPC_CTIMER0->MR[1] = cap_meter_timeout_ticks();
+  LPC_CTIMER0->MCR = 1<<MR1I | 1<<MR1S;
+  LPC_CTIMER0->EMR = SET_ON_MATCH<<EMC0 | 0<<EM0;
+  LPC_CTIMER0->CCR = 1<<CAP0RE | 1<<CAP0I;
+  LPC_CTIMER0->TCR = 1<<CEN;
+
+  _cap_meter_state = CAP_METER_ST_CHARGE;
+}
+
+static void cap_meter_reset_avg(void)
+{
+  _cap_meter_tap = 0;
+  _cap_meter_sum_t1 = 0;
+  _cap_meter_sum_t2 = 0;
+  _cap_meter_count = 0;
+  _cap_meter_gate_start = millis();
+}
+
+static void cap_meter_set_range(cap_meter_range_t range)
+{
+  _cap_meter_range = range;
+  ConfigSWM(T0_MAT0, cap_meter_pin());
+  cap_meter_reset_avg();
+
+  // Start over, the new GPIO pin joins in
+  cap_meter_discharge();
+}
+
+/**
+ * Sets up the comparator, loopback and CTIMER0 and starts measuring on
+ * the 1M range.
+ */
+void cap_meter_start(void)
+{
+  Enable_Periph_Clock(CLK_SWM);
+  Enable_Periph_Clock(CLK_IOCON);
+
+#if BUTTON_USE_CAPTOUCH
+  // Let the poll in progress finish, then keep X0 off the comparator
+  _cap_meter_capt_irq = (NVIC->ISER[0] & (1 << CAPT_IRQn)) ? 1 : 0;
+  capt_nvic_disable();
+  _cap_meter_capt_ctrl = LPC_CAPT->CTRL;
+  LPC_CAPT->CTRL = _cap_meter_capt_ctrl & ~(3 << POLLMODE);
+  while (LPC_CAPT->STATUS & BUSY) { }
+  DisableFixedPinFunc(CAPT_X0);
+#endif
+
+  // Powered and clocked first, a fresh comparator reads back as zeros
+  LPC_SYSCON->PDRUNCFG &= ~(ACMP_PD);
+  Enable_Periph_Clock(CLK_ACMP);
+  _cap_meter_cmp_ctrl = LPC_CMP->CTRL;
+  _cap_meter_cmp_lad = LPC_CMP->LAD;
+
+  // Ladder against our input, rising edges, a little hysteresis so a
+  // slow crossing can't chatter
+  LPC_CMP->CTRL = (_5mV<<HYS) | (0<<INTENA) | (RISING<<EDGESEL) | (V_LADDER_OUT<<COMP_VM_SEL) | (ACOMP_IN4<<COMP_VP_SEL);
+  DisableFixedPinFunc(ADC_3);     // Same pin, adc_poll puts it back
+  EnableFixedPinFunc(ACMP_I4);
+
+  Enable_Periph_Clock(CLK_CTIMER0);
+  Enable_Periph_Clock(CLK_GPIO0);
+
+  // No pulls anywhere near the DUT, a 50k pull-up would swamp the 1M.
+  // Update this if the pins are changed.
+  LPC_IOCON->PIO0_23 &= (IOCON_MODE_MASK|MODE_INACTIVE);
+  LPC_IOCON->PIO0_22 &= (IOCON_MODE_MASK|MODE_INACTIVE);
+  LPC_IOCON->PIO0_8  &= (IOCON_MODE_MASK|MODE_INACTIVE);
+
+  ConfigSWM(ACOMP, CAP_LOOP_PIN);
+  ConfigSWM(T0_CAP0, CAP_LOOP_PIN);
+
+  LPC_CTIMER0->TCR  = 1<<CRST;
+  LPC_CTIMER0->CTCR = TIMER_MODE<<CTMODE;
+  LPC_CTIMER0->PR   = 0;
+
+  _cap_meter_hold_ticks = (system_ahb_clk / 1000000) * CAP_METER_HOLD_MIN_US;
+
+  cap_meter_set_range(CAP_METER_RANGE_HI);
+}
+
+/**
+ * Stops with the DUT half way through a discharge, and gives the pins
+ * and the comparator back.
+ */
+void cap_meter_stop(void)
+{
+  cap_meter_discharge();
+
+  LPC_CTIMER0->TCR = 0;
+  LPC_CTIMER0->EMR = 0;
+
+  // Unassign, the other CTIMER0 users mustn't drive these pins
+  ConfigSWM(T0_MAT0, 0xFF);
+  ConfigSWM(T0_CAP0, 0xFF);
+  ConfigSWM(ACOMP, 0xFF);
+
+  LPC_GPIO_PORT->DIRCLR[0] = 1<<CAP_CHARGE_HI_PIN | 1<<CAP_CHARGE_LO_PIN;
+
+  DisableFixedPinFunc(ACMP_I4);
+  LPC_CMP->LAD = _cap_meter_cmp_lad;
+  LPC_CMP->CTRL = _cap_meter_cmp_ctrl;
+
+#if BUTTON_USE_CAPTOUCH
+  EnableFixedPinFunc(CAPT_X0);
+  LPC_CAPT->CTRL = _cap_meter_capt_ctrl;
+  if (_cap_meter_capt_irq)
+  {
+    capt_nvic_enable();
+  }
+#endif
+}
+
+// Averages what's in, picks the range for the next gate
+static void cap_meter_result(cap_meter_result_t *r)
+{
+  uint32_t r_ohm = _cap_meter_range == CAP_METER_RANGE_HI ? CAP_METER_R_HI_OHM : CAP_METER_R_LO_OHM;
+  uint64_t dt = _cap_meter_sum_t2 - _cap_meter_sum_t1;
+  uint64_t tau_ns = dt * CAP_METER_K_NS / ((uint64_t)_cap_meter_count * system_ahb_clk);
+
+  r->c_pf = tau_ns * 1000 / r_ohm;
+  r->count = _cap_meter_count;
+  r->range = _cap_meter_range;
+  r->status = CAP_METER_OK;
+  r->esr_mohm = CAP_METER_ESR_NONE;
+
+  if (_cap_meter_range == CAP_METER_RANGE_LO && dt)
+  {
+    int64_t esr = ((int64_t)CAP_METER_LN_T1_PPM * (int64_t)dt - (int64_t)CAP_METER_LN_DT_PPM * (int64_t)_cap_meter_sum_t1) *
+                  r_ohm / ((int64_t)dt * 1000);
+
+    // Noise can take it just under zero
+    r->esr_mohm = esr < 0 ? 0 : (int32_t)esr;
+  }
+
+  // Drain for 3 tau of the 1k for the next measurement, the little
+  // that's left cancels out of t2 - t1 anyway
+  uint64_t hold = tau_ns * CAP_METER_R_LO_OHM / r_ohm * 3 * (system_ahb_clk / 1000000) / 1000;
+  uint32_t hold_min = (system_ahb_clk / 1000000) * CAP_METER_HOLD_MIN_US;
+  _cap_meter_hold_ticks = hold < hold_min ? hold_min : (hold > 0xFFFFFFF ? 0xFFFFFFF : (uint32_t)hold);
+
+  if (_cap_meter_range == CAP_METER_RANGE_HI && r->c_pf > CAP_METER_HI_MAX_PF)
+  {
+    cap_meter_set_range(CAP_METER_RANGE_LO);
+  }
+  else if (_cap_meter_range == CAP_METER_RANGE_LO && r->c_pf < CAP_METER_LO_MIN_PF)
+  {
+    cap_meter_set_range(CAP_METER_RANGE_HI);
+  }
+  else
+  {
+    cap_meter_reset_avg();
+  }
+}
+
+/**
+ * Steps the measurement along, call from the main loop. A result holds
+ * up to CAP_METER_AVG_MAX measurements, fewer for slow (big) parts.
+ *
+ * @return 1 with a new result in 'r', 0 otherwise
+ */
+int cap_meter_poll(cap_meter_result_t *r)
+{
+  uint32_t ir = LPC_CTIMER0->IR;
+
+  switch (_cap_meter_state)
+  {
+  case CAP_METER_ST_DISCHARGE:
+    if (!(LPC_CMP->CTRL & (1<<COMPSTAT)))
+    {
+      cap_meter_hold();
+    }
+    return 0;
+
+  case CAP_METER_ST_HOLD:
+    if (ir & (1<<MR1INT))
+    {
+      cap_meter_charge();
+    }
+    return 0;
+
+  case CAP_METER_ST_CHARGE:
+    break;
+  }
+
+  if (ir & (1<<CR0INT))
+  {
+    uint32_t t = LPC_CTIMER0->CR[0] - CAP_METER_START_TICKS;
+
+    cap_meter_discharge();
+
+    if (!_cap_meter_tap)
+    {
+      _cap_meter_t1 = t;
+      _cap_meter_tap = 1;
+      return 0;
+    }
+
+    _cap_meter_sum_t1 += _cap_meter_t1;
+    _cap_meter_sum_t2 += t;
+    _cap_meter_count++;
+    _cap_meter_tap = 0;
+
+    if (_cap_meter_count < CAP_METER_AVG_MAX && millis() - _cap_meter_gate_start < CAP_METER_GATE_MS)
+    {
+      return 0;
+    }
+
+    cap_meter_result(r);
+    return 1;
+  }
+
+  if (ir & (1<<MR1INT))
+  {
+    // Never got there
+    if (_cap_meter_range == CAP_METER_RANGE_HI)
+    {
+      cap_meter_set_range(CAP_METER_RANGE_LO);
+      return 0;
+    }
+
+    cap_meter_discharge();
+    cap_meter_reset_avg();
+
+    r->c_pf = 0;
+    r->esr_mohm = CAP_METER_ESR_NONE;
+    r->count = 0;
+    r->range = _cap_meter_range;
+    r->status = CAP_METER_OVER;
+    return 1;
+  }
+
+  return 0;
+}
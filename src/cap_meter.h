@@ -0,0 +1,49 @@
+/*
+===============================================================================
+ Name        : cap_meter.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description :
+===============================================================================
+*/
+
+#ifndef CAP_METER_H_
+#define CAP_METER_H_
+
+#include <stdint.h>
+
+// Charge resistors, put the measured values in here for best accuracy
+// (the pin driver adds ~30R to both)
+#define CAP_METER_R_HI_OHM       (1000000)
+#define CAP_METER_R_LO_OHM       (1000)
+
+#define CAP_METER_ESR_NONE       (-1)
+
+typedef enum
+{
+  CAP_METER_RANGE_HI = 0,     // 1M, ~5pF .. ~200nF
+  CAP_METER_RANGE_LO,         // 1k, ~10nF .. ~5000uF, with ESR
+  CAP_METER_RANGE_LAST
+} cap_meter_range_t;
+
+typedef enum
+{
+  CAP_METER_OK = 0,
+  CAP_METER_OVER,             // Didn't charge on the 1k range either (short?)
+} cap_meter_status_t;
+
+typedef struct
+{
+  uint64_t           c_pf;        // Capacitance, pF
+  int32_t            esr_mohm;    // Series resistance, mOhm, or CAP_METER_ESR_NONE
+  uint16_t           count;       // Measurements averaged
+  cap_meter_range_t  range;
+  cap_meter_status_t status;
+} cap_meter_result_t;
+
+void cap_meter_start(void);
+void cap_meter_stop(void);
+int  cap_meter_poll(cap_meter_result_t *r);
+
+#endif /* CAP_METER_H_ */
@@ -0,0 +1,188 @@
+/*
+===============================================================================
+ Name        : capt_filter.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Fixed point filters for the captouch counts
+===============================================================================
+*/
+
+#include "LPC8xx.h"
+#include "core_cm0plus.h"
+#include "chip_setup.h"
+
+#include "capt_filter.h"
+
+/*
+ The filters CAPT_IRQHandler used to pick between with #if flags, behind
+ one call and switchable at run time. Only one runs at a time, so the per
+ sensor state is a union sized for the biggest of them (the FIR taps).
+ Counts are 12 bits, everything fits in 16 bits except the Butterworth
+ outputs, kept in 1/16 count for the rounding.
+*/
+
+// 2nd order Butterworth, fc = fs/10, Q14. a1 is negated, the DC gain is 1.
+#define CAPT_FILTER_BW_B0    (1106)
+#define CAPT_FILTER_BW_B1    (2208)
+#define CAPT_FILTER_BW_A1    (18727)
+#define CAPT_FILTER_BW_A2    (6763)
+#define CAPT_FILTER_BW_Q     (4)
+
+#if (1 << FILTER_GAIN) != NUM_SAMPLES
+#error "FILTER_GAIN must be log2(NUM_SAMPLES)"
+#endif
+
+typedef union
+{
+  struct
+  {
+    uint16_t tap[NUM_SAMPLES];
+    uint16_t sum;
+    uint8_t  i;
+  } fir;
+  struct
+  {
+    uint16_t avg;             // << FILTER_GAIN
+  } iir;
+  struct
+  {
+    uint16_t x1, x2;
+    int32_t  y1, y2;          // << CAPT_FILTER_BW_Q
+  } bw;
+  struct
+  {
+    uint16_t env;
+    uint8_t  n;
+  } decim;
+} capt_filter_state_t;
+
+static capt_filter_state_t _capt_filter_state[NUM_SENSORS];
+static uint32_t            _capt_filter_primed = 0;     // Bit per sensor
+static capt_filter_type_t  _capt_filter_type = CAPT_FILTER_NONE;
+
+static char * const _capt_filter_names[CAPT_FILTER_LAST] = {
+  "NONE",
+  "FIR",
+  "IIR",
+  "BUTTERWORTH",
+  "DECIMATE"
+};
+
+/**
+ * Switches the filter, the state starts over from the next sample of each
+ * sensor. Safe against CAPT_IRQHandler.
+ */
+void capt_filter_select(capt_filter_type_t type)
+{
+  uint32_t primask = __get_PRIMASK();
+
+  if (type >= CAPT_FILTER_LAST) type = CAPT_FILTER_NONE;
+
+  __disable_irq();
+  _capt_filter_type = type;
+  _capt_filter_primed = 0;
+  __set_PRIMASK(primask);
+}
+
+capt_filter_type_t capt_filter_type(void)
+{
+  return _capt_filter_type;
+}
+
+const char *capt_filter_name(capt_filter_type_t type)
+{
+  return type < CAPT_FILTER_LAST ? _capt_filter_names[type] : "";
+}
+
+// Fills the state as if 'count' had always been there
+static void capt_filter_prime(capt_filter_state_t *s, uint16_t count)
+{
+  uint8_t i;
+
+  switch (_capt_filter_type)
+  {
+    case CAPT_FILTER_FIR:
+      for (i = 0; i < NUM_SAMPLES; i++)
+      {
+        s->fir.tap[i] = count;
+      }
+      s->fir.sum = count << FILTER_GAIN;
+      s->fir.i = 0;
+      break;
+    case CAPT_FILTER_IIR:
+      s->iir.avg = count << FILTER_GAIN;
+      break;
+    case CAPT_FILTER_BUTTERWORTH:
+      s->bw.x1 = s->bw.x2 = count;
+      s->bw.y1 = s->bw.y2 = (int32_t)count << CAPT_FILTER_BW_Q;
+      break;
+    case CAPT_FILTER_DECIMATE:
+      s->decim.n = 0;
+      break;
+    default:
+      break;
+  }
+}
+
+/**
+ * Runs a TOUCH count (12 bits) from sensor 'x' through the selected filter.
+ *
+ * @return 1 with the filtered count in 'out', 0 when the filter has
+ *         nothing new (the decimator between outputs)
+ */
+int capt_filter_run(uint8_t x, uint16_t count, uint16_t *out)
+{
+  capt_filter_state_t *s = &_capt_filter_state[x];
+  int32_t y;
+
+  if (!(_capt_filter_primed & (1 << x)))
+  {
+    capt_filter_prime(s, count);
+    _capt_filter_primed |= 1 << x;
+  }
+
+  switch (_capt_filter_type)
+  {
+    case CAPT_FILTER_FIR:
+      s->fir.sum += count - s->fir.tap[s->fir.i];
+      s->fir.tap[s->fir.i] = count;
+      s->fir.i = (s->fir.i + 1) & (NUM_SAMPLES - 1);
+      *out = s->fir.sum >> FILTER_GAIN;
+      return 1;
+
+    case CAPT_FILTER_IIR:
+      s->iir.avg += count - (s->iir.avg >> FILTER_GAIN);
+      *out = s->iir.avg >> FILTER_GAIN;
+      return 1;
+
+    case CAPT_FILTER_BUTTERWORTH:
+      y = ((CAPT_FILTER_BW_B0 * ((int32_t)count + s->bw.x2) + CAPT_FILTER_BW_B1 * (int32_t)s->bw.x1) << CAPT_FILTER_BW_Q)
+          + CAPT_FILTER_BW_A1 * s->bw.y1 - CAPT_FILTER_BW_A2 * s->bw.y2;
+      y = (y + (1 << 13)) >> 14;
+      s->bw.x2 = s->bw.x1;
+      s->bw.x1 = count;
+      s->bw.y2 = s->bw.y1;
+      s->bw.y1 = y;
+
+      y = (y + (1 << (CAPT_FILTER_BW_Q - 1))) >> CAPT_FILTER_BW_Q;
+      *out = y < 0 ? 0 : (y > 0xFFF ? 0xFFF : (uint16_t)y);
+      return 1;
+
+    case CAPT_FILTER_DECIMATE:
+      // Keep the count furthest towards a touch
+#if TOUCH_TRIGGERS_LOWER == 1
+      if (s->decim.n == 0 || count < s->decim.env) s->decim.env = count;
+#else
+      if (s->decim.n == 0 || count > s->decim.env) s->decim.env = count;
+#endif
+      if (++s->decim.n < DECIMATE_FACTOR) return 0;
+      s->decim.n = 0;
+      *out = s->decim.env;
+      return 1;
+
+    default:
+      *out = count;
+      return 1;
+  }
+}
@@ -0,0 +1,31 @@
+/*
+===============================================================================
+ Name        : capt_filter.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Fixed point filters for the captouch counts
+===============================================================================
+*/
+
+#ifndef CAPT_FILTER_H_
+#define CAPT_FILTER_H_
+
+#include <stdint.h>
+
+typedef enum
+{
+  CAPT_FILTER_NONE = 0,       // Raw counts
+  CAPT_FILTER_FIR,            // NUM_SAMPLES point moving average
+  CAPT_FILTER_IIR,            // Exponential average, 1/NUM_SAMPLES of each sample
+  CAPT_FILTER_BUTTERWORTH,    // 2nd order low pass at 1/10 of the sample rate
+  CAPT_FILTER_DECIMATE,       // Envelope on the touch side, one output per DECIMATE_FACTOR samples
+  CAPT_FILTER_LAST
+} capt_filter_type_t;
+
+void               capt_filter_select (capt_filter_type_t type);
+capt_filter_type_t capt_filter_type   (void);
+const char        *capt_filter_name   (capt_filter_type_t type);
+int                capt_filter_run    (uint8_t x, uint16_t count, uint16_t *out);
+
+#endif /* CAPT_FILTER_H_ */
@@ -151,10 +151,7 @@
 // None of the following are applicable to CapTouch buttons examples
 #define DB_VAL 75              // If using debounce, count up to this number
 #define DEBOUNCE 0             // '1' to introduce a debounce delay on the first touch after a no-touch
-#define FIR 0                  // '1' to use FIR averaging filter
-#define IIR 0                  // '1' to use IIR averaging filter
-#define BUTT 0                 // '1' to use digital Butterworth LPF
-#define DECIM 0                // '1' to use decimating filter
+// The filter itself is picked at run time, see capt_filter_select()
 #define NUM_SAMPLES 8          // Memory of the FIR filter (a.k.a. 'L')
 #define FILTER_GAIN 3          // Log2 of Filter gain for the FIR and IIR filters. Must always = Log2 of NUM_SAMPLES
 #define DECIMATE_FACTOR 4      // If using decimating filter decimate by this factor
@@ -73,6 +73,24 @@
 
 #define ADC_CHANNEL               (2) // Pin P0.14 (A0)
 #define WAVEGEN_DAC               (1) // 0 = P0.17/ANALOG4, 1 = 0.29/ANALOG5
+#define SWEEP_SYNC_PIN            (P0_15) // High for 1ms at the start of each wavegen sweep
+#define FREQ_IN_PIN               (P0_9)  // Frequency counter input (3.3V logic)
+#define PWM_OUT0_PIN              (P0_26) // PWM generator outputs (SCT_OUT0..2)
+#define PWM_OUT1_PIN              (P0_27)
+#define PWM_OUT2_PIN              (P0_28)
+#define CAP_SENSE_PIN             (P0_23) // Capacitance meter DUT +, ACMP_I4 (DUT - to GND)
+#define CAP_CHARGE_HI_PIN         (P0_22) // 1M to CAP_SENSE_PIN
+#define CAP_CHARGE_LO_PIN         (P0_8)  // 1k to CAP_SENSE_PIN
+#define CAP_LOOP_PIN              (P1_10) // ACMP_O to T0_CAP0 loopback, leave open (not a CAPT_X pin)
+
+// Settings store, the last flash sectors are reserved for it (1KB each).
+// The MFlash64 region in .cproject ends at SETTINGS_WAVE_SECTOR (0xE800),
+// so the linker fails before code or rodata can land in them. Move both
+// together.
+#define SETTINGS_WAVE_SECTOR      (58)  // User waveform table
+#define SETTINGS_WAVE_SECTORS     (2)
+#define SETTINGS_FLASH_SECTOR     (60)  // Settings record ring
+#define SETTINGS_FLASH_SECTORS    (4)
 
 // NOTE: USB Serial pins are defined in chip_setup.h
 // USB Serial is routed through the MBED USB CDC interface using:
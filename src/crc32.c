@@ -0,0 +1,51 @@
+/*
+===============================================================================
+ Name        : crc32.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Standard (zlib/Ethernet) CRC-32 using the CRC engine
+===============================================================================
+*/
+
+#include "LPC8xx.h"
+#include "syscon.h"
+
+#include "crc32.h"
+
+// CRC engine MODE: CRC-32 polynomial, bit reversed input and sum, complemented sum
+#define CRC32_MODE   (0x36)
+
+void crc32_init(void)
+{
+  Enable_Periph_Clock(CLK_CRC);
+}
+
+void crc32_start(void)
+{
+  LPC_CRC->MODE = CRC32_MODE;
+  LPC_CRC->SEED = 0xFFFFFFFF;
+}
+
+void crc32_update(const void *data, uint32_t len)
+{
+  const uint8_t *p = (const uint8_t *)data;
+
+  // Byte writes keep the result identical to the host side crc32()
+  while (len--)
+  {
+    *(volatile uint8_t *)&LPC_CRC->WR_DATA = *p++;
+  }
+}
+
+uint32_t crc32_sum(void)
+{
+  return LPC_CRC->SUM;
+}
+
+uint32_t crc32(const void *data, uint32_t len)
+{
+  crc32_start();
+  crc32_update(data, len);
+  return crc32_sum();
+}
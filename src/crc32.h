@@ -0,0 +1,22 @@
+/*
+===============================================================================
+ Name        : crc32.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description :
+===============================================================================
+*/
+
+#ifndef CRC32_H_
+#define CRC32_H_
+
+#include <stdint.h>
+
+void     crc32_init(void);
+void     crc32_start(void);
+void     crc32_update(const void *data, uint32_t len);
+uint32_t crc32_sum(void);
+uint32_t crc32(const void *data, uint32_t len);
+
+#endif /* CRC32_H_ */
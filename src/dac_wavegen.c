@@ -8,26 +8,146 @@
 ===============================================================================
 */
 #include "LPC8xx.h"
+#include "lpc_types.h"
 #include "syscon.h"
 #include "iocon.h"
 #include "swm.h"
 #include "dac.h"
 #include "gpio.h"
+#include "ctimer.h"
 #include "config.h"
+#include "dma_common.h"
 #include "dac_wavegen.h"
 
 #include "chip_setup.h"
 
 #define DAC1_IRQHandler PININT5_IRQHandler // DAC1 shares NVIC slot with PININT5 for LPC845
 
-uint16_t const* _sample_data  = NULL;
-uint32_t        _sample_count = 0;
-uint32_t        _dac_wavegen_isr_counter = 0;
+// Per channel generator state. In IRQ mode 'samples'/'count' point to the
+// caller's table; in DDS mode the top 'dds_shift' bits of the 32-bit phase
+// accumulator index it, and the tuning word is added on every DAC tick, so
+// the frequency resolution is DAC_WAVEGEN_DDS_SAMPLE_HZ / 2^32 (~4.7uHz)
+typedef struct
+{
+  uint16_t const*   samples;
+  uint32_t          count;
+  uint32_t          idx;
+  volatile uint32_t dds_phase;
+  volatile uint32_t dds_phase_inc;
+  uint8_t           dds_shift;
+
+  // Sweep state, advanced from the DAC IRQ every sweep_div samples. The
+  // position is the tuning word (linear) or its log2 (log), in Q32.
+  uint64_t          sweep_pos;
+  uint64_t          sweep_start;
+  uint64_t          sweep_step;     // Two's complement for down sweeps
+  uint32_t          sweep_stop_inc;
+  uint32_t          sweep_steps;
+  uint32_t          sweep_count;
+  uint16_t          sweep_div;
+  uint16_t          sweep_tick;
+  volatile uint8_t  sweep_flags;    // 0 = not sweeping
+} dac_wavegen_ch_t;
+
+static dac_wavegen_ch_t _dac_wavegen_ch[2];
+
+// 2^(i/64) in Q30, for the log sweep exp2()
+static const uint32_t _dac_wavegen_exp2_q30[65] = {
+	0x40000000, 0x40B268FA, 0x4166C34C, 0x421D1462, 0x42D561B4, 0x438FB0CB,
+	0x444C0740, 0x450A6ABB, 0x45CAE0F2, 0x468D6FAE, 0x47521CC6, 0x4818EE22,
+	0x48E1E9BA, 0x49AD1598, 0x4A7A77D4, 0x4B4A169C, 0x4C1BF829, 0x4CF022CA,
+	0x4DC69CDD, 0x4E9F6CD4, 0x4F7A9930, 0x50582888, 0x51382182, 0x521A8AD7,
+	0x52FF6B55, 0x53E6C9DA, 0x54D0AD5A, 0x55BD1CDB, 0x56AC1F75, 0x579DBC57,
+	0x5891FAC1, 0x5988E209, 0x5A82799A, 0x5B7EC8F2, 0x5C7DD7A4, 0x5D7FAD59,
+	0x5E8451D0, 0x5F8BCCDB, 0x60962665, 0x61A3666D, 0x62B39509, 0x63C6BA64,
+	0x64DCDEC3, 0x65F60A7F, 0x6712460B, 0x683199ED, 0x69540EC9, 0x6A79AD56,
+	0x6BA27E65, 0x6CCE8AE1, 0x6DFDDBCC, 0x6F307A41, 0x70666F76, 0x719FC4B9,
+	0x72DC8374, 0x741CB528, 0x75606374, 0x76A7980F, 0x77F25CCE, 0x7940BB9E,
+	0x7A92BE8B, 0x7BE86FBA, 0x7D41D96E, 0x7E9F0606, 0x80000000
+};
+uint32_t _dac_wavegen_isr_counter = 0;
+
+// Pre-shifted DAC CR words for the dual channel DMA mode
+static uint32_t _dac_wavegen_dma_buf[2][DAC_WAVEGEN_DMA_SAMPLES];
+
+// Reload descriptors that loop each DMA channel over its buffer forever
+ALIGN(16) static DMA_RELOADDESC_T _dac_wavegen_dma_reload[2];
+
+// Full scale (0..1.8V) 1024 point sine wave for DDS mode
+const uint16_t dac_wavegen_sine_1024[1024] = {
+	279, 281, 282, 284, 286, 288, 289, 291, 293, 294, 296, 298, 300, 301, 303, 305,
+	306, 308, 310, 311, 313, 315, 317, 318, 320, 322, 323, 325, 327, 328, 330, 332,
+	333, 335, 337, 338, 340, 342, 343, 345, 347, 348, 350, 352, 353, 355, 357, 358,
+	360, 362, 363, 365, 367, 368, 370, 371, 373, 375, 376, 378, 379, 381, 383, 384,
+	386, 387, 389, 390, 392, 394, 395, 397, 398, 400, 401, 403, 404, 406, 407, 409,
+	411, 412, 414, 415, 417, 418, 419, 421, 422, 424, 425, 427, 428, 430, 431, 433,
+	434, 435, 437, 438, 440, 441, 442, 444, 445, 447, 448, 449, 451, 452, 453, 455,
+	456, 457, 459, 460, 461, 463, 464, 465, 466, 468, 469, 470, 471, 473, 474, 475,
+	476, 477, 479, 480, 481, 482, 483, 485, 486, 487, 488, 489, 490, 491, 492, 494,
+	495, 496, 497, 498, 499, 500, 501, 502, 503, 504, 505, 506, 507, 508, 509, 510,
+	511, 512, 513, 514, 515, 516, 517, 517, 518, 519, 520, 521, 522, 523, 523, 524,
+	525, 526, 527, 527, 528, 529, 530, 530, 531, 532, 533, 533, 534, 535, 535, 536,
+	537, 537, 538, 539, 539, 540, 541, 541, 542, 542, 543, 543, 544, 544, 545, 545,
+	546, 546, 547, 547, 548, 548, 549, 549, 550, 550, 550, 551, 551, 552, 552, 552,
+	553, 553, 553, 554, 554, 554, 554, 555, 555, 555, 555, 556, 556, 556, 556, 556,
+	557, 557, 557, 557, 557, 557, 557, 558, 558, 558, 558, 558, 558, 558, 558, 558,
+	558, 558, 558, 558, 558, 558, 558, 558, 558, 558, 557, 557, 557, 557, 557, 557,
+	557, 556, 556, 556, 556, 556, 555, 555, 555, 555, 554, 554, 554, 554, 553, 553,
+	553, 552, 552, 552, 551, 551, 550, 550, 550, 549, 549, 548, 548, 547, 547, 546,
+	546, 545, 545, 544, 544, 543, 543, 542, 542, 541, 541, 540, 539, 539, 538, 537,
+	537, 536, 535, 535, 534, 533, 533, 532, 531, 530, 530, 529, 528, 527, 527, 526,
+	525, 524, 523, 523, 522, 521, 520, 519, 518, 517, 517, 516, 515, 514, 513, 512,
+	511, 510, 509, 508, 507, 506, 505, 504, 503, 502, 501, 500, 499, 498, 497, 496,
+	495, 494, 492, 491, 490, 489, 488, 487, 486, 485, 483, 482, 481, 480, 479, 477,
+	476, 475, 474, 473, 471, 470, 469, 468, 466, 465, 464, 463, 461, 460, 459, 457,
+	456, 455, 453, 452, 451, 449, 448, 447, 445, 444, 442, 441, 440, 438, 437, 435,
+	434, 433, 431, 430, 428, 427, 425, 424, 422, 421, 419, 418, 417, 415, 414, 412,
+	411, 409, 407, 406, 404, 403, 401, 400, 398, 397, 395, 394, 392, 390, 389, 387,
+	386, 384, 383, 381, 379, 378, 376, 375, 373, 371, 370, 368, 367, 365, 363, 362,
+	360, 358, 357, 355, 353, 352, 350, 348, 347, 345, 343, 342, 340, 338, 337, 335,
+	333, 332, 330, 328, 327, 325, 323, 322, 320, 318, 317, 315, 313, 311, 310, 308,
+	306, 305, 303, 301, 300, 298, 296, 294, 293, 291, 289, 288, 286, 284, 282, 281,
+	279, 277, 276, 274, 272, 270, 269, 267, 265, 264, 262, 260, 258, 257, 255, 253,
+	252, 250, 248, 247, 245, 243, 241, 240, 238, 236, 235, 233, 231, 230, 228, 226,
+	225, 223, 221, 220, 218, 216, 215, 213, 211, 210, 208, 206, 205, 203, 201, 200,
+	198, 196, 195, 193, 191, 190, 188, 187, 185, 183, 182, 180, 179, 177, 175, 174,
+	172, 171, 169, 168, 166, 164, 163, 161, 160, 158, 157, 155, 154, 152, 151, 149,
+	147, 146, 144, 143, 141, 140, 139, 137, 136, 134, 133, 131, 130, 128, 127, 125,
+	124, 123, 121, 120, 118, 117, 116, 114, 113, 111, 110, 109, 107, 106, 105, 103,
+	102, 101,  99,  98,  97,  95,  94,  93,  92,  90,  89,  88,  87,  85,  84,  83,
+	 82,  81,  79,  78,  77,  76,  75,  73,  72,  71,  70,  69,  68,  67,  66,  64,
+	 63,  62,  61,  60,  59,  58,  57,  56,  55,  54,  53,  52,  51,  50,  49,  48,
+	 47,  46,  45,  44,  43,  42,  41,  41,  40,  39,  38,  37,  36,  35,  35,  34,
+	 33,  32,  31,  31,  30,  29,  28,  28,  27,  26,  25,  25,  24,  23,  23,  22,
+	 21,  21,  20,  19,  19,  18,  17,  17,  16,  16,  15,  15,  14,  14,  13,  13,
+	 12,  12,  11,  11,  10,  10,   9,   9,   8,   8,   8,   7,   7,   6,   6,   6,
+	  5,   5,   5,   4,   4,   4,   4,   3,   3,   3,   3,   2,   2,   2,   2,   2,
+	  1,   1,   1,   1,   1,   1,   1,   0,   0,   0,   0,   0,   0,   0,   0,   0,
+	  0,   0,   0,   0,   0,   0,   0,   0,   0,   0,   1,   1,   1,   1,   1,   1,
+	  1,   2,   2,   2,   2,   2,   3,   3,   3,   3,   4,   4,   4,   4,   5,   5,
+	  5,   6,   6,   6,   7,   7,   8,   8,   8,   9,   9,  10,  10,  11,  11,  12,
+	 12,  13,  13,  14,  14,  15,  15,  16,  16,  17,  17,  18,  19,  19,  20,  21,
+	 21,  22,  23,  23,  24,  25,  25,  26,  27,  28,  28,  29,  30,  31,  31,  32,
+	 33,  34,  35,  35,  36,  37,  38,  39,  40,  41,  41,  42,  43,  44,  45,  46,
+	 47,  48,  49,  50,  51,  52,  53,  54,  55,  56,  57,  58,  59,  60,  61,  62,
+	 63,  64,  66,  67,  68,  69,  70,  71,  72,  73,  75,  76,  77,  78,  79,  81,
+	 82,  83,  84,  85,  87,  88,  89,  90,  92,  93,  94,  95,  97,  98,  99, 101,
+	102, 103, 105, 106, 107, 109, 110, 111, 113, 114, 116, 117, 118, 120, 121, 123,
+	124, 125, 127, 128, 130, 131, 133, 134, 136, 137, 139, 140, 141, 143, 144, 146,
+	147, 149, 151, 152, 154, 155, 157, 158, 160, 161, 163, 164, 166, 168, 169, 171,
+	172, 174, 175, 177, 179, 180, 182, 183, 185, 187, 188, 190, 191, 193, 195, 196,
+	198, 200, 201, 203, 205, 206, 208, 210, 211, 213, 215, 216, 218, 220, 221, 223,
+	225, 226, 228, 230, 231, 233, 235, 236, 238, 240, 241, 243, 245, 247, 248, 250,
+	252, 253, 255, 257, 258, 260, 262, 264, 265, 267, 269, 270, 272, 274, 276, 277
+};
 
 void dac_wavegen_init(uint8_t dac_id)
 {
-  _sample_data  = NULL;
-  _sample_count = 0;
+  dac_wavegen_ch_t* ch = &_dac_wavegen_ch[dac_id ? 1 : 0];
+
+  ch->samples = NULL;
+  ch->count = 0;
+  ch->dds_phase_inc = 0;
 
   // Enable clocks to relevant peripherals
   LPC_SYSCON->SYSAHBCLKCTRL[0] |= SWM|IOCON|GPIO1|GPIO_INT;
@@ -62,8 +182,11 @@ void dac_wavegen_init(uint8_t dac_id)
 
 void dac_wavegen_run(uint8_t dac_id, uint16_t const samples[], uint32_t count, uint32_t freq)
 {
-  _sample_data  = samples;
-  _sample_count = count;
+  dac_wavegen_ch_t* ch = &_dac_wavegen_ch[dac_id ? 1 : 0];
+
+  ch->samples = samples;
+  ch->count = count;
+  ch->dds_phase_inc = 0;
 
   LPC_DAC_TypeDef* lpc_adc = (dac_id ? LPC_DAC1 : LPC_DAC0);
 
@@ -82,45 +205,387 @@ void dac_wavegen_run(uint8_t dac_id, uint16_t const samples[], uint32_t count, u
   NVIC_EnableIRQ( dac_id ? DAC1_IRQn : DAC0_IRQn);
 }
 
-void dac_wavegen_stop(uint8_t dac_id)
+/**
+ * Converts a frequency in mHz into a DDS tuning word (the per-sample
+ * phase increment), i.e. freq * 2^32 / DAC_WAVEGEN_DDS_SAMPLE_HZ.
+ */
+uint32_t dac_wavegen_dds_tuning_word(uint32_t freq_mhz)
 {
-  // TODO more work to do
+  return (uint32_t)(((uint64_t)freq_mhz << 32) / (DAC_WAVEGEN_DDS_SAMPLE_HZ * 1000ULL));
+}
+
+/**
+ * Starts the DAC in DDS mode with a fixed sample clock.
+ *
+ * @param samples     Lookup table with (1 << table_bits) entries
+ * @param table_bits  log2 of the table size (1..DAC_WAVEGEN_DDS_MAX_BITS)
+ * @param freq_mhz    Output frequency in mHz, up to the Nyquist limit
+ */
+void dac_wavegen_dds_run(uint8_t dac_id, uint16_t const samples[], uint8_t table_bits, uint32_t freq_mhz)
+{
+  dac_wavegen_ch_t* ch = &_dac_wavegen_ch[dac_id ? 1 : 0];
+
+  if (table_bits == 0 || table_bits > DAC_WAVEGEN_DDS_MAX_BITS) return;
+
+  LPC_DAC_TypeDef* lpc_adc = (dac_id ? LPC_DAC1 : LPC_DAC0);
+
+  // Keep the ISR quiet while the table is swapped
   NVIC_DisableIRQ( dac_id ? DAC1_IRQn : DAC0_IRQn);
-  Disable_Periph_Clock(dac_id ? CLK_DAC1 : CLK_DAC0);
+
+  ch->samples = samples;
+  ch->count = 1UL << table_bits;
+  ch->dds_shift = 32 - table_bits;
+  ch->dds_phase = 0;
+  ch->dds_phase_inc = dac_wavegen_dds_tuning_word(freq_mhz);
+  ch->sweep_flags = 0;
+
+  // The sample clock is fixed in DDS mode, only the tuning word changes
+  lpc_adc->CNTVAL = (system_ahb_clk / DAC_WAVEGEN_DDS_SAMPLE_HZ) - 1;
+
+  // Power to the DAC!
+  LPC_SYSCON->PDRUNCFG &= ~(dac_id ? DAC1_PD : DAC0_PD);
+
+  // Double buffering enabled, Count enabled.
+  lpc_adc->CTRL = (1<<DAC_DBLBUF_ENA) | (1<<DAC_CNT_ENA);
+
+  NVIC_EnableIRQ( dac_id ? DAC1_IRQn : DAC0_IRQn);
 }
 
-void DAC0_IRQHandler(void)
+/**
+ * Updates the DDS output frequency on the fly. The phase accumulator is
+ * left untouched so the output stays phase-continuous.
+ */
+void dac_wavegen_dds_set_freq(uint8_t dac_id, uint32_t freq_mhz)
 {
-  LPC_DAC_TypeDef* lpc_adc = LPC_DAC0;
+  // A single aligned 32-bit store, so no need to mask the DAC IRQ
+  _dac_wavegen_ch[dac_id ? 1 : 0].sweep_flags = 0;
+  _dac_wavegen_ch[dac_id ? 1 : 0].dds_phase_inc = dac_wavegen_dds_tuning_word(freq_mhz);
+}
 
-  // For debug purposes
-  _dac_wavegen_isr_counter++;
+// log2(x) in Q32, by repeated squaring of the normalised mantissa.
+// Only used when a sweep is set up, never from the IRQ.
+static uint64_t dac_wavegen_log2_q32(uint32_t x)
+{
+  uint64_t result;
+  uint64_t m;
+  uint8_t n = 31;
 
-  static uint32_t idx = 0;
+  if (x == 0) return 0;
 
-  if (_sample_data == NULL || _sample_count == 0 ) return;
+  while (!(x & (1UL << n))) n--;
+  result = (uint64_t)n << 32;
 
-  if (idx >= _sample_count) idx = 0;
+  // Mantissa in [1, 2) as Q31
+  m = (uint64_t)x << (31 - n);
+  for (uint64_t bit = 1ULL << 31; bit; bit >>= 1)
+  {
+    m = (m * m) >> 31;
+    if (m >= (1ULL << 32))
+    {
+      m >>= 1;
+      result += bit;
+    }
+  }
 
-  // ToDo: We need to shift the DAC values 6 bits for now ...
-  // adjust the lookup tables to be pre-shifted instead!
-  lpc_adc->CR = (_sample_data[idx++] << 6) & 0x0000FFFF;
+  return result;
 }
 
-void DAC1_IRQHandler(void)
+// 2^(x) for a Q32 exponent, table lookup plus linear interpolation
+static inline uint32_t dac_wavegen_exp2_q32(uint64_t x)
+{
+  uint32_t n = (uint32_t)(x >> 32);
+  uint32_t frac = (uint32_t)(x >> 16) & 0xFFFF;
+  uint32_t idx = frac >> 10;
+  uint32_t a = _dac_wavegen_exp2_q30[idx];
+  uint32_t v = a + (uint32_t)(((uint64_t)(_dac_wavegen_exp2_q30[idx + 1] - a) * (frac & 0x3FF)) >> 10);
+
+  // Tuning words stay below 2^31 (Nyquist), so n <= 30
+  if (n > 30) n = 30;
+
+  return v >> (30 - n);
+}
+
+/**
+ * Starts a DDS frequency sweep (chirp) on top of dac_wavegen_dds_run().
+ *
+ * The tuning word is stepped from the DAC IRQ DAC_WAVEGEN_SWEEP_UPDATE_HZ
+ * times a second, without touching the phase accumulator, so the output
+ * stays glitch free. SWEEP_SYNC_PIN pulses high for one update at the
+ * start of every sweep.
+ *
+ * @param start_mhz    Start frequency in mHz
+ * @param stop_mhz     Stop frequency in mHz (may be below start_mhz)
+ * @param duration_ms  Sweep time
+ * @param flags        DAC_WAVEGEN_SWEEP_LOG and/or DAC_WAVEGEN_SWEEP_REPEAT
+ *
+ * @return 0 on success, -1 on invalid arguments
+ */
+int dac_wavegen_sweep_run(uint8_t dac_id, uint16_t const samples[], uint8_t table_bits,
+                          uint32_t start_mhz, uint32_t stop_mhz, uint32_t duration_ms, uint8_t flags)
+{
+  dac_wavegen_ch_t* ch = &_dac_wavegen_ch[dac_id ? 1 : 0];
+  uint32_t start_inc = dac_wavegen_dds_tuning_word(start_mhz);
+  uint32_t stop_inc = dac_wavegen_dds_tuning_word(stop_mhz);
+  uint32_t steps = (duration_ms * DAC_WAVEGEN_SWEEP_UPDATE_HZ) / 1000;
+  uint64_t start_pos, stop_pos;
+
+  if (start_inc == 0 || stop_inc == 0 || steps == 0) return -1;
+
+  if (flags & DAC_WAVEGEN_SWEEP_LOG)
+  {
+    start_pos = dac_wavegen_log2_q32(start_inc);
+    stop_pos = dac_wavegen_log2_q32(stop_inc);
+  }
+  else
+  {
+    start_pos = (uint64_t)start_inc << 32;
+    stop_pos = (uint64_t)stop_inc << 32;
+  }
+
+  GPIOSetDir(SWEEP_SYNC_PIN/32, SWEEP_SYNC_PIN%32, 1);
+  LPC_GPIO_PORT->CLR[SWEEP_SYNC_PIN/32] = 1 << (SWEEP_SYNC_PIN%32);
+
+  dac_wavegen_dds_run(dac_id, samples, table_bits, start_mhz);
+
+  NVIC_DisableIRQ( dac_id ? DAC1_IRQn : DAC0_IRQn);
+
+  ch->sweep_start = start_pos;
+  ch->sweep_pos = start_pos;
+  ch->sweep_step = (uint64_t)(((int64_t)stop_pos - (int64_t)start_pos) / (int64_t)steps);
+  ch->sweep_stop_inc = stop_inc;
+  ch->sweep_steps = steps;
+  ch->sweep_count = 0;
+  ch->sweep_div = DAC_WAVEGEN_DDS_SAMPLE_HZ / DAC_WAVEGEN_SWEEP_UPDATE_HZ;
+  ch->sweep_tick = 0;
+  ch->sweep_flags = flags | DAC_WAVEGEN_SWEEP_ACTIVE;
+
+  // Sync pulse for the first sweep
+  LPC_GPIO_PORT->SET[SWEEP_SYNC_PIN/32] = 1 << (SWEEP_SYNC_PIN%32);
+
+  NVIC_EnableIRQ( dac_id ? DAC1_IRQn : DAC0_IRQn);
+
+  return 0;
+}
+
+// One sweep step, called from the DAC IRQ
+static inline void dac_wavegen_sweep_update(dac_wavegen_ch_t* ch)
+{
+  // End of the sync pulse
+  if (ch->sweep_count == 1)
+  {
+    LPC_GPIO_PORT->CLR[SWEEP_SYNC_PIN/32] = 1 << (SWEEP_SYNC_PIN%32);
+  }
+
+  if (++ch->sweep_count >= ch->sweep_steps)
+  {
+    if (!(ch->sweep_flags & DAC_WAVEGEN_SWEEP_REPEAT))
+    {
+      // Park on the stop frequency
+      ch->dds_phase_inc = ch->sweep_stop_inc;
+      ch->sweep_flags = 0;
+      return;
+    }
+
+    ch->sweep_pos = ch->sweep_start;
+    ch->sweep_count = 0;
+    LPC_GPIO_PORT->SET[SWEEP_SYNC_PIN/32] = 1 << (SWEEP_SYNC_PIN%32);
+  }
+  else
+  {
+    ch->sweep_pos += ch->sweep_step;
+  }
+
+  if (ch->sweep_flags & DAC_WAVEGEN_SWEEP_LOG)
+  {
+    ch->dds_phase_inc = dac_wavegen_exp2_q32(ch->sweep_pos);
+  }
+  else
+  {
+    ch->dds_phase_inc = (uint32_t)(ch->sweep_pos >> 32);
+  }
+}
+
+// Resamples a 10-bit source table into a DMA buffer of pre-shifted DAC
+// CR words, applying the channel gain and phase offset
+static void dac_wavegen_dma_render(uint32_t *dst, const dac_wavegen_chcfg_t *cfg)
+{
+  // Phase offset in source samples, 16.16 fixed point
+  uint32_t step  = ((uint32_t)cfg->count << 16) / DAC_WAVEGEN_DMA_SAMPLES;
+  uint32_t pos   = (((uint32_t)cfg->phase_deg % 360) * ((uint32_t)cfg->count << 16)) / 360;
+  uint32_t limit = (uint32_t)cfg->count << 16;
+
+  for (uint32_t i = 0; i < DAC_WAVEGEN_DMA_SAMPLES; i++)
+  {
+    uint32_t v = ((uint32_t)cfg->samples[pos >> 16] * cfg->gain) >> 8;
+    if (v > 0x3FF) v = 0x3FF;
+
+    dst[i] = (v << DAC_VALUE) & 0x0000FFFF;
+
+    pos += step;
+    if (pos >= limit) pos -= limit;
+  }
+}
+
+static void dac_wavegen_dma_channel(uint8_t dac_id)
 {
-  LPC_DAC_TypeDef* lpc_adc = LPC_DAC1;
+  uint8_t dma_ch = dac_id ? DMA_CH_DAC1 : DMA_CH_DAC0;
+  LPC_DAC_TypeDef* lpc_dac = (dac_id ? LPC_DAC1 : LPC_DAC0);
+
+  uint32_t xfercfg = 1 << DMA_XFERCFG_CFGVALID |
+                     1 << DMA_XFERCFG_RELOAD   |  // Loop back to the reload descriptor
+                     0 << DMA_XFERCFG_SETINTA  |  // No CPU involvement at all
+                     2 << DMA_XFERCFG_WIDTH    |  // 32-bit writes to DAC CR
+                     1 << DMA_XFERCFG_SRCINC   |
+                     0 << DMA_XFERCFG_DSTINC   |
+                     (DAC_WAVEGEN_DMA_SAMPLES - 1) << DMA_XFERCFG_XFERCOUNT;
+
+  // The reload descriptor points at itself, so the buffer plays in a loop
+  _dac_wavegen_dma_reload[dac_id].xfercfg = xfercfg;
+  _dac_wavegen_dma_reload[dac_id].source  = (uint32_t) &_dac_wavegen_dma_buf[dac_id][DAC_WAVEGEN_DMA_SAMPLES - 1];
+  _dac_wavegen_dma_reload[dac_id].dest    = (uint32_t) &lpc_dac->CR;
+  _dac_wavegen_dma_reload[dac_id].next    = (uint32_t) &_dac_wavegen_dma_reload[dac_id];
+
+  Chan_Desc_Table[dma_ch].source = _dac_wavegen_dma_reload[dac_id].source;
+  Chan_Desc_Table[dma_ch].dest   = _dac_wavegen_dma_reload[dac_id].dest;
+  Chan_Desc_Table[dma_ch].next   = _dac_wavegen_dma_reload[dac_id].next;
+
+  // One sample per timer match, both channels share the same trigger
+  LPC_DMA->CHANNEL[dma_ch].CFG = 1 << DMA_CFG_HWTRIGEN   |
+                                 0 << DMA_CFG_TRIGTYPE   |   // Edge
+                                 1 << DMA_CFG_TRIGPOL    |   // Rising
+                                 1 << DMA_CFG_TRIGBURST  |
+                                 0 << DMA_CFG_BURSTPOWER |
+                                 0 << DMA_CFG_CHPRIORITY;
+
+  LPC_DMA->ENABLESET0 = 1 << dma_ch;
+  LPC_DMA->SETVALID0 = 1 << dma_ch;
+  LPC_DMA->CHANNEL[dma_ch].XFERCFG = xfercfg;
+
+  // Power up the DAC with its own counter disabled so every DMA write
+  // lands on the output immediately
+  LPC_SYSCON->PDRUNCFG &= ~(dac_id ? DAC1_PD : DAC0_PD);
+  lpc_dac->CTRL = 0;
+}
+
+/**
+ * Starts DAC0 and DAC1 together, phase-locked to a single CTIMER0 match.
+ *
+ * Each channel is resampled into a DAC_WAVEGEN_DMA_SAMPLES point RAM
+ * buffer with its own gain and phase offset, and DMA feeds both DACs from
+ * the same timer trigger, so no CPU time is spent once running. CTIMER0
+ * MAT3 toggles on every sample for a hardware triggered ADC capture.
+ *
+ * @param cfg   Two channel configs, index 0 = DAC0, index 1 = DAC1
+ * @param freq  Output frequency in Hz (shared by both channels)
+ *
+ * @return 0 on success, -1 if the frequency can't be reached
+ */
+int dac_wavegen_dual_run(const dac_wavegen_chcfg_t cfg[2], uint32_t freq)
+{
+  uint32_t ticks;
+
+  if (freq == 0) return -1;
+
+  // Both DMA requests must be served well within one sample period
+  ticks = system_ahb_clk / (freq * DAC_WAVEGEN_DMA_SAMPLES);
+  if (ticks < DAC_WAVEGEN_DMA_MIN_TICKS) return -1;
+
+  dac_wavegen_dual_stop();
+
+  for (uint8_t i = 0; i < 2; i++)
+  {
+    if (cfg[i].samples == NULL || cfg[i].count == 0) return -1;
+
+    // The IRQ paths must not touch the DACs while DMA owns them
+    NVIC_DisableIRQ( i ? DAC1_IRQn : DAC0_IRQn);
+    _dac_wavegen_ch[i].samples = NULL;
+
+    dac_wavegen_dma_render(_dac_wavegen_dma_buf[i], &cfg[i]);
+  }
+
+  dma_common_init();
 
+  // Both channels are triggered by CTIMER0 MAT0
+  LPC_INMUX_TRIGMUX->DMA_ITRIG_INMUX22 = DMA_ITRIG_T0_MAT0;
+  LPC_INMUX_TRIGMUX->DMA_ITRIG_INMUX23 = DMA_ITRIG_T0_MAT0;
+
+  dac_wavegen_dma_channel(0);
+  dac_wavegen_dma_channel(1);
+
+  // CTIMER0 MR0 sets the sample rate, resetting the counter on match
+  Enable_Periph_Clock(CLK_CTIMER0);
+  LPC_CTIMER0->TCR = 1<<CRST;
+  LPC_CTIMER0->PR  = 0;
+  LPC_CTIMER0->MR[0] = ticks - 1;
+  LPC_CTIMER0->MCR = (1<<MR0R);
+
+  // MAT3 toggles with every sample, starting low, so an ADC triggered on
+  // its rising edge converts coherently with the output at half the rate
+  LPC_CTIMER0->MR[3] = ticks - 1;
+  LPC_CTIMER0->EMR = (TOGGLE_ON_MATCH<<EMC3);
+
+  // Start the action, both DMA channels see the first match together
+  LPC_CTIMER0->TCR = 1<<CEN;
+
+  return 0;
+}
+
+void dac_wavegen_dual_stop(void)
+{
+  // Stop the sample clock first so neither channel runs ahead
+  if (LPC_SYSCON->SYSAHBCLKCTRL0 & CTIMER0)
+  {
+    LPC_CTIMER0->TCR = 0;
+  }
+
+  if (LPC_SYSCON->SYSAHBCLKCTRL0 & DMA)
+  {
+    LPC_DMA->ENABLECLR0 = (1 << DMA_CH_DAC0) | (1 << DMA_CH_DAC1);
+    LPC_DMA->ABORT0     = (1 << DMA_CH_DAC0) | (1 << DMA_CH_DAC1);
+  }
+}
+
+void dac_wavegen_stop(uint8_t dac_id)
+{
+  // TODO more work to do
+  NVIC_DisableIRQ( dac_id ? DAC1_IRQn : DAC0_IRQn);
+  Disable_Periph_Clock(dac_id ? CLK_DAC1 : CLK_DAC0);
+}
+
+static inline void dac_wavegen_isr(LPC_DAC_TypeDef* lpc_adc, dac_wavegen_ch_t* ch)
+{
   // For debug purposes
   _dac_wavegen_isr_counter++;
 
-  static uint32_t idx = 0;
+  if (ch->samples == NULL || ch->count == 0 ) return;
+
+  if (ch->dds_phase_inc)
+  {
+    // DDS mode: index the table with the top bits of the phase accumulator
+    lpc_adc->CR = (ch->samples[ch->dds_phase >> ch->dds_shift] << 6) & 0x0000FFFF;
+    ch->dds_phase += ch->dds_phase_inc;
 
-  if (_sample_data == NULL || _sample_count == 0 ) return;
+    if (ch->sweep_flags && ++ch->sweep_tick >= ch->sweep_div)
+    {
+      ch->sweep_tick = 0;
+      dac_wavegen_sweep_update(ch);
+    }
+    return;
+  }
 
-  if (idx >= _sample_count) idx = 0;
+  if (ch->idx >= ch->count) ch->idx = 0;
 
   // ToDo: We need to shift the DAC values 6 bits for now ...
   // adjust the lookup tables to be pre-shifted instead!
-  lpc_adc->CR = (_sample_data[idx++] << 6) & 0x0000FFFF;
+  lpc_adc->CR = (ch->samples[ch->idx++] << 6) & 0x0000FFFF;
+}
+
+void DAC0_IRQHandler(void)
+{
+  dac_wavegen_isr(LPC_DAC0, &_dac_wavegen_ch[0]);
+}
+
+void DAC1_IRQHandler(void)
+{
+  dac_wavegen_isr(LPC_DAC1, &_dac_wavegen_ch[1]);
 }
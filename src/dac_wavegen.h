@@ -18,10 +18,46 @@
  extern "C" {
 #endif
 
+// DDS mode runs the DAC from a fixed sample clock, and the output frequency
+// is set by a 32-bit phase accumulator. At the default 12MHz AHB clock this
+// is 600 ticks per DAC IRQ, well above the ~200 tick limit of the system.
+#define DAC_WAVEGEN_DDS_SAMPLE_HZ   (20000)
+#define DAC_WAVEGEN_DDS_MAX_BITS    (10)    // Lookup tables up to 1024 entries
+
+// Sweeps step the DDS tuning word from the DAC IRQ at this rate
+#define DAC_WAVEGEN_SWEEP_UPDATE_HZ (1000)
+#define DAC_WAVEGEN_SWEEP_LOG       (1 << 0)    // Logarithmic, else linear
+#define DAC_WAVEGEN_SWEEP_REPEAT    (1 << 1)    // Restart at the end, else hold
+#define DAC_WAVEGEN_SWEEP_ACTIVE    (1 << 7)    // Internal
+
+// Dual channel mode resamples both tables to this many points and feeds
+// them to DAC0/DAC1 by DMA, phase-locked to a single CTIMER0 match
+#define DAC_WAVEGEN_DMA_SAMPLES     (128)
+#define DAC_WAVEGEN_DMA_MIN_TICKS   (24)    // Minimum AHB clocks per sample
+
+typedef struct
+{
+	const uint16_t *samples;		// 10-bit source table
+	uint16_t count;					// Number of entries in the source table
+	uint16_t gain;					// Output gain, 256 = 1.0
+	uint16_t phase_deg;				// Phase lead (0..359 degrees), the table starts this far in
+} dac_wavegen_chcfg_t;
+
+extern const uint16_t dac_wavegen_sine_1024[1024];
+
 void dac_wavegen_init(uint8_t dac_id);
 void dac_wavegen_run(uint8_t dac_id, const uint16_t samples[], uint32_t count, uint32_t freq);
 void dac_wavegen_stop(uint8_t dac_id);
 
+int      dac_wavegen_dual_run(const dac_wavegen_chcfg_t cfg[2], uint32_t freq);
+void     dac_wavegen_dual_stop(void);
+
+void     dac_wavegen_dds_run(uint8_t dac_id, const uint16_t samples[], uint8_t table_bits, uint32_t freq_mhz);
+void     dac_wavegen_dds_set_freq(uint8_t dac_id, uint32_t freq_mhz);
+uint32_t dac_wavegen_dds_tuning_word(uint32_t freq_mhz);
+int      dac_wavegen_sweep_run(uint8_t dac_id, const uint16_t samples[], uint8_t table_bits,
+                               uint32_t start_mhz, uint32_t stop_mhz, uint32_t duration_ms, uint8_t flags);
+
 #ifdef __cplusplus
  }
 #endif
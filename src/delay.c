@@ -14,6 +14,8 @@
 #include "utilities.h"
 
 #include "delay.h"
+#include "qei.h"
+#include "input.h"
 
 volatile uint32_t g_delay_ms_ticks = 0;
 
@@ -21,6 +23,9 @@ void
 SysTick_Handler(void)
 {
 	g_delay_ms_ticks++;
+
+	qei_poll();
+	input_tick();
 }
 
 uint32_t millis(void)
@@ -37,7 +42,7 @@ delay_ms(uint32_t delayms)
 
 	while ((g_delay_ms_ticks - curTicks) < delayms)
 	{
-//		__WFI();
+		__WFI();			// Woken by the SysTick at the latest
 	}
 }
 
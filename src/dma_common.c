@@ -0,0 +1,70 @@
+/*
+ ===============================================================================
+ Name        : dma_common.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : DMA controller setup shared by the ADC and DAC drivers
+ ===============================================================================
+ */
+
+#include <stdbool.h>
+
+#include "LPC8xx.h"
+#include "lpc_types.h"
+#include "syscon.h"
+
+#include "dma_common.h"
+
+// Instantiate the channel descriptor table, which must be 512-byte aligned (see lpc8xx_dma.h)
+ALIGN(512) DMA_CHDESC_T Chan_Desc_Table[NUM_DMA_CHANNELS];
+
+static bool _dma_common_ready = false;
+
+// Only the channels that interrupt need a slot, the rest stay NULL
+#define DMA_COMMON_IRQ_CHANNELS  (3)
+static dma_common_handler_t _dma_common_handler[DMA_COMMON_IRQ_CHANNELS];
+
+// Resets and enables the DMA controller once. Later calls are no-ops so
+// that one driver can't wipe out the channels another driver is running.
+void dma_common_init(void)
+{
+  if (_dma_common_ready) return;
+
+  // Reset the DMA, and enable peripheral clocks
+  LPC_SYSCON->PRESETCTRL0 &= (DMA_RST_N);
+  LPC_SYSCON->PRESETCTRL0 |= ~(DMA_RST_N);
+  LPC_SYSCON->SYSAHBCLKCTRL0 |= DMA;
+
+  // Set the master DMA controller enable bit in the CTRL register
+  LPC_DMA->CTRL = 1;
+
+  // Point the SRAMBASE register to the beginning of the channel descriptor SRAM table
+  LPC_DMA->SRAMBASE = (uint32_t) (&Chan_Desc_Table);
+
+  _dma_common_ready = true;
+}
+
+// Routes a channel's INTA flag to its driver. Only the low channels can
+// have a handler, the DAC channels run without interrupts.
+void dma_common_set_handler(uint8_t ch, dma_common_handler_t handler)
+{
+  if (ch >= DMA_COMMON_IRQ_CHANNELS) return;
+
+  _dma_common_handler[ch] = handler;
+}
+
+void DMA_IRQHandler(void)
+{
+  uint32_t intsts = LPC_DMA->INTA0; // Get the interrupt A flags
+
+  LPC_DMA->INTA0 = intsts; // Clear before dispatching, so a block that completes meanwhile isn't lost
+
+  for (uint8_t ch = 0; ch < DMA_COMMON_IRQ_CHANNELS; ch++)
+  {
+    if ((intsts & (1UL << ch)) && _dma_common_handler[ch])
+    {
+      _dma_common_handler[ch]();
+    }
+  }
+}
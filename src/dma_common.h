@@ -0,0 +1,44 @@
+/*
+===============================================================================
+ Name        : dma_common.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description :
+===============================================================================
+*/
+
+#ifndef DMA_COMMON_H_
+#define DMA_COMMON_H_
+
+#include <stdint.h>
+#include "LPC8xx.h"
+#include "dma.h"
+
+// DMA channels are hard wired to their peripheral requests on the LPC845
+#define DMA_CH_ADC           (0)    // USART0 RX request slot, HW triggered by ADC Seq A
+#define DMA_CH_LOGIC         (1)    // USART0 TX request slot, HW triggered by CTIMER0 MAT0
+#define DMA_CH_UART0_TX      (1)    // Same slot for the I2C sniffer's UART stream, never both at once
+#define DMA_CH_FREQ          (2)    // USART1 RX request slot, HW triggered by CTIMER0 MAT0
+#define DMA_CH_DAC0          (22)
+#define DMA_CH_DAC1          (23)
+
+// DMA_ITRIG_INMUX hardware trigger sources
+#define DMA_ITRIG_ADC0_SEQA  (0)
+#define DMA_ITRIG_ADC0_SEQB  (1)
+#define DMA_ITRIG_SCT0_DMA0  (2)
+#define DMA_ITRIG_SCT0_DMA1  (3)
+#define DMA_ITRIG_ACMP_O     (4)
+#define DMA_ITRIG_T0_MAT0    (9)
+#define DMA_ITRIG_T0_MAT1    (10)
+
+// Channel descriptor table, shared by every DMA user (512-byte aligned)
+extern DMA_CHDESC_T Chan_Desc_Table[NUM_DMA_CHANNELS];
+
+// Per-channel INTA callback, run from DMA_IRQHandler
+typedef void (*dma_common_handler_t)(void);
+
+void dma_common_init(void);
+void dma_common_set_handler(uint8_t ch, dma_common_handler_t handler);
+
+#endif /* DMA_COMMON_H_ */
@@ -0,0 +1,386 @@
+/*
+===============================================================================
+ Name        : dsp.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Fixed point signal helpers (CORDIC, Goertzel, log/sqrt)
+===============================================================================
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "dsp.h"
+
+// CORDIC gain compensation, 1/1.6467... in Q30
+#define DSP_CORDIC_K      (652032874)
+#define DSP_CORDIC_STEPS  (30)
+
+// atan(2^-i) in turns
+static const uint32_t _dsp_cordic_atan[DSP_CORDIC_STEPS] = {
+  0x20000000, 0x12E4051E, 0x09FB385B, 0x051111D4, 0x028B0D43, 0x0145D7E1,
+  0x00A2F61E, 0x00517C55, 0x0028BE53, 0x00145F2F, 0x000A2F98, 0x000517CC,
+  0x00028BE6, 0x000145F3, 0x0000A2FA, 0x0000517D, 0x000028BE, 0x0000145F,
+  0x00000A30, 0x00000518, 0x0000028C, 0x00000146, 0x000000A3, 0x00000051,
+  0x00000029, 0x00000014, 0x0000000A, 0x00000005, 0x00000003, 0x00000001
+};
+
+// First quarter of a 1024 point cosine in Q15, for the analysis window
+static const int16_t _dsp_cos_q15[257] = {
+  32767, 32766, 32765, 32761, 32757, 32752, 32745, 32737, 32728, 32717, 32705, 32692,
+  32678, 32663, 32646, 32628, 32609, 32589, 32567, 32545, 32521, 32495, 32469, 32441,
+  32412, 32382, 32351, 32318, 32285, 32250, 32213, 32176, 32137, 32098, 32057, 32014,
+  31971, 31926, 31880, 31833, 31785, 31736, 31685, 31633, 31580, 31526, 31470, 31414,
+  31356, 31297, 31237, 31176, 31113, 31050, 30985, 30919, 30852, 30783, 30714, 30643,
+  30571, 30498, 30424, 30349, 30273, 30195, 30117, 30037, 29956, 29874, 29791, 29706,
+  29621, 29534, 29447, 29358, 29268, 29177, 29085, 28992, 28898, 28803, 28706, 28609,
+  28510, 28411, 28310, 28208, 28105, 28001, 27896, 27790, 27683, 27575, 27466, 27356,
+  27245, 27133, 27019, 26905, 26790, 26674, 26556, 26438, 26319, 26198, 26077, 25955,
+  25832, 25708, 25582, 25456, 25329, 25201, 25072, 24942, 24811, 24680, 24547, 24413,
+  24279, 24143, 24007, 23870, 23731, 23592, 23452, 23311, 23170, 23027, 22884, 22739,
+  22594, 22448, 22301, 22154, 22005, 21856, 21705, 21554, 21403, 21250, 21096, 20942,
+  20787, 20631, 20475, 20317, 20159, 20000, 19841, 19680, 19519, 19357, 19195, 19032,
+  18868, 18703, 18537, 18371, 18204, 18037, 17869, 17700, 17530, 17360, 17189, 17018,
+  16846, 16673, 16499, 16325, 16151, 15976, 15800, 15623, 15446, 15269, 15090, 14912,
+  14732, 14553, 14372, 14191, 14010, 13828, 13645, 13462, 13279, 13094, 12910, 12725,
+  12539, 12353, 12167, 11980, 11793, 11605, 11417, 11228, 11039, 10849, 10659, 10469,
+  10278, 10087,  9896,  9704,  9512,  9319,  9126,  8933,  8739,  8545,  8351,  8157,
+   7962,  7767,  7571,  7375,  7179,  6983,  6786,  6590,  6393,  6195,  5998,  5800,
+   5602,  5404,  5205,  5007,  4808,  4609,  4410,  4210,  4011,  3811,  3612,  3412,
+   3212,  3012,  2811,  2611,  2410,  2210,  2009,  1809,  1608,  1407,  1206,  1005,
+    804,   603,   402,   201,     0
+};
+
+/**
+ * Sine and cosine of an angle in turns, both in Q30.
+ */
+void dsp_sincos(uint32_t angle, int32_t *s, int32_t *c)
+{
+  int32_t a = (int32_t)angle;
+  int32_t x = DSP_CORDIC_K;
+  int32_t y = 0;
+  int32_t t;
+  uint8_t flip = 0;
+
+  // CORDIC only converges within +/-90 degrees, fold the rest over
+  if (a > 0x40000000 || a < -0x40000000)
+  {
+    a = (int32_t)(angle + 0x80000000);
+    flip = 1;
+  }
+
+  for (uint8_t i = 0; i < DSP_CORDIC_STEPS; i++)
+  {
+    t = x;
+    if (a >= 0)
+    {
+      x -= y >> i;
+      y += t >> i;
+      a -= _dsp_cordic_atan[i];
+    }
+    else
+    {
+      x += y >> i;
+      y -= t >> i;
+      a += _dsp_cordic_atan[i];
+    }
+  }
+
+  if (s) *s = flip ? -y : y;
+  if (c) *c = flip ? -x : x;
+}
+
+/**
+ * Four quadrant arctangent of y/x, in turns (DSP_TURN_DEG10 converts).
+ */
+uint32_t dsp_atan2(int32_t y, int32_t x)
+{
+  uint32_t a = 0;
+  int32_t t;
+
+  // Leave headroom for the CORDIC gain
+  while (x >= (1 << 29) || x <= -(1 << 29) || y >= (1 << 29) || y <= -(1 << 29))
+  {
+    x >>= 1;
+    y >>= 1;
+  }
+
+  if (x < 0)
+  {
+    x = -x;
+    y = -y;
+    a = 0x80000000;
+  }
+
+  for (uint8_t i = 0; i < DSP_CORDIC_STEPS; i++)
+  {
+    t = x;
+    if (y > 0)
+    {
+      x += y >> i;
+      y -= t >> i;
+      a += _dsp_cordic_atan[i];
+    }
+    else
+    {
+      x -= y >> i;
+      y += t >> i;
+      a -= _dsp_cordic_atan[i];
+    }
+  }
+
+  return a;
+}
+
+uint32_t dsp_isqrt64(uint64_t x)
+{
+  uint64_t r = 0;
+  uint64_t b = (uint64_t)1 << 62;
+
+  while (b > x) b >>= 2;
+
+  while (b)
+  {
+    if (x >= r + b)
+    {
+      x -= r + b;
+      r = (r >> 1) + b;
+    }
+    else
+    {
+      r >>= 1;
+    }
+    b >>= 2;
+  }
+
+  return (uint32_t)r;
+}
+
+uint32_t dsp_mag(int32_t re, int32_t im)
+{
+  return dsp_isqrt64((uint64_t)((int64_t)re * re) + (uint64_t)((int64_t)im * im));
+}
+
+/**
+ * log2(x) in Q16, by repeated squaring of the normalised mantissa.
+ * Returns INT32_MIN for x = 0.
+ */
+int32_t dsp_log2_q16(uint32_t x)
+{
+  int32_t r = 0;
+  uint32_t m;
+  uint8_t b = 0;
+
+  if (x == 0) return INT32_MIN;
+
+  // Integer part, mantissa left in Q30 (1.0 .. 2.0)
+  while ((x >> b) >= 2) b++;
+  r = (int32_t)b << 16;
+  m = (b <= 30) ? (x << (30 - b)) : (x >> (b - 30));
+
+  // Each squaring of the mantissa yields the next fractional bit
+  for (uint8_t i = 0; i < 16; i++)
+  {
+    m = (uint32_t)(((uint64_t)m * m) >> 30);
+    if (m >= 0x80000000)
+    {
+      m >>= 1;
+      r |= 1 << (15 - i);
+    }
+  }
+
+  return r;
+}
+
+/**
+ * 20*log10(num/den) in 0.1 dB units.
+ */
+int32_t dsp_db10(uint32_t num, uint32_t den)
+{
+  if (num == 0) num = 1;
+  if (den == 0) den = 1;
+
+  // 20*log10(2) = 6.0206 dB per octave of amplitude
+  return (int32_t)(((int64_t)(dsp_log2_q16(num) - dsp_log2_q16(den)) * 60206) / (65536 * 1000));
+}
+
+/**
+ * Single bin DFT of n unsigned samples at bin k (k cycles per n samples).
+ * Each sample is shifted right by 'shift' first, 4 for raw ADC DAT values.
+ *
+ * The DC level is removed first so the resonator state stays within 32
+ * bits for n up to 1024 12-bit samples. The result is scaled to the peak
+ * amplitude of the component in 1/256 LSB, phase relative to a cosine
+ * starting at x[0].
+ */
+void dsp_goertzel(const uint16_t *x, uint32_t n, uint8_t shift, uint32_t k, int32_t *re, int32_t *im)
+{
+  uint32_t w = (uint32_t)(((uint64_t)k << 32) / n);
+  uint32_t sum = 0;
+  int32_t mean;
+  int32_t sw, cw, sr, cr;
+  int32_t s0, s1 = 0, s2 = 0;
+  int64_t yr, yi;
+
+  if (n == 0) return;
+
+  for (uint32_t i = 0; i < n; i++) sum += x[i] >> shift;
+  mean = sum / n;
+
+  dsp_sincos(w, &sw, &cw);
+
+  // s[i] = x[i] + 2cos(w)*s[i-1] - s[i-2]
+  for (uint32_t i = 0; i < n; i++)
+  {
+    s0 = (int32_t)(x[i] >> shift) - mean + (int32_t)(((int64_t)cw * s1) >> 29) - s2;
+    s2 = s1;
+    s1 = s0;
+  }
+
+  // One more step with x[n] = 0, then y = s[n] - e^-jw * s[n-1]
+  s0 = (int32_t)(((int64_t)cw * s1) >> 29) - s2;
+  yr = s0 - (((int64_t)cw * s1) >> 30);
+  yi = ((int64_t)sw * s1) >> 30;
+
+  // X = e^-jwn * y, only a correction when w had to be rounded
+  dsp_sincos(0 - (w * n), &sr, &cr);
+  *re = (int32_t)((((yr * cr - yi * sr) >> 30) * 512) / (int64_t)n);
+  *im = (int32_t)((((yr * sr + yi * cr) >> 30) * 512) / (int64_t)n);
+}
+
+static int32_t dsp_cos1024_q15(uint32_t j)
+{
+  j &= 1023;
+  if (j <= 256) return _dsp_cos_q15[j];
+  if (j <= 512) return -_dsp_cos_q15[512 - j];
+  if (j <= 768) return -_dsp_cos_q15[j - 512];
+  return _dsp_cos_q15[1024 - j];
+}
+
+/**
+ * Measures a periodic signal: frequency, AC RMS and the amplitude of the
+ * fundamental and its harmonics up to DSP_TONE_HARMONICS (or Nyquist).
+ *
+ * The frequency comes from interpolated rising crossings of the mean, then
+ * a bank of Goertzel resonators, one per harmonic, runs over the Hann
+ * windowed block at exactly those frequencies, so there is no scalloping.
+ * The resonators only use 32-bit multiplies (Q15 coefficient, state split
+ * in two halves) and the window steps a fixed point phase, so nothing in
+ * the per sample loop needs the M0+'s software divide.
+ *
+ * @param x       Samples, n a power of two up to 1024
+ * @param shift   Right shift for each sample, 4 for raw ADC DAT values
+ * @param rate_hz Sample rate
+ * @param tone    Results, amplitudes in 1/256 LSB
+ *
+ * @return 0 on success, -1 if no tone (less than two whole periods)
+ */
+int dsp_tone_analyze(const uint16_t *x, uint32_t n, uint8_t shift, uint32_t rate_hz, dsp_tone_t *tone)
+{
+  uint32_t sum = 0;
+  uint64_t power = 0;
+  int32_t mean, v, last = 0, hys, vmin = 0, vmax = 0;
+  int32_t t_first = -1, t_last = -1;
+  uint32_t crossings = 0;
+  uint8_t armed = 0;
+  int32_t c[DSP_TONE_HARMONICS];
+  int32_t s1[DSP_TONE_HARMONICS];
+  int32_t s2[DSP_TONE_HARMONICS];
+  uint8_t count;
+  uint32_t win_inc;
+
+  for (uint32_t i = 0; i < n; i++) sum += x[i] >> shift;
+  mean = sum / n;
+
+  for (uint32_t i = 0; i < n; i++)
+  {
+    v = (int32_t)(x[i] >> shift) - mean;
+    if (v < vmin) vmin = v;
+    if (v > vmax) vmax = v;
+  }
+  hys = (vmax - vmin) / 8;
+
+  // Rising crossings of the mean, re-armed only after dropping below the
+  // hysteresis band, timed to 1/256 sample by linear interpolation
+  for (uint32_t i = 0; i < n; i++)
+  {
+    v = (int32_t)(x[i] >> shift) - mean;
+    power += (uint32_t)(v * v);
+
+    if (v < -hys)
+    {
+      armed = 1;
+    }
+    else if (armed && v >= 0 && i > 0)
+    {
+      int32_t t = ((int32_t)(i - 1) << 8) + ((-last) << 8) / (v - last);
+
+      if (t_first < 0) t_first = t;
+      t_last = t;
+      crossings++;
+      armed = 0;
+    }
+    last = v;
+  }
+
+  tone->rms = dsp_isqrt64((power << 16) / n);
+  tone->harmonics = 0;
+
+  if (crossings < 3 || hys == 0)
+  {
+    tone->freq_mhz = 0;
+    return -1;
+  }
+
+  // Periods between the first and last crossing over their distance
+  tone->freq_mhz = (uint32_t)(((uint64_t)(crossings - 1) * rate_hz * 1000 * 256) / (uint32_t)(t_last - t_first));
+
+  // One resonator per harmonic below Nyquist
+  for (count = 0; count < DSP_TONE_HARMONICS; count++)
+  {
+    uint64_t w = ((uint64_t)(count + 1) * tone->freq_mhz << 32) / ((uint64_t)rate_hz * 1000);
+    int32_t cw;
+
+    if (w >= 0x7F000000) break;
+
+    dsp_sincos((uint32_t)w, NULL, &cw);
+    c[count] = cw >> 14;      // 2cos(w) in Q15
+    s1[count] = 0;
+    s2[count] = 0;
+  }
+
+  // Hann window phase, 1024 steps per block in Q16
+  win_inc = (1024UL << 16) / n;
+
+  for (uint32_t i = 0, win = 0; i < n; i++, win += win_inc)
+  {
+    // Hann window, input scaled x4 for headroom in the resonators
+    int32_t w = (32768 - dsp_cos1024_q15(win >> 16)) >> 1;
+    v = ((((int32_t)(x[i] >> shift) - mean) * w) >> 13);
+
+    for (uint8_t h = 0; h < count; h++)
+    {
+      int32_t s = s1[h];
+
+      // (c * s) >> 15 without a 64-bit multiply
+      int32_t cs = c[h] * (s >> 15) + ((c[h] * (s & 0x7FFF)) >> 15);
+
+      s1[h] = v + cs - s2[h];
+      s2[h] = s;
+    }
+  }
+
+  for (uint8_t h = 0; h < count; h++)
+  {
+    // |X|^2 = s1^2 + s2^2 - 2cos(w)*s1*s2
+    int64_t m = (int64_t)s1[h] * s1[h] + (int64_t)s2[h] * s2[h] -
+                (((int64_t)s1[h] * s2[h]) >> 15) * c[h];
+
+    // Peak = 2|X| / (n * window gain 0.5 * input scale 4)
+    tone->ampl[h] = (uint32_t)(((uint64_t)dsp_isqrt64(m > 0 ? m : 0) * 256) / n);
+  }
+  tone->harmonics = count;
+
+  return 0;
+}
@@ -0,0 +1,40 @@
+/*
+===============================================================================
+ Name        : dsp.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description :
+===============================================================================
+*/
+
+#ifndef DSP_H_
+#define DSP_H_
+
+#include <stdint.h>
+
+// Angles are binary 'turns': the full uint32_t range is one revolution
+#define DSP_TURN_DEG10(_a)   ((int32_t)(((int64_t)(int32_t)(_a) * 3600) >> 32))
+
+// Fundamental plus harmonics 2..5, what fits in one 1024 sample block
+// period at 100kHz
+#define DSP_TONE_HARMONICS   (5)
+
+typedef struct
+{
+  uint32_t freq_mhz;                    // Fundamental, in mHz
+  uint32_t rms;                         // AC RMS of the block, 1/256 LSB
+  uint32_t ampl[DSP_TONE_HARMONICS];    // Peak amplitudes, [0] = fundamental, 1/256 LSB
+  uint8_t  harmonics;                   // Valid entries in ampl[]
+} dsp_tone_t;
+
+void     dsp_sincos(uint32_t angle, int32_t *s, int32_t *c);
+uint32_t dsp_atan2(int32_t y, int32_t x);
+uint32_t dsp_isqrt64(uint64_t x);
+uint32_t dsp_mag(int32_t re, int32_t im);
+int32_t  dsp_log2_q16(uint32_t x);
+int32_t  dsp_db10(uint32_t num, uint32_t den);
+void     dsp_goertzel(const uint16_t *x, uint32_t n, uint8_t shift, uint32_t k, int32_t *re, int32_t *im);
+int      dsp_tone_analyze(const uint16_t *x, uint32_t n, uint8_t shift, uint32_t rate_hz, dsp_tone_t *tone);
+
+#endif /* DSP_H_ */
@@ -0,0 +1,218 @@
+/*
+===============================================================================
+ Name        : evloop.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Cooperative event loop for the UI
+===============================================================================
+*/
+
+#include "LPC8xx.h"
+#include "core_cm0plus.h"
+
+#include "config.h"
+#include "delay.h"
+#include "input.h"
+#include "evloop.h"
+
+/*
+ The apps used to spin on button_pressed() and the QEI between bits of work.
+ evloop_run() hands the input events (see input.c) to the app's handlers
+ instead, fires the software timers and runs the calls deferred from
+ interrupts. When a pass has nothing left to do the core sleeps until the
+ next interrupt: at worst the 1ms SysTick, which the button debounce needs
+ anyway, or sooner when a DMA block or a capture comes in.
+
+ Timers are global, so a nested evloop_run() (a mode select inside an app)
+ keeps firing the outer app's timers. Stop them before returning.
+*/
+
+typedef struct
+{
+  evloop_fn_t fn;
+  void       *arg;
+} evloop_call_t;
+
+static evloop_call_t    _evloop_defer[EVLOOP_DEFER_SIZE];
+static volatile uint8_t _evloop_defer_head = 0;     // Written by evloop_defer()
+static volatile uint8_t _evloop_defer_tail = 0;     // Written by the loop
+static volatile uint8_t _evloop_quit = 0;
+static evloop_timer_t  *_evloop_timers = 0;
+
+/**
+ * Queues a call to 'fn' on the next pass of the loop. Safe from interrupts,
+ * which is the point: keep the ISR short and do the rest here.
+ *
+ * @return 0 on success, -1 if the queue is full
+ */
+int evloop_defer(evloop_fn_t fn, void *arg)
+{
+  uint32_t primask = __get_PRIMASK();
+  int ret = -1;
+
+  __disable_irq();
+  if ((uint8_t)(_evloop_defer_head - _evloop_defer_tail) < EVLOOP_DEFER_SIZE)
+  {
+    _evloop_defer[_evloop_defer_head & (EVLOOP_DEFER_SIZE - 1)].fn = fn;
+    _evloop_defer[_evloop_defer_head & (EVLOOP_DEFER_SIZE - 1)].arg = arg;
+    _evloop_defer_head++;
+    ret = 0;
+  }
+  __set_PRIMASK(primask);
+
+  return ret;
+}
+
+/**
+ * Runs 'fn' after 'ms', then every 'period' ms (0 = once). 't' stays linked
+ * into the loop until it expires or evloop_timer_stop(), so it must outlive
+ * that, a static in the app is the usual place. Restarting an armed timer
+ * just moves it.
+ */
+void evloop_timer_start(evloop_timer_t *t, uint32_t ms, uint32_t period, evloop_fn_t fn, void *arg)
+{
+  evloop_timer_stop(t);
+
+  t->fn = fn;
+  t->arg = arg;
+  t->due = millis() + ms;
+  t->period = period;
+  t->armed = 1;
+  t->next = _evloop_timers;
+  _evloop_timers = t;
+}
+
+void evloop_timer_stop(evloop_timer_t *t)
+{
+  evloop_timer_t **p;
+
+  for (p = &_evloop_timers; *p; p = &(*p)->next)
+  {
+    if (*p == t)
+    {
+      *p = t->next;
+      break;
+    }
+  }
+  t->armed = 0;
+}
+
+/**
+ * Makes evloop_run() return 0 once the current handler is done.
+ */
+void evloop_quit(void)
+{
+  _evloop_quit = 1;
+}
+
+// Fires the first expired timer. The list is walked again from the top
+// after every call since the handler may start or stop timers.
+static int evloop_fire_timer(uint32_t now)
+{
+  evloop_timer_t *t;
+
+  for (t = _evloop_timers; t; t = t->next)
+  {
+    if ((int32_t)(now - t->due) >= 0)
+    {
+      if (t->period)
+      {
+        t->due += t->period;
+
+        // Fell more than a period behind, don't fire a burst to catch up
+        if ((int32_t)(now - t->due) >= 0)
+        {
+          t->due = now + t->period;
+        }
+      }
+      else
+      {
+        evloop_timer_stop(t);
+      }
+
+      t->fn(t->arg);
+      return 1;
+    }
+  }
+
+  return 0;
+}
+
+static void evloop_run_deferred(void)
+{
+  evloop_call_t c;
+
+  while (_evloop_defer_tail != _evloop_defer_head)
+  {
+    c = _evloop_defer[_evloop_defer_tail & (EVLOOP_DEFER_SIZE - 1)];
+    _evloop_defer_tail++;
+    c.fn(c.arg);
+  }
+}
+
+/**
+ * Dispatches the input, timers and deferred calls to 'h' until one of the
+ * exit buttons is pressed or a handler calls evloop_quit().
+ *
+ * @return The button_pressed() mask that ended the loop, 0 for evloop_quit()
+ */
+uint32_t evloop_run(const evloop_handlers_t *h)
+{
+  uint32_t exit_mask = h->exit_mask ? h->exit_mask : (1 << QEI_SW_PIN);
+  input_event_t ev;
+
+  _evloop_quit = 0;
+
+  // Clicks and turns from before the app was ready aren't meant for it
+  input_flush();
+
+  while (1)
+  {
+    while (input_get(&ev))
+    {
+      if (ev.kind == INPUT_EV_PRESS)
+      {
+        if (ev.value & exit_mask)
+        {
+          return ev.value;
+        }
+        if (h->button)
+        {
+          h->button(ev.value, h->arg);
+        }
+      }
+      else if (ev.kind == INPUT_EV_ROTATE && h->qei)
+      {
+        h->qei(ev.value, h->arg);
+      }
+
+      if (h->event)
+      {
+        h->event(&ev, h->arg);
+      }
+    }
+
+    while (evloop_fire_timer(millis()));
+
+    evloop_run_deferred();
+
+    if (h->poll)
+    {
+      h->poll(h->arg);
+    }
+
+    // Masked so a deferred call queued after the check still wakes the WFI
+    __disable_irq();
+    if (!_evloop_quit && _evloop_defer_tail == _evloop_defer_head)
+    {
+      __WFI();
+    }
+    __enable_irq();
+
+    if (_evloop_quit)
+    {
+      return 0;
+    }
+  }
+}
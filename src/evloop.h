@@ -0,0 +1,49 @@
+/*
+===============================================================================
+ Name        : evloop.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Cooperative event loop for the UI
+===============================================================================
+*/
+
+#ifndef EVLOOP_H_
+#define EVLOOP_H_
+
+#include <stdint.h>
+#include "input.h"
+
+#define EVLOOP_DEFER_SIZE     (8)         // Deferred calls in flight, power of 2
+
+typedef void (*evloop_fn_t)(void *arg);
+
+// Software timer, owned by the caller and linked into the loop while armed
+typedef struct evloop_timer_s
+{
+  evloop_fn_t            fn;
+  void                  *arg;
+  uint32_t               due;           // millis() of the next expiry
+  uint32_t               period;        // ms, 0 = one shot
+  uint8_t                armed;
+  struct evloop_timer_s *next;
+} evloop_timer_t;
+
+// Per-app handlers, any of them can be NULL
+typedef struct
+{
+  void     (*button)(uint32_t pressed, void *arg);  // INPUT_EV_PRESS, see button_pressed()
+  void     (*qei)(int32_t steps, void *arg);        // INPUT_EV_ROTATE
+  void     (*event)(const input_event_t *ev, void *arg); // Every event, after the two above
+  void     (*poll)(void *arg);                      // Once per wake up, for DMA blocks and the like
+  void      *arg;
+  uint32_t   exit_mask;                             // Buttons that end evloop_run(), 0 = the QEI switch
+} evloop_handlers_t;
+
+uint32_t evloop_run         (const evloop_handlers_t *h);
+void     evloop_quit        (void);
+int      evloop_defer       (evloop_fn_t fn, void *arg);
+void     evloop_timer_start (evloop_timer_t *t, uint32_t ms, uint32_t period, evloop_fn_t fn, void *arg);
+void     evloop_timer_stop  (evloop_timer_t *t);
+
+#endif /* EVLOOP_H_ */
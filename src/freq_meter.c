@@ -0,0 +1,402 @@
+/*
+===============================================================================
+ Name        : freq_meter.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Reciprocal frequency, period and duty cycle meter (CTIMER0)
+===============================================================================
+*/
+
+#include "LPC8xx.h"
+#include "lpc_types.h"
+#include "core_cm0plus.h"
+#include "syscon.h"
+#include "swm.h"
+#include "ctimer.h"
+#include "mrt.h"
+#include "dma.h"
+
+#include "config.h"
+#include "delay.h"
+#include "dma_common.h"
+#include "freq_meter.h"
+
+/*
+ Pins used in this application:
+
+ FREQ_IN_PIN [I] - T0_CAP0 (rising edges) and T0_CAP1 (falling edges)
+*/
+
+// The SCT holds the QEI, so CTIMER0 does the capturing. Both modes count
+// reciprocally: the gate always spans a whole number of input periods and
+// the time between its first and last edge is measured, so the resolution
+// is one timer clock over the gate, whatever the input frequency.
+//
+// Edge mode: CAP0/CAP1 timestamp every rising/falling edge in hardware,
+// the ISR only sums them up, giving period and duty down to ~0.1Hz.
+// Count mode: the timer counts rising edges (up to system_ahb_clk/2) and
+// matches every N of them, where MRT channel 1 free runs as the time
+// reference. The timer can't count and timestamp at once and the QEI holds
+// the SCT, so the MAT0 match itself triggers a DMA copy of the MRT: the
+// stamp is taken a fixed few clocks after the edge, not whenever the
+// interrupt gets to run. The DMA interrupt only does the bookkeeping. N
+// keeps it near FREQ_METER_COUNT_IRQ_HZ, so the CPU cost no longer grows
+// with the input frequency. There is no duty here.
+#define FREQ_METER_COUNT_IRQ_HZ  (1000)
+#define FREQ_METER_GUARD_EDGES   (1024)     // Edge mode overrun check, power of 2
+#define FREQ_METER_TIMEOUT_MS    (12000)    // No whole period in this long is no signal
+#define FREQ_METER_MRT_CH        (1)        // Channel 0 is the ADC sample clock
+#define FREQ_METER_MRT_MASK      (0x7FFFFFFF)
+
+static freq_meter_mode_t  _freq_meter_mode;
+static uint32_t           _freq_meter_gate_ms;
+static uint32_t           _freq_meter_gate_start;    // millis()
+static uint32_t           _freq_meter_result_ms;     // millis() of the last result
+static uint32_t           _freq_meter_n;             // Count mode edges per match
+
+// Gate window, kept by the ISR. 'periods' counts input periods in edge
+// mode and MAT0 matches in count mode, between 'first' and 'last'.
+static volatile uint32_t  _freq_meter_first;
+static volatile uint32_t  _freq_meter_last;
+static volatile uint32_t  _freq_meter_periods;
+static volatile uint32_t  _freq_meter_high;          // High time up to 'last'
+static volatile uint32_t  _freq_meter_high_open;     // High time up to now
+static volatile uint32_t  _freq_meter_rise;          // Last rising edge
+static volatile uint8_t   _freq_meter_started;       // 'first' is valid
+static volatile uint8_t   _freq_meter_overrun;       // Edge rate too high for edge mode
+
+// Count mode, MRT at the last MAT0, written by the DMA
+static volatile uint32_t  _freq_meter_stamp;
+ALIGN(16) static DMA_RELOADDESC_T _freq_meter_desc;
+
+static void freq_meter_dma_stop(void)
+{
+  LPC_DMA->INTENCLR0  = 1 << DMA_CH_FREQ;
+  LPC_DMA->ENABLECLR0 = 1 << DMA_CH_FREQ;
+  LPC_DMA->ABORT0     = 1 << DMA_CH_FREQ;
+}
+
+// Count mode, the stamp of this match has landed
+static void freq_meter_dma_isr(void)
+{
+  // The MRT counts down, flip it into an up count
+  uint32_t t = ~_freq_meter_stamp & FREQ_METER_MRT_MASK;
+
+  if (!_freq_meter_started)
+  {
+    _freq_meter_first = t;
+    _freq_meter_started = 1;
+  }
+  else
+  {
+    _freq_meter_periods++;
+    _freq_meter_last = t;
+  }
+}
+
+// One word from the MRT on every MAT0, the descriptor reloads itself
+static void freq_meter_dma_start(void)
+{
+  uint32_t xfercfg = 1 << DMA_XFERCFG_CFGVALID |
+                     1 << DMA_XFERCFG_RELOAD |
+                     1 << DMA_XFERCFG_SETINTA |
+                     2 << DMA_XFERCFG_WIDTH |     // 32 bits
+                     0 << DMA_XFERCFG_SRCINC |
+                     0 << DMA_XFERCFG_DSTINC |
+                     0 << DMA_XFERCFG_XFERCOUNT;
+
+  dma_common_set_handler(DMA_CH_FREQ, freq_meter_dma_isr);
+
+  _freq_meter_desc.xfercfg = xfercfg;
+  _freq_meter_desc.source  = (uint32_t) &LPC_MRT->Channel[FREQ_METER_MRT_CH].TIMER;
+  _freq_meter_desc.dest    = (uint32_t) &_freq_meter_stamp;
+  _freq_meter_desc.next    = (uint32_t) &_freq_meter_desc;
+
+  Chan_Desc_Table[DMA_CH_FREQ].source = _freq_meter_desc.source;
+  Chan_Desc_Table[DMA_CH_FREQ].dest   = _freq_meter_desc.dest;
+  Chan_Desc_Table[DMA_CH_FREQ].next   = _freq_meter_desc.next;
+
+  LPC_DMA->CHANNEL[DMA_CH_FREQ].CFG = 1 << DMA_CFG_HWTRIGEN |
+                                      0 << DMA_CFG_TRIGTYPE |
+                                      1 << DMA_CFG_TRIGPOL  |
+                                      1 << DMA_CFG_TRIGBURST |
+                                      0 << DMA_CFG_BURSTPOWER |
+                                      0 << DMA_CFG_CHPRIORITY;
+
+  LPC_INMUX_TRIGMUX->DMA_ITRIG_INMUX2 = DMA_ITRIG_T0_MAT0;
+
+  LPC_DMA->INTA0 = 1 << DMA_CH_FREQ;
+  LPC_DMA->ENABLESET0 = 1 << DMA_CH_FREQ;
+  LPC_DMA->INTENSET0 = 1 << DMA_CH_FREQ;
+  LPC_DMA->SETVALID0 = 1 << DMA_CH_FREQ;
+  LPC_DMA->CHANNEL[DMA_CH_FREQ].XFERCFG = xfercfg;
+
+  NVIC_EnableIRQ(DMA_IRQn);
+}
+
+static void freq_meter_set_mode(freq_meter_mode_t mode, uint32_t hz)
+{
+  NVIC_DisableIRQ(CTIMER0_IRQn);
+  freq_meter_dma_stop();
+
+  LPC_CTIMER0->TCR = 1<<CRST;
+  LPC_CTIMER0->PR  = 0;
+  LPC_CTIMER0->IR  = 0xFF;
+
+  _freq_meter_started = 0;
+  _freq_meter_periods = 0;
+  _freq_meter_high = 0;
+  _freq_meter_high_open = 0;
+  _freq_meter_rise = 0;       // The counter restarts from 0, see CTIMER0_IRQHandler()
+  _freq_meter_overrun = 0;
+
+  if (mode == FREQ_METER_MODE_EDGE)
+  {
+    LPC_CTIMER0->CTCR = TIMER_MODE<<CTMODE;
+    LPC_CTIMER0->MCR  = 0;
+    LPC_CTIMER0->CCR  = 1<<CAP0RE | 1<<CAP0I | 1<<CAP1FE | 1<<CAP1I;
+  }
+  else
+  {
+    // MR0 = 0 would match with the counter held in reset
+    _freq_meter_n = hz / FREQ_METER_COUNT_IRQ_HZ;
+    if (_freq_meter_n < 2) _freq_meter_n = 2;
+
+    LPC_CTIMER0->CCR  = 0;
+    LPC_CTIMER0->CTCR = COUNTER_MODE_RISING<<CTMODE | 0<<CINSEL;    // Count CAP0
+    LPC_CTIMER0->MR[0] = _freq_meter_n - 1;
+    LPC_CTIMER0->MCR  = 1<<MR0R;
+
+    freq_meter_dma_start();
+  }
+
+  _freq_meter_mode = mode;
+  _freq_meter_gate_start = millis();
+
+  LPC_CTIMER0->TCR = 1<<CEN;
+
+  NVIC_ClearPendingIRQ(CTIMER0_IRQn);
+  NVIC_EnableIRQ(CTIMER0_IRQn);
+}
+
+/**
+ * Routes FREQ_IN_PIN to the CTIMER0 captures and starts measuring in edge
+ * mode, moving to count mode by itself if the input is fast.
+ *
+ * @param gate_ms   Minimum gate time, a gate is extended until it holds a
+ *                  whole input period
+ */
+void freq_meter_start(uint32_t gate_ms)
+{
+  LPC_SYSCON->SYSAHBCLKCTRL0 |= (SWM | MRT);
+  Enable_Periph_Clock(CLK_CTIMER0);
+
+  // Both captures on the same pin, one per edge, so the ISR never has to
+  // guess which edge it got
+  ConfigSWM(T0_CAP0, FREQ_IN_PIN);
+  ConfigSWM(T0_CAP1, FREQ_IN_PIN);
+
+  // Free running time reference for count mode, no interrupt
+  LPC_MRT->Channel[FREQ_METER_MRT_CH].CTRL = (MRT_Repeat<<MRT_MODE);
+  LPC_MRT->Channel[FREQ_METER_MRT_CH].INTVAL = ForceLoad | FREQ_METER_MRT_MASK;
+
+  dma_common_init();
+
+  _freq_meter_gate_ms = gate_ms;
+  _freq_meter_result_ms = millis();
+
+  freq_meter_set_mode(FREQ_METER_MODE_EDGE, 0);
+}
+
+void freq_meter_stop(void)
+{
+  NVIC_DisableIRQ(CTIMER0_IRQn);
+
+  LPC_CTIMER0->TCR  = 0;
+  LPC_CTIMER0->CCR  = 0;
+  LPC_CTIMER0->CTCR = 0;
+  LPC_CTIMER0->MCR  = 0;
+  LPC_CTIMER0->IR   = 0xFF;
+
+  freq_meter_dma_stop();
+
+  // Loading 0 idles the channel
+  LPC_MRT->Channel[FREQ_METER_MRT_CH].INTVAL = ForceLoad | 0;
+}
+
+void freq_meter_set_gate(uint32_t gate_ms)
+{
+  _freq_meter_gate_ms = gate_ms;
+}
+
+/**
+ * Closes the gate once it has run for the gate time and holds at least
+ * one whole period, and switches modes if the frequency asks for it.
+ * Call from the main loop.
+ *
+ * @return 1 with a new result in 'r' (r->periods = 0 means no signal),
+ *         0 if the gate is still open
+ */
+int freq_meter_poll(freq_meter_result_t *r)
+{
+  uint32_t now = millis();
+  uint32_t first, last, periods, high;
+
+  if (_freq_meter_overrun)
+  {
+    // The ISR gave up on timestamping, count the edges instead
+    freq_meter_set_mode(FREQ_METER_MODE_COUNT, 2 * FREQ_METER_EDGE_MAX_HZ);
+    return 0;
+  }
+
+  if (now - _freq_meter_gate_start < _freq_meter_gate_ms)
+  {
+    return 0;
+  }
+
+  // Take the window and start the next one on its last edge, gapless
+  __disable_irq();
+  first = _freq_meter_first;
+  last = _freq_meter_last;
+  periods = _freq_meter_periods;
+  high = _freq_meter_high;
+  if (periods)
+  {
+    _freq_meter_first = last;
+    _freq_meter_periods = 0;
+    _freq_meter_high_open -= high;
+    _freq_meter_high = 0;
+  }
+  __enable_irq();
+
+  _freq_meter_gate_start = now;
+
+  if (!periods)
+  {
+    // A count mode input that stopped goes back to timestamping
+    if (_freq_meter_mode == FREQ_METER_MODE_COUNT)
+    {
+      freq_meter_set_mode(FREQ_METER_MODE_EDGE, 0);
+    }
+
+    if (now - _freq_meter_result_ms < FREQ_METER_TIMEOUT_MS)
+    {
+      return 0;
+    }
+
+    r->freq_mhz = 0;
+    r->period_ns = 0;
+    r->duty = FREQ_METER_DUTY_NONE;
+    r->periods = 0;
+    r->mode = _freq_meter_mode;
+    _freq_meter_result_ms = now;
+    return 1;
+  }
+
+  uint64_t edges = periods;
+  uint32_t dt = last - first;
+
+  if (_freq_meter_mode == FREQ_METER_MODE_COUNT)
+  {
+    edges *= _freq_meter_n;
+    dt &= FREQ_METER_MRT_MASK;
+  }
+
+  r->freq_mhz = edges * system_ahb_clk * 1000 / dt;
+  r->period_ns = (uint64_t)dt * 1000000000 / (edges * system_ahb_clk);
+  r->duty = _freq_meter_mode == FREQ_METER_MODE_EDGE ? (uint16_t)((uint64_t)high * 1000 / dt) : FREQ_METER_DUTY_NONE;
+  r->periods = (uint32_t)edges;
+  r->mode = _freq_meter_mode;
+  _freq_meter_result_ms = now;
+
+  // Pick the mode for the next gate, with some hysteresis, and keep the
+  // count interrupt rate in range
+  uint32_t hz = (uint32_t)(r->freq_mhz / 1000);
+
+  if (_freq_meter_mode == FREQ_METER_MODE_EDGE && hz > FREQ_METER_EDGE_MAX_HZ)
+  {
+    freq_meter_set_mode(FREQ_METER_MODE_COUNT, hz);
+  }
+  else if (_freq_meter_mode == FREQ_METER_MODE_COUNT && hz < FREQ_METER_EDGE_MAX_HZ / 2)
+  {
+    freq_meter_set_mode(FREQ_METER_MODE_EDGE, 0);
+  }
+  else if (_freq_meter_mode == FREQ_METER_MODE_COUNT &&
+           (hz / FREQ_METER_COUNT_IRQ_HZ > 2 * _freq_meter_n || 2 * (hz / FREQ_METER_COUNT_IRQ_HZ) < _freq_meter_n))
+  {
+    freq_meter_set_mode(FREQ_METER_MODE_COUNT, hz);
+  }
+
+  return 1;
+}
+
+// Edge mode, falling edge closes a high pulse
+static inline void freq_meter_fall(uint32_t fall)
+{
+  if (_freq_meter_started)
+  {
+    _freq_meter_high_open += fall - _freq_meter_rise;
+  }
+}
+
+// Edge mode, rising edge closes a period
+static inline void freq_meter_rise(uint32_t rise)
+{
+  if (!_freq_meter_started)
+  {
+    _freq_meter_first = rise;
+    _freq_meter_started = 1;
+  }
+  else
+  {
+    _freq_meter_periods++;
+    _freq_meter_last = rise;
+    _freq_meter_high = _freq_meter_high_open;
+
+    // Far above the switch point the interrupts would starve the main
+    // loop before the gate closes, bail out early
+    if ((_freq_meter_periods & (FREQ_METER_GUARD_EDGES - 1)) == 0 &&
+        rise - _freq_meter_first < _freq_meter_periods * (system_ahb_clk / (2 * FREQ_METER_EDGE_MAX_HZ)))
+    {
+      LPC_CTIMER0->CCR = 0;
+      _freq_meter_overrun = 1;
+    }
+  }
+
+  _freq_meter_rise = rise;
+}
+
+void CTIMER0_IRQHandler(void)
+{
+  uint32_t ir = LPC_CTIMER0->IR;
+  LPC_CTIMER0->IR = ir;
+
+  if ((ir & (1<<CR0INT)) && (ir & (1<<CR1INT)))
+  {
+    // Both edges came in one interrupt latency, a narrow pulse or a
+    // narrow gap. Take them in the order they happened, counted from the
+    // last rise, or the high time spans the whole period.
+    uint32_t rise = LPC_CTIMER0->CR[0];
+    uint32_t fall = LPC_CTIMER0->CR[1];
+
+    if (fall - _freq_meter_rise < rise - _freq_meter_rise)
+    {
+      freq_meter_fall(fall);
+      freq_meter_rise(rise);
+    }
+    else
+    {
+      freq_meter_rise(rise);
+      freq_meter_fall(fall);
+    }
+  }
+  else if (ir & (1<<CR1INT))
+  {
+    freq_meter_fall(LPC_CTIMER0->CR[1]);
+  }
+  else if (ir & (1<<CR0INT))
+  {
+    freq_meter_rise(LPC_CTIMER0->CR[0]);
+  }
+}
@@ -0,0 +1,43 @@
+/*
+===============================================================================
+ Name        : freq_meter.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description :
+===============================================================================
+*/
+
+#ifndef FREQ_METER_H_
+#define FREQ_METER_H_
+
+#include <stdint.h>
+
+// Above this the edge interrupts get too expensive and the meter counts
+// edges in hardware instead, back below half of it it timestamps again
+#define FREQ_METER_EDGE_MAX_HZ   (20000)
+
+#define FREQ_METER_DUTY_NONE     (0xFFFF)
+
+typedef enum
+{
+  FREQ_METER_MODE_EDGE = 0,   // Every edge timestamped by capture (period, duty)
+  FREQ_METER_MODE_COUNT,      // Edges counted by the timer, one IRQ per N edges
+  FREQ_METER_MODE_LAST
+} freq_meter_mode_t;
+
+typedef struct
+{
+  uint64_t          freq_mhz;   // Frequency, mHz
+  uint64_t          period_ns;
+  uint16_t          duty;       // High time, 0.1%, or FREQ_METER_DUTY_NONE
+  uint32_t          periods;    // Whole periods in the gate
+  freq_meter_mode_t mode;
+} freq_meter_result_t;
+
+void freq_meter_start(uint32_t gate_ms);
+void freq_meter_stop(void);
+void freq_meter_set_gate(uint32_t gate_ms);
+int  freq_meter_poll(freq_meter_result_t *r);
+
+#endif /* FREQ_METER_H_ */
@@ -384,3 +384,43 @@ int gfx_printdec(uint8_t x, uint8_t y, int32_t dec, uint8_t scale, uint8_t color
 
 	return 0;
 }
+
+// Prints dec / 10^decimals with a fixed number of decimal places, and
+// returns the x position just after the last character
+uint8_t gfx_printfixed(uint8_t x, uint8_t y, int32_t dec, uint8_t decimals, uint8_t scale, uint8_t color)
+{
+	char c[2] = { 0x00, 0x00 };
+	uint32_t div = 1;
+	uint8_t i;
+
+	for (i=0;i<decimals;i++)
+	{
+		div *= 10;
+	}
+
+	if ( dec < 0 )
+	{
+	  ssd1306_set_text(x, y, color, "-", scale);
+	  x += 5*scale;
+
+	  dec = -dec;
+	}
+
+	gfx_printdec(x, y, dec / div, scale, color);
+	x += 5*scale*gfx_num_digits(dec / div);
+
+	if (decimals)
+	{
+		ssd1306_set_text(x, y, color, ".", scale);
+		x += 5*scale;
+
+		for (i=decimals;i>0;i--)
+		{
+			c[0] = gfx_dec1_to_char(gfx_div_ten(dec % div, i-1));
+			ssd1306_set_text(x, y, color, c, scale);
+			x += 5*scale;
+		}
+	}
+
+	return x;
+}
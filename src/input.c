@@ -0,0 +1,181 @@
+/*
+===============================================================================
+ Name        : input.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Input events from the QEI, the buttons and captouch
+===============================================================================
+*/
+
+#include "LPC8xx.h"
+#include "core_cm0plus.h"
+
+#include "config.h"
+#include "delay.h"
+#include "button.h"
+#include "qei.h"
+#include "input.h"
+
+/*
+ input_tick() runs from the 1ms SysTick and is the only producer: it reads
+ the QEI edge count (see qei_poll()), samples the buttons and the touch
+ state left by CAPT_IRQHandler, debounces them and queues what changed.
+ The app side is the only consumer, so the queue needs no locking, each
+ end just owns its index.
+
+ A PRESS goes out as soon as the button is stable, a DOUBLE follows the
+ PRESS of a second click, LONG comes once per press while still held and
+ RELEASE when it's let go. Rotation is never dropped: if the queue is full
+ the steps stay on the counter and go out, summed, on a later tick.
+*/
+
+static input_event_t    _input_queue[INPUT_QUEUE_SIZE];
+static volatile uint8_t _input_head = 0;    // Written by input_tick() only
+static volatile uint8_t _input_tail = 0;    // Written by the consumer only
+static volatile uint8_t _input_ready = 0;
+
+// Producer state, SysTick only
+static uint32_t _input_raw;                 // Last button sample
+static uint32_t _input_stable;              // ms it hasn't changed
+static uint32_t _input_down;                // Debounced buttons held
+static uint32_t _input_down_time;
+static uint8_t  _input_long_sent;
+static uint32_t _input_click;               // Buttons of the last press, for the double click
+static uint32_t _input_click_time;
+static uint32_t _input_qei_last;            // qei_edges() reported so far
+
+static int input_put(uint8_t kind, int32_t value, uint32_t now)
+{
+  uint8_t head = _input_head;
+  input_event_t *ev;
+
+  if ((uint8_t)(head - _input_tail) >= INPUT_QUEUE_SIZE) return -1;
+
+  ev = &_input_queue[head & (INPUT_QUEUE_SIZE - 1)];
+  ev->time = now;
+  ev->value = value;
+  ev->kind = kind;
+
+  // The event has to be in place before the consumer can see it
+  __DMB();
+  _input_head = head + 1;
+
+  return 0;
+}
+
+static void input_press(uint32_t pressed, uint32_t now)
+{
+  input_put(INPUT_EV_PRESS, pressed, now);
+
+  if (pressed == _input_click && now - _input_click_time < INPUT_DOUBLE_MS)
+  {
+    input_put(INPUT_EV_DOUBLE, pressed, now);
+    _input_click = 0;     // A third click starts over
+  }
+  else
+  {
+    _input_click = pressed;
+    _input_click_time = now;
+  }
+
+  _input_down_time = now;
+  _input_long_sent = 0;
+}
+
+/**
+ * Samples the inputs and queues the events, called every 1ms from
+ * SysTick_Handler.
+ */
+void input_tick(void)
+{
+  uint32_t now, raw, changed;
+  int32_t steps;
+
+  if (!_input_ready) return;
+
+  now = millis();
+
+  // Whole detents only, a half turned one stays for later
+  steps = (int32_t)((uint32_t)qei_edges() - _input_qei_last) / QEI_EDGES_PER_STEP;
+  if (steps && !input_put(INPUT_EV_ROTATE, steps, now))
+  {
+    _input_qei_last += (uint32_t)(steps * QEI_EDGES_PER_STEP);
+  }
+
+  raw = button_state();
+  if (raw != _input_raw)
+  {
+    _input_raw = raw;
+    _input_stable = 0;
+    return;
+  }
+  if (_input_stable < INPUT_DEBOUNCE_MS)
+  {
+    _input_stable++;
+    return;
+  }
+
+  changed = raw ^ _input_down;
+  _input_down = raw;
+
+  if (changed & raw)
+  {
+    input_press(changed & raw, now);
+  }
+  if (changed & ~raw)
+  {
+    input_put(INPUT_EV_RELEASE, changed & ~raw, now);
+  }
+
+  if (_input_down && !_input_long_sent && now - _input_down_time >= INPUT_LONG_MS)
+  {
+    input_put(INPUT_EV_LONG, _input_down, now);
+    _input_long_sent = 1;
+  }
+}
+
+/**
+ * Starts the event queue, call after qei_init() and button_init(). Buttons
+ * already held aren't reported until they're released.
+ */
+void input_init(void)
+{
+  _input_ready = 0;
+
+  _input_raw = _input_down = button_state();
+  _input_stable = INPUT_DEBOUNCE_MS;
+  _input_long_sent = 1;
+  _input_click = 0;
+  _input_qei_last = qei_edges();
+  _input_tail = _input_head;
+
+  _input_ready = 1;
+}
+
+/**
+ * Takes the oldest event off the queue.
+ *
+ * @return 1 if 'ev' was filled in, 0 if the queue is empty
+ */
+int input_get(input_event_t *ev)
+{
+  uint8_t tail = _input_tail;
+
+  if (tail == _input_head) return 0;
+
+  __DMB();
+  *ev = _input_queue[tail & (INPUT_QUEUE_SIZE - 1)];
+  _input_tail = tail + 1;
+
+  return 1;
+}
+
+/**
+ * Drops the queued events, for a new app that shouldn't see the clicks and
+ * turns meant for the last one.
+ */
+void input_flush(void)
+{
+  _input_tail = _input_head;
+}
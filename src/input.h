@@ -0,0 +1,42 @@
+/*
+===============================================================================
+ Name        : input.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Input events from the QEI, the buttons and captouch
+===============================================================================
+*/
+
+#ifndef INPUT_H_
+#define INPUT_H_
+
+#include <stdint.h>
+
+#define INPUT_QUEUE_SIZE      (16)        // Events, power of 2
+#define INPUT_DEBOUNCE_MS     (6)         // Buttons stable this long count
+#define INPUT_LONG_MS         (600)       // Held this long is a long press
+#define INPUT_DOUBLE_MS       (300)       // Second press within this is a double click
+
+typedef enum
+{
+  INPUT_EV_ROTATE = 0,        // 'value' = QEI detents, positive clockwise
+  INPUT_EV_PRESS,             // 'value' = button mask, see button_pressed()
+  INPUT_EV_RELEASE,
+  INPUT_EV_LONG,              // Still held after INPUT_LONG_MS, once per press
+  INPUT_EV_DOUBLE             // After the PRESS of a second click
+} input_ev_kind_t;
+
+typedef struct
+{
+  uint32_t time;              // millis() when it happened
+  int32_t  value;
+  uint8_t  kind;              // input_ev_kind_t
+} input_event_t;
+
+void input_init  (void);
+void input_tick  (void);
+int  input_get   (input_event_t *ev);
+void input_flush (void);
+
+#endif /* INPUT_H_ */
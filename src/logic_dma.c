@@ -0,0 +1,368 @@
+/*
+===============================================================================
+ Name        : logic_dma.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : 8 channel logic capture (GPIO port 0 by DMA, run-length store)
+===============================================================================
+*/
+
+#include "LPC8xx.h"
+#include "lpc_types.h"
+#include "core_cm0plus.h"
+#include "syscon.h"
+#include "ctimer.h"
+#include "dma.h"
+
+#include "dma_common.h"
+#include "logic_dma.h"
+
+// CTIMER0 MAT0 triggers one byte read of the GPIO port per sample into a
+// ping-pong pair of raw blocks. The block interrupt run-length compresses
+// the finished block into the caller's store, so a long idle stretch costs
+// a few entries and only edges use up space.
+//
+// The SCT would be the natural trigger engine, but the QEI holds all of
+// its events, so triggers come from the GPIO pattern match engine: one
+// product term over the 8 pins, ending on slice 7 (PININT7).
+#define LOGIC_DMA_BLOCK         (256)
+#define LOGIC_DMA_MIN_US        (2)     // Compressing a block takes ~8 cycles a sample
+
+static uint8_t _logic_dma_raw[2][LOGIC_DMA_BLOCK];
+ALIGN(16) static DMA_RELOADDESC_T _logic_dma_desc[2];
+
+static uint16_t                   *_logic_dma_store;
+static uint32_t                    _logic_dma_mask;
+static volatile uint32_t           _logic_dma_w;            // Entries written, wraps over the store
+static volatile uint32_t           _logic_dma_samples;      // Samples compressed so far
+static volatile uint32_t           _logic_dma_trig_sample;
+static uint32_t                    _logic_dma_trig_w;       // _logic_dma_w at the trigger
+static uint32_t                    _logic_dma_post;         // Samples to take after the trigger
+static uint32_t                    _logic_dma_post_entries; // Entries allowed after the trigger
+static volatile logic_dma_state_t  _logic_dma_state = LOGIC_DMA_IDLE;
+static uint8_t                     _logic_dma_block;        // Next raw block to compress
+static uint8_t                     _logic_dma_cur;          // Value of the open run
+static uint32_t                    _logic_dma_run;          // Length of the open run, 0 = none
+
+static inline void logic_dma_put(uint16_t e)
+{
+  _logic_dma_store[_logic_dma_w & _logic_dma_mask] = e;
+  _logic_dma_w++;
+}
+
+static void logic_dma_emit(uint8_t value, uint32_t run)
+{
+  uint32_t n = run > 128 ? 128 : run;
+
+  logic_dma_put((uint16_t)(((n - 1) << 8) | value));
+
+  for (run -= n; run; run -= n)
+  {
+    n = run > 0x7FFF ? 0x7FFF : run;
+    logic_dma_put((uint16_t)(0x8000 | n));
+  }
+}
+
+static void logic_dma_halt(void)
+{
+  LPC_CTIMER0->TCR = 0;
+
+  LPC_DMA->ENABLECLR0 = 1 << DMA_CH_LOGIC;
+  LPC_DMA->ABORT0     = 1 << DMA_CH_LOGIC;
+  LPC_DMA->INTENCLR0  = 1 << DMA_CH_LOGIC;
+
+  NVIC_DisableIRQ(PININT7_IRQn);
+  LPC_PIN_INT->PMCTRL = 0;
+}
+
+static void logic_dma_isr(void)
+{
+  const uint8_t *x = _logic_dma_raw[_logic_dma_block];
+  uint8_t  cur = _logic_dma_cur;
+  uint32_t run = _logic_dma_run;
+
+  _logic_dma_block ^= 1;
+
+  for (uint32_t i = 0; i < LOGIC_DMA_BLOCK; i++)
+  {
+    if (x[i] == cur)
+    {
+      run++;
+    }
+    else
+    {
+      if (run) logic_dma_emit(cur, run);
+      cur = x[i];
+      run = 1;
+    }
+  }
+
+  _logic_dma_samples += LOGIC_DMA_BLOCK;
+
+  // The trigger can fall in the block that is still filling, so compare signed
+  if (_logic_dma_state == LOGIC_DMA_TRIGGERED &&
+      ((int32_t)(_logic_dma_samples - _logic_dma_trig_sample) >= (int32_t)_logic_dma_post ||
+       _logic_dma_w - _logic_dma_trig_w >= _logic_dma_post_entries))
+  {
+    logic_dma_halt();
+    logic_dma_emit(cur, run);
+    run = 0;
+    _logic_dma_state = LOGIC_DMA_DONE;
+  }
+
+  _logic_dma_cur = cur;
+  _logic_dma_run = run;
+}
+
+// Sets up the pattern match engine. Returns 0 if every channel is don't
+// care, which leaves the capture free running.
+static int logic_dma_arm(const uint8_t cond[LOGIC_DMA_CHANNELS])
+{
+  // PMCFG slice configurations, indexed by logic_dma_cond_t
+  static const uint8_t pmcfg[LOGIC_DMA_COND_LAST] = {
+    0x0,      // Constant high
+    0x5,      // Low level
+    0x4,      // High level
+    0x1,      // Sticky rising edge
+    0x2       // Sticky falling edge
+  };
+  uint32_t cfg = 0, src = 0;
+  uint8_t  used = 0;
+
+  for (uint8_t s = 0; s < LOGIC_DMA_CHANNELS; s++)
+  {
+    src |= (uint32_t)s << (8 + 3 * s);
+    cfg |= (uint32_t)pmcfg[cond[s]] << (8 + 3 * s);
+    used |= cond[s] != LOGIC_DMA_COND_ANY;
+  }
+
+  if (!used) return 0;
+
+  LPC_SYSCON->SYSAHBCLKCTRL0 |= GPIO_INT;
+
+  for (uint8_t s = 0; s < LOGIC_DMA_CHANNELS; s++)
+  {
+    LPC_SYSCON->PINTSEL[s] = LOGIC_DMA_PIN(s);
+  }
+
+  // Writing PMSRC also clears the sticky edge detectors. No PROD_ENDPTS
+  // bits, so all 8 slices AND into the one term that ends on slice 7.
+  LPC_PIN_INT->PMCTRL = 0;
+  LPC_PIN_INT->PMSRC  = src;
+  LPC_PIN_INT->PMCFG  = cfg;
+  LPC_PIN_INT->PMCTRL = 1;    // SEL_PMATCH
+
+  NVIC_ClearPendingIRQ(PININT7_IRQn);
+  NVIC_EnableIRQ(PININT7_IRQn);
+
+  return 1;
+}
+
+/**
+ * Starts a capture of LOGIC_DMA_CHANNELS pins of port 0.
+ *
+ * The store holds pre-trigger history as a ring. Once triggered the
+ * capture runs for 'post' more samples, or until 3/4 of the store has
+ * been written since the trigger, so at least 1/4 is always history.
+ *
+ * @param store     Capture store, 'entries' uint16_t
+ * @param entries   Power of 2, at least 4 raw blocks (1024)
+ * @param period_us Sample period, LOGIC_DMA_MIN_US or more
+ * @param cond      Trigger condition per channel (logic_dma_cond_t),
+ *                  all LOGIC_DMA_COND_ANY triggers at once
+ * @param post      Samples to take after the trigger
+ * @return 0 on success, -1 on a bad parameter
+ */
+int logic_dma_start(uint16_t *store, uint32_t entries, uint32_t period_us,
+                    const uint8_t cond[LOGIC_DMA_CHANNELS], uint32_t post)
+{
+  if (store == NULL || entries < 4 * LOGIC_DMA_BLOCK || (entries & (entries - 1)) ||
+      period_us < LOGIC_DMA_MIN_US || post == 0)
+  {
+    return -1;
+  }
+
+  for (uint8_t s = 0; s < LOGIC_DMA_CHANNELS; s++)
+  {
+    if (cond[s] >= LOGIC_DMA_COND_LAST) return -1;
+  }
+
+  logic_dma_stop();
+
+  _logic_dma_store = store;
+  _logic_dma_mask = entries - 1;
+  _logic_dma_w = 0;
+  _logic_dma_samples = 0;
+  _logic_dma_post = post;
+  _logic_dma_block = 0;
+  _logic_dma_run = 0;
+
+  /*------------- DMA -------------*/
+
+  dma_common_init();
+  dma_common_set_handler(DMA_CH_LOGIC, logic_dma_isr);
+
+  uint32_t xfercfg = 1 << DMA_XFERCFG_CFGVALID |
+                     1 << DMA_XFERCFG_RELOAD |
+                     1 << DMA_XFERCFG_SETINTA |
+                     0 << DMA_XFERCFG_WIDTH |     // 8 bits, one byte lane of the port
+                     0 << DMA_XFERCFG_SRCINC |
+                     1 << DMA_XFERCFG_DSTINC |
+                     (LOGIC_DMA_BLOCK - 1) << DMA_XFERCFG_XFERCOUNT;
+
+  for (uint8_t i = 0; i < 2; i++)
+  {
+    _logic_dma_desc[i].xfercfg = xfercfg;
+    _logic_dma_desc[i].source  = (uint32_t) &LPC_GPIO_PORT->PIN[0] + LOGIC_DMA_LANE;
+    _logic_dma_desc[i].dest    = (uint32_t) &_logic_dma_raw[i][LOGIC_DMA_BLOCK - 1];
+    _logic_dma_desc[i].next    = (uint32_t) &_logic_dma_desc[i ^ 1];
+  }
+
+  Chan_Desc_Table[DMA_CH_LOGIC].source = _logic_dma_desc[0].source;
+  Chan_Desc_Table[DMA_CH_LOGIC].dest   = _logic_dma_desc[0].dest;
+  Chan_Desc_Table[DMA_CH_LOGIC].next   = _logic_dma_desc[0].next;
+
+  LPC_DMA->CHANNEL[DMA_CH_LOGIC].CFG = 1 << DMA_CFG_HWTRIGEN |
+                                       0 << DMA_CFG_TRIGTYPE |
+                                       1 << DMA_CFG_TRIGPOL  |
+                                       1 << DMA_CFG_TRIGBURST |
+                                       0 << DMA_CFG_BURSTPOWER |
+                                       0 << DMA_CFG_CHPRIORITY;
+
+  LPC_INMUX_TRIGMUX->DMA_ITRIG_INMUX1 = DMA_ITRIG_T0_MAT0;
+
+  LPC_DMA->INTA0 = 1 << DMA_CH_LOGIC;
+  LPC_DMA->ENABLESET0 = 1 << DMA_CH_LOGIC;
+  LPC_DMA->INTENSET0 = 1 << DMA_CH_LOGIC;
+  LPC_DMA->SETVALID0 = 1 << DMA_CH_LOGIC;
+  LPC_DMA->CHANNEL[DMA_CH_LOGIC].XFERCFG = xfercfg;
+
+  NVIC_EnableIRQ(DMA_IRQn);
+
+  /*------------- Trigger -------------*/
+
+  // A block can add up to LOGIC_DMA_BLOCK entries past the check
+  if (logic_dma_arm(cond))
+  {
+    _logic_dma_post_entries = entries / 4 * 3 - LOGIC_DMA_BLOCK;
+    _logic_dma_state = LOGIC_DMA_ARMED;
+  }
+  else
+  {
+    _logic_dma_post_entries = entries - 2 * LOGIC_DMA_BLOCK;
+    _logic_dma_trig_sample = 0;
+    _logic_dma_trig_w = 0;
+    _logic_dma_state = LOGIC_DMA_TRIGGERED;
+  }
+
+  /*------------- CTIMER0 -------------*/
+
+  // MR0 sets the sample rate, resetting the counter on match
+  Enable_Periph_Clock(CLK_CTIMER0);
+  LPC_CTIMER0->TCR = 1<<CRST;
+  LPC_CTIMER0->PR  = 0;
+  LPC_CTIMER0->MR[0] = (system_ahb_clk / 1000000) * period_us - 1;
+  LPC_CTIMER0->MCR = (1<<MR0R);
+  LPC_CTIMER0->EMR = 0;
+  LPC_CTIMER0->TCR = 1<<CEN;
+
+  return 0;
+}
+
+/**
+ * Cancels a capture that is still running. A finished capture stays
+ * readable.
+ */
+void logic_dma_stop(void)
+{
+  if (_logic_dma_state == LOGIC_DMA_ARMED || _logic_dma_state == LOGIC_DMA_TRIGGERED)
+  {
+    logic_dma_halt();
+    _logic_dma_state = LOGIC_DMA_IDLE;
+  }
+}
+
+/**
+ * Returns the capture state (logic_dma_state_t).
+ */
+logic_dma_state_t logic_dma_state(void)
+{
+  return _logic_dma_state;
+}
+
+/**
+ * Where the capture has got to, for code that follows it while it runs
+ * (see proto_decode_feed_rle()). Entries before 'end' are final.
+ *
+ * @param end       Entries written so far, wrapping over the store
+ * @param samples   Sample number where entry 'end' will start
+ */
+void logic_dma_progress(uint32_t *end, uint32_t *samples)
+{
+  __disable_irq();
+  *end = _logic_dma_w;
+  *samples = _logic_dma_samples - _logic_dma_run;
+  __enable_irq();
+}
+
+/**
+ * Describes the finished capture. Extension entries at the start whose
+ * value entry was overwritten by the ring are skipped.
+ *
+ * @return 0 on success, -1 if there is no finished capture
+ */
+int logic_dma_capture(logic_dma_capture_t *cap)
+{
+  if (_logic_dma_state != LOGIC_DMA_DONE) return -1;
+
+  uint32_t end = _logic_dma_w;
+  uint32_t first = end > _logic_dma_mask + 1 ? end - (_logic_dma_mask + 1) : 0;
+  uint32_t n = 0;
+
+  while (first < end && LOGIC_DMA_IS_EXT(_logic_dma_store[first & _logic_dma_mask]))
+  {
+    first++;
+  }
+
+  if (first == end) return -1;
+
+  for (uint32_t i = first; i < end; i++)
+  {
+    n += LOGIC_DMA_RUN(_logic_dma_store[i & _logic_dma_mask]);
+  }
+
+  cap->store = _logic_dma_store;
+  cap->mask = _logic_dma_mask;
+  cap->first = first;
+  cap->end = end;
+  cap->samples = _logic_dma_samples;
+  cap->first_sample = _logic_dma_samples - n;
+  cap->trig_sample = _logic_dma_trig_sample;
+
+  return 0;
+}
+
+// Pattern match on slice 7: estimate the trigger sample from the blocks
+// already counted and the position of the DMA in the current one. The
+// interrupt latency makes this good to a sample or two at the top rate.
+void PININT7_IRQHandler(void)
+{
+  uint32_t cnt = (LPC_DMA->CHANNEL[DMA_CH_LOGIC].XFERCFG >> DMA_XFERCFG_XFERCOUNT) & 0x3FF;
+  uint32_t pos = _logic_dma_samples + (cnt < LOGIC_DMA_BLOCK ? LOGIC_DMA_BLOCK - 1 - cnt : 0);
+
+  // A block that finished but wasn't compressed yet
+  if (LPC_DMA->INTA0 & (1 << DMA_CH_LOGIC))
+  {
+    pos += LOGIC_DMA_BLOCK;
+  }
+
+  NVIC_DisableIRQ(PININT7_IRQn);
+  LPC_PIN_INT->PMCTRL = 0;
+
+  if (_logic_dma_state != LOGIC_DMA_ARMED) return;
+
+  _logic_dma_trig_sample = pos;
+  _logic_dma_trig_w = _logic_dma_w;
+  _logic_dma_state = LOGIC_DMA_TRIGGERED;
+}
@@ -0,0 +1,66 @@
+/*
+===============================================================================
+ Name        : logic_dma.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description :
+===============================================================================
+*/
+
+#ifndef LOGIC_DMA_H_
+#define LOGIC_DMA_H_
+
+#include <stdint.h>
+
+// Byte lane of GPIO port 0 that is sampled, channel n is P0_(8*lane + n).
+// Lane 1 (P0_8..P0_15) covers the I2C pins, the sweep sync and two buttons.
+#define LOGIC_DMA_LANE          (1)
+#define LOGIC_DMA_CHANNELS      (8)
+#define LOGIC_DMA_PIN(_ch)      (LOGIC_DMA_LANE * 8 + (_ch))
+
+// Capture store entries (uint16_t):
+//   value entry     [15] = 0, [14:8] = run - 1 (1..128 samples), [7:0] = pins
+//   extension entry [15] = 1, [14:0] = more samples of the previous value
+#define LOGIC_DMA_IS_EXT(_e)    ((_e) & 0x8000)
+#define LOGIC_DMA_VALUE(_e)     ((uint8_t)(_e))
+#define LOGIC_DMA_RUN(_e)       (LOGIC_DMA_IS_EXT(_e) ? ((_e) & 0x7FFF) : ((((_e) >> 8) & 0x7F) + 1))
+
+typedef enum
+{
+  LOGIC_DMA_COND_ANY = 0,     // Don't care
+  LOGIC_DMA_COND_LOW,
+  LOGIC_DMA_COND_HIGH,
+  LOGIC_DMA_COND_RISE,
+  LOGIC_DMA_COND_FALL,
+  LOGIC_DMA_COND_LAST
+} logic_dma_cond_t;
+
+typedef enum
+{
+  LOGIC_DMA_IDLE = 0,
+  LOGIC_DMA_ARMED,            // Filling pre-trigger history
+  LOGIC_DMA_TRIGGERED,        // Taking post-trigger samples
+  LOGIC_DMA_DONE
+} logic_dma_state_t;
+
+// A finished capture, entries first..end-1 of the store (wrapped by mask)
+typedef struct
+{
+  const uint16_t *store;
+  uint32_t        mask;
+  uint32_t        first;          // First entry, always a value entry
+  uint32_t        end;
+  uint32_t        first_sample;   // Sample number of the first entry
+  uint32_t        trig_sample;    // Sample number of the trigger
+  uint32_t        samples;        // Sample number one past the end
+} logic_dma_capture_t;
+
+int               logic_dma_start(uint16_t *store, uint32_t entries, uint32_t period_us,
+                                  const uint8_t cond[LOGIC_DMA_CHANNELS], uint32_t post);
+void              logic_dma_stop(void);
+logic_dma_state_t logic_dma_state(void);
+void              logic_dma_progress(uint32_t *end, uint32_t *samples);
+int               logic_dma_capture(logic_dma_capture_t *cap);
+
+#endif /* LOGIC_DMA_H_ */
@@ -0,0 +1,395 @@
+/*
+===============================================================================
+ Name        : proto_decode.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Incremental UART / SPI / I2C decoders over captured samples
+===============================================================================
+*/
+
+#include <stddef.h>
+
+#include "logic_dma.h"
+#include "proto_decode.h"
+
+// The decoders never see single samples, they see segments: a value of
+// the pins held over a run of samples, which is what the logic_dma store
+// holds anyway. Each protocol has a segment handler in _proto_decode_ops,
+// and they all share the state and shift register in proto_decoder_t, so
+// a capture can be fed in as it grows, in pieces of any size. Only edges
+// cost anything, a line that sits idle for a million samples is one call.
+//
+// UART samples the middle of each bit, worked out from the start bit edge
+// in samples * 256 so the error doesn't add up over a frame. With the baud
+// rate set to 0 the shortest of the first PROTO_DECODE_REPLAY runs on RX is
+// taken as one bit, snapped to a standard rate, and those runs are then
+// decoded as well.
+#define PROTO_ST_IDLE            (0)
+#define PROTO_ST_FRAME           (1)        // UART frame or SPI byte under way
+#define PROTO_ST_ADDR            (2)        // I2C, first byte after a START
+#define PROTO_ST_DATA            (3)        // I2C, later bytes
+
+#define PROTO_BIT(_v, _ch)       (((_v) >> (_ch)) & 1)
+
+// Snap window for the auto baud guess, 1/x of the bit time
+#define PROTO_BAUD_SNAP          (5)
+
+typedef struct
+{
+  void (*seg)(proto_decoder_t *d, uint8_t value, uint32_t start, uint32_t end);
+} proto_decode_ops_t;
+
+// I2C line conditions, indexed by SCL << 1 | SDA before and after a change
+typedef enum
+{
+  PROTO_I2C_NONE = 0,
+  PROTO_I2C_BIT,              // SCL rises, SDA is a bit
+  PROTO_I2C_START,            // SDA falls with SCL high
+  PROTO_I2C_STOP              // SDA rises with SCL high
+} proto_i2c_ev_t;
+
+static const uint8_t _proto_i2c_ev[4][4] = {
+  //            -> 00             01               10              11
+  /* 00 */ { PROTO_I2C_NONE,  PROTO_I2C_NONE,  PROTO_I2C_BIT,  PROTO_I2C_BIT  },
+  /* 01 */ { PROTO_I2C_NONE,  PROTO_I2C_NONE,  PROTO_I2C_BIT,  PROTO_I2C_BIT  },
+  /* 10 */ { PROTO_I2C_NONE,  PROTO_I2C_NONE,  PROTO_I2C_NONE, PROTO_I2C_STOP },
+  /* 11 */ { PROTO_I2C_NONE,  PROTO_I2C_NONE,  PROTO_I2C_START, PROTO_I2C_NONE },
+};
+
+static const uint32_t _proto_decode_bauds[] = {
+  300, 1200, 2400, 4800, 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600
+};
+#define PROTO_DECODE_BAUDS       (sizeof(_proto_decode_bauds) / sizeof(_proto_decode_bauds[0]))
+
+static void proto_decode_put(proto_decoder_t *d, uint32_t sample, uint8_t data, uint8_t kind, uint8_t flags)
+{
+  proto_ann_t *a = &d->ann[d->ann_count & (d->ann_size - 1)];
+
+  a->sample = sample;
+  a->data = data;
+  a->kind = kind;
+  a->flags = flags;
+
+  d->ann_count++;
+}
+
+/*------------- UART -------------*/
+
+static void proto_uart_run(proto_decoder_t *d, uint8_t prev, uint8_t level, uint32_t s, uint32_t e)
+{
+  if (d->state == PROTO_ST_IDLE)
+  {
+    // Wait for the falling edge of a start bit
+    if (level || !prev) return;
+
+    d->state = PROTO_ST_FRAME;
+    d->start = s;
+    d->bits = 0;
+    d->shift = 0;
+  }
+
+  // Bit n is sampled at start + (n + 1/2) bits: start, 8 data, stop
+  while (1)
+  {
+    uint32_t c = d->start + (((2 * d->bits + 1) * d->bit_q8) >> 9);
+
+    if (c >= e) return;
+
+    if (d->bits == 0 && level)
+    {
+      // Glitch, not a start bit
+      d->state = PROTO_ST_IDLE;
+      return;
+    }
+
+    if (d->bits == 9)
+    {
+      proto_decode_put(d, d->start, (uint8_t)d->shift, PROTO_ANN_DATA, level ? 0 : PROTO_ANN_ERR);
+      d->state = PROTO_ST_IDLE;
+      return;
+    }
+
+    if (d->bits) d->shift |= level << (d->bits - 1);
+    d->bits++;
+  }
+}
+
+// Takes the shortest run as one bit
+static void proto_uart_autobaud(proto_decoder_t *d)
+{
+  uint32_t m = 0xFFFFFFFF;
+  uint32_t best = 0;
+
+  for (uint8_t i = 0; i + 1 < d->replay_n; i++)
+  {
+    uint32_t run = d->replay[i + 1] - d->replay[i];
+    if (run < m) m = run;
+  }
+
+  if (d->cfg.sample_hz)
+  {
+    // Nearest standard rate, if it's within the quantisation of the run
+    for (uint8_t i = 0; i < PROTO_DECODE_BAUDS; i++)
+    {
+      uint32_t bit = d->cfg.sample_hz / _proto_decode_bauds[i];
+
+      if (bit + bit / PROTO_BAUD_SNAP + 1 >= m && m + m / PROTO_BAUD_SNAP + 1 >= bit)
+      {
+        best = _proto_decode_bauds[i];
+      }
+    }
+  }
+
+  if (best)
+  {
+    d->baud = best;
+    d->bit_q8 = (uint32_t)(((uint64_t)d->cfg.sample_hz << 8) / best);
+  }
+  else
+  {
+    d->baud = d->cfg.sample_hz / m;
+    d->bit_q8 = m << 8;
+  }
+}
+
+static void proto_uart_seg(proto_decoder_t *d, uint8_t value, uint32_t s, uint32_t e)
+{
+  uint8_t level = PROTO_BIT(value, d->cfg.ch_a);
+  uint8_t prev = PROTO_BIT(d->last, d->cfg.ch_a);
+
+  if (!d->bit_q8)
+  {
+    if (level == prev) return;
+
+    // Time the runs, this one is still open
+    d->replay[d->replay_n] = s;
+    if (level) d->replay_level |= 1UL << d->replay_n;
+    if (++d->replay_n < PROTO_DECODE_REPLAY) return;
+
+    proto_uart_autobaud(d);
+
+    for (uint8_t i = 0; i + 1 < d->replay_n; i++)
+    {
+      uint8_t l = (d->replay_level >> i) & 1;
+      proto_uart_run(d, !l, l, d->replay[i], d->replay[i + 1]);
+    }
+  }
+
+  proto_uart_run(d, prev, level, s, e);
+}
+
+/*------------- SPI -------------*/
+
+static void proto_spi_seg(proto_decoder_t *d, uint8_t value, uint32_t s, uint32_t e)
+{
+  uint8_t clk = PROTO_BIT(value, d->cfg.ch_a);
+  uint8_t pclk = PROTO_BIT(d->last, d->cfg.ch_a);
+
+  (void)e;
+
+  if (d->cfg.ch_c != PROTO_DECODE_NO_CH)
+  {
+    uint8_t cs = PROTO_BIT(value, d->cfg.ch_c);
+    uint8_t pcs = PROTO_BIT(d->last, d->cfg.ch_c);
+
+    if (pcs && !cs)
+    {
+      proto_decode_put(d, s, 0, PROTO_ANN_START, 0);
+      d->bits = 0;
+      d->shift = 0;
+    }
+    else if (!pcs && cs)
+    {
+      proto_decode_put(d, s, 0, PROTO_ANN_STOP, d->bits ? PROTO_ANN_ERR : 0);
+      d->bits = 0;
+    }
+
+    // Not selected, the clock belongs to someone else
+    if (cs) return;
+  }
+
+  // Modes 0 and 3 sample on the rising edge, 1 and 2 on the falling one
+  if (clk == pclk || clk != (d->cfg.spi_mode == 0 || d->cfg.spi_mode == 3)) return;
+
+  if (!d->bits) d->start = s;
+  d->shift = (d->shift << 1) | PROTO_BIT(value, d->cfg.ch_b);
+
+  if (++d->bits == 8)
+  {
+    proto_decode_put(d, d->start, (uint8_t)d->shift, PROTO_ANN_DATA, 0);
+    d->bits = 0;
+    d->shift = 0;
+  }
+}
+
+/*------------- I2C -------------*/
+
+static void proto_i2c_seg(proto_decoder_t *d, uint8_t value, uint32_t s, uint32_t e)
+{
+  uint8_t cur = PROTO_BIT(value, d->cfg.ch_a) << 1 | PROTO_BIT(value, d->cfg.ch_b);
+  uint8_t prev = PROTO_BIT(d->last, d->cfg.ch_a) << 1 | PROTO_BIT(d->last, d->cfg.ch_b);
+  uint8_t sda = cur & 1;
+
+  (void)e;
+
+  switch (_proto_i2c_ev[prev][cur])
+  {
+  case PROTO_I2C_START:
+    proto_decode_put(d, s, 0, PROTO_ANN_START, 0);
+    d->state = PROTO_ST_ADDR;
+    d->bits = 0;
+    d->shift = 0;
+    break;
+
+  case PROTO_I2C_STOP:
+    if (d->state != PROTO_ST_IDLE)
+    {
+      proto_decode_put(d, s, 0, PROTO_ANN_STOP, 0);
+      d->state = PROTO_ST_IDLE;
+    }
+    break;
+
+  case PROTO_I2C_BIT:
+    if (d->state == PROTO_ST_IDLE) break;
+
+    if (d->bits < 8)
+    {
+      if (!d->bits) d->start = s;
+      d->shift = (d->shift << 1) | sda;
+      d->bits++;
+      break;
+    }
+
+    // Ninth clock, the ACK
+    proto_decode_put(d, d->start, (uint8_t)d->shift,
+                     d->state == PROTO_ST_ADDR ? PROTO_ANN_ADDR : PROTO_ANN_DATA,
+                     sda ? PROTO_ANN_NACK : 0);
+    d->state = PROTO_ST_DATA;
+    d->bits = 0;
+    d->shift = 0;
+    break;
+  }
+}
+
+// Indexed by proto_decode_type_t
+static const proto_decode_ops_t _proto_decode_ops[PROTO_DECODE_LAST] = {
+  { NULL },
+  { proto_uart_seg },
+  { proto_spi_seg },
+  { proto_i2c_seg },
+};
+
+/**
+ * Sets up a decoder.
+ *
+ * @param ann       Annotation ring, the decoder keeps the last ann_size
+ * @param ann_size  Power of 2
+ */
+void proto_decode_init(proto_decoder_t *d, const proto_decode_cfg_t *cfg, proto_ann_t *ann, uint32_t ann_size)
+{
+  d->cfg = *cfg;
+  d->ann = ann;
+  d->ann_size = ann_size;
+  d->ann_count = 0;
+
+  d->started = 0;
+  d->state = PROTO_ST_IDLE;
+  d->bits = 0;
+  d->shift = 0;
+
+  d->replay_n = 0;
+  d->replay_level = 0;
+  d->baud = 0;
+  d->bit_q8 = 0;
+
+  if (cfg->type == PROTO_DECODE_UART && cfg->baud && cfg->sample_hz)
+  {
+    d->baud = cfg->baud;
+    d->bit_q8 = (uint32_t)(((uint64_t)cfg->sample_hz << 8) / cfg->baud);
+  }
+
+  d->rle_r = 0;
+  d->rle_sample = 0;
+  d->rle_value = 0;
+}
+
+/**
+ * Feeds a segment: the channels had 'value' for 'run' samples from
+ * 'start'. Segments have to come in order, without gaps.
+ */
+void proto_decode_feed(proto_decoder_t *d, uint8_t value, uint32_t start, uint32_t run)
+{
+  if (!run || !_proto_decode_ops[d->cfg.type].seg) return;
+
+  // The first segment is only the level things start from
+  if (d->started)
+  {
+    _proto_decode_ops[d->cfg.type].seg(d, value, start, start + run);
+  }
+
+  d->last = value;
+  d->started = 1;
+}
+
+/**
+ * Feeds the entries of a logic_dma store up to 'end', from where the
+ * last call stopped. Call it while the capture runs (logic_dma_progress())
+ * and once more when it's done. If the capture lapped the decoder, it
+ * picks up again half a store behind.
+ *
+ * @param end_sample  Sample number where entry 'end' starts
+ */
+void proto_decode_feed_rle(proto_decoder_t *d, const uint16_t *store, uint32_t mask, uint32_t end, uint32_t end_sample)
+{
+  if (end - d->rle_r > mask + 1)
+  {
+    d->rle_r = end - (mask + 1) / 2;
+    d->rle_sample = end_sample;
+
+    for (uint32_t i = d->rle_r; i != end; i++)
+    {
+      d->rle_sample -= LOGIC_DMA_RUN(store[i & mask]);
+    }
+
+    // Whatever was in flight is lost
+    d->started = 0;
+    d->state = PROTO_ST_IDLE;
+    d->bits = 0;
+
+    while (d->rle_r != end && LOGIC_DMA_IS_EXT(store[d->rle_r & mask]))
+    {
+      d->rle_sample += LOGIC_DMA_RUN(store[d->rle_r++ & mask]);
+    }
+  }
+
+  for (; d->rle_r != end; d->rle_r++)
+  {
+    uint16_t e = store[d->rle_r & mask];
+    uint32_t run = LOGIC_DMA_RUN(e);
+
+    if (!LOGIC_DMA_IS_EXT(e)) d->rle_value = LOGIC_DMA_VALUE(e);
+
+    proto_decode_feed(d, d->rle_value, d->rle_sample, run);
+    d->rle_sample += run;
+  }
+}
+
+/**
+ * Index of the oldest annotation still in the ring.
+ */
+uint32_t proto_decode_ann_first(const proto_decoder_t *d)
+{
+  return d->ann_count > d->ann_size ? d->ann_count - d->ann_size : 0;
+}
+
+/**
+ * Returns annotation 'i' (counted from the start of the decode), or NULL
+ * if it isn't there (yet or any more).
+ */
+const proto_ann_t *proto_decode_ann(const proto_decoder_t *d, uint32_t i)
+{
+  if (i < proto_decode_ann_first(d) || i >= d->ann_count) return NULL;
+
+  return &d->ann[i & (d->ann_size - 1)];
+}
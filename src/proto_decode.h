@@ -0,0 +1,99 @@
+/*
+===============================================================================
+ Name        : proto_decode.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description :
+===============================================================================
+*/
+
+#ifndef PROTO_DECODE_H_
+#define PROTO_DECODE_H_
+
+#include <stdint.h>
+
+#define PROTO_DECODE_NO_CH       (0xFF)
+#define PROTO_DECODE_REPLAY      (24)       // Runs timed before an auto baud guess
+
+typedef enum
+{
+  PROTO_DECODE_OFF = 0,
+  PROTO_DECODE_UART,          // ch_a = RX, 8N1, LSB first
+  PROTO_DECODE_SPI,           // ch_a = SCK, ch_b = MOSI or MISO, ch_c = CS or PROTO_DECODE_NO_CH
+  PROTO_DECODE_I2C,           // ch_a = SCL, ch_b = SDA
+  PROTO_DECODE_LAST
+} proto_decode_type_t;
+
+typedef enum
+{
+  PROTO_ANN_DATA = 0,         // A byte (I2C: 'flags' has the ACK)
+  PROTO_ANN_ADDR,             // I2C address byte, R/W in bit 0
+  PROTO_ANN_START,            // I2C START / RESTART, SPI CS asserted
+  PROTO_ANN_STOP              // I2C STOP, SPI CS released
+} proto_ann_kind_t;
+
+// Annotation flags
+#define PROTO_ANN_NACK           (1<<0)     // I2C byte not acknowledged
+#define PROTO_ANN_ERR            (1<<1)     // UART framing error, SPI short byte
+
+typedef struct
+{
+  uint32_t sample;            // Where the byte or condition starts
+  uint8_t  data;
+  uint8_t  kind;              // proto_ann_kind_t
+  uint8_t  flags;
+} proto_ann_t;
+
+typedef struct
+{
+  proto_decode_type_t type;
+  uint8_t  ch_a;
+  uint8_t  ch_b;
+  uint8_t  ch_c;
+  uint8_t  spi_mode;          // 0..3, CPOL << 1 | CPHA
+  uint32_t sample_hz;         // Sample rate, for the UART
+  uint32_t baud;              // UART baud rate, 0 = auto detect
+} proto_decode_cfg_t;
+
+typedef struct
+{
+  proto_decode_cfg_t cfg;
+
+  // Annotations, a ring of the last 'ann_size' (power of 2)
+  proto_ann_t *ann;
+  uint32_t     ann_size;
+  uint32_t     ann_count;     // Written so far
+
+  // Signal
+  uint8_t      last;          // Pins of the last segment
+  uint8_t      started;       // 'last' is valid
+
+  // Bit engine shared by the protocols
+  uint8_t      state;
+  uint8_t      bits;
+  uint16_t     shift;
+  uint32_t     start;         // Sample the frame or byte started on
+
+  // UART timing, samples per bit * 256
+  uint32_t     bit_q8;
+  uint32_t     baud;          // Detected or given
+
+  // Auto baud: the first runs on RX, replayed once the bit time is known
+  uint32_t     replay[PROTO_DECODE_REPLAY];
+  uint32_t     replay_level;  // Bit n = level of run n
+  uint8_t      replay_n;
+
+  // Position in a logic_dma store, see proto_decode_feed_rle()
+  uint32_t     rle_r;
+  uint32_t     rle_sample;
+  uint8_t      rle_value;
+} proto_decoder_t;
+
+void               proto_decode_init(proto_decoder_t *d, const proto_decode_cfg_t *cfg, proto_ann_t *ann, uint32_t ann_size);
+void               proto_decode_feed(proto_decoder_t *d, uint8_t value, uint32_t start, uint32_t run);
+void               proto_decode_feed_rle(proto_decoder_t *d, const uint16_t *store, uint32_t mask, uint32_t end, uint32_t end_sample);
+const proto_ann_t *proto_decode_ann(const proto_decoder_t *d, uint32_t i);
+uint32_t           proto_decode_ann_first(const proto_decoder_t *d);
+
+#endif /* PROTO_DECODE_H_ */
@@ -11,6 +11,7 @@
 #include "syscon.h"
 #include "iocon.h"
 
+#include "delay.h"
 #include "qei.h"
 
 #define PIN_A_PORT   (QEI_A_PIN / 32)
@@ -21,38 +22,84 @@
 
 #if !QEI_USE_SCT
 volatile int32_t _qei_step = 0;
-volatile uint8_t _a_last = 0; // pin A bit0, pin B bit1
+
+// One count per edge on pin A
+#define QEI_GPIO_STEP  (1)
 
 #else
 
 extern volatile int32_t _qei_step;
 
+// The SCT counts every edge on A and B, stand-in GPIO decoding counts
+// only A, so double it to keep qei_abs_step() to scale
+#define QEI_GPIO_STEP  (2)
+
+void qei_sct_stop(void);    // qei_sct.c
+void qei_sct_poll(void);    // qei_sct.c
+
 #endif
 
+volatile uint8_t _a_last = 0; // pin A bit0, pin B bit1
+
 static volatile int32_t _qei_last_value = 0;
 
+// Where qei_abs_step() reads 0, _qei_step itself only ever counts edges
+static volatile int32_t _qei_zero = 0;
+
+// Acceleration. qei_detent() keeps a running average of the time between
+// detents (1/16 ms, millis() alone is too coarse for a fast spin) and adds
+// the curve's multiplier for it to _qei_accel. A direction change or a
+// pause longer than the slowest point starts over at 1x.
+#define QEI_ACCEL_Q          (4)
+
+static const qei_accel_t _qei_accel_default[] =
+{
+  { 8, 16 }, { 15, 8 }, { 30, 4 }, { 60, 2 }
+};
+
+static const qei_accel_t *_qei_accel_curve = _qei_accel_default;
+static uint8_t           _qei_accel_n = sizeof(_qei_accel_default) / sizeof(_qei_accel_default[0]);
+static volatile int32_t  _qei_accel = 0;
+static int32_t           _qei_accel_last = 0;
+static uint32_t          _qei_detent_ms = 0;
+static volatile uint32_t _qei_interval = 0;   // 1/16 ms, 0 = stopped
+static int8_t            _qei_detent_dir = 0;
+
 uint8_t qei_read_a(void)
 {
   return bit_test(LPC_GPIO_PORT->PIN[PIN_A_PORT], PIN_A_BIT);
 }
 
 int32_t qei_abs_step (void)
+{
+  // Unsigned so that the edge count can wrap
+  return (int32_t)((uint32_t)_qei_step - (uint32_t)_qei_zero) / QEI_EDGES_PER_STEP;
+}
+
+/**
+ * Brings the step count up to date, every 1ms from SysTick_Handler. Only
+ * the SCT decoder needs it, the pin interrupt one counts as it goes.
+ */
+void qei_poll (void)
 {
 #if QEI_USE_SCT
-  return _qei_step/2;
-#else
-  return _qei_step;
+  qei_sct_poll();
 #endif
 }
 
+/**
+ * Free running edge count, QEI_EDGES_PER_STEP per detent. Unlike
+ * qei_abs_step() it isn't moved by the resets, for the input events.
+ */
+int32_t qei_edges (void)
+{
+  return _qei_step;
+}
+
 // Sets the step counter to a specific value to invalidate clicks in certain situations
 void qei_reset_step_val (int32_t value)
 {
-#if QEI_USE_SCT
-  _qei_step = 2*value;
-#else
-  _qei_step = value;
-#endif
+  _qei_zero = _qei_step - QEI_EDGES_PER_STEP * value;
 }
 
 int32_t qei_offset_step (void)
@@ -66,20 +113,106 @@ int32_t qei_offset_step (void)
 
 void qei_reset_step (void)
 {
-  _qei_step = 0;
+  _qei_zero = _qei_step;
   _qei_last_value = 0;
+  _qei_accel_last = _qei_accel;
 }
 
-#if !QEI_USE_SCT
-void qei_init(void)
+/**
+ * Called on every detent, from the pin interrupt or qei_poll(), 'dir' +1
+ * clockwise.
+ */
+void qei_detent (int8_t dir)
+{
+  uint32_t now = millis();
+  uint32_t dt = (now - _qei_detent_ms) << QEI_ACCEL_Q;
+  uint32_t slowest = _qei_accel_n ? (uint32_t)_qei_accel_curve[_qei_accel_n - 1].ms << QEI_ACCEL_Q : 0;
+  uint16_t mult = 1;
+  uint8_t i;
+
+  if (dir != _qei_detent_dir || dt >= slowest)
+  {
+    _qei_interval = slowest;
+  }
+  else
+  {
+    _qei_interval = (3 * _qei_interval + dt) / 4;
+  }
+
+  for (i = 0; i < _qei_accel_n; i++)
+  {
+    if (_qei_interval < ((uint32_t)_qei_accel_curve[i].ms << QEI_ACCEL_Q))
+    {
+      mult = _qei_accel_curve[i].mult;
+      break;
+    }
+  }
+
+  _qei_accel += dir * mult;
+  _qei_detent_dir = dir;
+  _qei_detent_ms = now;
+}
+
+/**
+ * Steps since the last call (or qei_reset_step()) with the acceleration
+ * curve applied: slow turns move 1 per detent, fast spins up to the
+ * curve's top multiplier.
+ */
+int32_t qei_accel_step (void)
+{
+  int32_t accel = _qei_accel;
+  int32_t ret = accel - _qei_accel_last;
+
+  _qei_accel_last = accel;
+
+  return ret;
+}
+
+/**
+ * Sets the acceleration curve, 'n' points fastest first, NULL for the
+ * default one. 'curve' is kept, not copied. A single { 0, 1 } point turns
+ * the acceleration off.
+ */
+void qei_set_accel (const qei_accel_t *curve, uint8_t n)
+{
+  if (!curve)
+  {
+    curve = _qei_accel_default;
+    n = sizeof(_qei_accel_default) / sizeof(_qei_accel_default[0]);
+  }
+
+  uint32_t primask = __get_PRIMASK();
+
+  // Both at once for qei_detent()
+  __disable_irq();
+  _qei_accel_curve = curve;
+  _qei_accel_n = n;
+  __set_PRIMASK(primask);
+}
+
+/**
+ * Rotation speed in detents per second from the averaged detent interval,
+ * 0 once the knob has been still longer than the slowest curve point.
+ */
+uint32_t qei_velocity (void)
+{
+  uint32_t interval = _qei_interval;
+
+  if (!interval || (millis() - _qei_detent_ms) << QEI_ACCEL_Q > interval * 2) return 0;
+
+  return (1000 << QEI_ACCEL_Q) / interval;
+}
+
+static void qei_gpio_init(void)
 {
   LPC_SYSCON->SYSAHBCLKCTRL0 |= (GPIO_INT);
   LPC_SYSCON->PRESETCTRL0 &= (GPIOINT_RST_N);
   LPC_SYSCON->PRESETCTRL0 |= ~(GPIOINT_RST_N);
 
   // Enable internal pull up. Update this if QEI PIN A & B is changed
-  LPC_IOCON->PIO0_20 |= MODE_PULLUP;
-  LPC_IOCON->PIO0_21 |= MODE_PULLUP;
+  // (the SCT decoder moves the pull between up and down)
+  LPC_IOCON->PIO0_20 = (LPC_IOCON->PIO0_20 & ~(3 << 3)) | MODE_PULLUP;
+  LPC_IOCON->PIO0_21 = (LPC_IOCON->PIO0_21 & ~(3 << 3)) | MODE_PULLUP;
 
   // Set pin direction to input
   LPC_GPIO_PORT->DIRCLR[PIN_A_PORT] = bit(PIN_A_BIT);
@@ -108,6 +241,46 @@ void qei_init(void)
 //  NVIC_EnableIRQ(PININT1_IRQn);
 }
 
+#if !QEI_USE_SCT
+void qei_init(void)
+{
+  qei_gpio_init();
+}
+
+void qei_release_sct(void)
+{
+}
+
+void qei_claim_sct(void)
+{
+}
+#else
+/**
+ * Frees the SCT for another driver, the QEI keeps counting from pin
+ * interrupts on phase A until qei_claim_sct().
+ */
+void qei_release_sct(void)
+{
+  qei_sct_stop();
+  qei_gpio_init();
+}
+
+/**
+ * Takes the SCT back for the QEI, keeping the step count.
+ */
+void qei_claim_sct(void)
+{
+  NVIC_DisableIRQ(PININT0_IRQn);
+  LPC_PIN_INT->CIENR = 0x01;
+  LPC_PIN_INT->CIENF = 0x01;
+  LPC_PIN_INT->IST = 0x01;
+
+  int32_t step = _qei_step;
+  qei_init();
+  _qei_step = step;
+}
+#endif
+
 /**
  * Reference http://howtomechatronics.com/tutorials/arduino/rotary-encoder-works-use-arduino/
  * We can notice that the two output signals are displaced at 90 degrees out of phase from each other.
@@ -128,10 +301,12 @@ void qei_isr(uint8_t pin)
   {
      if ( a_value != bit_test(LPC_GPIO_PORT->PIN[PIN_B_PORT], PIN_B_BIT) )
      {
-       _qei_step++;
+       _qei_step += QEI_GPIO_STEP;
+       qei_detent(1);
      }else
      {
-       _qei_step--;
+       _qei_step -= QEI_GPIO_STEP;
+       qei_detent(-1);
      }
 
      _a_last = a_value;
@@ -147,4 +322,3 @@ void PININT0_IRQHandler(void)
 //{
 //  qei_isr(1);
 //}
-#endif
@@ -23,12 +23,34 @@
 // 1 use SCT, 0 use GPIO for QEI encoder
 #define QEI_USE_SCT            1
 
+// The SCT counts every edge on A and B, the GPIO decoder only A
+#if QEI_USE_SCT
+#define QEI_EDGES_PER_STEP     (2)
+#else
+#define QEI_EDGES_PER_STEP     (1)
+#endif
+
+// Acceleration curve point: detents less than 'ms' apart count as 'mult'
+// steps in qei_accel_step(). Tables go fastest first.
+typedef struct
+{
+  uint16_t ms;
+  uint16_t mult;
+} qei_accel_t;
+
 void    qei_init           (void);
 
 int32_t qei_abs_step       (void);
 int32_t qei_offset_step    (void);
+int32_t qei_edges          (void);
+void    qei_poll           (void);
 void    qei_reset_step     (void);
 void    qei_reset_step_val (int32_t value);
+int32_t qei_accel_step     (void);
+void    qei_set_accel      (const qei_accel_t *curve, uint8_t n);
+uint32_t qei_velocity      (void);
+void    qei_release_sct    (void);
+void    qei_claim_sct      (void);
 
 #ifdef __cplusplus
  }
@@ -24,6 +24,17 @@
 volatile uint32_t qei_state;
 volatile int32_t _qei_step;
 
+// The SCT only synchronizes the pins and keeps the quadrature phase in its
+// state, with no interrupts; the decoding is polled. qei_sct_poll() reads
+// the state from the 1ms SysTick and counts the edges since the last look:
+// one is +1 or -1, two (half a cycle) carry on in the last direction. At
+// QEI_EDGES_PER_STEP (2) edges per detent that is exact up to about 500
+// detents/s, past any hand turning the knob.
+static const uint8_t _qei_sct_phase[4] = { 0, 1, 3, 2 };	// By state, clockwise order
+static volatile uint8_t _qei_sct_running = 0;
+static uint8_t _qei_sct_last;
+static int8_t _qei_sct_dir = 1;
+
 #define	SCT_CONFIGURATION	0
 
 enum sct_in
@@ -79,6 +90,7 @@ enum sct_event
 #define QEI_B_LOW           (QEI_B_FE)
 
 uint32_t init_qei(uint32_t state);
+void qei_detent(int8_t dir);	// qei.c
 uint32_t init_sct(void);
 
 void qei_init(void)
@@ -243,20 +255,16 @@ uint32_t init_sct(void)
 
 	LPC_SCT0->EVFLAG = 0x000000FF;				        //clear all event flags
 
-	NVIC_SetPriority(SCT_IRQn, 1);
-	NVIC_EnableIRQ(SCT_IRQn);
-
-	//each of the events generates an interrupt request
-	LPC_SCT0->EVEN = 1 << sct_ev_qei00_A_re | 1 << sct_ev_qei00_B_re
-			| 1 << sct_ev_qei01_A_fe | 1 << sct_ev_qei01_B_re
-			| 1 << sct_ev_qei10_A_re | 1 << sct_ev_qei10_B_fe
-			| 1 << sct_ev_qei11_A_fe | 1 << sct_ev_qei11_B_fe;
+	//no interrupts, qei_sct_poll() reads the state
+	_qei_sct_last = _qei_sct_phase[LPC_SCT0->STATE & 0x03];
 
 	LPC_SCT0->COUNT = 0xDEADC0DE;			 				//prime the counter
 
 	LPC_SCT0->CTRL = (LPC_SCT0->CTRL & ~(1 << 2)) | //HALT->STOP
 			(1 << 1);
 
+	_qei_sct_running = 1;
+
 	//SCT setup end
 
 	result = 0;
@@ -294,22 +302,48 @@ uint32_t init_qei(uint32_t state)
 	return result;
 }
 
-void SCT_IRQHandler(void)
+// Halts the decoder and leaves the SCT to someone else, qei_init() brings
+// it back
+void qei_sct_stop(void)
+{
+	_qei_sct_running = 0;
+	LPC_SCT0->EVEN = 0;
+	LPC_SCT0->CTRL |= 1 << 2;	//HALT
+	LPC_SCT0->EVFLAG = 0x000000FF;
+}
+
+// Called from SysTick_Handler through qei_poll()
+void qei_sct_poll(void)
 {
-	LPC_SCT0->EVFLAG = 0x000000FF;	// Clear all event flags
+	uint8_t phase, n;
 
-	// Update step counter based on the direction
-	// ToDo: Add int overflow control for long running systems
-	if ((LPC_SCT0->OUTPUT & (1 << sct_out_qei_direction)) == 0)
+	if (!_qei_sct_running) return;
+
+	phase = _qei_sct_phase[LPC_SCT0->STATE & 0x03];
+	n = (phase - _qei_sct_last) & 0x03;
+	if (n == 0) return;
+	_qei_sct_last = phase;
+
+	if (n == 1)
 	{ //CW direction
-		_qei_step++;
+		_qei_sct_dir = 1;
 	}
-	else
+	else if (n == 3)
 	{ //CCW direction
-		_qei_step--;
+		_qei_sct_dir = -1;
+		n = 1;
 	}
 
-	return;
+	while (n--)
+	{
+		_qei_step += _qei_sct_dir;
+
+		// Two edges per detent
+		if ((_qei_step & 1) == 0)
+		{
+			qei_detent(_qei_sct_dir);
+		}
+	}
 }
 
 #endif
@@ -0,0 +1,239 @@
+/*
+===============================================================================
+ Name        : sct_pwm.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Multi-channel PWM with phase offsets, all in SCT hardware
+===============================================================================
+*/
+
+#include "LPC8xx.h"
+#include "syscon.h"
+#include "swm.h"
+#include "sct.h"
+
+#include "config.h"
+#include "sct_pwm.h"
+
+/*
+ Pins used in this application:
+
+ PWM_OUT0_PIN [O] - SCT_OUT0
+ PWM_OUT1_PIN [O] - SCT_OUT1
+ PWM_OUT2_PIN [O] - SCT_OUT2
+*/
+
+// Same register setup as Setup_SCT_PWM() in Functions.c (unified 32-bit
+// counter on the bus clock, match reload at the limit), generalised to a
+// programmable period and a phase per channel:
+//
+// EV0         match MR0 = period - 1, counter limit
+// EV(1+2n)    match on time of channel n, sets OUTn
+// EV(2+2n)    match off time of channel n, clears OUTn
+//
+// An off time before the on time wraps the pulse around the period end.
+// 0% and 100% move the on or off match out of the counter range, so it
+// never fires. New values go to MATCHREL and take effect at the next
+// limit, the outputs never glitch and the CPU has nothing to do.
+#define SCT_PWM_EV_LIMIT        (0)
+#define SCT_PWM_EV_ON(_ch)      (1 + 2 * (_ch))
+#define SCT_PWM_EV_OFF(_ch)     (2 + 2 * (_ch))
+#define SCT_PWM_EVENTS          (1 + 2 * SCT_PWM_CHANNELS)
+#define SCT_PWM_NEVER           (0xFFFFFFFF)
+
+static uint32_t _sct_pwm_period;                         // Counts per period
+static uint16_t _sct_pwm_duty[SCT_PWM_CHANNELS];         // 0.1%
+static uint32_t _sct_pwm_pulse_us[SCT_PWM_CHANNELS];     // Fixed pulse width, 0 = use duty
+static uint16_t _sct_pwm_phase[SCT_PWM_CHANNELS];        // Degrees
+
+// Computes the on and off matches of a channel, returns 1 if the output
+// is high at count 0
+static uint8_t sct_pwm_match(uint8_t ch, uint32_t *on, uint32_t *off)
+{
+  uint32_t p = _sct_pwm_period;
+  uint32_t w;
+
+  if (_sct_pwm_pulse_us[ch])
+  {
+    w = (system_ahb_clk / 1000000) * _sct_pwm_pulse_us[ch];
+  }
+  else
+  {
+    w = (uint32_t)((uint64_t)p * _sct_pwm_duty[ch] / 1000);
+  }
+
+  *on = (uint32_t)((uint64_t)p * _sct_pwm_phase[ch] / 360);
+
+  if (w >= p)
+  {
+    *off = SCT_PWM_NEVER;
+    return 1;
+  }
+
+  *off = *on + w;
+  if (*off >= p) *off -= p;
+
+  if (w == 0)
+  {
+    *on = SCT_PWM_NEVER;
+    return 0;
+  }
+
+  return *off < *on;
+}
+
+static void sct_pwm_reload(uint8_t ch)
+{
+  uint32_t on, off;
+
+  sct_pwm_match(ch, &on, &off);
+
+  LPC_SCT->MATCHREL[SCT_PWM_EV_ON(ch)].U = on;
+  LPC_SCT->MATCHREL[SCT_PWM_EV_OFF(ch)].U = off;
+}
+
+/**
+ * Takes over the SCT (the QEI has to let go of it first, see
+ * qei_release_sct()) and starts all channels at 0% duty.
+ *
+ * @return 0 on success, -1 if the frequency is out of range
+ */
+int sct_pwm_start(uint32_t freq_hz)
+{
+  uint32_t output = 0;
+
+  if (freq_hz < SCT_PWM_FREQ_MIN || freq_hz > SCT_PWM_FREQ_MAX) return -1;
+
+  Enable_Periph_Clock(CLK_SCT);
+  Enable_Periph_Clock(CLK_SWM);
+  Do_Periph_Reset(RESET_SCT);
+
+  ConfigSWM(SCT_OUT0, PWM_OUT0_PIN);
+  ConfigSWM(SCT_OUT1, PWM_OUT1_PIN);
+  ConfigSWM(SCT_OUT2, PWM_OUT2_PIN);
+
+  // UNIFY counter, CLKMODE=busclock, reload matches at the limit
+  LPC_SCT->CONFIG = (1<<UNIFY) |
+                    (Bus_clock<<CLKMODE) |
+                    (0<<NORELOAD_L) |
+                    (0<<AUTOLIMIT_L);
+
+  // Halted while setting up, up-count, no prescaler
+  LPC_SCT->CTRL = (1<<Halt_L) |
+                  (1<<CLRCTR_L) |
+                  (0<<BIDIR_L) |
+                  (0<<PRE_L);
+
+  LPC_SCT->LIMIT = 1<<SCT_PWM_EV_LIMIT;
+  LPC_SCT->HALT = 0;
+  LPC_SCT->STOP = 0;
+  LPC_SCT->START = 0;
+  LPC_SCT->COUNT = 0;
+  LPC_SCT->STATE = 0;
+  LPC_SCT->REGMODE = 0;
+  LPC_SCT->OUTPUTDIRCTRL = 0;
+  LPC_SCT->RES = 0;
+  LPC_SCT->EVEN = 0;
+  LPC_SCT->EVFLAG = 0xFF;
+  LPC_SCT->CONEN = 0;
+  LPC_SCT->CONFLAG = 0xFFFFFFFF;
+
+  // Every event is a plain match in state 0, event n on match n
+  for (uint8_t e = 0; e < SCT_PWM_EVENTS; e++)
+  {
+    LPC_SCT->EVENT[e].STATE = 1<<0;
+    LPC_SCT->EVENT[e].CTRL = (e<<MATCHSEL) | (Match_Only<<COMBMODE) | (0<<STATELD) | (0<<STATEV);
+  }
+
+  _sct_pwm_period = system_ahb_clk / freq_hz;
+  LPC_SCT->MATCH[SCT_PWM_EV_LIMIT].U = _sct_pwm_period - 1;
+  LPC_SCT->MATCHREL[SCT_PWM_EV_LIMIT].U = _sct_pwm_period - 1;
+
+  for (uint8_t ch = 0; ch < SCT_PWM_CHANNELS; ch++)
+  {
+    uint32_t on, off;
+
+    _sct_pwm_duty[ch] = 0;
+    _sct_pwm_pulse_us[ch] = 0;
+    _sct_pwm_phase[ch] = 0;
+
+    output |= sct_pwm_match(ch, &on, &off) << ch;
+    LPC_SCT->MATCH[SCT_PWM_EV_ON(ch)].U = on;
+    LPC_SCT->MATCHREL[SCT_PWM_EV_ON(ch)].U = on;
+    LPC_SCT->MATCH[SCT_PWM_EV_OFF(ch)].U = off;
+    LPC_SCT->MATCHREL[SCT_PWM_EV_OFF(ch)].U = off;
+
+    LPC_SCT->OUT[ch].SET = 1<<SCT_PWM_EV_ON(ch);
+    LPC_SCT->OUT[ch].CLR = 1<<SCT_PWM_EV_OFF(ch);
+  }
+
+  LPC_SCT->OUTPUT = output;
+
+  // Run
+  LPC_SCT->CTRL &= ~(1<<Halt_L);
+
+  return 0;
+}
+
+/**
+ * Changes the period, keeping every channel's duty (or pulse width) and
+ * phase. Takes effect at the end of the current period.
+ *
+ * @return 0 on success, -1 if the frequency is out of range
+ */
+int sct_pwm_set_freq(uint32_t freq_hz)
+{
+  if (freq_hz < SCT_PWM_FREQ_MIN || freq_hz > SCT_PWM_FREQ_MAX) return -1;
+
+  _sct_pwm_period = system_ahb_clk / freq_hz;
+  LPC_SCT->MATCHREL[SCT_PWM_EV_LIMIT].U = _sct_pwm_period - 1;
+
+  for (uint8_t ch = 0; ch < SCT_PWM_CHANNELS; ch++)
+  {
+    sct_pwm_reload(ch);
+  }
+
+  return 0;
+}
+
+/**
+ * Sets a channel's duty cycle and phase.
+ *
+ * @param duty        High time, 0.1% (0..1000)
+ * @param phase_deg   Delay of the rising edge, degrees of the period (0..359)
+ */
+void sct_pwm_set_duty(uint8_t ch, uint16_t duty, uint16_t phase_deg)
+{
+  if (ch >= SCT_PWM_CHANNELS) return;
+
+  _sct_pwm_duty[ch] = duty > 1000 ? 1000 : duty;
+  _sct_pwm_pulse_us[ch] = 0;
+  _sct_pwm_phase[ch] = phase_deg % 360;
+
+  sct_pwm_reload(ch);
+}
+
+/**
+ * Sets a channel to a fixed pulse width (servo pulses), which doesn't
+ * scale with the frequency.
+ */
+void sct_pwm_set_pulse(uint8_t ch, uint32_t width_us, uint16_t phase_deg)
+{
+  if (ch >= SCT_PWM_CHANNELS) return;
+
+  _sct_pwm_duty[ch] = 0;
+  _sct_pwm_pulse_us[ch] = width_us;
+  _sct_pwm_phase[ch] = phase_deg % 360;
+
+  sct_pwm_reload(ch);
+}
+
+/**
+ * Halts the SCT with all outputs low.
+ */
+void sct_pwm_stop(void)
+{
+  LPC_SCT->CTRL |= (1<<Halt_L);
+  LPC_SCT->OUTPUT = 0;
+}
@@ -0,0 +1,28 @@
+/*
+===============================================================================
+ Name        : sct_pwm.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description :
+===============================================================================
+*/
+
+#ifndef SCT_PWM_H_
+#define SCT_PWM_H_
+
+#include <stdint.h>
+
+// Event 0 sets the period, every channel needs two more (on, off) out of
+// the 8 the SCT has
+#define SCT_PWM_CHANNELS        (3)
+#define SCT_PWM_FREQ_MIN        (1)
+#define SCT_PWM_FREQ_MAX        (100000)
+
+int  sct_pwm_start(uint32_t freq_hz);
+int  sct_pwm_set_freq(uint32_t freq_hz);
+void sct_pwm_set_duty(uint8_t ch, uint16_t duty, uint16_t phase_deg);
+void sct_pwm_set_pulse(uint8_t ch, uint32_t width_us, uint16_t phase_deg);
+void sct_pwm_stop(void);
+
+#endif /* SCT_PWM_H_ */
@@ -0,0 +1,253 @@
+/*
+===============================================================================
+ Name        : settings.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Flash backed settings store (IAP ROM API)
+===============================================================================
+*/
+
+#include <stddef.h>
+#include <string.h>
+
+#include "LPC8xx.h"
+#include "core_cm0plus.h"
+#include "syscon.h"
+#include "iap.h"
+
+#include "config.h"
+#include "crc32.h"
+#include "settings.h"
+
+// The settings area is a ring of fixed size slots spread over
+// SETTINGS_FLASH_SECTORS sectors. Every save goes into the slot after the
+// newest record, and a sector is only erased when the ring wraps into it,
+// so each sector sees one erase per (slots in the ring) saves and the
+// previous record survives a power loss during the erase/write.
+#define SETTINGS_SECTOR_SIZE      (1024)
+#define SETTINGS_SLOTS_PER_SECTOR (SETTINGS_SECTOR_SIZE / SETTINGS_SLOT_SIZE)
+#define SETTINGS_SLOTS            (SETTINGS_FLASH_SECTORS * SETTINGS_SLOTS_PER_SECTOR)
+#define SETTINGS_WAVE             ((const uint16_t *)(SETTINGS_WAVE_SECTOR * SETTINGS_SECTOR_SIZE))
+#define SETTINGS_SLOT(_n)         ((const settings_record_t *)((SETTINGS_FLASH_SECTOR * SETTINGS_SECTOR_SIZE) + ((_n) * SETTINGS_SLOT_SIZE)))
+
+// Fail the build if the record outgrows a slot
+typedef char settings_slot_size_check[(sizeof(settings_record_t) <= SETTINGS_SLOT_SIZE) ? 1 : -1];
+
+settings_data_t _settings;
+
+static int32_t  _settings_slot = -1;      // Slot with the newest valid record, -1 = none
+static uint32_t _settings_sequence = 0;
+
+static struct sIAP _settings_iap;
+
+static int settings_record_valid(const settings_record_t *rec)
+{
+  if (rec->magic != SETTINGS_MAGIC) return 0;
+  if (rec->version != SETTINGS_VERSION) return 0;
+  if (rec->length != sizeof(settings_data_t)) return 0;
+
+  return crc32(rec, offsetof(settings_record_t, crc)) == rec->crc;
+}
+
+static int settings_slot_blank(uint32_t slot)
+{
+  const uint32_t *p = (const uint32_t *)SETTINGS_SLOT(slot);
+
+  for (uint32_t i = 0; i < SETTINGS_SLOT_SIZE / 4; i++)
+  {
+    if (p[i] != 0xFFFFFFFF) return 0;
+  }
+
+  return 1;
+}
+
+static uint32_t settings_iap(uint32_t cmd, uint32_t p0, uint32_t p1, uint32_t p2)
+{
+  _settings_iap.cmd = cmd;
+  _settings_iap.par[0] = p0;
+  _settings_iap.par[1] = p1;
+  _settings_iap.par[2] = p2;
+  _settings_iap.par[3] = system_ahb_clk / 1000;   // Clock in kHz
+  IAP_Call(&_settings_iap.cmd, &_settings_iap.stat);
+
+  return _settings_iap.stat;
+}
+
+/**
+ * Locates the newest valid record and loads it into _settings.
+ *
+ * Records are stored as the raw settings_data_t image, so loading is a
+ * header check and CRC per slot followed by a single memcpy.
+ *
+ * @return 0 if a record was loaded, -1 if the store is empty (the
+ *         caller keeps its defaults and pushes them into _settings)
+ */
+int settings_init(void)
+{
+  crc32_init();
+
+  _settings_slot = -1;
+  _settings_sequence = 0;
+
+  for (uint32_t i = 0; i < SETTINGS_SLOTS; i++)
+  {
+    const settings_record_t *rec = SETTINGS_SLOT(i);
+
+    if ((_settings_slot < 0 || rec->sequence > _settings_sequence) && settings_record_valid(rec))
+    {
+      _settings_slot = i;
+      _settings_sequence = rec->sequence;
+    }
+  }
+
+  if (_settings_slot < 0)
+  {
+    memset(&_settings, 0, sizeof(_settings));
+    return -1;
+  }
+
+  memcpy(&_settings, &SETTINGS_SLOT(_settings_slot)->data, sizeof(_settings));
+
+  return 0;
+}
+
+/**
+ * Returns non-zero if the settings were restored from flash at boot
+ * (or have been saved since).
+ */
+int settings_loaded(void)
+{
+  return _settings_slot >= 0;
+}
+
+/**
+ * Writes _settings into the next slot of the ring. Nothing is written if
+ * the newest record already matches, so apps can call this freely.
+ *
+ * @return 0 on success, -1 on an IAP or verify failure
+ */
+int settings_save(void)
+{
+  // Word aligned RAM image of one slot, unused bytes stay erased (0xFF)
+  uint32_t buf[SETTINGS_SLOT_SIZE / 4];
+  settings_record_t *rec = (settings_record_t *)buf;
+  uint32_t slot, sector, stat = 0;
+
+  if (_settings_slot >= 0 &&
+      memcmp(&SETTINGS_SLOT(_settings_slot)->data, &_settings, sizeof(_settings)) == 0)
+  {
+    return 0;
+  }
+
+  memset(buf, 0xFF, sizeof(buf));
+  rec->magic = SETTINGS_MAGIC;
+  rec->version = SETTINGS_VERSION;
+  rec->length = sizeof(settings_data_t);
+  rec->sequence = _settings_sequence + 1;
+  memcpy(&rec->data, &_settings, sizeof(_settings));
+  rec->crc = crc32(rec, offsetof(settings_record_t, crc));
+
+  slot = (_settings_slot + 1) % SETTINGS_SLOTS;
+
+  // A half written slot (power loss) is skipped by moving on to the next
+  // sector, which then gets erased like any other wrap
+  if (!settings_slot_blank(slot) && (slot % SETTINGS_SLOTS_PER_SECTOR))
+  {
+    slot = ((slot / SETTINGS_SLOTS_PER_SECTOR + 1) * SETTINGS_SLOTS_PER_SECTOR) % SETTINGS_SLOTS;
+  }
+  sector = SETTINGS_FLASH_SECTOR + (slot / SETTINGS_SLOTS_PER_SECTOR);
+
+  // Flash is not readable while IAP runs, keep every ISR off it
+  __disable_irq();
+
+  if (!settings_slot_blank(slot))
+  {
+    stat = settings_iap(IAP_PREPARE, sector, sector, 0);
+    if (!stat) stat = settings_iap(IAP_ERASE, sector, sector, 0);
+  }
+  if (!stat) stat = settings_iap(IAP_PREPARE, sector, sector, 0);
+  if (!stat) stat = settings_iap(IAP_COPY_RAM2FLASH, (uint32_t)SETTINGS_SLOT(slot), (uint32_t)buf, SETTINGS_SLOT_SIZE);
+
+  __enable_irq();
+
+  if (stat || memcmp(SETTINGS_SLOT(slot), buf, SETTINGS_SLOT_SIZE))
+  {
+    return -1;
+  }
+
+  _settings_slot = slot;
+  _settings_sequence = rec->sequence;
+
+  return 0;
+}
+
+/**
+ * Writes a user waveform table into the wave sectors and records its
+ * length and CRC in the settings. The table is written first, so a power
+ * loss leaves the previous record pointing at a table that fails its CRC
+ * rather than at a half written one that passes.
+ *
+ * @param samples  Word aligned table, count must be a multiple of 128
+ * @param count    Number of entries, up to SETTINGS_WAVE_MAX_LEN
+ *
+ * @return 0 on success, -1 on a bad argument, IAP or verify failure
+ */
+int settings_save_wave(const uint16_t *samples, uint16_t count)
+{
+  uint32_t len = count * sizeof(uint16_t);
+  uint32_t first = SETTINGS_WAVE_SECTOR;
+  uint32_t last = SETTINGS_WAVE_SECTOR + SETTINGS_WAVE_SECTORS - 1;
+  uint32_t stat;
+
+  if (count == 0 || count > SETTINGS_WAVE_MAX_LEN || (len % 256) || ((uint32_t)samples & 3))
+  {
+    return -1;
+  }
+
+  if (_settings.wavegen_user_len == count && settings_wave() &&
+      memcmp(SETTINGS_WAVE, samples, len) == 0)
+  {
+    return 0;
+  }
+
+  __disable_irq();
+
+  stat = settings_iap(IAP_PREPARE, first, last, 0);
+  if (!stat) stat = settings_iap(IAP_ERASE, first, last, 0);
+
+  // 256 bytes at a time, the largest size that divides every valid length
+  for (uint32_t offset = 0; !stat && offset < len; offset += 256)
+  {
+    stat = settings_iap(IAP_PREPARE, first, last, 0);
+    if (!stat) stat = settings_iap(IAP_COPY_RAM2FLASH, (uint32_t)SETTINGS_WAVE + offset,
+                                   (uint32_t)samples + offset, 256);
+  }
+
+  __enable_irq();
+
+  if (stat || memcmp(SETTINGS_WAVE, samples, len))
+  {
+    _settings.wavegen_user_len = 0;
+    return -1;
+  }
+
+  _settings.wavegen_user_len = count;
+  _settings.wavegen_user_crc = crc32(SETTINGS_WAVE, len);
+
+  return settings_save();
+}
+
+/**
+ * Returns the persisted user waveform (in flash, _settings.wavegen_user_len
+ * entries), or NULL if there is none or it fails its CRC.
+ */
+const uint16_t* settings_wave(void)
+{
+  uint16_t count = _settings.wavegen_user_len;
+
+  if (count == 0 || count > SETTINGS_WAVE_MAX_LEN) return NULL;
+  if (crc32(SETTINGS_WAVE, count * sizeof(uint16_t)) != _settings.wavegen_user_crc) return NULL;
+
+  return SETTINGS_WAVE;
+}
@@ -0,0 +1,63 @@
+/*
+===============================================================================
+ Name        : settings.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description :
+===============================================================================
+*/
+
+#ifndef SETTINGS_H_
+#define SETTINGS_H_
+
+#include <stdint.h>
+
+#define SETTINGS_MAGIC            (0x454B4153)  // "SAKE"
+#define SETTINGS_VERSION          (3)           // Bump when settings_data_t changes layout
+
+#define SETTINGS_SLOT_SIZE        (64)          // One record per slot, IAP copy size
+#define SETTINGS_WAVE_MAX_LEN     (SETTINGS_WAVE_SECTORS * 1024 / 2)
+
+// Persisted instrument state, stored as a raw image so loading is a plain
+// copy. Keep fields naturally aligned and bump SETTINGS_VERSION on change.
+typedef struct
+{
+	uint32_t wavegen_user_crc;    // CRC-32 of the table in the wave sectors
+	uint16_t wavegen_user_len;    // Entries in the wave sectors, 0 = none
+	uint16_t wavegen_hz;
+	uint16_t wavegen_ampl;        // Peak to peak, DAC lsb
+	uint16_t wavegen_offset;      // Midpoint, DAC lsb
+	uint8_t  wavegen_wave;
+	uint8_t  wavegen_duty;
+	uint8_t  wavegen_harmonics;
+	uint8_t  wavegen_reserved;
+	uint16_t scope_thresh_l;
+	uint16_t scope_thresh_h;
+	uint8_t  scope_rate;
+	uint8_t  scope_coupling;
+	uint8_t  scope_vdiv;
+	uint8_t  capt_filter;         // capt_filter_type_t, 0 (raw counts) in older records
+} settings_data_t;
+
+typedef struct
+{
+	uint32_t        magic;
+	uint16_t        version;
+	uint16_t        length;       // sizeof(settings_data_t)
+	uint32_t        sequence;     // Highest valid sequence number wins
+	settings_data_t data;
+	uint32_t        crc;          // CRC-32 over everything above
+} settings_record_t;
+
+// Working copy, apps update it and call settings_save()
+extern settings_data_t _settings;
+
+int  settings_init(void);
+int  settings_loaded(void);
+int  settings_save(void);
+
+int  settings_save_wave(const uint16_t *samples, uint16_t count);
+const uint16_t* settings_wave(void);
+
+#endif /* SETTINGS_H_ */
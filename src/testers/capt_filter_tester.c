@@ -0,0 +1,105 @@
+/*
+===============================================================================
+ Name        : capt_filter_tester.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Cycle counts of the captouch filters on the board
+===============================================================================
+*/
+
+#include <stdio.h>
+
+#include "LPC8xx.h"
+#include "core_cm0plus.h"
+#include "../chip_setup.h"
+#include "../delay.h"
+#include "../capt_filter.h"
+#include "capt_filter_tester.h"
+
+// Cycle counts only, call capt_filter_tester_run() with the debug UART up.
+// Detection latency and false touches are measured on the PC with
+// tools/capt_replay.cpp, which runs the same filter code over a trace.
+// The counts are a copy of tools/capt_trace.txt, a glitch and a touch, so
+// the filters go through the same branches as on real input.
+static const uint16_t capt_filter_tester_trace[128] = {
+	 989,  997, 1008,  990, 1005,  992, 1006,  995,
+	 989,  993, 1009, 1002, 1002,  993,  999, 1009,
+	 996, 1002,  988, 1000,  780, 1000, 1002,  990,
+	1004, 1001, 1002, 1003,  993,  995, 1003,  988,
+	 992,  994, 1012,  993, 1003, 1005,  995, 1012,
+	 959,  896,  850,  800,  762,  752,  761,  755,
+	 749,  753,  770,  766,  753,  767,  759,  752,
+	 753,  765,  766,  761,  756,  768,  756,  770,
+	 762,  753,  766,  755,  772,  768,  771,  772,
+	 771,  748,  755,  766,  751,  764,  749,  753,
+	 759,  753,  771,  766,  763,  763,  766,  751,
+	 758,  762,  754,  768,  755,  765,  755,  758,
+	 757,  749,  764,  771,  800,  861,  894,  951,
+	 991,  998,  990,  994, 1011, 1007, 1005, 1003,
+	 990,  996, 1012,  988,  993,  993,  994, 1010,
+	 997, 1000, 1010, 1001, 1002, 1012,  992, 1008
+};
+
+// SysTick cycles since boot, good for short spans
+static uint32_t capt_filter_tester_systick(void)
+{
+	uint32_t ms, val;
+
+	do
+	{
+		ms = millis();
+		val = SysTick->VAL;
+	} while (ms != millis());
+
+	return ms * (SysTick->LOAD + 1) + (SysTick->LOAD - val);
+}
+
+/**
+ * Runs 'n' counts of 'trace' through 'type' on sensor 0.
+ *
+ * Selects 'type' and leaves it selected, the CAPT interrupt must be off.
+ *
+ * @return Cycles per sample, the replay loop included
+ */
+uint32_t capt_filter_tester_cycles(capt_filter_type_t type, const uint16_t *trace, uint32_t n)
+{
+	uint32_t i, t;
+	uint16_t out;
+
+	capt_filter_select(type);
+
+	t = capt_filter_tester_systick();
+	for (i = 0; i < n; i++)
+	{
+		capt_filter_run(0, trace[i], &out);
+	}
+	t = capt_filter_tester_systick() - t;
+
+	return t / n;
+}
+
+int capt_filter_tester_run(void)
+{
+	capt_filter_type_t was = capt_filter_type();
+	uint32_t irq = NVIC->ISER[0] & (1 << CAPT_IRQn);
+	uint8_t type;
+
+	NVIC_DisableIRQ(CAPT_IRQn);
+
+	printf("FILTER       CYC/SAMPLE\n\r");
+	for (type = 0; type < CAPT_FILTER_LAST; type++)
+	{
+		printf("%-12s %10d\n\r", capt_filter_name((capt_filter_type_t)type),
+		       (int)capt_filter_tester_cycles((capt_filter_type_t)type, capt_filter_tester_trace,
+		                                      sizeof(capt_filter_tester_trace) / sizeof(capt_filter_tester_trace[0])));
+	}
+
+	capt_filter_select(was);
+	if (irq)
+	{
+		NVIC_EnableIRQ(CAPT_IRQn);
+	}
+
+	return 0;
+}
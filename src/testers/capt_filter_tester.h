@@ -0,0 +1,20 @@
+/*
+===============================================================================
+ Name        : capt_filter_tester.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description :
+===============================================================================
+*/
+
+#ifndef TESTERS_CAPT_FILTER_TESTER_H_
+#define TESTERS_CAPT_FILTER_TESTER_H_
+
+#include <stdint.h>
+#include "../capt_filter.h"
+
+uint32_t capt_filter_tester_cycles(capt_filter_type_t type, const uint16_t *trace, uint32_t n);
+int      capt_filter_tester_run(void);
+
+#endif /* TESTERS_CAPT_FILTER_TESTER_H_ */
@@ -0,0 +1,153 @@
+/*
+===============================================================================
+ Name        : wave_synth.c
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Fixed point waveform table synthesizer
+===============================================================================
+*/
+
+#include "dac_wavegen.h"
+#include "wave_synth.h"
+
+// Every waveform is first generated as a signed Q15 shape (+/-32767)
+// and then mapped to offset +/- amplitude/2, so amplitude and offset
+// work the same way for all of them. No divisions in the per-sample
+// paths, a full 1024 point table renders in a few ms on the M0+.
+#define WAVE_SYNTH_FULL           (32767)
+
+// dac_wavegen_sine_1024[] is centred on 279 with a 279 peak
+#define WAVE_SYNTH_SINE_MID       (279)
+
+static const uint16_t _wave_synth_harmonic_weight[WAVE_SYNTH_MAX_HARMONICS] = {
+	256, 128, 85, 64, 51, 43, 37, 32		// 256 / k
+};
+
+static inline uint16_t wave_synth_map(int32_t shape, const wave_synth_cfg_t *cfg)
+{
+	int32_t v = (int32_t)cfg->offset + ((shape * (int32_t)cfg->amplitude) >> 16);
+
+	if (v < 0) v = 0;
+	if (v > cfg->limit) v = cfg->limit;
+
+	return (uint16_t)v;
+}
+
+// Sine plus harmonics 2..n at 1/k weight, normalised to the full scale.
+// The raw sum is parked in dst (signed) to find its peak first.
+static void wave_synth_sine(uint16_t *dst, uint8_t bits, const wave_synth_cfg_t *cfg)
+{
+	uint32_t n = 1UL << bits;
+	uint32_t step = 1UL << (DAC_WAVEGEN_DDS_MAX_BITS - bits);
+	uint8_t harmonics = cfg->harmonics;
+	int32_t peak = 1;
+	int32_t scale;
+
+	if (harmonics < 1) harmonics = 1;
+	if (harmonics > WAVE_SYNTH_MAX_HARMONICS) harmonics = WAVE_SYNTH_MAX_HARMONICS;
+
+	for (uint32_t i = 0; i < n; i++)
+	{
+		int32_t sum = 0;
+
+		for (uint8_t k = 1; k <= harmonics; k++)
+		{
+			uint32_t idx = (i * step * k) & ((1UL << DAC_WAVEGEN_DDS_MAX_BITS) - 1);
+			sum += ((int32_t)dac_wavegen_sine_1024[idx] - WAVE_SYNTH_SINE_MID) * _wave_synth_harmonic_weight[k - 1];
+		}
+
+		// +/-279 * 256 * (1 + 1/2 + ... + 1/8) fits an int16 after >> 4
+		sum >>= 4;
+		((int16_t *)dst)[i] = (int16_t)sum;
+
+		if (sum < 0) sum = -sum;
+		if (sum > peak) peak = sum;
+	}
+
+	// One division for the whole table, Q15 reciprocal after that
+	scale = (WAVE_SYNTH_FULL << 15) / peak;
+
+	for (uint32_t i = 0; i < n; i++)
+	{
+		dst[i] = wave_synth_map((((int16_t *)dst)[i] * scale) >> 15, cfg);
+	}
+}
+
+/**
+ * Renders a (1 << bits) point table into dst.
+ *
+ * @param dst   Output table, 10-bit DAC codes
+ * @param bits  log2 of the table size (1..WAVE_SYNTH_MAX_BITS)
+ * @param cfg   Waveform type, shape parameters, amplitude and offset
+ */
+void wave_synth_render(uint16_t *dst, uint8_t bits, const wave_synth_cfg_t *cfg)
+{
+	uint32_t n = 1UL << bits;
+
+	if (bits == 0 || bits > WAVE_SYNTH_MAX_BITS) return;
+
+	switch (cfg->type)
+	{
+	case WAVE_SYNTH_SINE:
+	case WAVE_SYNTH_LAST:
+		wave_synth_sine(dst, bits, cfg);
+		break;
+
+	case WAVE_SYNTH_SQUARE:
+	{
+		uint32_t high = (n * cfg->duty) / 100;
+
+		for (uint32_t i = 0; i < n; i++)
+		{
+			dst[i] = wave_synth_map(i < high ? WAVE_SYNTH_FULL : -WAVE_SYNTH_FULL, cfg);
+		}
+		break;
+	}
+
+	case WAVE_SYNTH_TRIANGLE:
+		for (uint32_t i = 0; i < n; i++)
+		{
+			// Phase in 16-bit fixed point, rising for the first half
+			uint32_t p = (i << 16) >> bits;
+			int32_t shape = (p < 0x8000) ? (int32_t)(p * 2) : (int32_t)((0xFFFF - p) * 2);
+			dst[i] = wave_synth_map(shape - WAVE_SYNTH_FULL, cfg);
+		}
+		break;
+
+	case WAVE_SYNTH_SAW:
+		for (uint32_t i = 0; i < n; i++)
+		{
+			dst[i] = wave_synth_map((int32_t)((i << 16) >> bits) - WAVE_SYNTH_FULL, cfg);
+		}
+		break;
+
+	case WAVE_SYNTH_NOISE:
+	{
+		// 16-bit Galois LFSR (x^16 + x^14 + x^13 + x^11 + 1), fixed seed
+		// so the same settings always give the same table
+		uint16_t lfsr = 0xACE1;
+
+		for (uint32_t i = 0; i < n; i++)
+		{
+			lfsr = (lfsr >> 1) ^ (-(lfsr & 1) & 0xB400);
+			dst[i] = wave_synth_map((int32_t)lfsr - 0x8000, cfg);
+		}
+		break;
+	}
+
+	case WAVE_SYNTH_TABLE:
+	{
+		// Q8 factor taking the source range to 0..65534
+		uint32_t scale = (65534UL << 8) / (cfg->table_max ? cfg->table_max : 1);
+
+		for (uint32_t i = 0; i < n; i++)
+		{
+			uint32_t j = (bits >= cfg->table_bits) ? (i >> (bits - cfg->table_bits)) : (i << (cfg->table_bits - bits));
+			int32_t shape = (int32_t)((cfg->table[j] * scale) >> 8) - WAVE_SYNTH_FULL;
+			dst[i] = wave_synth_map(shape, cfg);
+		}
+		break;
+	}
+	}
+}
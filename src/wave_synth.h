@@ -0,0 +1,45 @@
+/*
+===============================================================================
+ Name        : wave_synth.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description :
+===============================================================================
+*/
+
+#ifndef WAVE_SYNTH_H_
+#define WAVE_SYNTH_H_
+
+#include <stdint.h>
+
+#define WAVE_SYNTH_MAX_BITS       (10)
+#define WAVE_SYNTH_MAX_HARMONICS  (8)
+
+typedef enum
+{
+	WAVE_SYNTH_SINE = 0,
+	WAVE_SYNTH_SQUARE,
+	WAVE_SYNTH_TRIANGLE,
+	WAVE_SYNTH_SAW,
+	WAVE_SYNTH_NOISE,
+	WAVE_SYNTH_TABLE,               // Rescale an existing table
+	WAVE_SYNTH_LAST
+} wave_synth_type_t;
+
+typedef struct
+{
+	wave_synth_type_t type;
+	uint8_t  duty;                  // SQUARE: high time in percent (1..99)
+	uint8_t  harmonics;             // SINE: harmonics summed at 1/k weight (1 = pure sine)
+	uint16_t amplitude;             // Peak to peak, in DAC lsb
+	uint16_t offset;                // Waveform midpoint, in DAC lsb
+	uint16_t limit;                 // Output is clamped to 0..limit
+	const uint16_t *table;          // TABLE: source samples
+	uint8_t  table_bits;            // TABLE: log2 of the source size
+	uint16_t table_max;             // TABLE: source full scale value
+} wave_synth_cfg_t;
+
+void wave_synth_render(uint16_t *dst, uint8_t bits, const wave_synth_cfg_t *cfg);
+
+#endif /* WAVE_SYNTH_H_ */
@@ -0,0 +1,252 @@
+/*
+===============================================================================
+ Name        : capt_replay.cpp
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Host side replay of TOUCH counts through the captouch filters
+===============================================================================
+
+ Build:  cc -std=c99 -O2 -I tools/host -c src/capt_filter.c
+         c++ -std=c++11 -O2 -I src -I tools/host -o capt_replay \
+             tools/capt_replay.cpp capt_filter.o
+ Usage:  capt_replay [-o <onset>] [-r <release>] [-t <threshold>] [-c] <trace file>
+
+ Runs a recorded TOUCH count trace (one sensor, 12-bit counts separated by
+ whitespace or commas, '#' starts a comment line) through every filter in
+ src/capt_filter.c, the firmware code itself built for the PC. A touch is
+ an output past <threshold> on the touch side (see TOUCH_TRIGGERS_LOWER).
+ Reported per filter:
+   LATENCY  samples from <onset> to the first touch output
+   RELEASE  samples from <release> to the first output back past it
+   FALSE    touch outputs before <onset>, glitches that got through
+   HOST NS  PC time per sample, only good for ranking the filters
+ -c prints every output as CSV instead, for plotting.
+
+ HOST NS says nothing about the target. The cost on the Cortex-M0+, in
+ cycles per sample, comes from capt_filter_tester_run() on the board
+ (src/testers/capt_filter_tester.c). tools/capt_trace.txt is a sample
+ trace.
+*/
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+extern "C" {
+#include "chip_setup.h"
+#include "capt_filter.h"
+}
+
+namespace {
+
+const double kBenchSeconds = 0.1;			// Per filter, repeating the trace
+
+struct result_t
+{
+	long latency;							// -1 = never touched
+	long release;							// -1 = never released, or not asked for
+	unsigned false_touches;
+	unsigned outputs;
+	double ns_per_sample;					// On the PC, not the target
+};
+
+bool touched(uint16_t out, uint16_t threshold)
+{
+#if TOUCH_TRIGGERS_LOWER == 1
+	return out < threshold;
+#else
+	return out > threshold;
+#endif
+}
+
+bool load_trace(const char *path, std::vector<uint16_t> &trace)
+{
+	std::ifstream in(path);
+	std::string line;
+
+	if (!in) return false;
+
+	while (std::getline(in, line))
+	{
+		if (line.empty() || line[0] == '#') continue;
+
+		for (char &c : line) if (c == ',') c = ' ';
+		char *p = &line[0];
+		char *end;
+		for (long v = strtol(p, &end, 0); end != p; v = strtol(p, &end, 0))
+		{
+			if (v < 0 || v > 0xFFF)
+			{
+				fprintf(stderr, "Count %zu out of range: %ld\n", trace.size(), v);
+				return false;
+			}
+			trace.push_back((uint16_t)v);
+			p = end;
+		}
+	}
+
+	return true;
+}
+
+// Sensor 0 only, selecting the filter again starts it from scratch
+result_t replay(capt_filter_type_t type, const std::vector<uint16_t> &trace,
+                size_t onset, size_t release, uint16_t threshold)
+{
+	result_t r = { -1, -1, 0, 0, 0 };
+	uint16_t out;
+
+	capt_filter_select(type);
+	for (size_t i = 0; i < trace.size(); i++)
+	{
+		if (!capt_filter_run(0, trace[i], &out)) continue;
+
+		r.outputs++;
+		if (touched(out, threshold))
+		{
+			if (i < onset) r.false_touches++;
+			else if (r.latency < 0) r.latency = (long)(i - onset);
+		}
+		else if (release && i >= release && r.release < 0 && r.latency >= 0)
+		{
+			r.release = (long)(i - release);
+		}
+	}
+
+	// Time the filter alone, the trace is replayed until it's long enough
+	using clock = std::chrono::steady_clock;
+	clock::time_point start = clock::now();
+	double elapsed;
+	size_t samples = 0;
+	volatile uint16_t sink = 0;
+	do
+	{
+		capt_filter_select(type);
+		for (uint16_t count : trace)
+		{
+			if (capt_filter_run(0, count, &out)) sink = out;
+		}
+		samples += trace.size();
+		elapsed = std::chrono::duration<double>(clock::now() - start).count();
+	} while (elapsed < kBenchSeconds);
+	(void)sink;
+
+	r.ns_per_sample = elapsed * 1e9 / samples;
+
+	return r;
+}
+
+void print_csv(const std::vector<uint16_t> &trace)
+{
+	std::vector<std::vector<long>> out(CAPT_FILTER_LAST, std::vector<long>(trace.size(), -1));
+	uint16_t v;
+
+	for (int type = 0; type < CAPT_FILTER_LAST; type++)
+	{
+		capt_filter_select((capt_filter_type_t)type);
+		for (size_t i = 0; i < trace.size(); i++)
+		{
+			if (capt_filter_run(0, trace[i], &v)) out[type][i] = v;
+		}
+	}
+
+	printf("sample,raw");
+	for (int type = 0; type < CAPT_FILTER_LAST; type++)
+	{
+		printf(",%s", capt_filter_name((capt_filter_type_t)type));
+	}
+	printf("\n");
+	for (size_t i = 0; i < trace.size(); i++)
+	{
+		printf("%zu,%u", i, trace[i]);
+		for (int type = 0; type < CAPT_FILTER_LAST; type++)
+		{
+			// The decimator leaves the samples between its outputs empty
+			if (out[type][i] >= 0) printf(",%ld", out[type][i]);
+			else printf(",");
+		}
+		printf("\n");
+	}
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	size_t onset = 40, release = 0;
+	uint16_t threshold = 880;
+	bool csv = false;
+	int arg = 1;
+
+	for (; arg < argc && argv[arg][0] == '-'; arg++)
+	{
+		if (strcmp(argv[arg], "-c") == 0)
+		{
+			csv = true;
+		}
+		else if (arg + 1 < argc && strcmp(argv[arg], "-o") == 0)
+		{
+			onset = strtoul(argv[++arg], NULL, 0);
+		}
+		else if (arg + 1 < argc && strcmp(argv[arg], "-r") == 0)
+		{
+			release = strtoul(argv[++arg], NULL, 0);
+		}
+		else if (arg + 1 < argc && strcmp(argv[arg], "-t") == 0)
+		{
+			threshold = (uint16_t)strtoul(argv[++arg], NULL, 0);
+		}
+		else
+		{
+			break;
+		}
+	}
+	if (argc - arg != 1)
+	{
+		fprintf(stderr, "Usage: %s [-o <onset>] [-r <release>] [-t <threshold>] [-c] <trace file>\n", argv[0]);
+		return 2;
+	}
+
+	std::vector<uint16_t> trace;
+	if (!load_trace(argv[arg], trace) || trace.empty())
+	{
+		fprintf(stderr, "No TOUCH counts in %s\n", argv[arg]);
+		return 1;
+	}
+	if (onset >= trace.size() || release >= trace.size() || (release && release <= onset))
+	{
+		fprintf(stderr, "Onset and release must fall inside the %zu count trace, in order\n", trace.size());
+		return 1;
+	}
+
+	if (csv)
+	{
+		print_csv(trace);
+		return 0;
+	}
+
+	printf("%zu counts, touch at %zu", trace.size(), onset);
+	if (release) printf(", release at %zu", release);
+	printf(", threshold %u\n", threshold);
+	printf("HOST NS is PC time, for M0+ cycles run capt_filter_tester_run() on the board\n\n");
+	printf("%-12s %8s %8s %6s %8s %8s\n", "FILTER", "LATENCY", "RELEASE", "FALSE", "OUTPUTS", "HOST NS");
+
+	for (int type = 0; type < CAPT_FILTER_LAST; type++)
+	{
+		result_t r = replay((capt_filter_type_t)type, trace, onset, release, threshold);
+
+		printf("%-12s ", capt_filter_name((capt_filter_type_t)type));
+		if (r.latency >= 0) printf("%8ld ", r.latency);
+		else printf("%8s ", "MISSED");
+		if (r.release >= 0) printf("%8ld ", r.release);
+		else printf("%8s ", "-");
+		printf("%6u %8u %8.1f\n", r.false_touches, r.outputs, r.ns_per_sample);
+	}
+
+	return 0;
+}
@@ -0,0 +1,313 @@
+/*
+===============================================================================
+ Name        : dds_model.cpp
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Host side reference model of the DAC wavegen DDS mode
+===============================================================================
+
+ Build:  c++ -std=c++11 -O2 -o dds_model dds_model.cpp
+ Usage:  dds_model [-m <min SFDR dBc>] <table> <freq Hz> [<freq Hz> ...]
+
+ Runs the DDS exactly as dac_wavegen_dds_run() does (mHz tuning word,
+ 32-bit phase accumulator, table indexed by its top bits) and reports the
+ spectral purity of the sample stream at each frequency. <table> is either
+ src/dac_wavegen.c, for its 1024 point sine, or a sample file (2..1024
+ 10-bit values, a power of 2, as for wave_upload). Each frequency gets an
+ FFT of at least 16 periods, which sets the lower limit at ~0.08Hz.
+
+ The DAC hold (sinc roll-off) and the analog stage aren't modelled, only
+ what the firmware feeds the DAC. For reference the output also shows the
+ SINAD of an ideal sine quantized to the table's amplitude, and the
+ ~-6dB per index bit worst case of the phase truncation spurs. With -m
+ the exit code is 1 if any frequency has less SFDR than given.
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+
+// Keep in step with src/dac_wavegen.h
+const uint32_t kSampleHz = 20000;			// DAC_WAVEGEN_DDS_SAMPLE_HZ
+const unsigned kMaxBits = 10;				// DAC_WAVEGEN_DDS_MAX_BITS
+
+const unsigned kPointsLog2 = 16;			// Shortest FFT, ~3.3s of output
+const unsigned kPointsLog2Max = 22;			// Longest, ~210s
+const unsigned kMinCycles = 16;				// Periods in the FFT, clear of the DC lobe
+const unsigned kLobe = 5;					// Blackman-Harris main lobe half width, bins
+const unsigned kHarmonics = 5;				// Fundamental plus 2..5, as dsp_tone_analyze()
+
+struct result_t
+{
+	double actual_hz;
+	double sfdr_db;
+	double spur_hz;
+	double thd_db;
+	double sinad_db;
+};
+
+// dac_wavegen_dds_tuning_word()
+uint32_t tuning_word(uint32_t freq_mhz)
+{
+	return (uint32_t)(((uint64_t)freq_mhz << 32) / (kSampleHz * 1000ULL));
+}
+
+// In place radix-2 FFT, 'x' a power of 2 long
+void fft(std::vector<std::complex<double>> &x)
+{
+	size_t n = x.size();
+
+	for (size_t i = 1, j = 0; i < n; i++)
+	{
+		size_t bit = n >> 1;
+		for (; j & bit; bit >>= 1) j ^= bit;
+		j ^= bit;
+		if (i < j) std::swap(x[i], x[j]);
+	}
+
+	for (size_t len = 2; len <= n; len <<= 1)
+	{
+		std::complex<double> w = std::polar(1.0, -2 * M_PI / len);
+		for (size_t i = 0; i < n; i += len)
+		{
+			std::complex<double> wk = 1;
+			for (size_t k = 0; k < len / 2; k++)
+			{
+				std::complex<double> a = x[i + k], b = x[i + k + len / 2] * wk;
+				x[i + k] = a + b;
+				x[i + k + len / 2] = a - b;
+				wk *= w;
+			}
+		}
+	}
+}
+
+// Power in the main lobe around the largest bin near 'bin'. Sums over the
+// lobe keep the ratios independent of the window's noise bandwidth.
+double lobe_power(const std::vector<double> &p, size_t bin, size_t *peak)
+{
+	size_t lo = bin > 2 ? bin - 2 : 0, hi = std::min(bin + 2, p.size() - 1);
+	size_t k = lo;
+	double sum = 0;
+
+	for (size_t i = lo; i <= hi; i++)
+	{
+		if (p[i] > p[k]) k = i;
+	}
+	for (size_t i = (k > kLobe ? k - kLobe : 0); i <= k + kLobe && i < p.size(); i++)
+	{
+		sum += p[i];
+	}
+	if (peak) *peak = k;
+
+	return sum;
+}
+
+// FFT length that holds kMinCycles periods, 0 if it's over the limit
+size_t fft_points(double freq_hz)
+{
+	for (unsigned b = kPointsLog2; b <= kPointsLog2Max; b++)
+	{
+		if ((1u << b) * freq_hz >= (double)kMinCycles * kSampleHz) return 1u << b;
+	}
+
+	return 0;
+}
+
+result_t analyze(const std::vector<uint16_t> &table, unsigned bits, uint32_t freq_mhz, size_t n)
+{
+	const uint32_t inc = tuning_word(freq_mhz);
+	std::vector<std::complex<double>> x(n);
+	std::vector<double> p(n / 2 + 1);
+	result_t r;
+	uint32_t phase = 0;
+	double mean = 0;
+
+	r.actual_hz = (double)inc * kSampleHz / 4294967296.0;
+
+	// The DAC IRQ: output the entry, then advance the accumulator
+	for (size_t i = 0; i < n; i++)
+	{
+		x[i] = table[phase >> (32 - bits)];
+		mean += x[i].real();
+		phase += inc;
+	}
+	mean /= n;
+
+	// 4 term Blackman-Harris, sidelobes at -92dB, below the 10-bit floor
+	for (size_t i = 0; i < n; i++)
+	{
+		double a = 2 * M_PI * i / n;
+		double w = 0.35875 - 0.48829 * cos(a) + 0.14128 * cos(2 * a) - 0.01168 * cos(3 * a);
+		x[i] = (x[i].real() - mean) * w;
+	}
+	fft(x);
+	for (size_t k = 0; k <= n / 2; k++)
+	{
+		p[k] = std::norm(x[k]);
+	}
+
+	size_t fund;
+	double bin_hz = (double)kSampleHz / n;
+	double pf = lobe_power(p, (size_t)lround(r.actual_hz / bin_hz), &fund);
+
+	// Harmonics, folded back below Nyquist
+	double ph = 0;
+	for (unsigned h = 2; h <= kHarmonics; h++)
+	{
+		double f = fmod(h * r.actual_hz, (double)kSampleHz);
+		if (f > kSampleHz / 2.0) f = kSampleHz - f;
+		size_t k = (size_t)lround(f / bin_hz);
+		if (k > kLobe && (k + kLobe < fund || k > fund + kLobe))
+		{
+			ph += lobe_power(p, k, NULL);
+		}
+	}
+
+	// Everything but DC and the fundamental is noise or distortion
+	double total = 0, spur = 0;
+	size_t spur_k = 0;
+	for (size_t k = kLobe + 1; k <= n / 2; k++)
+	{
+		total += p[k];
+		if ((k + kLobe < fund || k > fund + kLobe) && p[k] > spur)
+		{
+			spur = p[k];
+			spur_k = k;
+		}
+	}
+
+	r.sfdr_db = 10 * log10(p[fund] / (spur > 0 ? spur : 1e-30));
+	r.spur_hz = spur_k * bin_hz;
+	r.thd_db = 10 * log10((ph > 0 ? ph : 1e-30) / pf);
+	r.sinad_db = 10 * log10(pf / std::max(total - pf, 1e-30));
+
+	return r;
+}
+
+bool parse_values(std::istream &in, std::vector<uint16_t> &samples)
+{
+	std::string tok;
+
+	while (in >> tok)
+	{
+		for (char &c : tok) if (c == ',') c = ' ';
+		char *p = &tok[0];
+		char *end;
+		for (long v = strtol(p, &end, 0); end != p; v = strtol(p, &end, 0))
+		{
+			if (v < 0 || v > 1023)
+			{
+				fprintf(stderr, "Sample %zu out of range: %ld\n", samples.size(), v);
+				return false;
+			}
+			samples.push_back((uint16_t)v);
+			p = end;
+		}
+	}
+
+	return true;
+}
+
+// A .c file is searched for the firmware's sine table, anything else is
+// read as a plain sample file
+bool load_table(const char *path, std::vector<uint16_t> &table)
+{
+	std::ifstream in(path);
+	std::string src;
+	size_t len = strlen(path);
+
+	if (!in) return false;
+
+	src.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	if (len > 2 && strcmp(path + len - 2, ".c") == 0)
+	{
+		size_t pos = src.find("dac_wavegen_sine_1024[1024] = {");
+		if (pos == std::string::npos) return false;
+		pos = src.find('{', pos) + 1;
+		std::istringstream body(src.substr(pos, src.find('}', pos) - pos));
+		return parse_values(body, table);
+	}
+
+	std::istringstream body(src);
+	return parse_values(body, table);
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	double min_sfdr = 0;
+	int arg = 1;
+
+	if (arg + 1 < argc && strcmp(argv[arg], "-m") == 0)
+	{
+		min_sfdr = atof(argv[arg + 1]);
+		arg += 2;
+	}
+	if (argc - arg < 2)
+	{
+		fprintf(stderr, "Usage: %s [-m <min SFDR dBc>] <table> <freq Hz> [<freq Hz> ...]\n", argv[0]);
+		return 2;
+	}
+
+	std::vector<uint16_t> table;
+	unsigned bits = 0;
+	if (load_table(argv[arg], table))
+	{
+		while (bits <= kMaxBits && (1u << bits) < table.size()) bits++;
+	}
+	if (bits == 0 || bits > kMaxBits || (1u << bits) != table.size())
+	{
+		fprintf(stderr, "Need a power of 2 from 2 to %u samples in %s\n", 1u << kMaxBits, argv[arg]);
+		return 1;
+	}
+
+	uint16_t lo = 1023, hi = 0;
+	for (uint16_t v : table)
+	{
+		lo = std::min(lo, v);
+		hi = std::max(hi, v);
+	}
+	double ampl = (hi - lo) / 2.0;
+
+	printf("%u point table, %u-%u lsb, %u Hz sample clock, %.2f uHz resolution\n",
+	       (unsigned)table.size(), lo, hi, kSampleHz, kSampleHz / 4294967296.0 * 1e6);
+	printf("Ideal quantized sine SINAD %.1f dB, phase truncation spurs < %.1f dBc\n\n",
+	       10 * log10(6 * ampl * ampl), -6.02 * bits);
+	printf("%12s %16s %10s %10s %8s %8s\n", "FREQ Hz", "ACTUAL Hz", "SFDR dBc", "SPUR Hz", "THD dB", "SINAD dB");
+
+	int ret = 0;
+	for (arg++; arg < argc; arg++)
+	{
+		double f = atof(argv[arg]);
+		size_t n = f < kSampleHz / 2.0 ? fft_points(f) : 0;
+		if (!n)
+		{
+			fprintf(stderr, "%s: outside %.2f..%u Hz\n", argv[arg],
+			        (double)kMinCycles * kSampleHz / (1u << kPointsLog2Max), kSampleHz / 2);
+			return 1;
+		}
+
+		// The firmware takes whole mHz
+		result_t r = analyze(table, bits, (uint32_t)lround(f * 1000), n);
+		printf("%12.3f %16.6f %10.1f %10.1f %8.1f %8.1f\n",
+		       f, r.actual_hz, r.sfdr_db, r.spur_hz, r.thd_db, r.sinad_db);
+
+		if (min_sfdr && r.sfdr_db < min_sfdr) ret = 1;
+	}
+
+	return ret;
+}
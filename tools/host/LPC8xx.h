@@ -0,0 +1,20 @@
+/*
+===============================================================================
+ Name        : LPC8xx.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Host build stand-in, see capt_replay.cpp
+===============================================================================
+
+ The fixed point modules that tools/ replays on the PC only need the
+ target headers for interrupt masking. These stand-ins are found through
+ -I tools/host, the target build never sees them.
+*/
+
+#ifndef LPC8XX_H_
+#define LPC8XX_H_
+
+#include <stdint.h>
+
+#endif /* LPC8XX_H_ */
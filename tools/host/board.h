@@ -0,0 +1,20 @@
+/*
+===============================================================================
+ Name        : board.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Host build stand-in, see capt_replay.cpp
+===============================================================================
+*/
+
+#ifndef BOARD_H_
+#define BOARD_H_
+
+#include <stdint.h>
+
+// chip_setup.h redefines __CONCAT with three arguments. The C library's
+// own two argument one is only used inside its headers, already in by now.
+#undef __CONCAT
+
+#endif /* BOARD_H_ */
@@ -0,0 +1,22 @@
+/*
+===============================================================================
+ Name        : core_cm0plus.h
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Host build stand-in, see capt_replay.cpp
+===============================================================================
+*/
+
+#ifndef CORE_CM0PLUS_H_
+#define CORE_CM0PLUS_H_
+
+#include <stdint.h>
+
+// Single threaded on the host, there is nothing to mask
+static inline uint32_t __get_PRIMASK(void) { return 0; }
+static inline void __set_PRIMASK(uint32_t primask) { (void)primask; }
+static inline void __disable_irq(void) { }
+static inline void __enable_irq(void) { }
+
+#endif /* CORE_CM0PLUS_H_ */
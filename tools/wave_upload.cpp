@@ -0,0 +1,241 @@
+/*
+===============================================================================
+ Name        : wave_upload.cpp
+ Author      : $(author)
+ Version     :
+ Copyright   : $(copyright)
+ Description : Host side binary USER waveform upload for the SAKEE wavegen
+===============================================================================
+
+ Build:  c++ -std=c++11 -O2 -o wave_upload wave_upload.cpp
+ Usage:  wave_upload [-f] <serial port> <sample file>
+
+ The sample file holds 2..1024 10-bit values (0..1023) separated by
+ whitespace or commas. Open the wavegen "UPLOAD USER WAVEFORM" screen on
+ the board first, then run the tool. -f also stores the table in flash.
+
+ Protocol (see app_wavegen_uart_read_binary() in src/app_wavegen.c):
+   host   'B'                                  at 9600 baud
+   board  "BINARY <baud>\n\r"                  then switches baud
+   host   'W' 'B' <count:u16> <flags:u8> 0 <count x u16> <crc32:u32>
+   board  "OK <count> <clipped>\n\r" or "ERROR: ...\n\r"
+*/
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/select.h>
+
+namespace {
+
+const unsigned kDefaultBaud = 9600;
+const unsigned kMaxSamples = 1024;
+const uint8_t kFlagFlash = 1 << 0;
+
+uint32_t crc32(const std::vector<uint8_t> &data)
+{
+	uint32_t crc = 0xFFFFFFFF;
+
+	for (uint8_t b : data)
+	{
+		crc ^= b;
+		for (int i = 0; i < 8; i++)
+		{
+			crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+		}
+	}
+
+	return ~crc;
+}
+
+speed_t baud_constant(unsigned baud)
+{
+	switch (baud)
+	{
+	case 9600:   return B9600;
+	case 19200:  return B19200;
+	case 38400:  return B38400;
+	case 57600:  return B57600;
+	case 115200: return B115200;
+	case 230400: return B230400;
+	default:     return 0;
+	}
+}
+
+bool set_baud(int fd, unsigned baud)
+{
+	struct termios tio;
+	speed_t speed = baud_constant(baud);
+
+	if (!speed || tcgetattr(fd, &tio)) return false;
+
+	cfmakeraw(&tio);
+	tio.c_cflag |= CLOCAL | CREAD;
+	tio.c_cflag &= ~(CSTOPB | PARENB | CRTSCTS);
+	cfsetispeed(&tio, speed);
+	cfsetospeed(&tio, speed);
+
+	return tcsetattr(fd, TCSADRAIN, &tio) == 0;
+}
+
+// Reads one '\n' terminated line, dropping '\r'. Returns false on timeout.
+bool read_line(int fd, std::string &line, int timeout_ms)
+{
+	line.clear();
+
+	for (;;)
+	{
+		fd_set fds;
+		struct timeval tv = { timeout_ms / 1000, (timeout_ms % 1000) * 1000 };
+		char c;
+
+		FD_ZERO(&fds);
+		FD_SET(fd, &fds);
+		if (select(fd + 1, &fds, NULL, NULL, &tv) <= 0) return false;
+		if (read(fd, &c, 1) != 1) return false;
+
+		if (c == '\n') return true;
+		if (c != '\r') line += c;
+	}
+}
+
+bool write_all(int fd, const std::vector<uint8_t> &data)
+{
+	size_t done = 0;
+
+	while (done < data.size())
+	{
+		ssize_t n = write(fd, data.data() + done, data.size() - done);
+		if (n <= 0) return false;
+		done += n;
+	}
+
+	return tcdrain(fd) == 0;
+}
+
+bool load_samples(const char *path, std::vector<uint16_t> &samples)
+{
+	std::ifstream in(path);
+	std::string tok;
+
+	if (!in) return false;
+
+	while (in >> tok)
+	{
+		for (char &c : tok) if (c == ',') c = ' ';
+		char *p = &tok[0];
+		char *end;
+		for (long v = strtol(p, &end, 0); end != p; v = strtol(p, &end, 0))
+		{
+			if (v < 0 || v > 1023)
+			{
+				fprintf(stderr, "Sample %zu out of range: %ld\n", samples.size(), v);
+				return false;
+			}
+			samples.push_back((uint16_t)v);
+			p = end;
+		}
+	}
+
+	return true;
+}
+
+} // namespace
+
+int main(int argc, char **argv)
+{
+	uint8_t flags = 0;
+	int arg = 1;
+
+	if (arg < argc && strcmp(argv[arg], "-f") == 0)
+	{
+		flags |= kFlagFlash;
+		arg++;
+	}
+	if (argc - arg != 2)
+	{
+		fprintf(stderr, "Usage: %s [-f] <serial port> <sample file>\n", argv[0]);
+		return 2;
+	}
+
+	std::vector<uint16_t> samples;
+	if (!load_samples(argv[arg + 1], samples) || samples.size() < 2 || samples.size() > kMaxSamples)
+	{
+		fprintf(stderr, "Need 2..%u samples in %s\n", kMaxSamples, argv[arg + 1]);
+		return 1;
+	}
+
+	int fd = open(argv[arg], O_RDWR | O_NOCTTY);
+	if (fd < 0 || !set_baud(fd, kDefaultBaud))
+	{
+		perror(argv[arg]);
+		return 1;
+	}
+	tcflush(fd, TCIOFLUSH);
+
+	// Ask for the binary protocol and wait for the new baud rate
+	std::string line;
+	unsigned baud = 0;
+	if (!write_all(fd, std::vector<uint8_t>(1, 'B')))
+	{
+		perror("write");
+		return 1;
+	}
+	while (read_line(fd, line, 2000))
+	{
+		size_t pos = line.find("BINARY ");
+		if (pos != std::string::npos)
+		{
+			baud = strtoul(line.c_str() + pos + 7, NULL, 10);
+			break;
+		}
+	}
+	if (!baud || !set_baud(fd, baud))
+	{
+		fprintf(stderr, "No binary upload reply (is the upload screen open?)\n");
+		return 1;
+	}
+
+	// One frame: header, samples, CRC-32, all little-endian
+	std::vector<uint8_t> frame = {
+		'W', 'B',
+		(uint8_t)(samples.size() & 0xFF), (uint8_t)(samples.size() >> 8),
+		flags, 0
+	};
+	for (uint16_t v : samples)
+	{
+		frame.push_back(v & 0xFF);
+		frame.push_back(v >> 8);
+	}
+	uint32_t crc = crc32(frame);
+	for (int i = 0; i < 4; i++)
+	{
+		frame.push_back((crc >> (8 * i)) & 0xFF);
+	}
+
+	if (!write_all(fd, frame))
+	{
+		perror("write");
+		return 1;
+	}
+
+	// Flash programming can take a moment before the reply
+	if (!read_line(fd, line, 5000))
+	{
+		fprintf(stderr, "No reply from the board\n");
+		return 1;
+	}
+	printf("%s\n", line.c_str());
+
+	close(fd);
+
+	return line.compare(0, 2, "OK") == 0 ? 0 : 1;
+}